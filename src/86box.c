@@ -240,6 +240,8 @@ int      portable_mode = 0;                                       /* We are runn
 int      global_cfg_overridden = 0;                               /* Global config file was overriden on command line */
 
 char     control_socket_path[1024] = { '\0' };                     /* (O) control socket path */
+char     sound_capture_path[1024] = { '\0' };                      /* (O) sound capture file */
+int      sound_output_null = 0;                                   /* (O) no host audio device */
 
 int      monitor_edid = 0;                                        /* (C) Which EDID to use. 0=default, 1=custom. */
 char     monitor_edid_path[1024] = { 0 };                         /* (C) Path to custom EDID */
@@ -695,6 +697,7 @@ pc_show_usage(void)
             "Valid options are:\n\n"
             "-? or --help\t\t\t- show this information\n"
             "-A or --assetpath path\t\t- set 'path' to be asset path\n"
+            "-B or --audiocapture path\t- write the sound output to 'path' (.wav or .flac)\n"
 #ifdef SHOW_EXTRA_PARAMS
             "-C or --config path\t\t- set 'path' to be config file\n"
 #endif
@@ -716,11 +719,14 @@ pc_show_usage(void)
 #ifdef USE_INSTRUMENT
             "-J or --instrument name\t- set 'name' to be the profiling instrument\n"
 #endif
+            "-K or --mergeoverlay ovl base\t- merge hard disk overlay 'ovl' into 'base'\n"
+            "\t\t\t\t   and exit\n"
             "-L or --logfile path\t\t- set 'path' to be the logfile\n"
             "-M or --missing\t\t- dump missing machines and video cards\n"
             "-N or --noconfirm\t\t- do not ask for confirmation on quit\n"
             "-P or --vmpath path\t\t- set 'path' to be root for vm\n"
             "-O or --global path\t\t- set 'path' to be global config file\n"
+            "-Q or --nullaudio\t\t- do not open a host audio device\n"
             "-R or --rompath path\t\t- set 'path' to be ROM path\n"
 #ifndef USE_SDL_UI
             "-S or --settings\t\t\t- show only the settings dialog\n"
@@ -870,6 +876,17 @@ usage:
 #endif
         } else if (!strcasecmp(argv[c], "--fullscreen") || !strcasecmp(argv[c], "-F")) {
             start_in_fullscreen = 1;
+        } else if (!strcasecmp(argv[c], "--mergeoverlay") || !strcasecmp(argv[c], "-K")) {
+            if ((c + 2) >= argc)
+                goto usage;
+
+            /* Offline operation, merge and then exit. */
+            if (hdd_overlay_merge(argv[c + 1], argv[c + 2])) {
+                /* pc_init() returning 0 means a clean exit, so fail from here. */
+                fprintf(stderr, "Error merging '%s' into '%s'\n", argv[c + 1], argv[c + 2]);
+                exit(1);
+            }
+            return 0;
         } else if (!strcasecmp(argv[c], "--logfile") || !strcasecmp(argv[c], "-L")) {
             if ((c + 1) == argc)
                 goto usage;
@@ -893,6 +910,13 @@ usage:
 
             apath = argv[++c];
             asset_add_path(apath);
+        } else if (!strcasecmp(argv[c], "--audiocapture") || !strcasecmp(argv[c], "-B")) {
+            if ((c + 1) == argc)
+                goto usage;
+
+            strncpy(sound_capture_path, argv[++c], sizeof(sound_capture_path) - 1);
+        } else if (!strcasecmp(argv[c], "--nullaudio") || !strcasecmp(argv[c], "-Q")) {
+            sound_output_null = 1;
         } else if (!strcasecmp(argv[c], "--config") || !strcasecmp(argv[c], "-C")) {
             if ((c + 1) == argc || plat_dir_check(argv[c + 1]))
                 goto usage;
@@ -1983,6 +2007,10 @@ pc_close(UNUSED(thread_t *ptr))
 
     sound_cd_thread_end();
 
+    sound_workers_end();
+
+    sound_capture_close();
+
     cdrom_close();
 
     rdisk_close();
@@ -2031,6 +2059,9 @@ pc_run(void)
     /* Update the guest-CPU independent timer for devices with independent clock speed */
     rivatimer_update_all();
 
+    /* Restart network cards that have received frames while idle. */
+    network_wake_cards();
+
     /* Run a block of code. */
     startblit();
     cpu_exec((int32_t) cpu_s->rspeed / (force_10ms ? 100 : 1000));
@@ -37,9 +37,13 @@
 #include <86box/nvr.h>
 #include <86box/path.h>
 #include <86box/plat.h>
+#include <86box/thread.h>
 #include <86box/cdrom.h>
 #include <86box/cdrom_image.h>
 #include <86box/cdrom_image_viso.h>
+#ifdef USE_LIBCHDR
+#include <86box/cdrom_image_chd.h>
+#endif
 
 #include <sndfile.h>
 
@@ -59,6 +63,18 @@
 static char temp_keyword[1024];
 static char temp_file[260]     = { 0 };
 
+/*
+   Binary file read-ahead: once reads turn sequential, a helper thread keeps
+   the following BIN_PREFETCH_CHUNKS chunks of the file in memory.
+ */
+#define BIN_PREFETCH_CHUNK  (32 * 2352)
+#define BIN_PREFETCH_CHUNKS 8
+#define BIN_PREFETCH_SEQ    2 /* Sequential reads needed to start prefetching. */
+
+#define CHUNK_EMPTY   0
+#define CHUNK_FILLING 1
+#define CHUNK_READY   2
+
 #define INDEX_SPECIAL -2 /* Track A0h onwards. */
 #define INDEX_NONE    -1 /* Empty block. */
 #define INDEX_ZERO     0 /* Block not in the file, return all 0x00's. */
@@ -386,11 +402,209 @@ cleanup_error:
     return NULL;
 }
 
+typedef struct bin_chunk_t {
+    uint64_t start;
+    uint32_t len;
+    int      state;
+    uint8_t *data;
+} bin_chunk_t;
+
+typedef struct bin_prefetch_t {
+    FILE             *fp;   /* Own handle, so seeks never race with bin_read(). */
+    thread_t         *thread;
+    event_t          *wake;
+    mutex_t          *mutex;
+    uint64_t          length;
+    uint64_t          next_seek;
+    uint64_t          want; /* Start of the window to keep prefetched, under mutex. */
+    volatile int      stop;
+    int               seq;
+    int               failed;
+    bin_chunk_t       chunks[BIN_PREFETCH_CHUNKS];
+} bin_prefetch_t;
+
 /* Binary file functions. */
+static void
+bin_prefetch_thread(void *priv)
+{
+    bin_prefetch_t *pf = (bin_prefetch_t *) priv;
+    bin_chunk_t    *ch;
+    uint64_t        base;
+    uint64_t        start;
+    size_t          len;
+
+    while (!pf->stop) {
+        thread_wait_event(pf->wake, -1);
+        thread_reset_event(pf->wake);
+
+        for (int i = 0; (i < BIN_PREFETCH_CHUNKS) && !pf->stop; i++) {
+            thread_wait_mutex(pf->mutex);
+
+            base  = pf->want - (pf->want % BIN_PREFETCH_CHUNK);
+            start = base + ((uint64_t) i * BIN_PREFETCH_CHUNK);
+
+            if (start >= pf->length) {
+                thread_release_mutex(pf->mutex);
+                break;
+            }
+
+            ch = NULL;
+            for (int j = 0; j < BIN_PREFETCH_CHUNKS; j++) {
+                if ((pf->chunks[j].state != CHUNK_EMPTY) && (pf->chunks[j].start == start)) {
+                    ch = &pf->chunks[j];
+                    break;
+                }
+            }
+            if (ch != NULL) {
+                thread_release_mutex(pf->mutex);
+                continue;
+            }
+
+            /* Recycle a chunk that has fallen out of the window. */
+            for (int j = 0; j < BIN_PREFETCH_CHUNKS; j++) {
+                if ((pf->chunks[j].state == CHUNK_EMPTY) ||
+                    ((pf->chunks[j].state == CHUNK_READY) &&
+                     ((pf->chunks[j].start < base) ||
+                      (pf->chunks[j].start >= (base + (BIN_PREFETCH_CHUNKS * BIN_PREFETCH_CHUNK)))))) {
+                    ch = &pf->chunks[j];
+                    break;
+                }
+            }
+            if (ch == NULL) {
+                thread_release_mutex(pf->mutex);
+                break;
+            }
+
+            ch->state = CHUNK_FILLING;
+            ch->start = start;
+            thread_release_mutex(pf->mutex);
+
+            len = BIN_PREFETCH_CHUNK;
+            if ((start + len) > pf->length)
+                len = (size_t) (pf->length - start);
+
+            if ((fseeko64(pf->fp, start, SEEK_SET) == -1) ||
+                (fread(ch->data, 1, len, pf->fp) != len))
+                len = 0;
+
+            thread_wait_mutex(pf->mutex);
+            ch->len   = (uint32_t) len;
+            ch->state = len ? CHUNK_READY : CHUNK_EMPTY;
+            thread_release_mutex(pf->mutex);
+        }
+    }
+}
+
+/* Copies the range out of the prefetched chunks, returns 0 if any of it is missing. */
+static int
+bin_prefetch_get(bin_prefetch_t *pf, uint8_t *buffer, const uint64_t seek, const size_t count)
+{
+    uint64_t pos  = seek;
+    size_t   left = count;
+    int      hit  = 1;
+
+    thread_wait_mutex(pf->mutex);
+
+    while (hit && (left > 0)) {
+        const bin_chunk_t *ch = NULL;
+
+        for (int i = 0; i < BIN_PREFETCH_CHUNKS; i++) {
+            if ((pf->chunks[i].state == CHUNK_READY) && (pos >= pf->chunks[i].start) &&
+                (pos < (pf->chunks[i].start + pf->chunks[i].len))) {
+                ch = &pf->chunks[i];
+                break;
+            }
+        }
+
+        if (ch == NULL)
+            hit = 0;
+        else {
+            size_t len = (size_t) (ch->start + ch->len - pos);
+            if (len > left)
+                len = left;
+
+            memcpy(buffer, ch->data + (pos - ch->start), len);
+            buffer += len;
+            pos += len;
+            left -= len;
+        }
+    }
+
+    thread_release_mutex(pf->mutex);
+
+    return hit;
+}
+
+static void
+bin_prefetch_update(const track_file_t *tf, bin_prefetch_t *pf, const uint64_t seek, const size_t count)
+{
+    if (seek == pf->next_seek)
+        pf->seq++;
+    else
+        pf->seq = 0;
+    pf->next_seek = seek + count;
+
+    if (pf->failed || (pf->seq < BIN_PREFETCH_SEQ))
+        return;
+
+    if (pf->thread == NULL) {
+        pf->fp = plat_fopen64(tf->fn, "rb");
+        if (pf->fp == NULL) {
+            /* Do not try again. */
+            pf->failed = 1;
+            return;
+        }
+
+        for (int i = 0; i < BIN_PREFETCH_CHUNKS; i++)
+            pf->chunks[i].data = (uint8_t *) malloc(BIN_PREFETCH_CHUNK);
+
+        pf->mutex  = thread_create_mutex();
+        pf->wake   = thread_create_event();
+        pf->want   = pf->next_seek;
+        pf->thread = thread_create(bin_prefetch_thread, pf);
+
+        image_log(tf->log, "binary_read: sequential access, prefetch started\n");
+    }
+
+    /* Only wake the thread up when the window has moved by a chunk. */
+    if ((pf->next_seek / BIN_PREFETCH_CHUNK) != (pf->want / BIN_PREFETCH_CHUNK)) {
+        /* A 64-bit store is not atomic on 32-bit hosts. */
+        thread_wait_mutex(pf->mutex);
+        pf->want = pf->next_seek;
+        thread_release_mutex(pf->mutex);
+        thread_set_event(pf->wake);
+    } else if (pf->seq == BIN_PREFETCH_SEQ)
+        thread_set_event(pf->wake);
+}
+
+static void
+bin_prefetch_close(bin_prefetch_t *pf)
+{
+    if (pf == NULL)
+        return;
+
+    if (pf->thread != NULL) {
+        pf->stop = 1;
+        thread_set_event(pf->wake);
+        thread_wait(pf->thread);
+        thread_destroy_event(pf->wake);
+        thread_close_mutex(pf->mutex);
+
+        for (int i = 0; i < BIN_PREFETCH_CHUNKS; i++)
+            free(pf->chunks[i].data);
+    }
+
+    if (pf->fp != NULL)
+        fclose(pf->fp);
+
+    free(pf);
+}
+
 static int
 bin_read(void *priv, uint8_t *buffer, const uint64_t seek, const size_t count)
 {
     const track_file_t *tf = (track_file_t *) priv;
+    bin_prefetch_t     *pf = (bin_prefetch_t *) tf->priv;
 
     if (tf->fp == NULL)
         return 0;
@@ -398,18 +612,23 @@ bin_read(void *priv, uint8_t *buffer, const uint64_t seek, const size_t count)
     image_log(tf->log, "binary_read(%08lx, pos=%" PRIu64 " count=%lu)\n",
                     tf->fp, seek, count);
 
-    if (fseeko64(tf->fp, seek, SEEK_SET) == -1) {
-        image_log(tf->log, "binary_read failed during seek!\n");
+    if ((pf == NULL) || (pf->thread == NULL) || !bin_prefetch_get(pf, buffer, seek, count)) {
+        if (fseeko64(tf->fp, seek, SEEK_SET) == -1) {
+            image_log(tf->log, "binary_read failed during seek!\n");
 
-        return -1;
-    }
+            return -1;
+        }
 
-    if (fread(buffer, count, 1, tf->fp) != 1) {
-        image_log(tf->log, "binary_read failed during read!\n");
+        if (fread(buffer, count, 1, tf->fp) != 1) {
+            image_log(tf->log, "binary_read failed during read!\n");
 
-        return -1;
+            return -1;
+        }
     }
 
+    if (pf != NULL)
+        bin_prefetch_update(tf, pf, seek, count);
+
     if (UNLIKELY(tf->motorola)) {
         for (uint64_t i = 0; i < count; i += 2) {
             const uint8_t buffer0 = buffer[i];
@@ -445,6 +664,9 @@ bin_close(void *priv)
     if (tf == NULL)
         return;
 
+    bin_prefetch_close((bin_prefetch_t *) tf->priv);
+    tf->priv = NULL;
+
     if (tf->fp != NULL) {
         fclose(tf->fp);
         tf->fp = NULL;
@@ -487,6 +709,12 @@ bin_init(const uint8_t id, const char *filename, int *error)
 
     /* Set the function pointers. */
     if (!*error) {
+        bin_prefetch_t *pf = (bin_prefetch_t *) calloc(1, sizeof(bin_prefetch_t));
+
+        if (pf != NULL)
+            pf->length = bin_get_length(tf);
+
+        tf->priv       = pf;
         tf->read       = bin_read;
         tf->get_length = bin_get_length;
         tf->close      = bin_close;
@@ -1389,6 +1617,23 @@ image_set_track_subch_type(track_t *ct)
         ct->subch_type = 0x00;
 }
 
+static void
+image_set_track_form(track_t *ct)
+{
+    if (ct->mode == 2)  switch(ct->sector_size) {
+        default:
+            break;
+        case 2324: case 2328:
+            ct->form = 2;
+            break;
+        case 2048: case 2332: case 2336: case 2352: case 2368: case 2448:
+            ct->form = 1;
+            break;
+    }
+    if (((ct->sector_size == 2336) || (ct->sector_size == 2332)) && (ct->mode == 2) && (ct->form == 1))
+        ct->skip        = 8;
+}
+
 static int
 image_load_iso(cd_image_t *img, const char *filename)
 {
@@ -1672,18 +1917,7 @@ image_load_cue(cd_image_t *img, const char *cuefile)
                 sscanf(type, "MODE%" PRIu32 "/%" PRIu32,
                        &mode, &(ct->sector_size));
                 ct->mode = mode;
-                if (ct->mode == 2)  switch(ct->sector_size) {
-                    default:
-                        break;
-                    case 2324: case 2328:
-                        ct->form = 2;
-                        break;
-                    case 2048: case 2332: case 2336: case 2352: case 2368: case 2448:
-                        ct->form = 1;
-                        break;
-                }
-                if (((ct->sector_size == 2336) || (ct->sector_size == 2332)) && (ct->mode == 2) && (ct->form == 1))
-                    ct->skip        = 8;
+                image_set_track_form(ct);
             } else if (!memcmp(type, "CD", 2)) {
                 ct->attr        = DATA_TRACK;
                 ct->mode        = 2;
@@ -1897,6 +2131,114 @@ image_load_cue(cd_image_t *img, const char *cuefile)
     return success;
 }
 
+#ifdef USE_LIBCHDR
+static int
+image_load_chd(cd_image_t *img, const char *chdfile)
+{
+    track_t          *ct      = NULL;
+    track_index_t    *ci      = NULL;
+    track_file_t     *tf      = NULL;
+    chd_track_info_t  info;
+    void             *chd;
+    int               success = 1;
+    int               audio   = 0;
+    int               error;
+
+    img->tracks     = NULL;
+    img->tracks_num = 0;
+
+    chd = chd_image_open(img->dev->id, chdfile, &error);
+    if (error)
+        return 0;
+
+    /*
+       Pass 1 - building the tracks from the CHD metadata, every track gets its
+       own view of the shared hunk cache, like a per-track BIN file.
+     */
+    image_log(img->log, "Pass 1 (loading the CHD track metadata)...\n");
+
+    for (int i = 0; i < 3; i++)
+        (void) image_insert_track(img, 1, 0xa0 + i);
+
+    for (int i = 0; success && chd_image_get_track(chd, i, &info); i++) {
+        tf = chd_track_init(chd, &info, &error);
+        if (error) {
+            success = 0;
+            break;
+        }
+
+        ct = image_insert_track(img, 1, info.number);
+
+        for (int j = 2; j >= 0; j--)
+            ct->idx[j].type = INDEX_NONE;
+
+        ct->sector_size = info.data_size;
+        ct->mode        = info.mode;
+        ct->form        = 0;
+
+        if (info.audio) {
+            ct->attr = AUDIO_TRACK;
+            audio    = 1;
+        } else {
+            ct->attr = DATA_TRACK;
+            image_set_track_form(ct);
+        }
+
+        image_set_track_subch_type(ct);
+
+        if (info.pregap_data) {
+            ci             = &(ct->idx[0]);
+            ci->type       = INDEX_NORMAL;
+            ci->file_start = 0ULL;
+        } else if (info.pregap) {
+            ci             = &(ct->idx[0]);
+            ci->type       = INDEX_ZERO;
+            ci->length     = info.pregap;
+        }
+
+        ci             = &(ct->idx[1]);
+        ci->type       = INDEX_NORMAL;
+        ci->file_start = info.pregap_data;
+
+        if (info.postgap) {
+            ci             = &(ct->idx[2]);
+            ci->type       = INDEX_ZERO;
+            ci->length     = info.postgap;
+        }
+
+        for (int j = 0; j <= ct->max_index; j++)
+            ct->idx[j].file = tf;
+
+        image_log(img->log, "    [TRACK   ] %02X/%02X, ATTR %02X, MODE %02X/%02X,\n",
+                  ct->session,
+                  ct->point,
+                  ct->attr,
+                  ct->mode, ct->form);
+        image_log(img->log, "               %i\n",
+                  ct->sector_size);
+    }
+
+    /* The tracks hold their own references from here on. */
+    chd_image_release(chd);
+
+    if (success && (ct == NULL))
+        success = 0;
+
+    if (success) {
+        image_process(img);
+        /* Like image_load_cue(): 1 = has audio, 2 = data only. */
+        success = audio ? 1 : 2;
+    } else
+#ifdef ENABLE_IMAGE_LOG
+        log_warning(img->log, "    [CHD   ] Unable to open CHD image \"%s\"\n", chdfile);
+#else
+        warning("Unable to open CHD image \"%s\"\n", chdfile);
+#endif
+
+    return success;
+}
+#endif
+
 // Converts UTF-16 string into UTF-8 string.
 // If destination string is NULL returns total number of symbols that would've
 // been written (without null terminator). However, when actually writing into
@@ -2997,6 +3339,9 @@ image_open(cdrom_t *dev, const char *path)
         const int is_cue  = ((ext == 4) && !stricmp(path + strlen(path) - ext + 1, "CUE"));
         const int is_mds  = ((ext == 4) && (!stricmp(path + strlen(path) - ext + 1, "MDS") ||
                                             !stricmp(path + strlen(path) - ext + 1, "MDX")));
+#ifdef USE_LIBCHDR
+        const int is_chd  = ((ext == 4) && !stricmp(path + strlen(path) - ext + 1, "CHD"));
+#endif
         char      n[1024] = { 0 };
 
         sprintf(n, "CD-ROM %i Image", dev->id + 1);
@@ -3021,6 +3366,15 @@ image_open(cdrom_t *dev, const char *path)
 
             if (ret >= 1)
                 img->is_dvd = 2;
+#ifdef USE_LIBCHDR
+        } else if (is_chd) {
+            ret = image_load_chd(img, path);
+
+            if (ret >= 2)
+                img->has_audio = 0;
+            else if (ret)
+                img->has_audio = 1;
+#endif
         } else {
             ret = image_load_iso(img, path);
 
@@ -0,0 +1,615 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          CHD (MAME compressed hunks of data) CD-ROM image back-end.
+ *
+ *          Hunk decompression (zlib, LZMA, FLAC and the CD codecs) is
+ *          done by libchdr, on a helper thread only. Decoded hunks are
+ *          kept in a small LRU cache shared by all tracks of the image. A
+ *          reader that misses the cache hands the hunk to the helper and
+ *          waits for it, and sequential access makes the helper decode
+ *          the following hunks ahead of time.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#ifdef ENABLE_CHD_LOG
+#include <stdarg.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <86box/86box.h>
+#include <86box/log.h>
+#include <86box/plat.h>
+#include <86box/thread.h>
+#include <86box/cdrom.h>
+#include <86box/cdrom_image.h>
+#include <86box/cdrom_image_chd.h>
+
+#include <libchdr/chd.h>
+
+#define CHD_FRAME_SIZE    2448 /* 2352 bytes of sector data + 96 bytes of subchannel. */
+#define CHD_TRACK_PADDING 4    /* Tracks are padded to a multiple of this many frames. */
+#define CHD_MAX_TRACKS    99
+#define CHD_CACHE_HUNKS   16
+#define CHD_READ_AHEAD    4
+#define CHD_NO_HUNK       0xffffffff
+
+typedef struct chd_hunk_t {
+    uint32_t hunk;
+    uint32_t stamp;
+    uint8_t *data;
+} chd_hunk_t;
+
+typedef struct chd_image_t {
+    chd_file        *chd;
+    void            *log;
+    int              refcount;
+
+    uint32_t         hunk_bytes;
+    uint32_t         total_hunks;
+
+    int              tracks_num;
+    chd_track_info_t tracks[CHD_MAX_TRACKS];
+
+    /* LRU cache of decoded hunks, protected by cache_mutex. */
+    mutex_t         *cache_mutex;
+    chd_hunk_t       cache[CHD_CACHE_HUNKS];
+    uint32_t         stamp;
+    uint32_t         last_hunk;
+    uint32_t         ahead_hunk; /* Next hunk for the read-ahead. */
+
+    /* Cache miss handed to the helper thread, protected by cache_mutex;
+       request_mutex lets one reader at a time make one. */
+    mutex_t         *request_mutex;
+    event_t         *request_done;
+    uint32_t         request_hunk; /* CHD_NO_HUNK if none. */
+    uint8_t         *request_buffer;
+    uint32_t         request_offset;
+    uint32_t         request_count;
+    int              request_ret;
+
+    /* Helper thread, the only one calling into libchdr once the image is open. */
+    thread_t        *thread;
+    event_t         *wake;
+    uint8_t         *scratch;
+    volatile int     stop;
+} chd_image_t;
+
+typedef struct chd_track_t {
+    chd_image_t *img;
+    uint64_t     frame_start;
+    uint32_t     frames;
+    uint32_t     data_size;
+} chd_track_t;
+
+#ifdef ENABLE_CHD_LOG
+int chd_do_log = ENABLE_CHD_LOG;
+
+void
+chd_log(void *priv, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (chd_do_log) {
+        va_start(ap, fmt);
+        log_out(priv, fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define chd_log(priv, fmt, ...)
+#endif
+
+/* Returns the cache slot holding the hunk, must be called with cache_mutex held. */
+static chd_hunk_t *
+chd_cache_find(chd_image_t *img, const uint32_t hunk)
+{
+    for (int i = 0; i < CHD_CACHE_HUNKS; i++) {
+        if (img->cache[i].hunk == hunk) {
+            img->cache[i].stamp = ++img->stamp;
+            return &img->cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+   Inserts a freshly decoded hunk into the least recently used slot by
+   swapping buffers, so *data receives the evicted buffer back as scratch.
+   Helper thread only.
+ */
+static void
+chd_cache_insert(chd_image_t *img, const uint32_t hunk, uint8_t **data)
+{
+    chd_hunk_t *lru = &img->cache[0];
+    uint8_t    *old;
+
+    thread_wait_mutex(img->cache_mutex);
+
+    if (chd_cache_find(img, hunk) == NULL) {
+        for (int i = 1; i < CHD_CACHE_HUNKS; i++) {
+            if (img->cache[i].stamp < lru->stamp)
+                lru = &img->cache[i];
+        }
+
+        old        = lru->data;
+        lru->data  = *data;
+        lru->hunk  = hunk;
+        lru->stamp = ++img->stamp;
+        *data      = old;
+    }
+
+    thread_release_mutex(img->cache_mutex);
+}
+
+/* Helper thread only. */
+static int
+chd_decode(chd_image_t *img, const uint32_t hunk, uint8_t *buffer)
+{
+    const chd_error err = chd_read(img->chd, hunk, buffer);
+
+    if (err != CHDERR_NONE) {
+        chd_log(img->log, "Hunk %u: %s\n", hunk, chd_error_string(err));
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+chd_cached(chd_image_t *img, const uint32_t hunk)
+{
+    int ret;
+
+    thread_wait_mutex(img->cache_mutex);
+    ret = (chd_cache_find(img, hunk) != NULL);
+    thread_release_mutex(img->cache_mutex);
+
+    return ret;
+}
+
+static uint32_t
+chd_ahead_hunk(chd_image_t *img)
+{
+    uint32_t ret;
+
+    thread_wait_mutex(img->cache_mutex);
+    ret = img->ahead_hunk;
+    thread_release_mutex(img->cache_mutex);
+
+    return ret;
+}
+
+/* Serves a reader waiting on a cache miss, if there is one. */
+static void
+chd_serve_request(chd_image_t *img)
+{
+    chd_hunk_t *ch  = NULL;
+    int         ret = 1;
+    uint32_t    hunk;
+
+    thread_wait_mutex(img->cache_mutex);
+    hunk = img->request_hunk;
+    if (hunk != CHD_NO_HUNK) {
+        /* The read-ahead may have got there first. */
+        ch = chd_cache_find(img, hunk);
+        if (ch != NULL)
+            memcpy(img->request_buffer, ch->data + img->request_offset, img->request_count);
+    }
+    thread_release_mutex(img->cache_mutex);
+
+    if (hunk == CHD_NO_HUNK)
+        return;
+
+    if (ch == NULL) {
+        ret = chd_decode(img, hunk, img->scratch);
+        if (ret) {
+            memcpy(img->request_buffer, img->scratch + img->request_offset, img->request_count);
+            chd_cache_insert(img, hunk, &img->scratch);
+        }
+    }
+
+    thread_wait_mutex(img->cache_mutex);
+    img->request_ret  = ret;
+    img->request_hunk = CHD_NO_HUNK;
+    thread_release_mutex(img->cache_mutex);
+
+    thread_set_event(img->request_done);
+}
+
+static void
+chd_decode_thread(void *priv)
+{
+    chd_image_t *img = (chd_image_t *) priv;
+    uint32_t     hunk;
+
+    while (!img->stop) {
+        thread_wait_event(img->wake, -1);
+        thread_reset_event(img->wake);
+
+        if (img->stop)
+            break;
+
+        chd_serve_request(img);
+
+        hunk = chd_ahead_hunk(img);
+
+        for (int i = 0; (i < CHD_READ_AHEAD) && !img->stop; i++, hunk++) {
+            /* A waiting reader always goes first. */
+            chd_serve_request(img);
+
+            if (hunk >= img->total_hunks)
+                break;
+
+            /* A newer request supersedes this one. */
+            if (chd_ahead_hunk(img) != (hunk - i))
+                break;
+
+            if (chd_cached(img, hunk))
+                continue;
+
+            if (chd_decode(img, hunk, img->scratch))
+                chd_cache_insert(img, hunk, &img->scratch);
+        }
+    }
+}
+
+/* Copies count bytes at offset within the hunk into buffer. */
+static int
+chd_read_hunk(chd_image_t *img, const uint32_t hunk, uint8_t *buffer,
+              const uint32_t offset, const uint32_t count)
+{
+    chd_hunk_t *ch;
+    int         wake = 0;
+    int         ret  = 1;
+
+    if (hunk >= img->total_hunks)
+        return 0;
+
+    thread_wait_mutex(img->cache_mutex);
+    if (((hunk == img->last_hunk) || (hunk == (img->last_hunk + 1))) && (img->ahead_hunk != (hunk + 1))) {
+        img->ahead_hunk = hunk + 1;
+        wake            = 1;
+    }
+    img->last_hunk = hunk;
+    ch             = chd_cache_find(img, hunk);
+    if (ch != NULL)
+        memcpy(buffer, ch->data + offset, count);
+    thread_release_mutex(img->cache_mutex);
+
+    if (ch == NULL) {
+        /* Have the helper thread decode it straight into the buffer. */
+        thread_wait_mutex(img->request_mutex);
+        thread_reset_event(img->request_done);
+
+        thread_wait_mutex(img->cache_mutex);
+        img->request_hunk   = hunk;
+        img->request_buffer = buffer;
+        img->request_offset = offset;
+        img->request_count  = count;
+        thread_release_mutex(img->cache_mutex);
+
+        thread_set_event(img->wake);
+        thread_wait_event(img->request_done, -1);
+
+        thread_wait_mutex(img->cache_mutex);
+        ret = img->request_ret;
+        thread_release_mutex(img->cache_mutex);
+
+        thread_release_mutex(img->request_mutex);
+    } else if (wake)
+        thread_set_event(img->wake);
+
+    return ret;
+}
+
+/* Track file functions. */
+static int
+chd_track_read(void *priv, uint8_t *buffer, const uint64_t seek, const size_t count)
+{
+    const track_file_t *tf   = (track_file_t *) priv;
+    const chd_track_t  *trk  = (chd_track_t *) tf->priv;
+    chd_image_t        *img  = trk->img;
+    uint64_t            pos  = seek;
+    size_t              left = count;
+    uint8_t            *p    = buffer;
+
+    while (left > 0) {
+        const uint64_t frame  = trk->frame_start + (pos / trk->data_size);
+        const uint32_t offset = (uint32_t) (pos % trk->data_size);
+        uint32_t       len    = trk->data_size - offset;
+        const uint64_t byte   = (frame * CHD_FRAME_SIZE) + offset;
+
+        if (len > left)
+            len = (uint32_t) left;
+
+        /* A frame never crosses a hunk boundary. */
+        if (!chd_read_hunk(img, (uint32_t) (byte / img->hunk_bytes), p,
+                           (uint32_t) (byte % img->hunk_bytes), len)) {
+            chd_log(img->log, "chd_track_read failed at %016" PRIX64 "\n", pos);
+            return -1;
+        }
+
+        pos += len;
+        p += len;
+        left -= len;
+    }
+
+    if (UNLIKELY(tf->motorola)) {
+        for (uint64_t i = 0; i < count; i += 2) {
+            const uint8_t buffer0 = buffer[i];
+            const uint8_t buffer1 = buffer[i + 1];
+            buffer[i] = buffer1;
+            buffer[i + 1] = buffer0;
+        }
+    }
+
+    return 1;
+}
+
+static uint64_t
+chd_track_get_length(void *priv)
+{
+    const track_file_t *tf  = (track_file_t *) priv;
+    const chd_track_t  *trk = (chd_track_t *) tf->priv;
+
+    return ((uint64_t) trk->frames) * trk->data_size;
+}
+
+static void
+chd_track_close(void *priv)
+{
+    track_file_t *tf  = (track_file_t *) priv;
+    chd_track_t  *trk = (chd_track_t *) tf->priv;
+
+    if (trk != NULL) {
+        chd_image_release(trk->img);
+        free(trk);
+    }
+
+    memset(tf->fn, 0x00, sizeof(tf->fn));
+
+    free(tf);
+}
+
+static int
+chd_parse_type(chd_track_info_t *info, const char *type)
+{
+    static const struct {
+        const char *name;
+        int         mode;
+        uint32_t    data_size;
+    } types[] = {
+        { "MODE1",          1, COOKED_SECTOR_SIZE },
+        { "MODE1/2048",     1, COOKED_SECTOR_SIZE },
+        { "MODE1_RAW",      1, RAW_SECTOR_SIZE    },
+        { "MODE1/2352",     1, RAW_SECTOR_SIZE    },
+        { "MODE2",          2, 2336               },
+        { "MODE2/2336",     2, 2336               },
+        { "MODE2_FORM1",    2, COOKED_SECTOR_SIZE },
+        { "MODE2/2048",     2, COOKED_SECTOR_SIZE },
+        { "MODE2_FORM2",    2, 2324               },
+        { "MODE2/2324",     2, 2324               },
+        { "MODE2_FORM_MIX", 2, 2336               },
+        { "MODE2_RAW",      2, RAW_SECTOR_SIZE    },
+        { "MODE2/2352",     2, RAW_SECTOR_SIZE    },
+        { "AUDIO",          0, RAW_SECTOR_SIZE    }
+    };
+
+    for (size_t i = 0; i < (sizeof(types) / sizeof(types[0])); i++) {
+        if (!strcmp(type, types[i].name)) {
+            info->mode      = types[i].mode;
+            info->audio     = (types[i].mode == 0);
+            info->data_size = types[i].data_size;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+chd_parse_tracks(chd_image_t *img)
+{
+    char     meta[256];
+    char     type[32];
+    char     subtype[32];
+    char     pgtype[32];
+    char     pgsub[32];
+    uint32_t len;
+    uint32_t tag;
+    uint8_t  flags;
+    uint64_t frame = 0ULL;
+    int      num;
+    int      frames;
+    int      pregap;
+    int      postgap;
+
+    for (int i = 0; i < CHD_MAX_TRACKS; i++) {
+        chd_track_info_t *info = &img->tracks[i];
+
+        memset(meta, 0x00, sizeof(meta));
+        pregap    = 0;
+        postgap   = 0;
+        pgtype[0] = 0x00;
+
+        if (chd_get_metadata(img->chd, CDROM_TRACK_METADATA2_TAG, i, meta, sizeof(meta) - 1,
+                             &len, &tag, &flags) == CHDERR_NONE) {
+            if (sscanf(meta, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d PGTYPE:%31s PGSUB:%31s POSTGAP:%d",
+                       &num, type, subtype, &frames, &pregap, pgtype, pgsub, &postgap) != 8)
+                return 0;
+        } else if (chd_get_metadata(img->chd, CDROM_TRACK_METADATA_TAG, i, meta, sizeof(meta) - 1,
+                                    &len, &tag, &flags) == CHDERR_NONE) {
+            if (sscanf(meta, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d",
+                       &num, type, subtype, &frames) != 4)
+                return 0;
+        } else
+            break;
+
+        if ((num < 1) || (num > 99) || (frames <= 0) || !chd_parse_type(info, type)) {
+            chd_log(img->log, "Unsupported track: \"%s\"\n", meta);
+            return 0;
+        }
+
+        info->number      = num;
+        info->frames      = frames;
+        info->pregap      = pregap;
+        /* A 'V' pre-gap type means the pre-gap data is stored in the CHD. */
+        info->pregap_data = (pgtype[0] == 'V') ? pregap : 0;
+        info->postgap     = postgap;
+        info->frame_start = frame;
+
+        chd_log(img->log, "Track %02i: %s, %i frames at %" PRIu64 ", pregap %i%s\n",
+                num, type, frames, frame, pregap, info->pregap_data ? " (stored)" : "");
+
+        frame += ((frames + CHD_TRACK_PADDING - 1) / CHD_TRACK_PADDING) * CHD_TRACK_PADDING;
+        img->tracks_num++;
+    }
+
+    return (img->tracks_num > 0) && ((frame * CHD_FRAME_SIZE) <= ((uint64_t) img->hunk_bytes * img->total_hunks));
+}
+
+void *
+chd_image_open(const uint8_t id, const char *filename, int *error)
+{
+    chd_image_t      *img = (chd_image_t *) calloc(1, sizeof(chd_image_t));
+    const chd_header *hdr;
+    chd_error         err;
+    char              n[1024] = { 0 };
+
+    *error = 1;
+
+    if (img == NULL)
+        return NULL;
+
+    sprintf(n, "CD-ROM %i CHD  ", id + 1);
+    img->log = log_open(n);
+
+    err = chd_open(filename, CHD_OPEN_READ, NULL, &img->chd);
+    if (err != CHDERR_NONE) {
+        chd_log(img->log, "Unable to open \"%s\": %s\n", filename, chd_error_string(err));
+        log_close(img->log);
+        free(img);
+        return NULL;
+    }
+
+    hdr              = chd_get_header(img->chd);
+    img->hunk_bytes  = hdr->hunkbytes;
+    img->total_hunks = hdr->totalhunks;
+    img->refcount    = 1;
+
+    if ((img->hunk_bytes % CHD_FRAME_SIZE) || !chd_parse_tracks(img)) {
+        chd_log(img->log, "\"%s\" is not a CD-ROM CHD\n", filename);
+        chd_close(img->chd);
+        log_close(img->log);
+        free(img);
+        return NULL;
+    }
+
+    for (int i = 0; i < CHD_CACHE_HUNKS; i++) {
+        img->cache[i].hunk = CHD_NO_HUNK;
+        img->cache[i].data = (uint8_t *) malloc(img->hunk_bytes);
+    }
+    img->scratch      = (uint8_t *) malloc(img->hunk_bytes);
+    img->last_hunk    = CHD_NO_HUNK - 1;
+    img->ahead_hunk   = CHD_NO_HUNK;
+    img->request_hunk = CHD_NO_HUNK;
+
+    img->cache_mutex   = thread_create_mutex();
+    img->request_mutex = thread_create_mutex();
+    img->request_done  = thread_create_event();
+    img->wake          = thread_create_event();
+    img->thread        = thread_create(chd_decode_thread, img);
+
+    *error = 0;
+
+    return img;
+}
+
+int
+chd_image_get_track(void *priv, const int index, chd_track_info_t *info)
+{
+    const chd_image_t *img = (chd_image_t *) priv;
+
+    if ((img == NULL) || (index < 0) || (index >= img->tracks_num))
+        return 0;
+
+    memcpy(info, &img->tracks[index], sizeof(chd_track_info_t));
+
+    return 1;
+}
+
+track_file_t *
+chd_track_init(void *priv, const chd_track_info_t *info, int *error)
+{
+    chd_image_t  *img = (chd_image_t *) priv;
+    track_file_t *tf  = (track_file_t *) calloc(1, sizeof(track_file_t));
+    chd_track_t  *trk = (chd_track_t *) calloc(1, sizeof(chd_track_t));
+
+    if ((tf == NULL) || (trk == NULL)) {
+        free(tf);
+        free(trk);
+        *error = 1;
+        return NULL;
+    }
+
+    trk->img         = img;
+    trk->frame_start = info->frame_start;
+    trk->frames      = info->frames;
+    trk->data_size   = info->data_size;
+
+    img->refcount++;
+
+    snprintf(tf->fn, sizeof(tf->fn), "CHD track %02i", info->number);
+    tf->priv       = trk;
+    tf->fp         = NULL;
+    /* CHD stores audio samples in big endian order. */
+    tf->motorola   = info->audio;
+    tf->read       = chd_track_read;
+    tf->get_length = chd_track_get_length;
+    tf->close      = chd_track_close;
+
+    *error = 0;
+
+    return tf;
+}
+
+void
+chd_image_release(void *priv)
+{
+    chd_image_t *img = (chd_image_t *) priv;
+
+    if ((img == NULL) || (--img->refcount > 0))
+        return;
+
+    img->stop = 1;
+    thread_set_event(img->wake);
+    thread_wait(img->thread);
+    thread_destroy_event(img->wake);
+    thread_destroy_event(img->request_done);
+
+    thread_close_mutex(img->cache_mutex);
+    thread_close_mutex(img->request_mutex);
+
+    for (int i = 0; i < CHD_CACHE_HUNKS; i++)
+        free(img->cache[i].data);
+    free(img->scratch);
+
+    chd_close(img->chd);
+
+    log_close(img->log);
+    free(img);
+}
@@ -41,7 +41,6 @@
 #include <86box/bswap.h>
 #include <86box/plat_dir.h>
 #include <86box/version.h>
-#include <86box/nvr.h>
 
 #ifndef S_ISDIR
 #    define S_ISDIR(m) (((m) &S_IFMT) == S_IFDIR)
@@ -78,8 +77,10 @@ typedef struct stat stat_t;
         (p) += 4;                               \
     }
 
-#define VISO_SECTOR_SIZE COOKED_SECTOR_SIZE
-#define VISO_OPEN_FILES  32
+#define VISO_SECTOR_SIZE     COOKED_SECTOR_SIZE
+#define VISO_OPEN_FILES      32
+#define VISO_META_CACHE      64        /* generated path tables and directory record sets kept in memory... */
+#define VISO_META_CACHE_SIZE (4 << 20) /* ...as long as they add up to no more than this many bytes */
 
 enum {
     VISO_CHARSET_D = 0,
@@ -104,14 +105,16 @@ enum {
 
 typedef struct _viso_entry_ {
     union { /* save some memory */
-        uint64_t pt_offsets[4];
-        FILE    *file;
-    };
-    union {
-        char     name_short[13];
-        uint64_t dr_offsets[2];
-        uint64_t data_offset;
+        struct { /* directories: extent location and size on each tree */
+            uint32_t dir_lba[2];
+            uint32_t dir_size[2];
+        };
+        struct { /* files */
+            FILE    *file;
+            uint32_t data_lba;
+        };
     };
+    char     name_short[13];
     uint16_t pt_idx;
 
     stat_t stats;
@@ -121,20 +124,37 @@ typedef struct _viso_entry_ {
     char *basename, path[];
 } viso_entry_t;
 
+/* Path table or directory record array, generated on first access. */
+typedef struct {
+    uint32_t      lba;
+    uint32_t      sectors;
+    int           index; /* path table number, or directory tree if dir is set */
+    viso_entry_t *dir;
+    uint8_t      *data;
+    uint32_t      last_used;
+} viso_extent_t;
+
 typedef struct {
-    uint64_t vol_size_offsets[2];
-    uint64_t pt_meta_offsets[2];
+    uint32_t pt_lba[4];
+    uint32_t pt_size[4];
     int      format;
     uint8_t  use_version_suffix : 1;
-    size_t   metadata_sectors, all_sectors, entry_map_size, sector_size, file_fifo_pos;
-    uint8_t *metadata;
-
-    track_file_t   tf;
-    viso_entry_t  *root_dir;
-    viso_entry_t **entry_map;
-    viso_entry_t  *file_fifo[VISO_OPEN_FILES];
+    size_t   header_sectors, metadata_sectors, all_sectors, sector_size, file_fifo_pos;
+    size_t   file_map_size, extents_count, cache_count, cache_size;
+    uint32_t cache_clock;
+    uint8_t *header;
+
+    track_file_t        tf;
+    viso_entry_t       *root_dir;
+    const viso_entry_t *eltorito_dir;
+    const viso_entry_t *eltorito_entry;
+    viso_entry_t      **file_map;
+    viso_extent_t      *extents;
+    viso_extent_t      *cache[VISO_META_CACHE];
+    viso_entry_t       *file_fifo[VISO_OPEN_FILES];
 } viso_t;
 
+
 static const char rr_eid[]   = "RRIP_1991A"; /* identifiers used in ER field for Rock Ridge */
 static const char rr_edesc[] = "THE ROCK RIDGE INTERCHANGE PROTOCOL PROVIDES SUPPORT FOR POSIX FILE SYSTEM SEMANTICS.";
 static int8_t     tz_offset  = 0;
@@ -157,30 +177,6 @@ image_viso_log(void *priv, const char *fmt, ...)
 #    define image_viso_log(priv, fmt, ...)
 #endif
 
-static size_t
-viso_pread(void *ptr, const uint64_t offset, const size_t size,
-           const size_t count, FILE *fp)
-{
-    const uint64_t cur_pos = ftello64(fp);
-    size_t         ret     = 0;
-    if (fseeko64(fp, offset, SEEK_SET) != -1)
-        ret = fread(ptr, size, count, fp);
-    fseeko64(fp, cur_pos, SEEK_SET);
-    return ret;
-}
-
-static size_t
-viso_pwrite(const void *ptr, const uint64_t offset, const size_t size,
-            const size_t count, FILE *fp)
-{
-    const uint64_t cur_pos = ftello64(fp);
-    size_t         ret     = 0;
-    if (fseeko64(fp, offset, SEEK_SET) != -1)
-        ret = fwrite(ptr, size, count, fp);
-    fseeko64(fp, cur_pos, SEEK_SET);
-    return ret;
-}
-
 static size_t
 viso_convert_utf8(wchar_t *dest, const char *src, ssize_t buf_size)
 {
@@ -574,7 +570,8 @@ viso_fill_dir_record(uint8_t *data, viso_entry_t *entry, viso_t *viso, int type)
                 *p++ = 5; /* length */
                 *p++ = 1; /* version */
 
-                q = p++; /* save Rock Ridge flags location for later */
+                q    = p; /* save Rock Ridge flags location for later */
+                *p++ = 0;
 
 #ifndef _WIN32              /* attributes reported by MinGW don't really make sense because it's Windows */
                 *q |= 0x01; /* PX = POSIX attributes */
@@ -680,6 +677,226 @@ viso_compare_entries(const void *a, const void *b)
     return strcmp((*((viso_entry_t **) a))->name_short, (*((viso_entry_t **) b))->name_short);
 }
 
+static size_t
+viso_fill_path_table(viso_t *viso, uint8_t *data, int i)
+{
+    uint8_t  entry_data[264];
+    uint8_t *p;
+    uint32_t pt_temp;
+    size_t   pos    = 0;
+    uint16_t pt_idx = 1;
+
+    /* Go through directories. */
+    viso_entry_t *dir = viso->root_dir;
+    while (dir) {
+        /* Ignore . and .. pseudo-directories, and hide the El Torito
+           boot code directory if no other files are present in it. */
+        if ((dir->name_short[0] == '.' && (dir->name_short[1] == '\0' || (dir->name_short[1] == '.' && dir->name_short[2] == '\0'))) || (dir == viso->eltorito_dir)) {
+            dir = dir->next_dir;
+            continue;
+        }
+
+        /* Save this directory's path table index. */
+        dir->pt_idx = pt_idx;
+
+        /* Fill path table entry. */
+        pt_temp = dir->dir_lba[i >> 1];
+        pt_temp = (i & 1) ? cpu_to_be32(pt_temp) : cpu_to_le32(pt_temp);
+        p       = entry_data;
+        if (!(viso->format & VISO_FORMAT_ISO)) {
+            *((uint32_t *) p) = pt_temp; /* extent location */
+            p += 4;
+            *p++ = 0; /* extended attribute length */
+            p++;      /* skip ID length for now */
+        } else {
+            p++;      /* skip ID length for now */
+            *p++ = 0; /* extended attribute length */
+            *((uint32_t *) p) = pt_temp; /* extent location */
+            p += 4;
+        }
+
+        *((uint16_t *) p) = (i & 1) ? cpu_to_be16(dir->parent->pt_idx) : cpu_to_le16(dir->parent->pt_idx); /* parent directory number */
+        p += 2;
+
+        pt_temp = 5 * !(viso->format & VISO_FORMAT_ISO); /* directory ID length at offset 0 for ISO, 5 for HSF */
+        if (dir == viso->root_dir) {                     /* directory ID length then ID for root... */
+            entry_data[pt_temp] = 1;
+            *p                  = 0x00;
+        } else if (i & 2) { /* ...or Joliet... */
+            entry_data[pt_temp] = viso_fill_fn_joliet(p, dir, 255);
+        } else { /* ...or short name */
+            entry_data[pt_temp] = strlen(dir->name_short);
+            memcpy(p, dir->name_short, entry_data[pt_temp]);
+        }
+        p += entry_data[pt_temp];
+
+        if ((p - entry_data) & 1) /* padding for odd directory ID lengths */
+            *p++ = 0x00;
+
+        /* Copy path table entry if we're not just sizing the table. */
+        if (data)
+            memcpy(data + pos, entry_data, p - entry_data);
+        pos += p - entry_data;
+
+        /* Increment path table index and stop if it overflows. */
+        if (++pt_idx == 0)
+            break;
+
+        /* Move on to the next directory. */
+        dir = dir->next_dir;
+    }
+
+    return pos;
+}
+
+static size_t
+viso_fill_dir_records(viso_t *viso, uint8_t *data, viso_entry_t *dir, int i)
+{
+    uint8_t       record[512];
+    uint8_t      *p;
+    size_t        write;
+    size_t        pos      = 0;
+    int           dir_type = (!i && (dir == viso->root_dir)) ? VISO_DIR_CURRENT_ROOT : VISO_DIR_CURRENT;
+    viso_entry_t *entry    = dir->first_child;
+
+    /* Go through entries in this directory. */
+    while (entry) {
+        /* Skip the El Torito boot code entry if present, or hide the
+           boot code directory if no other files are present in it. */
+        if ((entry == viso->eltorito_entry) || (entry == viso->eltorito_dir))
+            goto next_entry;
+
+        /* Fill directory record. */
+        viso_fill_dir_record(record, entry, viso, dir_type);
+
+        /* Entries cannot cross sector boundaries, so pad to the next sector if needed. */
+        write = viso->sector_size - (pos % viso->sector_size);
+        if (write < record[0]) {
+            if (data)
+                memset(data + pos, 0x00, write);
+            pos += write;
+        }
+
+        /* Fill in the extent location and size, while advancing
+           the current directory type past the . and .. entries. */
+        p = record + 2;
+        if (dir_type < VISO_DIR_PARENT) {
+            VISO_LBE_32(p, dir->dir_lba[i]);
+            VISO_LBE_32(p, dir->dir_size[i]);
+
+            dir_type = VISO_DIR_PARENT;
+        } else if (dir_type == VISO_DIR_PARENT) {
+            /* The root directory is its own parent. */
+            VISO_LBE_32(p, dir->parent->dir_lba[i]);
+            VISO_LBE_32(p, dir->parent->dir_size[i]);
+
+            dir_type = i ? VISO_DIR_JOLIET : VISO_DIR_REGULAR;
+        } else if (S_ISDIR(entry->stats.st_mode)) {
+            VISO_LBE_32(p, entry->dir_lba[i]);
+            VISO_LBE_32(p, entry->dir_size[i]);
+        } else {
+            VISO_LBE_32(p, entry->data_lba);
+        }
+
+        /* Copy entry if we're not just sizing the array. */
+        if (data)
+            memcpy(data + pos, record, record[0]);
+        pos += record[0];
+
+next_entry:
+        /* Move on to the next entry, and stop if the end of this directory was reached. */
+        entry = entry->next;
+        if (entry && (entry->parent != dir))
+            break;
+    }
+
+    return pos;
+}
+
+static viso_extent_t *
+viso_get_extent(viso_t *viso, size_t sector)
+{
+    viso_extent_t *ext;
+    size_t         lo = 0;
+    size_t         hi = viso->extents_count;
+
+    /* Extents are laid out in order, so look the sector up with a binary search. */
+    while (lo < hi) {
+        size_t mid = (lo + hi) >> 1;
+        if (viso->extents[mid].lba <= sector)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo)
+        return NULL;
+    ext = &viso->extents[lo - 1];
+    if ((sector - ext->lba) >= ext->sectors)
+        return NULL; /* padding between extents */
+
+    if (!ext->data) {
+        size_t size = ext->sectors * viso->sector_size;
+
+        /* Evict the least recently used extents until the new one fits. */
+        while (viso->cache_count && ((viso->cache_count == VISO_META_CACHE) || ((viso->cache_size + size) > VISO_META_CACHE_SIZE))) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < viso->cache_count; i++) {
+                if ((viso->cache_clock - viso->cache[i]->last_used) > (viso->cache_clock - viso->cache[oldest]->last_used))
+                    oldest = i;
+            }
+
+            image_viso_log(viso->tf.log, "Evicting metadata at sector %u\n", viso->cache[oldest]->lba);
+            viso->cache_size -= viso->cache[oldest]->sectors * viso->sector_size;
+            free(viso->cache[oldest]->data);
+            viso->cache[oldest]->data = NULL;
+            viso->cache[oldest]       = viso->cache[--viso->cache_count];
+        }
+
+        ext->data = (uint8_t *) calloc(ext->sectors, viso->sector_size);
+        if (!ext->data)
+            return NULL;
+
+        if (ext->dir) {
+            image_viso_log(viso->tf.log, "Generating directory record set #%d for [%s]\n",
+                           ext->index, ext->dir->path);
+            viso_fill_dir_records(viso, ext->data, ext->dir, ext->index);
+        } else {
+            image_viso_log(viso->tf.log, "Generating path table #%d\n", ext->index);
+            viso_fill_path_table(viso, ext->data, ext->index);
+        }
+
+        viso->cache[viso->cache_count++] = ext;
+        viso->cache_size += size;
+    }
+    ext->last_used = ++viso->cache_clock;
+
+    return ext;
+}
+
+static viso_entry_t *
+viso_get_file(viso_t *viso, size_t sector)
+{
+    viso_entry_t *entry;
+    size_t        lo = 0;
+    size_t        hi = viso->file_map_size;
+
+    /* Files are allocated in order, so look the sector up with a binary search. */
+    while (lo < hi) {
+        size_t mid = (lo + hi) >> 1;
+        if (viso->file_map[mid]->data_lba <= sector)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo)
+        return NULL;
+    entry = viso->file_map[lo - 1];
+    if (((uint64_t) (sector - entry->data_lba) * viso->sector_size) >= (uint64_t) entry->stats.st_size)
+        return NULL;
+
+    return entry;
+}
+
 int
 viso_read(void *priv, uint8_t *buffer, uint64_t seek, size_t count)
 {
@@ -694,14 +911,21 @@ viso_read(void *priv, uint8_t *buffer, uint64_t seek, size_t count)
         size_t sector_remain = MIN(count, viso->sector_size - sector_offset);
 
         /* Handle sector. */
-        if (sector < viso->metadata_sectors) {
-            /* Copy metadata. */
-            memcpy(buffer, viso->metadata + seek, sector_remain);
+        if (sector < viso->header_sectors) {
+            /* Copy volume descriptors and boot catalog. */
+            memcpy(buffer, viso->header + seek, sector_remain);
+        } else if (sector < viso->metadata_sectors) {
+            /* Copy path table or directory records, generating them if required. */
+            const viso_extent_t *ext = viso_get_extent(viso, sector);
+            if (ext && ext->data)
+                memcpy(buffer, ext->data + ((sector - ext->lba) * viso->sector_size) + sector_offset, sector_remain);
+            else
+                memset(buffer, 0x00, sector_remain);
         } else {
             size_t read = 0;
 
             /* Get the file entry corresponding to this sector. */
-            viso_entry_t *entry = viso->entry_map[sector - viso->metadata_sectors];
+            viso_entry_t *entry = viso_get_file(viso, sector);
             if (entry) {
                 /* Open file if it's not already open. */
                 if (!entry->file) {
@@ -731,7 +955,7 @@ viso_read(void *priv, uint8_t *buffer, uint64_t seek, size_t count)
                 }
 
                 /* Read data. */
-                if (!entry->file || (fseeko64(entry->file, seek - entry->data_offset, SEEK_SET) == -1))
+                if (!entry->file || (fseeko64(entry->file, seek - (((uint64_t) entry->data_lba) * viso->sector_size), SEEK_SET) == -1))
                     return -1;
                 read = fread(buffer, 1, sector_remain, entry->file);
                 if (sector_remain && !read)
@@ -773,26 +997,27 @@ viso_close(void *priv)
     image_viso_log(viso->tf.log, "close()\n");
 
     /* De-allocate everything. */
-    if (tf->fp)
-        fclose(tf->fp);
-#ifndef ENABLE_IMAGE_VISO_LOG
-    remove(nvr_path(viso->tf.fn));
-#endif
-
     viso_entry_t *entry = viso->root_dir;
     viso_entry_t *next_entry;
     while (entry) {
-        if (entry->file)
+        if (!S_ISDIR(entry->stats.st_mode) && entry->file)
             fclose(entry->file);
         next_entry = entry->next;
         free(entry);
         entry = next_entry;
     }
 
-    if (viso->metadata)
-        free(viso->metadata);
-    if (viso->entry_map)
-        free(viso->entry_map);
+    if (viso->extents) {
+        for (size_t i = 0; i < viso->extents_count; i++) {
+            if (viso->extents[i].data)
+                free(viso->extents[i].data);
+        }
+        free(viso->extents);
+    }
+    if (viso->header)
+        free(viso->header);
+    if (viso->file_map)
+        free(viso->file_map);
 
     if (tf->log != NULL)
         log_close(tf->log);
@@ -828,16 +1053,6 @@ viso_init(const uint8_t id, const char *dirname, int *error)
     if (!data)
         goto end;
 
-        /* Open temporary file. */
-#ifdef ENABLE_IMAGE_VISO_LOG
-    strcpy(viso->tf.fn, "viso-debug.iso");
-#else
-    plat_tempfile(viso->tf.fn, "viso", ".tmp");
-#endif
-    viso->tf.fp = plat_fopen64(nvr_path(viso->tf.fn), "w+b");
-    if (!viso->tf.fp)
-        goto end;
-
     /* Set up directory traversal. */
     image_viso_log(viso->tf.log, "Traversing directories:\n");
     viso_entry_t        *entry;
@@ -850,7 +1065,6 @@ viso_init(const uint8_t id, const char *dirname, int *error)
     int                  len;
     int                  eltorito_others_present = 0;
     size_t               dir_path_len;
-    uint64_t             eltorito_offset = 0;
     uint8_t              eltorito_type   = 0;
 
     /* Fill root directory entry. */
@@ -954,10 +1168,9 @@ viso_init(const uint8_t id, const char *dirname, int *error)
                     if (entry->stats.st_size > ((uint32_t) -1))
                         entry->stats.st_size = (uint32_t) -1;
 
-                    /* Increase entry map size. */
-                    viso->entry_map_size += entry->stats.st_size / viso->sector_size;
-                    if (entry->stats.st_size % viso->sector_size)
-                        viso->entry_map_size++; /* round up to the next sector */
+                    /* Increase file map size. */
+                    if (entry->stats.st_size)
+                        viso->file_map_size++;
 
                     /* Detect El Torito boot code file and set it accordingly. */
                     if (dir == eltorito_dir) {
@@ -1038,9 +1251,11 @@ next_dir:
     if (dir_entries)
         free(dir_entries);
 
-    /* Write 16 blank sectors. */
-    for (int i = 0; i < 16; i++)
-        fwrite(data, viso->sector_size, 1, viso->tf.fp);
+    /* Flag that we shouldn't hide the boot code directory if it contains other files. */
+    if (eltorito_entry && eltorito_others_present)
+        eltorito_dir = NULL;
+    viso->eltorito_dir   = eltorito_dir;
+    viso->eltorito_entry = eltorito_entry;
 
     /* Get current time for the volume descriptors, and calculate
        the timezone offset for descriptors and file times to use. */
@@ -1065,12 +1280,129 @@ next_dir:
        (as well as 2 directory trees and 4 path tables) for Joliet. */
     int max_vd = (viso->format & VISO_FORMAT_JOLIET) ? 1 : 0;
 
+    /* The header consists of 16 blank sectors, the volume descriptors
+       (including El Torito's) and the terminator, followed by the El
+       Torito boot catalog. We start seeing a pattern of padding to even
+       sectors here. mkisofs does this, presumably for a very good reason... */
+    viso->header_sectors = 16 + (max_vd + 1) + (eltorito_entry ? 1 : 0) + 1;
+    viso->header_sectors += viso->header_sectors & 1;
+    uint32_t eltorito_catalog = viso->header_sectors;
+    if (eltorito_entry)
+        viso->header_sectors += 2;
+
+    /* Lay out the path tables and directory records. Only their sizes are
+       calculated here, as their contents are generated on first read. */
+    size_t dir_count = 0;
+    for (dir = viso->root_dir; dir; dir = dir->next_dir)
+        dir_count++;
+    viso->extents = (viso_extent_t *) calloc(((max_vd + 1) << 1) + (dir_count * (max_vd + 1)), sizeof(viso_extent_t));
+    if (!viso->extents)
+        goto end;
+
+    viso_extent_t *ext;
+    uint64_t       pos = ((uint64_t) viso->header_sectors) * viso->sector_size;
+    int            write;
+    for (int i = 0; i <= ((max_vd << 1) | 1); i++) {
+        viso->pt_lba[i]  = pos / viso->sector_size;
+        viso->pt_size[i] = viso_fill_path_table(viso, NULL, i);
+        image_viso_log(viso->tf.log, "Path table #%d: %u bytes at sector %u\n", i,
+                       viso->pt_size[i], viso->pt_lba[i]);
+
+        ext          = &viso->extents[viso->extents_count++];
+        ext->lba     = viso->pt_lba[i];
+        ext->sectors = (viso->pt_size[i] + viso->sector_size - 1) / viso->sector_size;
+        ext->index   = i;
+        pos += viso->pt_size[i];
+
+        /* Pad to the next even sector. */
+        write = pos % (viso->sector_size * 2);
+        if (write)
+            pos += (viso->sector_size * 2) - write;
+    }
+
+    for (int i = 0; i <= max_vd; i++) {
+        /* Go through directories. */
+        dir = viso->root_dir;
+        while (dir) {
+            /* Hide the El Torito boot code directory if no other files are present in it. */
+            if (dir == eltorito_dir) {
+                dir = dir->next_dir;
+                continue;
+            }
+
+            /* Pad to the next sector if required. */
+            write = pos % viso->sector_size;
+            if (write)
+                pos += viso->sector_size - write;
+
+            dir->dir_lba[i]  = pos / viso->sector_size;
+            dir->dir_size[i] = viso_fill_dir_records(viso, NULL, dir, i);
+            image_viso_log(viso->tf.log, "[%08X] %s => %u bytes at sector %u\n", dir,
+                           dir->path, dir->dir_size[i], dir->dir_lba[i]);
+
+            ext          = &viso->extents[viso->extents_count++];
+            ext->lba     = dir->dir_lba[i];
+            ext->sectors = (dir->dir_size[i] + viso->sector_size - 1) / viso->sector_size;
+            ext->index   = i;
+            ext->dir     = dir;
+            pos += dir->dir_size[i];
+
+            /* Move on to the next directory. */
+            dir = dir->next_dir;
+        }
+
+        /* Pad to the next even sector. */
+        write = pos % (viso->sector_size * 2);
+        if (write)
+            pos += (viso->sector_size * 2) - write;
+    }
+
+    /* Start sector counts. */
+    viso->metadata_sectors = pos / viso->sector_size;
+    viso->all_sectors      = viso->metadata_sectors;
+
+    /* Allocate file map for sector->file lookups. */
+    image_viso_log(viso->tf.log, "Allocating file map for %zu files\n", viso->file_map_size);
+    viso->file_map = (viso_entry_t **) calloc(viso->file_map_size + 1, sizeof(viso_entry_t *));
+    if (!viso->file_map)
+        goto end;
+    viso->file_map_size = 0;
+
+    /* Go through files, assigning sectors to them. */
+    image_viso_log(viso->tf.log, "Assigning sectors to files:\n");
+    for (entry = viso->root_dir; entry; entry = entry->next) {
+        /* Skip this entry if it corresponds to a directory. */
+        if (S_ISDIR(entry->stats.st_mode))
+            continue;
+
+        /* Save this file's base sector. */
+        entry->data_lba = viso->all_sectors;
+
+        /* Determine how many sectors this file will take. */
+        size_t size = entry->stats.st_size / viso->sector_size;
+        if (entry->stats.st_size % viso->sector_size)
+            size++; /* round up to the next sector */
+        image_viso_log(viso->tf.log, "[%08X] %s => %zu + %zu sectors\n", entry,
+                       entry->path, viso->all_sectors, size);
+
+        /* Allocate sectors to this file. */
+        viso->all_sectors += size;
+        if (size)
+            viso->file_map[viso->file_map_size++] = entry;
+    }
+
+    /* Now fill the header. */
+    viso->header = (uint8_t *) calloc(viso->header_sectors, viso->sector_size);
+    if (!viso->header)
+        goto end;
+    pos = 16 * viso->sector_size; /* 16 blank sectors */
+
     /* Write volume descriptors. */
     for (int i = 0; i <= max_vd; i++) {
         /* Fill volume descriptor. */
         p = data;
         if (!(viso->format & VISO_FORMAT_ISO))
-            VISO_LBE_32(p, ftello64(viso->tf.fp) / viso->sector_size);    /* sector offset (HSF only) */
+            VISO_LBE_32(p, pos / viso->sector_size);                        /* sector offset (HSF only) */
         *p++ = 1 + i;                                                       /* type */
         memcpy(p, (viso->format & VISO_FORMAT_ISO) ? "CD001" : "CDROM", 5); /* standard ID */
         p += 5;
@@ -1093,8 +1425,7 @@ next_dir:
 
         VISO_SKIP(p, 8); /* unused */
 
-        viso->vol_size_offsets[i] = ftello64(viso->tf.fp) + (p - data);
-        VISO_LBE_32(p, 0); /* volume space size (filled in later) */
+        VISO_LBE_32(p, viso->all_sectors); /* volume space size */
 
         if (i) {
             *p++ = 0x25; /* escape sequence (indicates our Joliet names are UCS-2 Level 3) */
@@ -1109,12 +1440,19 @@ next_dir:
         VISO_LBE_16(p, 1);                 /* volume sequence number */
         VISO_LBE_16(p, viso->sector_size); /* logical block size */
 
-        /* Path table metadata is filled in later. */
-        viso->pt_meta_offsets[i] = ftello64(viso->tf.fp) + (p - data);
+        /* Fill path table metadata. */
+        uint8_t *q = p;
         VISO_SKIP(p, 24 + (16 * !(viso->format & VISO_FORMAT_ISO))); /* PT size, LE PT offset, optional LE PT offset (three on HSF), BE PT offset, optional BE PT offset (three on HSF) */
+        VISO_LBE_32(q, viso->pt_size[i << 1]);
+        *((uint32_t *) q) = cpu_to_le32(viso->pt_lba[i << 1]);
+        q += 8;
+        *((uint32_t *) q) = cpu_to_be32(viso->pt_lba[(i << 1) | 1]);
 
-        viso->root_dir->dr_offsets[i] = ftello64(viso->tf.fp) + (p - data);
-        p += viso_fill_dir_record(p, viso->root_dir, viso, VISO_DIR_CURRENT); /* root directory */
+        /* Fill root directory record. */
+        q = p + 2;
+        p += viso_fill_dir_record(p, viso->root_dir, viso, VISO_DIR_CURRENT);
+        VISO_LBE_32(q, viso->root_dir->dir_lba[i]);
+        VISO_LBE_32(q, viso->root_dir->dir_size[i]);
 
         int copyright_abstract_len = (viso->format & VISO_FORMAT_ISO) ? 37 : 32;
         if (i) {
@@ -1165,7 +1503,8 @@ next_dir:
         memset(p, 0x00, viso->sector_size - (p - data));
 
         /* Write volume descriptor. */
-        fwrite(data, viso->sector_size, 1, viso->tf.fp);
+        memcpy(viso->header + pos, data, viso->sector_size);
+        pos += viso->sector_size;
 
         /* Write El Torito boot descriptor. This is an awkward spot for
            that, but the spec requires it to be the second descriptor. */
@@ -1176,7 +1515,7 @@ next_dir:
             p = data;
             if (!(viso->format & VISO_FORMAT_ISO))
                 /* Sector offset (HSF only). */
-                VISO_LBE_32(p, ftello64(viso->tf.fp) / viso->sector_size);
+                VISO_LBE_32(p, pos / viso->sector_size);
             /* Type. */
             *p++ = 0;
             /* Standard ID. */
@@ -1188,21 +1527,22 @@ next_dir:
             p += 24;
             VISO_SKIP(p, 40);
 
-            /* Save the boot catalog pointer's offset for later. */
-            eltorito_offset = ftello64(viso->tf.fp) + (p - data);
-
             /* Blank the rest of the working sector. */
             memset(p, 0x00, viso->sector_size - (p - data));
 
+            /* Write a pointer to the boot catalog. */
+            *((uint32_t *) p) = cpu_to_le32(eltorito_catalog);
+
             /* Write boot descriptor. */
-            fwrite(data, viso->sector_size, 1, viso->tf.fp);
+            memcpy(viso->header + pos, data, viso->sector_size);
+            pos += viso->sector_size;
         }
     }
 
     /* Fill terminator. */
     p = data;
     if (!(viso->format & VISO_FORMAT_ISO))
-        VISO_LBE_32(p, ftello64(viso->tf.fp) / viso->sector_size);    /* sector offset (HSF only) */
+        VISO_LBE_32(p, pos / viso->sector_size);                        /* sector offset (HSF only) */
     *p++ = 0xff;                                                        /* type */
     memcpy(p, (viso->format & VISO_FORMAT_ISO) ? "CD001" : "CDROM", 5); /* standard ID */
     p += 5;
@@ -1212,23 +1552,10 @@ next_dir:
     memset(p, 0x00, viso->sector_size - (p - data));
 
     /* Write terminator. */
-    fwrite(data, viso->sector_size, 1, viso->tf.fp);
-
-    /* We start seeing a pattern of padding to even sectors here.
-       mkisofs does this, presumably for a very good reason... */
-    int write = ftello64(viso->tf.fp) % (viso->sector_size * 2);
-    if (write) {
-        write = (viso->sector_size * 2) - write;
-        memset(data, 0x00, write);
-        fwrite(data, write, 1, viso->tf.fp);
-    }
+    memcpy(viso->header + pos, data, viso->sector_size);
 
     /* Handle El Torito boot catalog. */
     if (eltorito_entry) {
-        /* Write a pointer to this boot catalog to the boot descriptor. */
-        *((uint32_t *) data) = cpu_to_le32(ftello64(viso->tf.fp) / viso->sector_size);
-        viso_pwrite(data, eltorito_offset, 4, 1, viso->tf.fp);
-
         /* Fill boot catalog validation entry. */
         p    = data;
         *p++ = 0x01; /* header ID */
@@ -1256,364 +1583,33 @@ next_dir:
         *p++ = 0x00; /* system type (is this even relevant?) */
         *p++ = 0x00; /* reserved */
 
-        /* Save offsets to the boot catalog entry's offset and size fields for later. */
-        eltorito_offset = ftello64(viso->tf.fp) + (p - data);
-
         /* Blank the rest of the working sector. This includes the sector count,
            ISO sector offset and 20-byte selection criteria fields at the end. */
         memset(p, 0x00, viso->sector_size - (p - data));
 
-        /* Write boot catalog. */
-        fwrite(data, viso->sector_size, 1, viso->tf.fp);
-
-        /* Pad to the next even sector. */
-        write = ftello64(viso->tf.fp) % (viso->sector_size * 2);
-        if (write) {
-            write = (viso->sector_size * 2) - write;
-            memset(data, 0x00, write);
-            fwrite(data, write, 1, viso->tf.fp);
-        }
-
-        /* Flag that we shouldn't hide the boot code directory if it contains other files. */
-        if (eltorito_others_present)
-            eltorito_dir = NULL;
-    }
-
-    /* Write each path table. */
-    for (int i = 0; i <= ((max_vd << 1) | 1); i++) {
-        image_viso_log(viso->tf.log, "Generating path table #%d:\n", i);
-
-        /* Save this path table's start offset. */
-        uint64_t pt_start = ftello64(viso->tf.fp);
-
-        /* Write this table's sector offset to the corresponding volume descriptor. */
-        uint32_t pt_temp     = pt_start / viso->sector_size;
-        *((uint32_t *) data) = (i & 1) ? cpu_to_be32(pt_temp) : cpu_to_le32(pt_temp);
-        viso_pwrite(data, viso->pt_meta_offsets[i >> 1] + 8 + (8 * (i & 1)), 4, 1, viso->tf.fp);
-
-        /* Go through directories. */
-        dir             = viso->root_dir;
-        uint16_t pt_idx = 1;
-        while (dir) {
-            /* Ignore . and .. pseudo-directories, and hide the El Torito
-               boot code directory if no other files are present in it. */
-            if ((dir->name_short[0] == '.' && (dir->name_short[1] == '\0' || (dir->name_short[1] == '.' && dir->name_short[2] == '\0'))) || (dir == eltorito_dir)) {
-                dir = dir->next_dir;
-                continue;
-            }
-
-            image_viso_log(viso->tf.log, "[%08X] %s => %s\n", dir,
-                           dir->path, ((i & 2) || (dir == viso->root_dir)) ? dir->basename :
-                           dir->name_short);
-
-            /* Save this directory's path table index and offset. */
-            dir->pt_idx        = pt_idx;
-            dir->pt_offsets[i] = ftello64(viso->tf.fp);
-
-            /* Fill path table entry. */
-            p = data;
-            if (!(viso->format & VISO_FORMAT_ISO)) {
-                *((uint32_t *) p) = 0; /* extent location (filled in later) */
-                p += 4;
-                *p++ = 0; /* extended attribute length */
-                p++;      /* skip ID length for now */
-            } else {
-                p++;      /* skip ID length for now */
-                *p++ = 0; /* extended attribute length */
-                dir->pt_offsets[i] += p - data;
-                *((uint32_t *) p) = 0; /* extent location (filled in later) */
-                p += 4;
-            }
-
-            *((uint16_t *) p) = (i & 1) ? cpu_to_be16(dir->parent->pt_idx) : cpu_to_le16(dir->parent->pt_idx); /* parent directory number */
-            p += 2;
-
-            pt_temp = 5 * !(viso->format & VISO_FORMAT_ISO); /* directory ID length at offset 0 for ISO, 5 for HSF */
-            if (dir == viso->root_dir) {                     /* directory ID length then ID for root... */
-                data[pt_temp] = 1;
-                *p            = 0x00;
-            } else if (i & 2) { /* ...or Joliet... */
-                data[pt_temp] = viso_fill_fn_joliet(p, dir, 255);
-            } else { /* ...or short name */
-                data[pt_temp] = strlen(dir->name_short);
-                memcpy(p, dir->name_short, data[pt_temp]);
-            }
-            p += data[pt_temp];
-
-            if ((p - data) & 1) /* padding for odd directory ID lengths */
-                *p++ = 0x00;
-
-            /* Write path table entry. */
-            fwrite(data, p - data, 1, viso->tf.fp);
-
-            /* Increment path table index and stop if it overflows. */
-            if (++pt_idx == 0)
-                break;
-
-            /* Move on to the next directory. */
-            dir = dir->next_dir;
-        }
-
-        /* Write this table's size to the corresponding volume descriptor. */
-        pt_temp = ftello64(viso->tf.fp) - pt_start;
-        p       = data;
-        VISO_LBE_32(p, pt_temp);
-        viso_pwrite(data, viso->pt_meta_offsets[i >> 1], 8, 1, viso->tf.fp);
-
-        /* Pad to the next even sector. */
-        write = ftello64(viso->tf.fp) % (viso->sector_size * 2);
-        if (write) {
-            write = (viso->sector_size * 2) - write;
-            memset(data, 0x00, write);
-            fwrite(data, write, 1, viso->tf.fp);
-        }
-    }
-
-    /* Write directory records for each type. */
-    int dir_type = VISO_DIR_CURRENT_ROOT;
-    for (int i = 0; i <= max_vd; i++) {
-        image_viso_log(viso->tf.log, "Generating directory record set #%d:\n", i);
-
-        /* Go through directories. */
-        dir = viso->root_dir;
-        while (dir) {
-            /* Hide the El Torito boot code directory if no other files are present in it. */
-            if (dir == eltorito_dir) {
-                dir = dir->next_dir;
-                continue;
-            }
-
-            /* Pad to the next sector if required. */
-            write = ftello64(viso->tf.fp) % viso->sector_size;
-            if (write) {
-                write = viso->sector_size - write;
-                memset(data, 0x00, write);
-                fwrite(data, write, 1, viso->tf.fp);
-            }
-
-            /* Save this directory's child record array's start offset. */
-            uint64_t dir_start = ftello64(viso->tf.fp);
-
-            /* Write this directory's child record array's sector offset to its record... */
-            uint32_t dir_temp = dir_start / viso->sector_size;
-            p                 = data;
-            VISO_LBE_32(p, dir_temp);
-            viso_pwrite(data, dir->dr_offsets[i] + 2, 8, 1, viso->tf.fp);
-
-            /* ...and to its path table entries. */
-            viso_pwrite(data, dir->pt_offsets[i << 1], 4, 1, viso->tf.fp);           /* little endian */
-            viso_pwrite(data + 4, dir->pt_offsets[(i << 1) | 1], 4, 1, viso->tf.fp); /* big endian */
-
-            if (i == max_vd) /* overwrite pt_offsets in the union if we no longer need them */
-                dir->file = NULL;
-
-            /* Go through entries in this directory. */
-            entry = dir->first_child;
-            while (entry) {
-                /* Skip the El Torito boot code entry if present, or hide the
-                   boot code directory if no other files are present in it. */
-                if ((entry == eltorito_entry) || (entry == eltorito_dir))
-                    goto next_entry;
-
-                image_viso_log(viso->tf.log, "[%08X] %s => %s\n", entry, dir->path,
-                               ((dir_type == VISO_DIR_PARENT) ? ".." :
-                               ((dir_type < VISO_DIR_PARENT) ? "." :
-                                (i ? entry->basename : entry->name_short))));
-
-                /* Fill directory record. */
-                viso_fill_dir_record(data, entry, viso, dir_type);
-
-                /* Entries cannot cross sector boundaries, so pad to the next sector if needed. */
-                write = viso->sector_size - (ftello64(viso->tf.fp) % viso->sector_size);
-                if (write < data[0]) {
-                    p = data + (viso->sector_size * 2) - write;
-                    memset(p, 0x00, write);
-                    fwrite(p, write, 1, viso->tf.fp);
-                }
-
-                /* Save this entry's record's offset. This overwrites name_short in the union. */
-                entry->dr_offsets[i] = ftello64(viso->tf.fp);
-
-                /* Write data related to the . and .. pseudo-subdirectories,
-                   while advancing the current directory type. */
-                if (dir_type < VISO_DIR_PARENT) {
-                    /* Write a self-referential pointer to this entry. */
-                    p = data + 2;
-                    VISO_LBE_32(p, dir_temp);
-
-                    dir_type = VISO_DIR_PARENT;
-                } else if (dir_type == VISO_DIR_PARENT) {
-                    /* Copy the parent directory's offset and size. The root directory's
-                       parent size is a special, self-referential case handled later. */
-                    viso_pread(data + 2, dir->parent->dr_offsets[i] + 2, 16, 1, viso->tf.fp);
-
-                    dir_type = i ? VISO_DIR_JOLIET : VISO_DIR_REGULAR;
-                }
-
-                /* Write entry. */
-                fwrite(data, data[0], 1, viso->tf.fp);
-next_entry:
-                /* Move on to the next entry, and stop if the end of this directory was reached. */
-                entry = entry->next;
-                if (entry && (entry->parent != dir))
-                    break;
-            }
-
-            /* Write this directory's child record array's size to its parent and . records. */
-            dir_temp = ftello64(viso->tf.fp) - dir_start;
-            p        = data;
-            VISO_LBE_32(p, dir_temp);
-            viso_pwrite(data, dir->dr_offsets[i] + 10, 8, 1, viso->tf.fp);
-            viso_pwrite(data, dir->first_child->dr_offsets[i] + 10, 8, 1, viso->tf.fp);
-            if (dir->parent == dir) /* write size to .. on root directory as well */
-                viso_pwrite(data, dir->first_child->next->dr_offsets[i] + 10, 8, 1, viso->tf.fp);
-
-            /* Move on to the next directory. */
-            dir_type = VISO_DIR_CURRENT;
-            dir      = dir->next_dir;
-        }
-
-        /* Pad to the next even sector. */
-        write = ftello64(viso->tf.fp) % (viso->sector_size * 2);
-        if (write) {
-            write = (viso->sector_size * 2) - write;
-            memset(data, 0x00, write);
-            fwrite(data, write, 1, viso->tf.fp);
-        }
-    }
-
-    /* Allocate entry map for sector->file lookups. */
-    size_t orig_sector_size = viso->sector_size;
-    while (1) {
-        image_viso_log(viso->tf.log, "Allocating entry map for %zu %zu-byte sectors\n",
-                       viso->entry_map_size, viso->sector_size);
-        viso->entry_map = (viso_entry_t **) calloc(viso->entry_map_size, sizeof(viso_entry_t *));
-        if (viso->entry_map) {
-            /* Successfully allocated. */
-            break;
-        } else {
-            /* Blank data buffer for padding if this is the first run. */
-            if (orig_sector_size == viso->sector_size)
-                memset(data, 0x00, orig_sector_size);
-
-            /* If we don't have enough memory, double the sector size. */
-            viso->sector_size *= 2;
-            if ((viso->sector_size < VISO_SECTOR_SIZE) || (viso->sector_size > (1 << 30))) /* give up if sectors become too large */
-                goto end;
-
-            /* Go through files, recalculating the entry map size. */
-            size_t orig_entry_map_size = viso->entry_map_size;
-            viso->entry_map_size       = 0;
-            entry                      = viso->root_dir;
-            while (entry) {
-                if (!S_ISDIR(entry->stats.st_mode)) {
-                    viso->entry_map_size += entry->stats.st_size / viso->sector_size;
-                    if (entry->stats.st_size % viso->sector_size)
-                        viso->entry_map_size++; /* round up to the next sector */
-                }
-                entry = entry->next;
-            }
-            if (viso->entry_map_size == orig_entry_map_size) /* give up if there was no change in map size */
-                goto end;
-
-            /* Pad metadata to the new size's next sector. */
-            while (ftello64(viso->tf.fp) % viso->sector_size)
-                fwrite(data, orig_sector_size, 1, viso->tf.fp);
+        /* Load the entire file if not emulating, or just the first virtual
+           sector (which usually contains all the boot code) if emulating. */
+        if (eltorito_type == 0x00) { /* non-emulation */
+            uint32_t boot_size = eltorito_entry->stats.st_size;
+            if (boot_size % 512) /* round up */
+                boot_size += 512 - (boot_size % 512);
+            AS_U16(p[0]) = cpu_to_le16(boot_size / 512);
+        } else { /* emulation */
+            AS_U16(p[0]) = cpu_to_le16(1);
         }
-    }
+        AS_U32(p[2]) = cpu_to_le32(eltorito_entry->data_lba);
 
-    /* Start sector counts. */
-    viso->metadata_sectors = ftello64(viso->tf.fp) / viso->sector_size;
-    viso->all_sectors      = viso->metadata_sectors;
-
-    /* Go through files, assigning sectors to them. */
-    image_viso_log(viso->tf.log, "Assigning sectors to files:\n");
-    size_t        base_factor  = viso->sector_size / orig_sector_size;
-    viso_entry_t *prev_entry   = viso->root_dir;
-    viso_entry_t **entry_map_p = viso->entry_map;
-    entry                      = prev_entry->next;
-    while (entry) {
-        /* Skip this entry if it corresponds to a directory. */
-        if (S_ISDIR(entry->stats.st_mode)) {
-            /* Deallocate directory entries to save some memory. */
-            prev_entry->next = entry->next;
-            free(entry);
-            entry = prev_entry->next;
-            continue;
-        }
-
-        /* Write this file's base sector offset to its directory
-           entries, unless this is the El Torito boot code entry,
-           in which case, write offset and size to the boot entry. */
-        if (entry == eltorito_entry) {
-            /* Load the entire file if not emulating, or just the first virtual
-               sector (which usually contains all the boot code) if emulating. */
-            if (eltorito_type == 0x00) { /* non-emulation */
-                uint32_t boot_size = entry->stats.st_size;
-                if (boot_size % 512) /* round up */
-                    boot_size += 512 - (boot_size % 512);
-                AS_U16(data[0]) = cpu_to_le16(boot_size / 512);
-            } else { /* emulation */
-                AS_U16(data[0]) = cpu_to_le16(1);
-            }
-            AS_U32(data[2]) = cpu_to_le32(viso->all_sectors * base_factor);
-            viso_pwrite(data, eltorito_offset, 6, 1, viso->tf.fp);
-        } else {
-            p = data;
-            VISO_LBE_32(p, viso->all_sectors * base_factor);
-            for (int i = 0; i <= max_vd; i++)
-                viso_pwrite(data, entry->dr_offsets[i] + 2, 8, 1, viso->tf.fp);
-        }
-
-        /* Save this file's base offset. This overwrites dr_offsets in the union. */
-        entry->data_offset = ((uint64_t) viso->all_sectors) * viso->sector_size;
-
-        /* Determine how many sectors this file will take. */
-        size_t size = entry->stats.st_size / viso->sector_size;
-        if (entry->stats.st_size % viso->sector_size)
-            size++; /* round up to the next sector */
-        image_viso_log(viso->tf.log, "[%08X] %s => %zu + %zu sectors\n", entry,
-                       entry->path, viso->all_sectors, size);
-
-        /* Allocate sectors to this file. */
-        viso->all_sectors += size;
-        while (size-- > 0)
-            *entry_map_p++ = entry;
-
-        /* Move on to the next entry. */
-        prev_entry = entry;
-        entry      = entry->next;
+        /* Write boot catalog. */
+        memcpy(viso->header + (eltorito_catalog * viso->sector_size), data, viso->sector_size);
     }
 
-    /* Write final volume size to all volume descriptors. */
-    p = data;
-    VISO_LBE_32(p, viso->all_sectors);
-    for (int i = 0; i < (sizeof(viso->vol_size_offsets) / sizeof(viso->vol_size_offsets[0])); i++)
-        viso_pwrite(data, viso->vol_size_offsets[i], 8, 1, viso->tf.fp);
-
-    /* Metadata processing is finished, read it back to memory. */
-    image_viso_log(viso->tf.log, "Reading back %zu %zu-byte sectors of metadata\n",
-                   viso->metadata_sectors, viso->sector_size);
-    viso->metadata = (uint8_t *) calloc(viso->metadata_sectors, viso->sector_size);
-    if (viso->metadata == NULL)
-        goto end;
-    fseeko64(viso->tf.fp, 0, SEEK_SET);
-    size_t metadata_size = viso->metadata_sectors * viso->sector_size;
-    size_t metadata_remain = metadata_size;
-    while (metadata_remain > 0)
-        metadata_remain -= fread(viso->metadata + (metadata_size - metadata_remain), 1, MIN(metadata_remain, viso->sector_size), viso->tf.fp);
-
-    /* We no longer need the temporary file; close and delete it. */
-    fclose(viso->tf.fp);
-    viso->tf.fp = NULL;
-#ifndef ENABLE_IMAGE_VISO_LOG
-    remove(nvr_path(viso->tf.fn));
-#endif
-
     /* All good. */
     *error = 0;
 
 end:
+    if (data)
+        free(data);
+
     /* Set the function pointers. */
     viso->tf.priv = viso;
     if (!*error) {
@@ -1627,8 +1623,6 @@ end:
     } else {
         if (viso != NULL) {
             image_viso_log(viso->tf.log, "Initialization failed\n");
-            if (data)
-                free(data);
             viso_close(&viso->tf);
         }
         return NULL;
@@ -933,6 +933,27 @@ load_network(void)
         p = ini_section_get_string(cat, temp, NULL);
         strncpy(nc->nrs_hostname, p ? p : "", sizeof(nc->nrs_hostname) - 1);
 
+        sprintf(temp, "net_%02i_queue_len", c + 1);
+        nc->queue_len = ini_section_get_int(cat, temp, NET_QUEUE_LEN_DEFAULT);
+
+        sprintf(temp, "net_%02i_fast_link", c + 1);
+        nc->fast_link = !!ini_section_get_int(cat, temp, 0);
+
+        sprintf(temp, "net_%02i_switch_shm", c + 1);
+        nc->switch_shm = !!ini_section_get_int(cat, temp, 0);
+
+        sprintf(temp, "net_%02i_vlan", c + 1);
+        nc->vlan = ini_section_get_int(cat, temp, 1);
+        if (nc->vlan > 4094)
+            nc->vlan = 1;
+
+        sprintf(temp, "net_%02i_slirp_sockbuf", c + 1);
+        nc->slirp_sockbuf = ini_section_get_int(cat, temp, 0);
+        if (nc->slirp_sockbuf < 0)
+            nc->slirp_sockbuf = 0;
+        else if (nc->slirp_sockbuf > NET_SLIRP_SOCKBUF_MAX)
+            nc->slirp_sockbuf = NET_SLIRP_SOCKBUF_MAX;
+
         sprintf(temp, "net_%02i_link", c + 1);
         nc->link_state = ini_section_get_int(cat, temp,
                                              (NET_LINK_10_HD | NET_LINK_10_FD |
@@ -1477,6 +1498,14 @@ load_hard_disks(void)
         sprintf(temp, "hdd_%02i_raw_device", c + 1);
         hdd[c].raw_device = ini_section_get_int(cat, temp, 0) ? 1 : 0;
 
+        /* Delta overlay - when set, writes go to this file instead */
+        sprintf(temp, "hdd_%02i_overlay", c + 1);
+        p = ini_section_get_string(cat, temp, "");
+        strncpy(hdd[c].overlay_fn, p, sizeof(hdd[c].overlay_fn) - 1);
+
+        sprintf(temp, "hdd_%02i_overlay_dedup", c + 1);
+        hdd[c].overlay_dedup = ini_section_get_int(cat, temp, 0) ? 1 : 0;
+
         /* If disk is empty or invalid, mark it for deletion. */
         if (!hdd_is_valid(c)) {
             sprintf(temp, "hdd_%02i_parameters", c + 1);
@@ -3185,6 +3214,36 @@ save_network(void)
             ini_section_delete_var(cat, temp);
         else
             ini_section_set_string(cat, temp, net_cards_conf[c].nrs_hostname);
+
+        sprintf(temp, "net_%02i_queue_len", c + 1);
+        if ((nc->queue_len == 0) || (nc->queue_len == NET_QUEUE_LEN_DEFAULT))
+            ini_section_delete_var(cat, temp);
+        else
+            ini_section_set_int(cat, temp, nc->queue_len);
+
+        sprintf(temp, "net_%02i_fast_link", c + 1);
+        if (nc->fast_link == 0)
+            ini_section_delete_var(cat, temp);
+        else
+            ini_section_set_int(cat, temp, nc->fast_link);
+
+        sprintf(temp, "net_%02i_switch_shm", c + 1);
+        if (nc->switch_shm == 0)
+            ini_section_delete_var(cat, temp);
+        else
+            ini_section_set_int(cat, temp, nc->switch_shm);
+
+        sprintf(temp, "net_%02i_vlan", c + 1);
+        if (nc->vlan == 1)
+            ini_section_delete_var(cat, temp);
+        else
+            ini_section_set_int(cat, temp, nc->vlan);
+
+        sprintf(temp, "net_%02i_slirp_sockbuf", c + 1);
+        if (nc->slirp_sockbuf == 0)
+            ini_section_delete_var(cat, temp);
+        else
+            ini_section_set_int(cat, temp, nc->slirp_sockbuf);
     }
 
     ini_delete_section_if_empty(config, cat);
@@ -3671,6 +3730,19 @@ save_hard_disks(void)
         else
             ini_section_delete_var(cat, temp);
 
+        sprintf(temp, "hdd_%02i_overlay", c + 1);
+        if (hdd_is_valid(c) && hdd[c].overlay_fn[0]) {
+            path_normalize(hdd[c].overlay_fn);
+            ini_section_set_string(cat, temp, hdd[c].overlay_fn);
+        } else
+            ini_section_delete_var(cat, temp);
+
+        sprintf(temp, "hdd_%02i_overlay_dedup", c + 1);
+        if (hdd_is_valid(c) && hdd[c].overlay_fn[0] && hdd[c].overlay_dedup)
+            ini_section_set_int(cat, temp, 1);
+        else
+            ini_section_delete_var(cat, temp);
+
         sprintf(temp, "hdd_%02i_speed", c + 1);
         if (!hdd_is_valid(c) ||
             ((hdd[c].bus_type != HDD_BUS_MFM) && (hdd[c].bus_type != HDD_BUS_ESDI) &&
@@ -228,6 +228,57 @@ serial_write_fifo(serial_t *dev, uint8_t dat)
         write_fifo(dev, dat);
 }
 
+/* How many bytes serial_write_fifo_buf() would take right now. */
+int
+serial_rx_space(serial_t *dev)
+{
+    if ((dev == NULL) || (dev->out_new != 0xffff))
+        return 0;
+
+    if ((dev->type >= SERIAL_16550) && dev->fifo_enabled)
+        return ((fifo_t *) dev->rcvr_fifo)->len - fifo_get_count(dev->rcvr_fifo);
+
+    return !(dev->lsr & 0x01);
+}
+
+/*
+ * Deliver a burst of received bytes at once instead of one per receive
+ * timer tick. In FIFO mode the bytes go straight into the receiver FIFO
+ * and the character timeout is restarted once; otherwise only a single
+ * byte fits. Returns the number of bytes taken, which callers use to pace
+ * their next burst at the line rate.
+ */
+int
+serial_write_fifo_buf(serial_t *dev, const uint8_t *buf, int len)
+{
+    int count;
+
+    if ((dev == NULL) || (len <= 0))
+        return 0;
+
+    /* Loopback mode: the line is disconnected, the bytes are lost. */
+    if (dev->mctrl & 0x10)
+        return len;
+
+    count = MIN(serial_rx_space(dev), len);
+    if (count == 0)
+        return 0;
+
+    serial_log("serial_write_fifo_buf(%08X, %i of %i)\n", dev, count, len);
+
+    if ((dev->type >= SERIAL_16550) && dev->fifo_enabled) {
+        serial_clear_timeout(dev);
+
+        for (int i = 0; i < count; i++)
+            fifo_write_evt(buf[i], dev->rcvr_fifo);
+
+        timer_on_auto(&dev->timeout_timer, 4.0 * dev->bits * dev->transmit_period);
+    } else
+        write_fifo(dev, buf[0]);
+
+    return count;
+}
+
 void
 serial_transmit(serial_t *dev, uint8_t val)
 {
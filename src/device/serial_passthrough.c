@@ -30,6 +30,8 @@
 #include <86box/plat_serial_passthrough.h>
 #include <86box/plat_unused.h>
 
+#define SERPT_TX_DELAY 1000.0 /* us to gather guest bytes before writing them out */
+
 #define ENABLE_SERIAL_PASSTHROUGH_LOG 1
 #ifdef ENABLE_SERIAL_PASSTHROUGH_LOG
 int serial_passthrough_do_log = ENABLE_SERIAL_PASSTHROUGH_LOG;
@@ -60,47 +62,88 @@ serial_passthrough_init(void)
     }
 }
 
+static double
+serial_passthrough_char_time(serial_passthrough_t *dev)
+{
+    return (1000000.0 / dev->baudrate) * (double) dev->bits;
+}
+
 static void
-serial_passthrough_write(UNUSED(serial_t *s), void *priv, uint8_t val)
+serial_passthrough_flush(serial_passthrough_t *dev)
 {
-    plat_serpt_write(priv, val);
+    int res;
+
+    if (dev->tx_len == 0)
+        return;
+
+    res = plat_serpt_write(dev, dev->tx_buf, dev->tx_len);
+    if (res <= 0)
+        return;
+
+    dev->tx_len -= res;
+    if (dev->tx_len)
+        memmove(dev->tx_buf, &dev->tx_buf[res], dev->tx_len);
 }
 
 static void
-host_to_serial_cb(void *priv)
+serial_to_host_cb(void *priv)
 {
     serial_passthrough_t *dev = (serial_passthrough_t *) priv;
 
-    uint8_t byte;
+    serial_passthrough_flush(dev);
 
-    plat_serpt_set_line_state(priv);
+    /* The host is not keeping up; try again in a bit. */
+    if (dev->tx_len)
+        timer_on_auto(&dev->serial_to_host_timer, MAX(SERPT_TX_DELAY, serial_passthrough_char_time(dev)));
+}
 
-    /* write_fifo has no failure indication, but if we write to fast, the host
-     * can never fetch the bytes in time, so check if the fifo is full if in
-     * fifo mode or if lsr has bit 0 set if not in fifo mode */
-    if ((dev->serial->type >= SERIAL_16550) && dev->serial->fifo_enabled) {
-        if (fifo_get_full(dev->serial->rcvr_fifo)) {
-            goto no_write_to_machine;
-        }
-    } else {
-        if (dev->serial->lsr & 1) {
-            goto no_write_to_machine;
+static void
+serial_passthrough_write(UNUSED(serial_t *s), void *priv, uint8_t val)
+{
+    serial_passthrough_t *dev = (serial_passthrough_t *) priv;
+
+    /* Gather the bytes and write them out together, rather than one call per byte. */
+    if (dev->tx_len == SERPT_BUF_SIZE) {
+        serial_passthrough_flush(dev);
+        if (dev->tx_len == SERPT_BUF_SIZE) {
+            serial_passthrough_log("Serial passthrough: host is not reading, byte dropped\n");
+            return;
         }
     }
-    if (plat_serpt_read(dev, &byte)) {
-#if 0
-        printf("got byte %02X\n", byte);
-#endif
-        serial_write_fifo(dev->serial, byte);
-#if 0
-        serial_set_dsr(dev->serial, 1);
-#endif
+
+    dev->tx_buf[dev->tx_len++] = val;
+
+    if (!timer_is_enabled(&dev->serial_to_host_timer))
+        timer_on_auto(&dev->serial_to_host_timer, MAX(SERPT_TX_DELAY, serial_passthrough_char_time(dev)));
+}
+
+static void
+host_to_serial_cb(void *priv)
+{
+    serial_passthrough_t *dev = (serial_passthrough_t *) priv;
+    int                   count;
+    int                   res;
+
+    plat_serpt_set_line_state(priv);
+
+    /* Only go to the host once everything read last time has been delivered. */
+    if (dev->rx_pos == dev->rx_len) {
+        dev->rx_pos = dev->rx_len = 0;
+
+        res = plat_serpt_read(dev, dev->rx_buf, SERPT_BUF_SIZE);
+        if (res > 0)
+            dev->rx_len = res;
     }
-no_write_to_machine:
-#if 0
-    serial_device_timeout(dev->serial);
-#endif
-    timer_on_auto(&dev->host_to_serial_timer, (1000000.0 / dev->baudrate) * (double) dev->bits);
+
+    /*
+     * Hand over as much as the UART can take in one go, then wait as long
+     * as those characters would have taken on the line, so the guest still
+     * sees the configured rate on average.
+     */
+    count = serial_write_fifo_buf(dev->serial, &dev->rx_buf[dev->rx_pos], dev->rx_len - dev->rx_pos);
+    dev->rx_pos += count;
+
+    timer_on_auto(&dev->host_to_serial_timer, serial_passthrough_char_time(dev) * (double) MAX(count, 1));
 }
 
 static void
@@ -142,6 +185,9 @@ serial_passthrough_dev_close(void *priv)
     if (dev->serial && dev->serial->sd)
         memset(dev->serial->sd, 0, sizeof(serial_device_t));
 
+    timer_disable(&dev->serial_to_host_timer);
+    serial_passthrough_flush(dev);
+
     plat_serpt_close(dev);
     free(dev);
 }
@@ -210,6 +256,7 @@ serial_passthrough_dev_init(const device_t *info)
 
     memset(&dev->host_to_serial_timer, 0, sizeof(pc_timer_t));
     timer_add(&dev->host_to_serial_timer, host_to_serial_cb, dev, 1);
+    timer_add(&dev->serial_to_host_timer, serial_to_host_cb, dev, 0);
     serial_set_cts(dev->serial, 1);
     serial_set_dsr(dev->serial, 1);
     serial_set_dcd(dev->serial, 1);
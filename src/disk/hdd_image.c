@@ -46,8 +46,9 @@
 #define HDD_IMAGE_VHD 3
 
 typedef struct hdd_image_t {
-    FILE     *file; /* Used for HDD_IMAGE_RAW, HDD_IMAGE_HDI, and HDD_IMAGE_HDX. */
-    MVHDMeta *vhd;  /* Used for HDD_IMAGE_VHD. */
+    FILE          *file;    /* Used for HDD_IMAGE_RAW, HDD_IMAGE_HDI, and HDD_IMAGE_HDX. */
+    MVHDMeta      *vhd;     /* Used for HDD_IMAGE_VHD. */
+    hdd_overlay_t *overlay; /* Delta overlay above a read-only file. */
     uint32_t  base;
     uint32_t  pos;
     uint32_t  last_sector;
@@ -253,6 +254,17 @@ prepare_new_hard_disk(uint8_t id, uint64_t full_size)
     return 1;
 }
 
+static void
+hdd_image_open_overlay(uint8_t id)
+{
+    path_normalize(hdd[id].overlay_fn);
+
+    hdd_images[id].overlay = hdd_overlay_open(hdd[id].overlay_fn, hdd_images[id].file, hdd_images[id].base,
+                                              hdd_images[id].last_sector + 1, hdd[id].overlay_dedup);
+    if (hdd_images[id].overlay == NULL)
+        fatal("hdd_image_load(): Overlay: Could not open overlay file '%s'\n", hdd[id].overlay_fn);
+}
+
 void
 hdd_image_init(void)
 {
@@ -286,6 +298,10 @@ hdd_image_load(int id)
     hdd_images[id].is_block_device = 0;
 
     if (hdd_images[id].loaded) {
+        if (hdd_images[id].overlay) {
+            hdd_overlay_close(hdd_images[id].overlay);
+            hdd_images[id].overlay = NULL;
+        }
         if (hdd_images[id].file) {
             fclose(hdd_images[id].file);
             hdd_images[id].file = NULL;
@@ -304,7 +320,7 @@ hdd_image_load(int id)
             goto fail_raw;
         }
 
-        hdd_images[id].file = plat_fopen(fn, hdd[id].wp ? "rb" : "rb+");
+        hdd_images[id].file = plat_fopen(fn, (hdd[id].wp || hdd[id].overlay_fn[0]) ? "rb" : "rb+");
         if (hdd_images[id].file == NULL) {
             hdd_image_log("Block device: Unable to open\n");
             /* Don't clear hdd[id].fn - preserve config even if device is unavailable */
@@ -329,6 +345,9 @@ hdd_image_load(int id)
         hdd_images[id].last_sector = (uint32_t) (full_size >> 9) - 1;
         hdd_images[id].loaded = 1;
 
+        if (hdd[id].overlay_fn[0])
+            hdd_image_open_overlay(id);
+
         hdd_image_log("Block device: %s, size=%llu, C=%u H=%u S=%u\n",
                       fn, (unsigned long long)full_size, hdd[id].tracks, hdd[id].hpc, hdd[id].spt);
         return 1;
@@ -348,14 +367,14 @@ hdd_image_load(int id)
         memset(hdd[id].fn, 0, sizeof(hdd[id].fn));
         goto fail_raw;
     }
-    hdd_images[id].file = plat_fopen(fn, "rb+");
+    hdd_images[id].file = plat_fopen(fn, hdd[id].overlay_fn[0] ? "rb" : "rb+");
     if (hdd_images[id].file == NULL) {
         /* Failed to open existing hard disk image */
         if (errno == ENOENT) {
             /* Failed because it does not exist,
                so try to create new file */
-            if (hdd[id].wp) {
-                hdd_image_log("A write-protected image must exist\n");
+            if (hdd[id].wp || hdd[id].overlay_fn[0]) {
+                hdd_image_log("A write-protected or overlaid image must exist\n");
                 memset(hdd[id].fn, 0, sizeof(hdd[id].fn));
                 goto fail_raw;
             }
@@ -513,6 +532,10 @@ fail_raw:
             hdd[id].tracks      = tracks;
             hdd_images[id].type = HDD_IMAGE_HDX;
         } else if (is_vhd[1]) {
+            if (hdd[id].overlay_fn[0]) {
+                /* Differencing VHD's already cover this case. */
+                pclog("hdd_image_load(): VHD: Ignoring overlay '%s' for VHD file '%s'\n", hdd[id].overlay_fn, fn);
+            }
             fclose(hdd_images[id].file);
             hdd_images[id].file = NULL;
             hdd_images[id].vhd  = mvhd_open(fn, (bool) 0, &vhd_error);
@@ -548,14 +571,19 @@ fail_raw:
     if (fseeko64(hdd_images[id].file, 0, SEEK_END) == -1)
         fatal("hdd_image_load(): Error seeking to the end of file\n");
     s = ftello64(hdd_images[id].file);
-    if (s < (full_size + hdd_images[id].base))
+    if ((s < (full_size + hdd_images[id].base)) && !hdd[id].overlay_fn[0])
         ret = prepare_new_hard_disk(id, full_size);
     else {
+        /* A read-only base shorter than its geometry is padded with
+           zeroes by the overlay instead of being expanded. */
         hdd_images[id].last_sector = (uint32_t) (full_size >> 9) - 1;
         hdd_images[id].loaded      = 1;
         ret                        = 1;
     }
 
+    if ((ret > 0) && hdd[id].overlay_fn[0])
+        hdd_image_open_overlay(id);
+
     return ret;
 }
 
@@ -588,6 +616,10 @@ hdd_image_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
         hdd_images[id].pos        = sector + count - non_transferred_sectors - 1;
         if (hdd_images[id].vhd->error)
             return -1;
+    } else if (hdd_images[id].overlay) {
+        hdd_images[id].pos = sector + count;
+        if (hdd_overlay_read(hdd_images[id].overlay, sector, count, buffer) < 0)
+            return -1;
     } else {
         if (!hdd_images[id].file || (fseeko64(hdd_images[id].file, ((uint64_t) (sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1)) {
             hdd_image_log("Hard disk image %i: Read error during seek\n", id);
@@ -644,6 +676,10 @@ hdd_image_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
         hdd_images[id].pos        = sector + count - non_transferred_sectors - 1;
         if (hdd_images[id].vhd->error)
             return -1;
+    } else if (hdd_images[id].overlay) {
+        hdd_images[id].pos = sector + count;
+        if (hdd_overlay_write(hdd_images[id].overlay, sector, count, buffer) < 0)
+            return -1;
     } else {
         if (!hdd_images[id].file || (fseeko64(hdd_images[id].file, ((uint64_t) (sector) << 9LL) + hdd_images[id].base, SEEK_SET) == -1)) {
             hdd_image_log("Hard disk image %i: Write error during seek\n", id);
@@ -686,6 +722,10 @@ hdd_image_zero(uint8_t id, uint32_t sector, uint32_t count)
         hdd_images[id].pos          = sector + count - non_transferred_sectors - 1;
         if (hdd_images[id].vhd->error)
             return -1;
+    } else if (hdd_images[id].overlay) {
+        hdd_images[id].pos = sector + count;
+        if (hdd_overlay_zero(hdd_images[id].overlay, sector, count) < 0)
+            return -1;
     } else {
         memset(empty_sector, 0, 512);
 
@@ -744,6 +784,10 @@ hdd_image_unload(uint8_t id, UNUSED(int fn_preserve))
         return;
 
     if (hdd_images[id].loaded) {
+        if (hdd_images[id].overlay != NULL) {
+            hdd_overlay_close(hdd_images[id].overlay);
+            hdd_images[id].overlay = NULL;
+        }
         if (hdd_images[id].file != NULL) {
             fclose(hdd_images[id].file);
             hdd_images[id].file = NULL;
@@ -767,6 +811,11 @@ hdd_image_close(uint8_t id)
     if (!hdd_images[id].loaded)
         return;
 
+    if (hdd_images[id].overlay != NULL) {
+        hdd_overlay_close(hdd_images[id].overlay);
+        hdd_images[id].overlay = NULL;
+    }
+
     if (hdd_images[id].file != NULL) {
         fclose(hdd_images[id].file);
         hdd_images[id].file = NULL;
@@ -785,7 +834,9 @@ hdd_image_sync(uint8_t id)
     if (!hdd_images[id].loaded)
         return;
 
-    if (hdd_images[id].file != NULL) {
+    if (hdd_images[id].overlay != NULL)
+        hdd_overlay_sync(hdd_images[id].overlay);
+    else if (hdd_images[id].file != NULL) {
         fflush(hdd_images[id].file);
     }
 }
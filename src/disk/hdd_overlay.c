@@ -0,0 +1,573 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Sector-level delta overlay for shared base hard disk images.
+ *
+ *          The base image (raw, HDI or HDX) is opened read-only, so any
+ *          number of machines can share it (and the host's page cache
+ *          copy of it), while every write is redirected into a sparse
+ *          per-machine delta file.
+ *
+ *          Delta file layout (host byte order, like the HDI/HDX headers):
+ *
+ *            0x0000  header (512 bytes, see hdd_overlay_hdr_t)
+ *            0x0200  L1 table: one 64-bit file offset per L2 table,
+ *                    0 meaning "no sector in this range is present"
+ *            ...     L2 tables and sector data, appended on demand
+ *
+ *          Each L2 table covers OVL_L2_ENTRIES sectors and holds the file
+ *          offset of the sector data plus a 64-bit hash of its contents.
+ *          The hash lets an unchanged rewrite of a sector skip the write.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/plat.h>
+#include <86box/hdd.h>
+
+#define OVL_MAGIC      0x4C564F584F423638LL /* "86BOXOVL" */
+#define OVL_VERSION    1
+#define OVL_HDR_SIZE   512
+#define OVL_L2_SHIFT   10
+#define OVL_L2_ENTRIES (1 << OVL_L2_SHIFT)
+#define OVL_L2_MASK    (OVL_L2_ENTRIES - 1)
+#define OVL_L1_ENTRIES(s) ((uint32_t) (((uint64_t) (s) + OVL_L2_MASK) >> OVL_L2_SHIFT))
+
+typedef struct hdd_overlay_hdr_t {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t l2_entries;
+    uint32_t sectors;     /* Number of sectors in the base image. */
+    uint32_t l1_entries;
+    uint64_t l1_offset;
+    uint64_t used;        /* Number of sectors present in the delta. */
+} hdd_overlay_hdr_t;
+
+typedef struct ovl_entry_t {
+    uint64_t offset;      /* 0 = sector is not in the delta. */
+    uint64_t hash;
+} ovl_entry_t;
+
+struct hdd_overlay_t {
+    FILE              *fp;
+    FILE              *base;
+    uint64_t           base_off;
+    uint64_t           end;
+    uint64_t          *l1;
+    ovl_entry_t      **l2;
+    uint8_t            dedup;
+    hdd_overlay_hdr_t  hdr;
+};
+
+#ifdef ENABLE_HDD_OVERLAY_LOG
+int hdd_overlay_do_log = ENABLE_HDD_OVERLAY_LOG;
+
+static void
+hdd_overlay_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (hdd_overlay_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define hdd_overlay_log(fmt, ...)
+#endif
+
+/* FNV-1a, only used to detect (not to prove) identical sector contents. */
+static uint64_t
+ovl_hash(const uint8_t *buf)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (int i = 0; i < 512; i++) {
+        h ^= buf[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static int
+ovl_pread(FILE *fp, uint64_t offset, void *buf, size_t len)
+{
+    if (fseeko64(fp, offset, SEEK_SET) == -1)
+        return -1;
+
+    return (fread(buf, 1, len, fp) == len) ? 0 : -1;
+}
+
+static int
+ovl_pwrite(FILE *fp, uint64_t offset, const void *buf, size_t len)
+{
+    if (fseeko64(fp, offset, SEEK_SET) == -1)
+        return -1;
+
+    return (fwrite(buf, 1, len, fp) == len) ? 0 : -1;
+}
+
+static int
+ovl_write_hdr(hdd_overlay_t *ovl)
+{
+    uint8_t hdr[OVL_HDR_SIZE] = { 0 };
+
+    memcpy(hdr, &ovl->hdr, sizeof(hdd_overlay_hdr_t));
+
+    return ovl_pwrite(ovl->fp, 0, hdr, OVL_HDR_SIZE);
+}
+
+/* Returns the L2 table covering the sector, loading it on first use. */
+static ovl_entry_t *
+ovl_get_l2(hdd_overlay_t *ovl, uint32_t sector, int alloc)
+{
+    uint32_t     idx = sector >> OVL_L2_SHIFT;
+    ovl_entry_t *l2;
+    uint64_t     offset;
+
+    if (ovl->l2[idx] != NULL)
+        return ovl->l2[idx];
+
+    if ((ovl->l1[idx] == 0) && !alloc)
+        return NULL;
+
+    l2 = (ovl_entry_t *) calloc(OVL_L2_ENTRIES, sizeof(ovl_entry_t));
+
+    if (ovl->l1[idx] != 0) {
+        if (ovl_pread(ovl->fp, ovl->l1[idx], l2, OVL_L2_ENTRIES * sizeof(ovl_entry_t))) {
+            hdd_overlay_log("HDD overlay: Error reading L2 table %u\n", idx);
+            free(l2);
+            return NULL;
+        }
+    } else {
+        offset = ovl->end;
+        if (ovl_pwrite(ovl->fp, offset, l2, OVL_L2_ENTRIES * sizeof(ovl_entry_t)) ||
+            ovl_pwrite(ovl->fp, ovl->hdr.l1_offset + (idx * sizeof(uint64_t)), &offset, sizeof(uint64_t))) {
+            hdd_overlay_log("HDD overlay: Error allocating L2 table %u\n", idx);
+            free(l2);
+            return NULL;
+        }
+        ovl->l1[idx] = offset;
+        ovl->end += OVL_L2_ENTRIES * sizeof(ovl_entry_t);
+    }
+
+    ovl->l2[idx] = l2;
+    return l2;
+}
+
+static ovl_entry_t *
+ovl_lookup(hdd_overlay_t *ovl, uint32_t sector)
+{
+    ovl_entry_t *l2 = ovl_get_l2(ovl, sector, 0);
+
+    if ((l2 == NULL) || (l2[sector & OVL_L2_MASK].offset == 0))
+        return NULL;
+
+    return &l2[sector & OVL_L2_MASK];
+}
+
+static int
+ovl_base_read(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    size_t num_read;
+
+    if (fseeko64(ovl->base, ((uint64_t) sector << 9LL) + ovl->base_off, SEEK_SET) == -1)
+        return -1;
+
+    num_read = fread(buffer, 512, count, ovl->base);
+    if (num_read < count) {
+        if (!feof(ovl->base))
+            return -1;
+        /* Sectors past the end of a sparse base image read as zeroes. */
+        memset(buffer + (num_read << 9), 0x00, (count - num_read) << 9);
+    }
+
+    return 0;
+}
+
+hdd_overlay_t *
+hdd_overlay_open(const char *fn, FILE *base, uint64_t base_off, uint32_t sectors, int dedup)
+{
+    hdd_overlay_t *ovl     = (hdd_overlay_t *) calloc(1, sizeof(hdd_overlay_t));
+    int            created = 0;
+    uint32_t       l1_size;
+
+    ovl->base     = base;
+    ovl->base_off = base_off;
+    ovl->dedup    = !!dedup;
+
+    ovl->fp = plat_fopen64(fn, "rb+");
+    if (ovl->fp != NULL) {
+        if (ovl_pread(ovl->fp, 0, &ovl->hdr, sizeof(hdd_overlay_hdr_t)) ||
+            (ovl->hdr.magic != OVL_MAGIC) || (ovl->hdr.version != OVL_VERSION) ||
+            (ovl->hdr.l2_entries != OVL_L2_ENTRIES)) {
+            hdd_overlay_log("HDD overlay: '%s' is not a valid overlay file\n", fn);
+            goto fail;
+        }
+        if (ovl->hdr.sectors != sectors) {
+            hdd_overlay_log("HDD overlay: '%s' was created for a base of %u sectors, not %u\n",
+                            fn, ovl->hdr.sectors, sectors);
+            goto fail;
+        }
+        if (ovl->hdr.l1_entries != OVL_L1_ENTRIES(sectors)) {
+            hdd_overlay_log("HDD overlay: '%s' has a bad L1 table size\n", fn);
+            goto fail;
+        }
+    } else {
+        ovl->fp = plat_fopen64(fn, "wb+");
+        if (ovl->fp == NULL) {
+            hdd_overlay_log("HDD overlay: Unable to create '%s'\n", fn);
+            goto fail;
+        }
+
+        ovl->hdr.magic      = OVL_MAGIC;
+        ovl->hdr.version    = OVL_VERSION;
+        ovl->hdr.l2_entries = OVL_L2_ENTRIES;
+        ovl->hdr.sectors    = sectors;
+        ovl->hdr.l1_entries = OVL_L1_ENTRIES(sectors);
+        ovl->hdr.l1_offset  = OVL_HDR_SIZE;
+        ovl->hdr.used       = 0;
+        created             = 1;
+    }
+
+    l1_size = ovl->hdr.l1_entries * sizeof(uint64_t);
+    ovl->l1 = (uint64_t *) calloc(ovl->hdr.l1_entries + 1, sizeof(uint64_t));
+    ovl->l2 = (ovl_entry_t **) calloc(ovl->hdr.l1_entries + 1, sizeof(ovl_entry_t *));
+
+    if (created) {
+        if (ovl_write_hdr(ovl) || ovl_pwrite(ovl->fp, ovl->hdr.l1_offset, ovl->l1, l1_size)) {
+            hdd_overlay_log("HDD overlay: Error initializing '%s'\n", fn);
+            goto fail;
+        }
+    } else if (l1_size && ovl_pread(ovl->fp, ovl->hdr.l1_offset, ovl->l1, l1_size)) {
+        hdd_overlay_log("HDD overlay: Error reading L1 table of '%s'\n", fn);
+        goto fail;
+    }
+
+    if (fseeko64(ovl->fp, 0, SEEK_END) == -1)
+        goto fail;
+    ovl->end = ftello64(ovl->fp);
+    if (ovl->end < (ovl->hdr.l1_offset + l1_size))
+        ovl->end = ovl->hdr.l1_offset + l1_size;
+
+    hdd_overlay_log("HDD overlay: '%s' opened, %" PRIu64 " of %u sectors present\n",
+                    fn, ovl->hdr.used, sectors);
+
+    return ovl;
+
+fail:
+    hdd_overlay_close(ovl);
+    return NULL;
+}
+
+void
+hdd_overlay_close(hdd_overlay_t *ovl)
+{
+    if (ovl == NULL)
+        return;
+
+    if (ovl->l2 != NULL) {
+        for (uint32_t i = 0; i < ovl->hdr.l1_entries; i++)
+            free(ovl->l2[i]);
+        free(ovl->l2);
+    }
+    free(ovl->l1);
+
+    if (ovl->fp != NULL)
+        fclose(ovl->fp);
+
+    free(ovl);
+}
+
+void
+hdd_overlay_sync(hdd_overlay_t *ovl)
+{
+    if ((ovl != NULL) && (ovl->fp != NULL))
+        fflush(ovl->fp);
+}
+
+int
+hdd_overlay_read(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    const ovl_entry_t *e;
+    uint32_t           run;
+
+    if ((sector > ovl->hdr.sectors) || (count > (ovl->hdr.sectors - sector)))
+        return -1;
+
+    while (count > 0) {
+        e = ovl_lookup(ovl, sector);
+
+        if (e == NULL) {
+            /* Coalesce sectors that are all still in the base image. */
+            for (run = 1; (run < count) && (ovl_lookup(ovl, sector + run) == NULL); run++)
+                ;
+            if (ovl_base_read(ovl, sector, run, buffer))
+                return -1;
+        } else {
+            /* Coalesce sectors that are stored back to back in the delta. */
+            for (run = 1; run < count; run++) {
+                const ovl_entry_t *n = ovl_lookup(ovl, sector + run);
+                if ((n == NULL) || (n->offset != (e->offset + ((uint64_t) run << 9))))
+                    break;
+            }
+            if (ovl_pread(ovl->fp, e->offset, buffer, run << 9))
+                return -1;
+        }
+
+        sector += run;
+        count -= run;
+        buffer += run << 9;
+    }
+
+    return 0;
+}
+
+static int
+ovl_write_sector(hdd_overlay_t *ovl, uint32_t sector, const uint8_t *buffer)
+{
+    ovl_entry_t *l2;
+    ovl_entry_t *e;
+    uint8_t      old[512];
+    uint64_t     hash = ovl_hash(buffer);
+
+    l2 = ovl_get_l2(ovl, sector, 0);
+    e  = (l2 != NULL) ? &l2[sector & OVL_L2_MASK] : NULL;
+
+    if ((e != NULL) && (e->offset != 0)) {
+        if (ovl->dedup && (e->hash == hash) &&
+            !ovl_pread(ovl->fp, e->offset, old, 512) && !memcmp(old, buffer, 512))
+            return 0;
+    } else {
+        if (ovl->dedup && !ovl_base_read(ovl, sector, 1, old) && !memcmp(old, buffer, 512))
+            return 0;
+
+        if (l2 == NULL) {
+            l2 = ovl_get_l2(ovl, sector, 1);
+            if (l2 == NULL)
+                return -1;
+            e = &l2[sector & OVL_L2_MASK];
+        }
+
+        e->offset = ovl->end;
+        ovl->end += 512;
+        ovl->hdr.used++;
+    }
+
+    e->hash = hash;
+
+    if (ovl_pwrite(ovl->fp, e->offset, buffer, 512) ||
+        ovl_pwrite(ovl->fp, ovl->l1[sector >> OVL_L2_SHIFT] + ((sector & OVL_L2_MASK) * sizeof(ovl_entry_t)),
+                   e, sizeof(ovl_entry_t)))
+        return -1;
+
+    return 0;
+}
+
+int
+hdd_overlay_write(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, const uint8_t *buffer)
+{
+    uint64_t used;
+
+    if ((sector > ovl->hdr.sectors) || (count > (ovl->hdr.sectors - sector)))
+        return -1;
+
+    used = ovl->hdr.used;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (ovl_write_sector(ovl, sector + i, buffer + (i << 9)))
+            return -1;
+    }
+
+    if ((ovl->hdr.used != used) && ovl_write_hdr(ovl))
+        return -1;
+
+    fflush(ovl->fp);
+
+    return 0;
+}
+
+int
+hdd_overlay_zero(hdd_overlay_t *ovl, uint32_t sector, uint32_t count)
+{
+    static const uint8_t empty[512] = { 0 };
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (hdd_overlay_write(ovl, sector + i, 1, empty))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Checks that every L1 and L2 entry of the delta points inside the file. */
+static int
+ovl_merge_check(hdd_overlay_t *ovl, uint64_t size)
+{
+    uint64_t     start = ovl->hdr.l1_offset + ((uint64_t) ovl->hdr.l1_entries * sizeof(uint64_t));
+    ovl_entry_t *l2;
+    int          ret = 0;
+
+    if ((ovl->hdr.l1_offset < OVL_HDR_SIZE) || (start > size))
+        return -1;
+
+    for (uint32_t idx = 0; (ret == 0) && (idx < ovl->hdr.l1_entries); idx++) {
+        if (ovl->l1[idx] == 0)
+            continue;
+
+        if ((ovl->l1[idx] < start) || (ovl->l1[idx] > size) ||
+            ((size - ovl->l1[idx]) < (OVL_L2_ENTRIES * sizeof(ovl_entry_t))))
+            return -1;
+
+        l2 = ovl_get_l2(ovl, idx << OVL_L2_SHIFT, 0);
+        if (l2 == NULL)
+            return -1;
+
+        for (uint32_t i = 0; i < OVL_L2_ENTRIES; i++) {
+            if ((l2[i].offset != 0) &&
+                ((l2[i].offset < start) || (l2[i].offset > size) || ((size - l2[i].offset) < 512))) {
+                ret = -1;
+                break;
+            }
+        }
+
+        free(ovl->l2[idx]);
+        ovl->l2[idx] = NULL;
+    }
+
+    return ret;
+}
+
+/*
+ * Offline merge: writes every sector present in the delta back into the
+ * base image, after which the delta file can be deleted. Both files are
+ * checked before anything is written, so a wrong or truncated base, or a
+ * corrupt delta, leaves the base untouched.
+ */
+int
+hdd_overlay_merge(const char *delta_fn, const char *base_fn)
+{
+    hdd_overlay_t *ovl;
+    FILE          *base;
+    uint64_t       base_off  = 0;
+    uint64_t       base_size = 0;
+    uint64_t       hdr_size  = 0;
+    uint64_t       delta_size;
+    uint64_t       merged    = 0;
+    uint32_t       hdi_base  = 0;
+    uint32_t       hdi_size  = 0;
+    uint8_t        buf[512];
+    ovl_entry_t   *l2;
+    int            ret = 0;
+
+    base = plat_fopen64(base_fn, "rb+");
+    if (base == NULL) {
+        fprintf(stderr, "Unable to open base image '%s'\n", base_fn);
+        return -1;
+    }
+
+    if (image_is_hdi(base_fn)) {
+        if (ovl_pread(base, 0x8, &hdi_base, 4) || ovl_pread(base, 0xC, &hdi_size, 4)) {
+            fprintf(stderr, "Unable to read the HDI header of '%s'\n", base_fn);
+            fclose(base);
+            return -1;
+        }
+        base_off = hdi_base;
+        hdr_size = hdi_size;
+    } else if (image_is_hdx(base_fn, 1)) {
+        if (ovl_pread(base, 0x8, &hdr_size, 8)) {
+            fprintf(stderr, "Unable to read the HDX header of '%s'\n", base_fn);
+            fclose(base);
+            return -1;
+        }
+        base_off = 0x28;
+    }
+
+    if ((fseeko64(base, 0, SEEK_END) == -1) || ((int64_t) (base_size = ftello64(base)) < 0)) {
+        fprintf(stderr, "Unable to get the size of '%s'\n", base_fn);
+        fclose(base);
+        return -1;
+    }
+
+    ovl = (hdd_overlay_t *) calloc(1, sizeof(hdd_overlay_t));
+    ovl->fp = plat_fopen64(delta_fn, "rb");
+    if ((ovl->fp == NULL) || ovl_pread(ovl->fp, 0, &ovl->hdr, sizeof(hdd_overlay_hdr_t)) ||
+        (ovl->hdr.magic != OVL_MAGIC) || (ovl->hdr.version != OVL_VERSION) ||
+        (ovl->hdr.l2_entries != OVL_L2_ENTRIES) || (ovl->hdr.l1_entries != OVL_L1_ENTRIES(ovl->hdr.sectors))) {
+        fprintf(stderr, "'%s' is not a valid overlay file\n", delta_fn);
+        hdd_overlay_close(ovl);
+        fclose(base);
+        return -1;
+    }
+
+    /* The HDI/HDX header records the disk size, a raw image has to be at least that large. */
+    if ((hdr_size && ((hdr_size >> 9) != ovl->hdr.sectors)) ||
+        (base_size < (base_off + ((uint64_t) ovl->hdr.sectors << 9)))) {
+        fprintf(stderr, "'%s' was made for a base of %u sectors, which '%s' is not\n",
+                delta_fn, ovl->hdr.sectors, base_fn);
+        hdd_overlay_close(ovl);
+        fclose(base);
+        return -1;
+    }
+
+    ovl->l1 = (uint64_t *) calloc(ovl->hdr.l1_entries + 1, sizeof(uint64_t));
+    ovl->l2 = (ovl_entry_t **) calloc(ovl->hdr.l1_entries + 1, sizeof(ovl_entry_t *));
+    if ((fseeko64(ovl->fp, 0, SEEK_END) == -1) || ((int64_t) (delta_size = ftello64(ovl->fp)) < 0) ||
+        (ovl->hdr.l1_entries && ovl_pread(ovl->fp, ovl->hdr.l1_offset, ovl->l1, ovl->hdr.l1_entries * sizeof(uint64_t))) ||
+        ovl_merge_check(ovl, delta_size)) {
+        fprintf(stderr, "'%s' is corrupt\n", delta_fn);
+        ret = -1;
+    }
+
+    for (uint32_t s = 0; (ret == 0) && (s < ovl->hdr.sectors); s += OVL_L2_ENTRIES) {
+        if (ovl->l1[s >> OVL_L2_SHIFT] == 0)
+            continue;
+
+        l2 = ovl_get_l2(ovl, s, 0);
+        if (l2 == NULL) {
+            ret = -1;
+            break;
+        }
+
+        for (uint32_t i = 0; (i < OVL_L2_ENTRIES) && ((s + i) < ovl->hdr.sectors); i++) {
+            if (l2[i].offset == 0)
+                continue;
+
+            if (ovl_pread(ovl->fp, l2[i].offset, buf, 512) ||
+                ovl_pwrite(base, ((uint64_t) (s + i) << 9LL) + base_off, buf, 512)) {
+                ret = -1;
+                break;
+            }
+            merged++;
+        }
+
+        /* Only keep one L2 table in memory at a time. */
+        free(ovl->l2[s >> OVL_L2_SHIFT]);
+        ovl->l2[s >> OVL_L2_SHIFT] = NULL;
+    }
+
+    if (!ret)
+        fprintf(stderr, "Merged %" PRIu64 " sectors from '%s' into '%s'\n", merged, delta_fn, base_fn);
+
+    hdd_overlay_close(ovl);
+    fclose(base);
+
+    return ret;
+}
@@ -52,6 +52,13 @@ static uint16_t dma_sg_base;
 static uint16_t dma16_buffer[65536];
 static uint32_t dma_mask;
 
+#define DMA_SYNC_MAX 8
+
+static struct {
+    void (*sync)(void *priv);
+    void  *priv;
+} dma_sync_handlers[DMA_SYNC_MAX];
+
 static struct dma_ps2_t {
     int xfr_command;
     int xfr_channel;
@@ -88,6 +95,45 @@ dma_log(const char *fmt, ...)
 
 static void dma_ps2_run(int channel);
 
+/*
+   Devices that run their transfers lazily register a handler here; it is
+   called before any register access so the guest always sees the address,
+   count and status the transfers would have left behind by now.
+ */
+void
+dma_add_sync_handler(void (*sync)(void *priv), void *priv)
+{
+    for (int c = 0; c < DMA_SYNC_MAX; c++) {
+        if (dma_sync_handlers[c].sync == NULL) {
+            dma_sync_handlers[c].sync = sync;
+            dma_sync_handlers[c].priv = priv;
+            return;
+        }
+    }
+
+    fatal("DMA: Too many sync handlers\n");
+}
+
+void
+dma_remove_sync_handler(void *priv)
+{
+    for (int c = 0; c < DMA_SYNC_MAX; c++) {
+        if (dma_sync_handlers[c].priv == priv) {
+            dma_sync_handlers[c].sync = NULL;
+            dma_sync_handlers[c].priv = NULL;
+        }
+    }
+}
+
+static void
+dma_sync(void)
+{
+    for (int c = 0; c < DMA_SYNC_MAX; c++) {
+        if (dma_sync_handlers[c].sync != NULL)
+            dma_sync_handlers[c].sync(dma_sync_handlers[c].priv);
+    }
+}
+
 int
 dma_get_drq(int channel)
 {
@@ -460,6 +506,8 @@ dma_read(uint16_t addr, UNUSED(void *priv))
     int     count;
     uint8_t ret = (dmaregs[0][addr & 0xf]);
 
+    dma_sync();
+
     switch (addr & 0xf) {
         case 0:
         case 2:
@@ -509,6 +557,8 @@ dma_write(uint16_t addr, uint8_t val, UNUSED(void *priv))
 {
     int channel = (addr >> 1) & 3;
 
+    dma_sync();
+
     dma_log("DMA: [W] %04X = %02X\n", addr, val);
 
     dmaregs[0][addr & 0xf] = val;
@@ -609,6 +659,8 @@ dma_ps2_read(uint16_t addr, UNUSED(void *priv))
     const dma_t  *dma_c = &dma[dma_ps2.xfr_channel];
     uint8_t temp  = 0xff;
 
+    dma_sync();
+
     switch (addr) {
         case 0x1a:
             switch (dma_ps2.xfr_command) {
@@ -693,6 +745,8 @@ dma_ps2_write(uint16_t addr, uint8_t val, UNUSED(void *priv))
     dma_t  *dma_c = &dma[dma_ps2.xfr_channel];
     uint8_t mode;
 
+    dma_sync();
+
     switch (addr) {
         case 0x18:
             dma_ps2.xfr_channel = val & 0x7;
@@ -811,6 +865,8 @@ dma16_read(uint16_t addr, UNUSED(void *priv))
     uint8_t ret;
     int count;
 
+    dma_sync();
+
     addr >>= 1;
 
     ret = dmaregs[1][addr & 0xf];
@@ -864,6 +920,8 @@ dma16_write(uint16_t addr, uint8_t val, UNUSED(void *priv))
 {
     int channel = ((addr >> 2) & 3) + 4;
 
+    dma_sync();
+
     dma_log("dma16_write(%08X, %02X)\n", addr, val);
 
     addr >>= 1;
@@ -1227,6 +1285,9 @@ dma_init(void)
 {
     dma_reset();
 
+    /* Handlers are registered by devices added after this, drop stale ones. */
+    memset(dma_sync_handlers, 0x00, sizeof(dma_sync_handlers));
+
     io_sethandler(0x0000, 16,
                   dma_read, NULL, NULL, dma_write, NULL, NULL, NULL);
     io_sethandler(0x0080, 8,
@@ -1875,6 +1936,13 @@ dma_bm_read(uint32_t PhysAddress, uint8_t *DataRead, uint32_t TotalSize, int Tra
     uint32_t n;
     uint32_t n2;
     uint8_t  bytes[4] = { 0, 0, 0, 0 };
+    uint8_t *ram_ptr;
+
+    /* Plain RAM can be copied in one go. */
+    if ((ram_ptr = mem_get_phys_ptr(PhysAddress, TotalSize, 0))) {
+        memcpy(DataRead, ram_ptr, TotalSize);
+        return;
+    }
 
     n  = TotalSize & ~(TransferSize - 1);
     n2 = TotalSize - n;
@@ -1898,21 +1966,27 @@ dma_bm_write(uint32_t PhysAddress, const uint8_t *DataWrite, uint32_t TotalSize,
     uint32_t n;
     uint32_t n2;
     uint8_t  bytes[4] = { 0, 0, 0, 0 };
+    uint8_t *ram_ptr;
+
+    /* Plain RAM can be copied in one go. */
+    if ((ram_ptr = mem_get_phys_ptr(PhysAddress, TotalSize, 1)))
+        memcpy(ram_ptr, DataWrite, TotalSize);
+    else {
+        n  = TotalSize & ~(TransferSize - 1);
+        n2 = TotalSize - n;
+
+        /* Do the divisible block, if there is one. */
+        if (n) {
+            for (uint32_t i = 0; i < n; i += TransferSize)
+                mem_write_phys((void *) &(DataWrite[i]), PhysAddress + i, TransferSize);
+        }
 
-    n  = TotalSize & ~(TransferSize - 1);
-    n2 = TotalSize - n;
-
-    /* Do the divisible block, if there is one. */
-    if (n) {
-        for (uint32_t i = 0; i < n; i += TransferSize)
-            mem_write_phys((void *) &(DataWrite[i]), PhysAddress + i, TransferSize);
-    }
-
-    /* Do the non-divisible block, if there is one. */
-    if (n2) {
-        mem_read_phys((void *) bytes, PhysAddress + n, TransferSize);
-        memcpy(bytes, (void *) &(DataWrite[n]), n2);
-        mem_write_phys((void *) bytes, PhysAddress + n, TransferSize);
+        /* Do the non-divisible block, if there is one. */
+        if (n2) {
+            mem_read_phys((void *) bytes, PhysAddress + n, TransferSize);
+            memcpy(bytes, (void *) &(DataWrite[n]), n2);
+            mem_write_phys((void *) bytes, PhysAddress + n, TransferSize);
+        }
     }
 
     if (dma_at)
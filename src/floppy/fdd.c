@@ -34,6 +34,7 @@
 #include <86box/ui.h>
 #include <86box/fdd.h>
 #include <86box/fdd_86f.h>
+#include <86box/fdd_cache.h>
 #include <86box/fdd_fdi.h>
 #include <86box/fdd_imd.h>
 #include <86box/fdd_img.h>
@@ -122,6 +123,8 @@ int fdd_changed[FDD_NUM];
 int ui_writeprot[FDD_NUM] = { 0, 0, 0, 0 };
 int drive_empty[FDD_NUM]  = { 1, 1, 1, 1 };
 
+static int fdd_loading[FDD_NUM];
+
 DRIVE drives[FDD_NUM];
 
 uint64_t motoron[FDD_NUM];
@@ -716,11 +719,12 @@ fdd_load(int drive, char *fn)
                     floppyfns[drive][sizeof(floppyfns[drive]) - 1] = '\0';
                 }
                 d86f_setup(drive);
+                fdd_loading[drive] = 0;
                 loaders[c].load(drive, floppyfns[drive] + offs);
-                drive_empty[drive] = 0;
-                fdd_forced_seek(drive, 0);
-                fdd_changed[drive] = 1;
-                ui_sb_update_icon_wp(SB_FLOPPY | drive, ui_writeprot[drive]);
+                if (fdd_loading[drive])
+                    drive_empty[drive] = 1;
+                else
+                    fdd_load_complete(drive, 1);
                 return;
             }
             c++;
@@ -732,6 +736,34 @@ fdd_load(int drive, char *fn)
     ui_sb_update_icon_state(SB_FLOPPY | drive, 1);
 }
 
+/*
+ * Called by a loader that finishes loading in the background, the drive
+ * stays empty until it calls fdd_load_complete().
+ */
+void
+fdd_set_loading(int drive)
+{
+    fdd_loading[drive] = 1;
+}
+
+void
+fdd_load_complete(int drive, int success)
+{
+    fdd_loading[drive] = 0;
+
+    if (success) {
+        drive_empty[drive] = 0;
+        fdd_forced_seek(drive, 0);
+        fdd_changed[drive] = 1;
+        ui_sb_update_icon_wp(SB_FLOPPY | drive, ui_writeprot[drive]);
+    } else {
+        drive_empty[drive] = 1;
+        fdd_set_head(drive, 0);
+        memset(floppyfns[drive], 0, sizeof(floppyfns[drive]));
+        ui_sb_update_icon_state(SB_FLOPPY | drive, 1);
+    }
+}
+
 void
 fdd_close(int drive)
 {
@@ -755,6 +787,7 @@ fdd_close(int drive)
     } else if (loaders[driveloaders[drive]].close)
         loaders[driveloaders[drive]].close(drive);
 
+    fdd_loading[drive] = 0;
     drive_empty[drive] = 1;
     fdd_set_head(drive, 0);
     floppyfns[drive][0] = 0;
@@ -1012,6 +1045,7 @@ fdd_init(void)
 
     img_init();
     d86f_init();
+    fdd_cache_init();
     td0_init();
     imd_init();
     pcjs_init();
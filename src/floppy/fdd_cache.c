@@ -0,0 +1,216 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Cache of decoded floppy image data.
+ *
+ *          Formats which have to decompress or decode the image before
+ *          it can be used (Teledisk, FDI) store the result here, keyed
+ *          by a hash of the image contents, so swapping back to a disk
+ *          which was already inserted does not decode it again. The
+ *          cache is shared by all drives and bounded in size, with the
+ *          least recently used entries being dropped first.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/thread.h>
+#include <86box/fdd_cache.h>
+
+#define FDD_CACHE_SIZE (64 << 20) /* total bytes of decoded data kept */
+
+typedef struct fdd_cache_entry_t {
+    uint64_t hash;
+    uint32_t key;
+    uint32_t size;
+    void    *data;
+
+    struct fdd_cache_entry_t *prev, *next;
+} fdd_cache_entry_t;
+
+static mutex_t           *cache_mutex;
+static fdd_cache_entry_t *cache_head; /* most recently used */
+static fdd_cache_entry_t *cache_tail; /* least recently used */
+static size_t             cache_size;
+
+#ifdef ENABLE_FDD_CACHE_LOG
+int fdd_cache_do_log = ENABLE_FDD_CACHE_LOG;
+
+static void
+fdd_cache_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (fdd_cache_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define fdd_cache_log(fmt, ...)
+#endif
+
+static void
+fdd_cache_unlink(fdd_cache_entry_t *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache_head = entry->next;
+
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache_tail = entry->prev;
+
+    entry->prev = entry->next = NULL;
+}
+
+static void
+fdd_cache_link(fdd_cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache_head;
+    if (cache_head)
+        cache_head->prev = entry;
+    else
+        cache_tail = entry;
+    cache_head = entry;
+}
+
+static fdd_cache_entry_t *
+fdd_cache_find(uint64_t hash, uint32_t key)
+{
+    for (fdd_cache_entry_t *entry = cache_head; entry; entry = entry->next) {
+        if ((entry->hash == hash) && (entry->key == key))
+            return entry;
+    }
+
+    return NULL;
+}
+
+void
+fdd_cache_init(void)
+{
+    if (cache_mutex == NULL)
+        cache_mutex = thread_create_mutex();
+}
+
+/* FNV-1a over the whole file. */
+uint64_t
+fdd_cache_hash_file(FILE *fp)
+{
+    uint8_t  buf[65536];
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t   len;
+
+    if (fseek(fp, 0, SEEK_SET) == -1)
+        return 0;
+
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        for (size_t i = 0; i < len; i++) {
+            hash ^= buf[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+
+    return hash;
+}
+
+int
+fdd_cache_has(uint64_t hash, uint32_t key)
+{
+    int ret;
+
+    thread_wait_mutex(cache_mutex);
+    ret = (fdd_cache_find(hash, key) != NULL);
+    thread_release_mutex(cache_mutex);
+
+    return ret;
+}
+
+/* Returns a copy of the cached data, which the caller has to free. */
+void *
+fdd_cache_get(uint64_t hash, uint32_t key, uint32_t *size)
+{
+    fdd_cache_entry_t *entry;
+    void              *data = NULL;
+
+    thread_wait_mutex(cache_mutex);
+
+    entry = fdd_cache_find(hash, key);
+    if (entry) {
+        data = malloc(entry->size);
+        if (data) {
+            memcpy(data, entry->data, entry->size);
+            *size = entry->size;
+
+            fdd_cache_unlink(entry);
+            fdd_cache_link(entry);
+        }
+    }
+
+    thread_release_mutex(cache_mutex);
+
+    return data;
+}
+
+/* Takes ownership of data, which must have been allocated with malloc(). */
+void
+fdd_cache_put(uint64_t hash, uint32_t key, void *data, uint32_t size)
+{
+    fdd_cache_entry_t *entry;
+
+    if (size > FDD_CACHE_SIZE) {
+        free(data);
+        return;
+    }
+
+    thread_wait_mutex(cache_mutex);
+
+    entry = fdd_cache_find(hash, key);
+    if (entry) {
+        /* Already decoded by someone else. */
+        thread_release_mutex(cache_mutex);
+        free(data);
+        return;
+    }
+
+    while (cache_tail && ((cache_size + size) > FDD_CACHE_SIZE)) {
+        entry = cache_tail;
+        fdd_cache_log("FDD cache: Dropping %016" PRIX64 "/%08X (%u bytes)\n", entry->hash, entry->key, entry->size);
+        fdd_cache_unlink(entry);
+        cache_size -= entry->size;
+        free(entry->data);
+        free(entry);
+    }
+
+    entry = (fdd_cache_entry_t *) calloc(1, sizeof(fdd_cache_entry_t));
+    if (entry) {
+        entry->hash = hash;
+        entry->key  = key;
+        entry->size = size;
+        entry->data = data;
+        fdd_cache_link(entry);
+        cache_size += size;
+        fdd_cache_log("FDD cache: Added %016" PRIX64 "/%08X (%u bytes, %zu total)\n", hash, key, size, cache_size);
+    } else
+        free(data);
+
+    thread_release_mutex(cache_mutex);
+}
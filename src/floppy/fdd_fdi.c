@@ -27,25 +27,46 @@
 #include <86box/86box.h>
 #include <86box/timer.h>
 #include <86box/plat.h>
+#include <86box/thread.h>
 #include <86box/fdd.h>
 #include <86box/fdd_86f.h>
+#include <86box/fdd_cache.h>
 #include <86box/fdd_img.h>
 #include <86box/fdd_fdi.h>
 #include <86box/fdc.h>
 #include <fdi2raw.h>
 
+#define FDI_PREFETCH_TRACKS 2 /* tracks decoded ahead on either side of the current one */
+
+/* All four densities of both sides of a track. */
+typedef struct fdi_track_t {
+    int bit_rate;
+    int tracklen[2][4];
+    int trackindex[2][4];
+
+    uint8_t track_data[2][4][256 * 1024];
+    uint8_t track_timing[2][4][256 * 1024];
+} fdi_track_t;
+
 typedef struct fdi_t {
     FILE *fp;
     FDI  *h;
 
+    char     fn[MAX_IMAGE_PATH_LEN];
+    uint64_t hash;
+
     int lasttrack;
     int sides;
     int track;
-    int tracklen[2][4];
-    int trackindex[2][4];
+    int loaded_track;
 
-    uint8_t track_data[2][4][256 * 1024];
-    uint8_t track_timing[2][4][256 * 1024];
+    fdi_track_t cur;
+
+    /* Decoder thread, which keeps the neighbouring tracks in the cache. */
+    thread_t    *thread;
+    event_t     *wake;
+    volatile int stop;
+    volatile int prefetch_track;
 } fdi_t;
 
 static fdi_t *fdi[FDD_NUM];
@@ -75,7 +96,7 @@ disk_flags(int drive)
     fdi_t   *dev             = fdi[drive];
     uint16_t temp_disk_flags = 0x80; /* We ALWAYS claim to have extra bit cells, even if the actual amount is 0. */
 
-    switch (fdi2raw_get_bit_rate(dev->h)) {
+    switch (dev->cur.bit_rate) {
         case 500:
             temp_disk_flags |= 2;
             break;
@@ -111,7 +132,7 @@ side_flags(int drive)
     fdi_t   *dev             = fdi[drive];
     uint16_t temp_side_flags = 0;
 
-    switch (fdi2raw_get_bit_rate(dev->h)) {
+    switch (dev->cur.bit_rate) {
         case 500:
             temp_side_flags = 0;
             break;
@@ -205,42 +226,193 @@ extra_bit_cells(int drive, int side)
             raw_size = is_300_rpm ? 100000 : 83333;
     }
 
-    return (dev->tracklen[side][density] - raw_size);
+    return (dev->cur.tracklen[side][density] - raw_size);
+}
+
+/* Decodes a track with all densities, returns 1 if the result is the same on every revolution. */
+static int
+decode_track(FDI *h, int sides, int track, fdi_track_t *t)
+{
+    int c;
+    int ret = 1;
+
+    for (int den = 0; den < 4; den++) {
+        for (int side = 0; side < sides; side++) {
+            t->trackindex[side][den] = 0;
+            c = fdi2raw_loadtrack(h,
+                                  (uint16_t *) t->track_data[side][den],
+                                  (uint16_t *) t->track_timing[side][den],
+                                  (track * sides) + side,
+                                  &t->tracklen[side][den],
+                                  &t->trackindex[side][den], NULL, den);
+            if (!c) {
+                memset(t->track_data[side][den], 0, t->tracklen[side][den]);
+                ret = 0;
+            }
+            if (fdi2raw_get_lowlevel(h, (track * sides) + side))
+                ret = 0;
+        }
+
+        if (sides == 1) {
+            memset(t->track_data[1][den], 0, 106096);
+            t->tracklen[1][den] = 100000;
+        }
+    }
+
+    t->bit_rate = fdi2raw_get_bit_rate(h);
+
+    return ret;
+}
+
+/*
+ * Cached tracks are stored as the bit rate and track lengths and index
+ * positions, followed by the encoded data of each side and density.
+ */
+static void
+cache_track(const fdi_t *dev, int track, const fdi_track_t *t)
+{
+    uint32_t size = sizeof(int) * 17;
+    uint8_t *data;
+    uint8_t *p;
+
+    for (int side = 0; side < dev->sides; side++) {
+        for (int den = 0; den < 4; den++)
+            size += ((t->tracklen[side][den] + 15) >> 4) << 1;
+    }
+
+    data = (uint8_t *) malloc(size);
+    if (data == NULL)
+        return;
+
+    p = data;
+    memcpy(p, &t->bit_rate, sizeof(int));
+    p += sizeof(int);
+    memcpy(p, t->tracklen, sizeof(int) * 8);
+    p += sizeof(int) * 8;
+    memcpy(p, t->trackindex, sizeof(int) * 8);
+    p += sizeof(int) * 8;
+    for (int side = 0; side < dev->sides; side++) {
+        for (int den = 0; den < 4; den++) {
+            uint32_t len = ((t->tracklen[side][den] + 15) >> 4) << 1;
+            memcpy(p, t->track_data[side][den], len);
+            p += len;
+        }
+    }
+
+    fdd_cache_put(dev->hash, track, data, size);
+}
+
+static int
+load_cached_track(fdi_t *dev, int track)
+{
+    fdi_track_t *t = &dev->cur;
+    uint32_t     size;
+    uint8_t     *data = fdd_cache_get(dev->hash, track, &size);
+    uint8_t     *p;
+
+    if (data == NULL)
+        return 0;
+
+    p = data;
+    memcpy(&t->bit_rate, p, sizeof(int));
+    p += sizeof(int);
+    memcpy(t->tracklen, p, sizeof(int) * 8);
+    p += sizeof(int) * 8;
+    memcpy(t->trackindex, p, sizeof(int) * 8);
+    p += sizeof(int) * 8;
+    for (int side = 0; side < dev->sides; side++) {
+        for (int den = 0; den < 4; den++) {
+            uint32_t len = ((t->tracklen[side][den] + 15) >> 4) << 1;
+            memcpy(t->track_data[side][den], p, len);
+            p += len;
+        }
+    }
+    if (dev->sides == 1) {
+        for (int den = 0; den < 4; den++)
+            memset(t->track_data[1][den], 0, 106096);
+    }
+
+    free(data);
+
+    return 1;
+}
+
+static void
+fdi_decode_thread(void *priv)
+{
+    fdi_t       *dev         = (fdi_t *) priv;
+    fdi_track_t *t           = (fdi_track_t *) malloc(sizeof(fdi_track_t));
+    uint8_t     *uncacheable = (uint8_t *) calloc(1, dev->lasttrack + 1);
+    FILE        *fp          = plat_fopen(dev->fn, "rb");
+    FDI         *h           = NULL;
+    int          track;
+
+    /* Use a handle of our own, as FDI2RAW keeps decoding state in it. */
+    if (fp != NULL)
+        h = fdi2raw_header(fp);
+
+    while (!dev->stop) {
+        thread_wait_event(dev->wake, -1);
+        thread_reset_event(dev->wake);
+
+        if ((h == NULL) || (t == NULL) || (uncacheable == NULL))
+            continue;
+
+        for (int i = 1; (i <= (FDI_PREFETCH_TRACKS * 2)) && !dev->stop; i++) {
+            /* Go outwards, alternating between the next and previous tracks. */
+            track = dev->prefetch_track + ((i & 1) ? ((i + 1) >> 1) : -(i >> 1));
+            if ((track < 0) || (track > dev->lasttrack) || uncacheable[track] || fdd_cache_has(dev->hash, track))
+                continue;
+
+            fdi_log("FDI: Decoding track %i ahead\n", track);
+            if (decode_track(h, dev->sides, track, t))
+                cache_track(dev, track, t);
+            else
+                uncacheable[track] = 1;
+        }
+    }
+
+    if (h != NULL)
+        fdi2raw_header_free(h);
+    if (fp != NULL)
+        fclose(fp);
+    free(uncacheable);
+    free(t);
 }
 
 static void
 read_revolution(int drive)
 {
-    fdi_t *dev = fdi[drive];
-    int    c;
-    int    den;
+    fdi_t *dev   = fdi[drive];
     int    track = dev->track;
 
+    /* This is called on every revolution, but the data only changes
+       on a track change, or on tracks with weak bits. */
+    if (track == dev->loaded_track)
+        return;
+
     if (track > dev->lasttrack) {
-        for (den = 0; den < 4; den++) {
-            memset(dev->track_data[0][den], 0, 106096);
-            memset(dev->track_data[1][den], 0, 106096);
-            dev->tracklen[0][den] = dev->tracklen[1][den] = 100000;
+        for (int den = 0; den < 4; den++) {
+            memset(dev->cur.track_data[0][den], 0, 106096);
+            memset(dev->cur.track_data[1][den], 0, 106096);
+            dev->cur.tracklen[0][den] = dev->cur.tracklen[1][den] = 100000;
         }
+        dev->loaded_track = track;
         return;
     }
 
-    for (den = 0; den < 4; den++) {
-        for (int side = 0; side < dev->sides; side++) {
-            c = fdi2raw_loadtrack(dev->h,
-                                  (uint16_t *) dev->track_data[side][den],
-                                  (uint16_t *) dev->track_timing[side][den],
-                                  (track * dev->sides) + side,
-                                  &dev->tracklen[side][den],
-                                  &dev->trackindex[side][den], NULL, den);
-            if (!c)
-                memset(dev->track_data[side][den], 0, dev->tracklen[side][den]);
-        }
-
-        if (dev->sides == 1) {
-            memset(dev->track_data[1][den], 0, 106096);
-            dev->tracklen[1][den] = 100000;
-        }
+    if (load_cached_track(dev, track))
+        dev->loaded_track = track;
+    else if (decode_track(dev->h, dev->sides, track, &dev->cur)) {
+        cache_track(dev, track, &dev->cur);
+        dev->loaded_track = track;
+    } else
+        dev->loaded_track = -1;
+
+    /* Get the neighbouring tracks ready. */
+    if ((dev->thread != NULL) && (dev->prefetch_track != track)) {
+        dev->prefetch_track = track;
+        thread_set_event(dev->wake);
     }
 }
 
@@ -252,7 +424,7 @@ index_hole_pos(int drive, int side)
 
     density = fdi_density();
 
-    return (dev->trackindex[side][density]);
+    return (dev->cur.trackindex[side][density]);
 }
 
 static uint32_t
@@ -263,7 +435,7 @@ get_raw_size(int drive, int side)
 
     density = fdi_density();
 
-    return (dev->tracklen[side][density]);
+    return (dev->cur.tracklen[side][density]);
 }
 
 static uint16_t *
@@ -274,7 +446,7 @@ encoded_data(int drive, int side)
 
     density = fdi_density();
 
-    return ((uint16_t *) dev->track_data[side][density]);
+    return ((uint16_t *) dev->cur.track_data[side][density]);
 }
 
 void
@@ -341,9 +513,18 @@ fdi_load(int drive, char *fn)
     /* Set up the drive unit. */
     fdi[drive] = dev;
 
-    dev->h         = fdi2raw_header(dev->fp);
-    dev->lasttrack = fdi2raw_get_last_track(dev->h);
-    dev->sides     = fdi2raw_get_last_head(dev->h) + 1;
+    dev->h            = fdi2raw_header(dev->fp);
+    dev->lasttrack    = fdi2raw_get_last_track(dev->h);
+    dev->sides        = fdi2raw_get_last_head(dev->h) + 1;
+    dev->cur.bit_rate = fdi2raw_get_bit_rate(dev->h);
+    dev->loaded_track = -1;
+
+    /* Decoded tracks are cached by image contents. */
+    strncpy(dev->fn, fn, sizeof(dev->fn) - 1);
+    dev->hash           = fdd_cache_hash_file(dev->fp);
+    dev->prefetch_track = -1;
+    dev->wake           = thread_create_event();
+    dev->thread         = thread_create(fdi_decode_thread, dev);
 
     /* Attach this format to the D86F engine. */
     d86f_handler[drive].disk_flags        = disk_flags;
@@ -379,6 +560,13 @@ fdi_close(int drive)
 
     drives[drive].seek = NULL;
 
+    if (dev->thread) {
+        dev->stop = 1;
+        thread_set_event(dev->wake);
+        thread_wait(dev->thread);
+        thread_destroy_event(dev->wake);
+    }
+
     if (dev->h)
         fdi2raw_header_free(dev->h);
 
@@ -36,8 +36,10 @@
 #include <86box/86box.h>
 #include <86box/timer.h>
 #include <86box/plat.h>
+#include <86box/thread.h>
 #include <86box/fdd.h>
 #include <86box/fdd_86f.h>
+#include <86box/fdd_cache.h>
 #include <86box/fdd_td0.h>
 #include <86box/fdc.h>
 #include "lzw/lzw.h"
@@ -127,8 +129,21 @@ typedef struct td0_t {
     uint8_t *imagebuf;
 
     uint8_t *processed_buf;
+
+    /* Compressed images are decompressed on a thread while the drive stays empty. */
+    int        drive;
+    uint8_t    header[12];
+    uint32_t   file_size;
+    thread_t  *decode_thread;
+    ATOMIC_INT decode_state;
+    pc_timer_t load_timer;
 } td0_t;
 
+#define TD0_DECODE_BUSY   0
+#define TD0_DECODE_DONE   1
+#define TD0_DECODE_FAILED 2
+#define TD0_LOAD_POLL     (10000ULL * TIMER_USEC) /* 10 ms */
+
 /*
  * Tables for encoding/decoding upper 6 bits of
  * sliding dictionary pointer
@@ -593,11 +608,95 @@ get_raw_tsize(int side_flags, int slower_rpm)
     return size;
 }
 
+/* Reads the header, the image itself follows in td0_decompress() or td0_initialize(). */
+static int
+td0_open_image(td0_t *dev)
+{
+    if (dev->fp == NULL) {
+        td0_log("TD0: Attempted to initialize without loading a file first\n");
+        return 0;
+    }
+
+    fseek(dev->fp, 0, SEEK_END);
+    dev->file_size = ftell(dev->fp);
+
+    if (dev->file_size < 12) {
+        td0_log("TD0: File is too small to even contain the header\n");
+        return 0;
+    }
+
+    if (dev->file_size > TD0_MAX_BUFSZ) {
+        td0_log("TD0: File exceeds the maximum size\n");
+        return 0;
+    }
+
+    fseek(dev->fp, 0, SEEK_SET);
+    (void) !fread(dev->header, 1, 12, dev->fp);
+
+    return 1;
+}
+
+/* Runs on the decode thread, while the drive is still empty and nothing else touches dev. */
+static int
+td0_decompress(td0_t *dev)
+{
+    const uint8_t *header       = dev->header;
+    const uint32_t file_size    = dev->file_size;
+    uint32_t       decoded_size = 0;
+    uint64_t       lzw_size     = 0;
+    uint64_t       hash;
+    void          *cached;
+    td0dsk_t       disk_decode;
+
+    /* Decompression is slow, so reuse the result if this image was inserted before. */
+    hash   = fdd_cache_hash_file(dev->fp);
+    cached = fdd_cache_get(hash, 0, &decoded_size);
+    if (cached != NULL) {
+        td0_log("TD0: File is compressed, using cached decompressed image\n");
+        memcpy(dev->imagebuf, cached, MIN(decoded_size, TD0_MAX_BUFSZ));
+        free(cached);
+        return 1;
+    }
+
+    if (((header[4] / 10) % 10) == 2) {
+        td0_log("TD0: File is compressed (TeleDisk 2.x, LZHUF)\n");
+        disk_decode.fdd_file = dev->fp;
+        state_init_Decode(&disk_decode);
+        disk_decode.fdd_file_offset = 12;
+        decoded_size                = state_Decode(&disk_decode, dev->imagebuf, TD0_MAX_BUFSZ);
+    } else {
+        td0_log("TD0: File is compressed (TeleDisk 1.x, LZW)\n");
+        if ((fseek(dev->fp, 12, SEEK_SET) == -1) ||
+            (fread(dev->lzw_buf, 1, file_size - 12, dev->fp) != (file_size - 12))) {
+            td0_log("TD0: Error reading LZW-encoded buffer\n");
+            return 0;
+        }
+        LZWDecodeFile((char *) dev->imagebuf, (char *) dev->lzw_buf, &lzw_size, file_size - 12);
+        decoded_size = (uint32_t) MIN(lzw_size, TD0_MAX_BUFSZ);
+    }
+
+    cached = malloc(decoded_size);
+    if (cached != NULL) {
+        memcpy(cached, dev->imagebuf, decoded_size);
+        fdd_cache_put(hash, 0, cached, decoded_size);
+    }
+
+    return 1;
+}
+
+static void
+td0_decode_thread(void *priv)
+{
+    td0_t *dev = (td0_t *) priv;
+
+    ATOMIC_STORE(dev->decode_state, td0_decompress(dev) ? TD0_DECODE_DONE : TD0_DECODE_FAILED);
+}
+
 static int
 td0_initialize(int drive)
 {
-    td0_t         *dev = td0[drive];
-    uint8_t        header[12];
+    td0_t         *dev    = td0[drive];
+    const uint8_t *header = dev->header;
     int            fm;
     int            head;
     int            track;
@@ -608,10 +707,8 @@ td0_initialize(int drive)
     int            offset    = 0;
     int            density   = 0;
     int            temp_rate = 0;
-    uint32_t       file_size;
     uint16_t       len;
     uint16_t       rep;
-    td0dsk_t       disk_decode;
     const uint8_t *hs;
     uint16_t       size;
     uint8_t       *dbuf         = dev->processed_buf;
@@ -628,48 +725,14 @@ td0_initialize(int drive)
     int            size_diff;
     int            gap_sum;
 
-    if (dev->fp == NULL) {
-        td0_log("TD0: Attempted to initialize without loading a file first\n");
-        return 0;
-    }
-
-    fseek(dev->fp, 0, SEEK_END);
-    file_size = ftell(dev->fp);
-
-    if (file_size < 12) {
-        td0_log("TD0: File is too small to even contain the header\n");
-        return 0;
-    }
-
-    if (file_size > TD0_MAX_BUFSZ) {
-        td0_log("TD0: File exceeds the maximum size\n");
-        return 0;
-    }
-
-    fseek(dev->fp, 0, SEEK_SET);
-    (void) !fread(header, 1, 12, dev->fp);
     head_count = header[9];
 
-    if (header[0] == 't') {
-        if (((header[4] / 10) % 10) == 2) {
-            td0_log("TD0: File is compressed (TeleDisk 2.x, LZHUF)\n");
-            disk_decode.fdd_file = dev->fp;
-            state_init_Decode(&disk_decode);
-            disk_decode.fdd_file_offset = 12;
-            state_Decode(&disk_decode, dev->imagebuf, TD0_MAX_BUFSZ);
-        } else {
-            td0_log("TD0: File is compressed (TeleDisk 1.x, LZW)\n");
-            if (fseek(dev->fp, 12, SEEK_SET) == -1)
-                fatal("td0_initialize(): Error seeking to offet 12\n");
-            if (fread(dev->lzw_buf, 1, file_size - 12, dev->fp) != (file_size - 12))
-                fatal("td0_initialize(): Error reading LZW-encoded buffer\n");
-            LZWDecodeFile((char *) dev->imagebuf, (char *) dev->lzw_buf, NULL, file_size - 12);
-        }
-    } else {
+    /* Compressed images were read by td0_decompress() already. */
+    if (header[0] != 't') {
         td0_log("TD0: File is uncompressed\n");
         if (fseek(dev->fp, 12, SEEK_SET) == -1)
             fatal("td0_initialize(): Error seeking to offet 12\n");
-        if (fread(dev->imagebuf, 1, file_size - 12, dev->fp) != (file_size - 12))
+        if (fread(dev->imagebuf, 1, dev->file_size - 12, dev->fp) != (dev->file_size - 12))
             fatal("td0_initialize(): Error reading image buffer\n");
     }
 
@@ -1191,6 +1254,12 @@ td0_abort(int drive)
 {
     td0_t *dev = td0[drive];
 
+    if (dev->decode_thread != NULL)
+        thread_wait(dev->decode_thread);
+    timer_disable(&dev->load_timer);
+
+    if (dev->lzw_buf)
+        free(dev->lzw_buf);
     if (dev->imagebuf)
         free(dev->imagebuf);
     if (dev->processed_buf)
@@ -1202,6 +1271,66 @@ td0_abort(int drive)
     td0[drive] = NULL;
 }
 
+static int
+td0_finish_load(int drive)
+{
+    if (!td0_initialize(drive)) {
+        td0_log("TD0: Failed to initialize\n");
+        td0_abort(drive);
+        return 0;
+    } else {
+        td0_log("TD0: Initialized successfully\n");
+    }
+
+    /* Attach this format to the D86F engine. */
+    d86f_handler[drive].disk_flags        = disk_flags;
+    d86f_handler[drive].side_flags        = side_flags;
+    d86f_handler[drive].writeback         = null_writeback;
+    d86f_handler[drive].set_sector        = set_sector;
+    d86f_handler[drive].read_data         = poll_read_data;
+    d86f_handler[drive].write_data        = null_write_data;
+    d86f_handler[drive].format_conditions = null_format_conditions;
+    d86f_handler[drive].extra_bit_cells   = null_extra_bit_cells;
+    d86f_handler[drive].encoded_data      = common_encoded_data;
+    d86f_handler[drive].read_revolution   = common_read_revolution;
+    d86f_handler[drive].index_hole_pos    = null_index_hole_pos;
+    d86f_handler[drive].get_raw_size      = common_get_raw_size;
+    d86f_handler[drive].check_crc         = 1;
+    d86f_set_version(drive, 0x0063);
+
+    drives[drive].seek = td0_seek;
+
+    d86f_common_handlers(drive);
+
+    return 1;
+}
+
+/* Waits for the decode thread, then puts the disk in the drive. */
+static void
+td0_load_poll(void *priv)
+{
+    td0_t *dev   = (td0_t *) priv;
+    int    drive = dev->drive;
+    int    ret;
+
+    if (ATOMIC_LOAD(dev->decode_state) == TD0_DECODE_BUSY) {
+        timer_advance_u64(&dev->load_timer, TD0_LOAD_POLL);
+        return;
+    }
+
+    thread_wait(dev->decode_thread);
+    dev->decode_thread = NULL;
+
+    if (ATOMIC_LOAD(dev->decode_state) == TD0_DECODE_FAILED) {
+        td0_log("TD0: Failed to decompress\n");
+        td0_abort(drive);
+        ret = 0;
+    } else
+        ret = td0_finish_load(drive);
+
+    fdd_load_complete(drive, ret);
+}
+
 void
 td0_load(int drive, char *fn)
 {
@@ -1237,33 +1366,27 @@ td0_load(int drive, char *fn)
     dev->imagebuf = (uint8_t *) calloc(1, i);
     dev->processed_buf = (uint8_t *) calloc(1, i);
 
-    if (!td0_initialize(drive)) {
-        td0_log("TD0: Failed to initialize\n");
+    if (!td0_open_image(dev)) {
         td0_abort(drive);
         return;
-    } else {
-        td0_log("TD0: Initialized successfully\n");
     }
 
-    /* Attach this format to the D86F engine. */
-    d86f_handler[drive].disk_flags        = disk_flags;
-    d86f_handler[drive].side_flags        = side_flags;
-    d86f_handler[drive].writeback         = null_writeback;
-    d86f_handler[drive].set_sector        = set_sector;
-    d86f_handler[drive].read_data         = poll_read_data;
-    d86f_handler[drive].write_data        = null_write_data;
-    d86f_handler[drive].format_conditions = null_format_conditions;
-    d86f_handler[drive].extra_bit_cells   = null_extra_bit_cells;
-    d86f_handler[drive].encoded_data      = common_encoded_data;
-    d86f_handler[drive].read_revolution   = common_read_revolution;
-    d86f_handler[drive].index_hole_pos    = null_index_hole_pos;
-    d86f_handler[drive].get_raw_size      = common_get_raw_size;
-    d86f_handler[drive].check_crc         = 1;
-    d86f_set_version(drive, 0x0063);
-
-    drives[drive].seek = td0_seek;
+    /*
+     * Hashing and decompressing a large image takes long enough to
+     * stall the emulation, so it is done on a thread and the drive
+     * stays empty until td0_load_poll() sees it finish.
+     */
+    if (dev->header[0] == 't') {
+        dev->drive = drive;
+        ATOMIC_STORE(dev->decode_state, TD0_DECODE_BUSY);
+        timer_add(&dev->load_timer, td0_load_poll, dev, 0);
+        timer_set_delay_u64(&dev->load_timer, TD0_LOAD_POLL);
+        dev->decode_thread = thread_create(td0_decode_thread, dev);
+        fdd_set_loading(drive);
+        return;
+    }
 
-    d86f_common_handlers(drive);
+    (void) td0_finish_load(drive);
 }
 
 void
@@ -1276,6 +1399,10 @@ td0_close(int drive)
 
     d86f_unregister(drive);
 
+    if (dev->decode_thread != NULL)
+        thread_wait(dev->decode_thread);
+    timer_disable(&dev->load_timer);
+
     if (dev->lzw_buf)
         free(dev->lzw_buf);
     if (dev->imagebuf)
@@ -2159,6 +2159,12 @@ fdi2raw_get_tpi(FDI *fdi)
     return fdi->header[148];
 }
 
+int
+fdi2raw_get_lowlevel(FDI *fdi, int track)
+{
+    return fdi->cache[track].lowlevel;
+}
+
 FDI *
 fdi2raw_header(FILE *fp)
 {
@@ -260,6 +260,8 @@ extern int  portable_mode;         /* we are running in portable mode
                                       (global dirs = exe path) */
 extern int global_cfg_overridden;  /* global config file was overriden on command line */
 extern char control_socket_path[1024]; /* (O) control socket path for IPC */
+extern char sound_capture_path[1024];  /* (O) write the sound mixes to WAV or FLAC files */
+extern int  sound_output_null;        /* (O) do not open a host audio device */
 
 extern int  monitor_edid;                   /* (C) Which EDID to use. 0=default, 1=custom. */
 extern char monitor_edid_path[1024];        /* (C) Path to custom EDID */
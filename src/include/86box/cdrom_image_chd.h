@@ -0,0 +1,38 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          CHD (MAME compressed hunks of data) CD-ROM image back-end
+ *          header.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#ifndef CDROM_IMAGE_CHD_H
+#define CDROM_IMAGE_CHD_H
+
+/* Track description parsed from the CHD metadata. */
+typedef struct chd_track_info_t {
+    int      number;
+    int      audio;
+    int      mode;
+    uint32_t data_size;   /* Bytes of sector data stored in each frame. */
+    uint32_t frames;      /* Frames stored in the CHD, including pregap_data. */
+    uint32_t pregap;      /* Pre-gap length in frames. */
+    uint32_t pregap_data; /* Pre-gap frames that are stored in the CHD. */
+    uint32_t postgap;
+    uint64_t frame_start; /* First frame of the track in the CHD. */
+} chd_track_info_t;
+
+/* CHD functions. */
+extern void         *chd_image_open(const uint8_t id, const char *filename, int *error);
+extern int           chd_image_get_track(void *priv, int index, chd_track_info_t *info);
+extern track_file_t *chd_track_init(void *priv, const chd_track_info_t *info, int *error);
+extern void          chd_image_release(void *priv);
+
+#endif /*CDROM_IMAGE_CHD_H*/
@@ -91,6 +91,9 @@ extern int     readdma3(void);
 
 extern void writedma2(uint8_t temp);
 
+extern void dma_add_sync_handler(void (*sync)(void *priv), void *priv);
+extern void dma_remove_sync_handler(void *priv);
+
 extern int  dma_get_drq(int channel);
 extern void dma_set_drq(int channel, int set);
 
@@ -108,6 +108,8 @@ extern int64_t floppytime;
 
 extern void fdd_load(int drive, char *fn);
 extern void fdd_new(int drive, char *fn);
+extern void fdd_set_loading(int drive);
+extern void fdd_load_complete(int drive, int success);
 extern void fdd_close(int drive);
 extern void fdd_init(void);
 extern void fdd_reset(void);
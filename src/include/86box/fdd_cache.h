@@ -0,0 +1,24 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Definitions for the decoded floppy image data cache.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#ifndef EMU_FLOPPY_CACHE_H
+#define EMU_FLOPPY_CACHE_H
+
+extern void     fdd_cache_init(void);
+extern uint64_t fdd_cache_hash_file(FILE *fp);
+extern int      fdd_cache_has(uint64_t hash, uint32_t key);
+extern void    *fdd_cache_get(uint64_t hash, uint32_t key, uint32_t *size);
+extern void     fdd_cache_put(uint64_t hash, uint32_t key, void *data, uint32_t size);
+
+#endif /*EMU_FLOPPY_CACHE_H*/
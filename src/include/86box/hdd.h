@@ -158,13 +158,16 @@ typedef struct hard_disk_t {
                                         READ-ONLY */
     uint8_t            raw_device;   /* Path is a raw block device
                                         (e.g. /dev/sdX, /dev/diskN) */
-    uint8_t            pad0;
+    uint8_t            overlay_dedup; /* Skip overlay writes of
+                                           unchanged sectors */
 
     void              *priv;
 
     char               fn[MAX_IMAGE_PATH_LEN];     /* Name of current image file */
     /* Differential VHD parent file */
     char               vhd_parent[1280];
+    /* Delta overlay file, the base image is then opened read-only */
+    char               overlay_fn[1280];
 
     uint32_t           seek_pos;
     uint32_t           seek_len;
@@ -227,6 +230,16 @@ extern void     hdd_image_sync(uint8_t id);
 extern void     hdd_image_sync_all(void);
 extern void     hdd_image_calc_chs(uint32_t *c, uint32_t *h, uint32_t *s, uint32_t size);
 
+typedef struct hdd_overlay_t hdd_overlay_t;
+
+extern hdd_overlay_t *hdd_overlay_open(const char *fn, FILE *base, uint64_t base_off, uint32_t sectors, int dedup);
+extern void           hdd_overlay_close(hdd_overlay_t *ovl);
+extern void           hdd_overlay_sync(hdd_overlay_t *ovl);
+extern int            hdd_overlay_read(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, uint8_t *buffer);
+extern int            hdd_overlay_write(hdd_overlay_t *ovl, uint32_t sector, uint32_t count, const uint8_t *buffer);
+extern int            hdd_overlay_zero(hdd_overlay_t *ovl, uint32_t sector, uint32_t count);
+extern int            hdd_overlay_merge(const char *delta_fn, const char *base_fn);
+
 extern int image_is_hdi(const char *s);
 extern int image_is_hdx(const char *s, int check_signature);
 extern int image_is_vhd(const char *s, int check_signature);
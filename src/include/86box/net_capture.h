@@ -0,0 +1,47 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Definitions for the in-memory network capture ring.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#ifndef EMU_NET_CAPTURE_H
+#define EMU_NET_CAPTURE_H
+
+#include <stdatomic.h>
+
+#define NET_CAPTURE_SLOTS_DEFAULT 4096
+#define NET_CAPTURE_SLOTS_MAX     65536
+#define NET_CAPTURE_SNAPLEN       NET_MAX_FRAME
+#define NET_CAPTURE_ALL_CARDS     0xffffffff
+
+enum {
+    NET_CAPTURE_IN  = 1, /* host to guest */
+    NET_CAPTURE_OUT = 2  /* guest to host */
+};
+
+extern atomic_uint net_capture_cards; /* bit per card being captured */
+
+extern int      net_capture_start(uint32_t cards, int slots, const char *filter, char *err, int err_size);
+extern void     net_capture_stop(void);
+extern void     net_capture_clear(void);
+extern int      net_capture_status(uint32_t *cards, int *slots, uint32_t *count, uint64_t *dropped);
+extern uint8_t *net_capture_export(size_t *len);
+extern void     net_capture_frame(int card_num, int dir, const uint8_t *data, int len);
+
+/* Cheap enough to sit in the frame paths: one relaxed load while idle. */
+static inline void
+net_capture(int card_num, int dir, const uint8_t *data, int len)
+{
+    if (atomic_load_explicit(&net_capture_cards, memory_order_relaxed) & (1u << card_num))
+        net_capture_frame(card_num, dir, data, len);
+}
+
+#endif /*EMU_NET_CAPTURE_H*/
@@ -0,0 +1,70 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Definitions for the per-card network statistics.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#ifndef EMU_NET_STATS_H
+#define EMU_NET_STATS_H
+
+#include <stdatomic.h>
+
+/* Histograms are log2: bucket 0 counts zero, bucket n counts [2^(n-1), 2^n). */
+#define NET_STATS_BUCKETS 16
+
+typedef atomic_uint_fast64_t netstat_t;
+
+typedef struct netstats_t {
+    netstat_t rx_frames;   /* delivered to the card */
+    netstat_t rx_bytes;
+    netstat_t rx_dropped;  /* RX queue full when the backend had a frame */
+    netstat_t rx_refused;  /* card had no buffer, frame kept for later */
+    netstat_t tx_frames;   /* queued by the card */
+    netstat_t tx_bytes;
+    netstat_t tx_dropped;  /* TX queue full when the card sent a frame */
+    netstat_t syscalls;    /* host I/O calls made by the backend, any thread */
+    netstat_t rx_latency_sum; /* microseconds */
+    netstat_t rx_latency_max;
+    netstat_t rx_latency[NET_STATS_BUCKETS];
+    netstat_t rx_depth[NET_STATS_BUCKETS]; /* queue occupancy per card tick */
+    netstat_t tx_depth[NET_STATS_BUCKETS];
+} netstats_t;
+
+extern netstats_t net_stats[NET_CARD_MAX];
+
+extern void  net_stats_reset(int card_num);
+extern char *net_stats_json(int card_num);
+
+/*
+ * Apart from syscalls, every counter has a single writer (the emulation
+ * thread or the card's backend thread), so a relaxed load and store is
+ * enough and keeps the frame paths free of locked instructions.
+ */
+static inline void
+net_stats_add(netstat_t *stat, uint64_t val)
+{
+    atomic_store_explicit(stat, atomic_load_explicit(stat, memory_order_relaxed) + val, memory_order_relaxed);
+}
+
+static inline void
+net_stats_hist(netstat_t *hist, uint64_t val)
+{
+    int bucket = 0;
+
+    while (val && (bucket < (NET_STATS_BUCKETS - 1))) {
+        val >>= 1;
+        bucket++;
+    }
+
+    net_stats_add(&hist[bucket], 1);
+}
+
+#endif /*EMU_NET_STATS_H*/
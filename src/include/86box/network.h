@@ -54,15 +54,25 @@
 #define NET_TYPE_NRSWITCH 6 /* use the remote switch provider */
 
 #define NET_MAX_FRAME  1518
-/* Queue size must be a power of 2 */
-#define NET_QUEUE_LEN      16
-#define NET_QUEUE_LEN_MASK (NET_QUEUE_LEN - 1)
-#define NET_QUEUE_COUNT    4
+/* Per-card queue depth in frames, rounded up to a power of 2 */
+#define NET_QUEUE_LEN_MIN     16
+#define NET_QUEUE_LEN_DEFAULT 256
+#define NET_QUEUE_LEN_MAX     4096
+#define NET_QUEUE_COUNT       4
+/* Frames moved at once by the card timer or a host backend */
+#define NET_BATCH_LEN         64
+/* Largest SLiRP host socket buffer in KB, kept well inside an int in bytes */
+#define NET_SLIRP_SOCKBUF_MAX 65536
 #define NET_CARD_MAX       4
 #define NET_HOST_INTF_MAX  64
 
 #define NET_PERIOD_10M     0.8
 #define NET_PERIOD_100M    0.08
+/* Card timer period in fast link mode, regardless of the frame sizes */
+#define NET_PERIOD_FAST    50.0
+
+/* Transmit work a host backend can take over from the emulator */
+#define NET_OFFLOAD_CSUM   (1 << 0) /* TCP/UDP checksum from csum_start */
 
 /* Error buffers for network driver init */
 #define NET_DRV_ERRBUF_SIZE 384
@@ -85,9 +95,9 @@ enum {
 
 enum {
     NET_QUEUE_RX       = 0,
-    NET_QUEUE_TX_VM    = 1,
-    NET_QUEUE_TX_HOST  = 2,
-    NET_QUEUE_RX_ON_TX = 3
+    NET_QUEUE_TX       = 1,
+    NET_QUEUE_RX_ON_TX = 2,
+    NET_QUEUE_LOOPBACK = 3
 };
 
 typedef struct netcard_conf_t {
@@ -99,6 +109,11 @@ typedef struct netcard_conf_t {
     uint8_t  promisc_mode;
     char     slirp_net[16];
     char     nrs_hostname[128];
+    int      queue_len;
+    uint8_t  fast_link;
+    uint8_t  switch_shm;    /* local switch over shared memory instead of UDP */
+    uint16_t vlan;          /* local switch port VLAN, 0 for a trunk port */
+    int      slirp_sockbuf; /* SLiRP host socket buffer size in KB, 0 for the default */
 } netcard_conf_t;
 
 extern netcard_conf_t net_cards_conf[NET_CARD_MAX];
@@ -111,13 +126,18 @@ typedef int (*NETSETLINKSTATE)(void *, uint32_t link_state);
 typedef struct netpkt {
     uint8_t *data;
     int      len;
+    /*
+     * Checksum still to be filled in, as with a partial checksum on the
+     * host: the ones' complement sum from csum_start to the end of the
+     * frame goes at csum_start + csum_offset, which holds the seed (the
+     * pseudo-header sum). Zero csum_start means the frame is complete.
+     */
+    uint16_t csum_start;
+    uint16_t csum_offset;
 } netpkt_t;
 
-typedef struct netqueue_t {
-    netpkt_t packets[NET_QUEUE_LEN];
-    int      head;
-    int      tail;
-} netqueue_t;
+/* Single-producer/single-consumer frame ring, private to network.c. */
+typedef struct netqueue_t netqueue_t;
 
 typedef struct _netcard_t netcard_t;
 
@@ -134,6 +154,7 @@ extern const netdrv_t net_vde_drv;
 extern const netdrv_t net_tap_drv;
 extern const netdrv_t net_null_drv;
 extern const netdrv_t net_switch_drv;
+extern const netdrv_t net_switch_shm_drv;
 
 struct _netcard_t {
     const device_t *device;
@@ -141,16 +162,14 @@ struct _netcard_t {
     struct netdrv_t host_drv;
     NETRXCB         rx;
     NETSETLINKSTATE set_link_state;
-    netqueue_t      queues[NET_QUEUE_COUNT];
-    netpkt_t        queued_pkt;
-    mutex_t        *tx_mutex;
-    mutex_t        *rx_mutex;
+    netqueue_t     *queues[NET_QUEUE_COUNT];
     pc_timer_t      timer;
     uint16_t        card_num;
     double          byte_period;
     uint32_t        led_timer;
     uint32_t        led_state;
     uint32_t        link_state;
+    uint32_t        offload; /* NET_OFFLOAD_* done by the host backend */
 };
 
 typedef struct {
@@ -188,6 +207,7 @@ extern void       network_close(void);
 extern void       network_reset(void);
 extern int        network_available(void);
 extern void       network_tx(netcard_t *card, uint8_t *, int);
+extern void       network_wake_cards(void);
 
 extern int net_pcap_prepare(netdev_t *);
 extern int net_vde_prepare(void);
@@ -206,13 +226,32 @@ extern int             network_card_get_from_internal_name(char *);
 extern const device_t *network_card_getdevice(int);
 #endif
 
-extern int network_tx_pop(netcard_t *card, netpkt_t *out_pkt);
-extern int network_tx_popv(netcard_t *card, netpkt_t *pkt_vec, int vec_size);
-extern int network_rx_put(netcard_t *card, uint8_t *bufp, int len);
-extern int network_rx_on_tx_popv(netcard_t *card, netpkt_t *pkt_vec, int vec_size);
-extern int network_rx_on_tx_put(netcard_t *card, uint8_t *bufp, int len);
-extern int network_rx_put_pkt(netcard_t *card, netpkt_t *pkt);
-extern int network_rx_on_tx_put_pkt(netcard_t *card, netpkt_t *pkt);
+/* Host backend side; only ever called from the backend's own thread. */
+extern int  network_tx_peekv(netcard_t *card, netpkt_t *pkt_vec, int vec_size);
+extern void network_tx_release(netcard_t *card, int count);
+extern int  network_rx_put(netcard_t *card, uint8_t *bufp, int len);
+extern int  network_rx_put_pkt(netcard_t *card, netpkt_t *pkt);
+extern int  network_rx_reserve(netcard_t *card, netpkt_t *pkt_vec, int vec_size);
+extern void network_rx_commit(netcard_t *card, const netpkt_t *pkt_vec, int count);
+extern int  network_rx_on_tx_peekv(netcard_t *card, netpkt_t *pkt_vec, int vec_size);
+extern void network_rx_on_tx_release(netcard_t *card, int count);
+extern int  network_rx_on_tx_put(netcard_t *card, uint8_t *bufp, int len);
+extern int  network_rx_on_tx_put_pkt(netcard_t *card, netpkt_t *pkt);
+extern void network_count_syscalls(const netcard_t *card, int count);
+extern void network_rx_dropped(const netcard_t *card, int count);
+
+/* Card side; hands a frame straight back to the card's own receiver. */
+extern int network_loopback(netcard_t *card, uint8_t *bufp, int len);
+
+/* Card side; build a frame directly in the TX queue. */
+extern uint8_t *network_tx_reserve(netcard_t *card);
+extern void     network_tx_commit(netcard_t *card, int len);
+extern void     network_txv(netcard_t *card, const netpkt_t *pkt_vec, int vec_size);
+
+/* Internet checksum helpers; sums are over big-endian 16-bit words. */
+extern uint32_t network_csum_add(const uint8_t *data, int len, uint32_t sum);
+extern uint16_t network_csum_fold(uint32_t sum);
+extern void     network_csum_finish(uint8_t *frame, int len, int csum_start, int csum_offset);
 
 #ifdef EMU_DEVICE_H
 /* 3Com Etherlink */
@@ -40,6 +40,8 @@ enum serial_passthrough_mode {
 
 extern const char *serpt_mode_names[SERPT_MODES_MAX];
 
+#define SERPT_BUF_SIZE 4096
+
 typedef struct serial_passthrough_s {
     enum serial_passthrough_mode mode;
     pc_timer_t                   host_to_serial_timer;
@@ -56,6 +58,13 @@ typedef struct serial_passthrough_s {
     char  host_serial_path[1024];              /* Path to TTY/host serial port on the host */
     char  named_pipe[1024];                    /* (Windows only) Name of the pipe. */
     void *backend_priv;                        /* Private platform backend data */
+
+    /* Host I/O is done in bursts; these hold what is in flight. */
+    uint8_t rx_buf[SERPT_BUF_SIZE]; /* read from the host, not yet in the UART */
+    int     rx_pos;
+    int     rx_len;
+    uint8_t tx_buf[SERPT_BUF_SIZE]; /* sent by the guest, not yet written to the host */
+    int     tx_len;
 } serial_passthrough_t;
 
 extern bool           serial_passthrough_enabled[SERIAL_MAX - 1];
@@ -7,8 +7,8 @@ extern "C" {
 void   *sid_init(uint8_t type, double range);
 void    sid_close(void *priv);
 void    sid_reset(void *priv);
-uint8_t sid_read(uint16_t addr, void *priv);
-void    sid_write(uint16_t addr, uint8_t val, void *priv);
+uint8_t sid_read(uint16_t addr, int pos, void *priv);
+void    sid_write(uint16_t addr, uint8_t val, int pos, void *priv);
 void    sid_fillbuf(int16_t *buf, int len, void *priv);
 #ifdef __cplusplus
 }
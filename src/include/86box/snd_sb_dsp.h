@@ -141,6 +141,10 @@ typedef struct sb_dsp_t {
     double sblatcho;
     double sblatchi;
 
+    /* Block mode: output samples are fetched lazily, see sb_dsp_block_sync(). */
+    int     block_mode;
+    int64_t block_offset; /* due time of the next output sample, 32:32 from output_timer */
+
     uint16_t sb_addr;
 
     int stereo;
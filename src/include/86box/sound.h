@@ -70,6 +70,24 @@ extern void wavetable_add_handler(void (*get_buffer)(int32_t *buffer,
                                                      int len, void *priv),
                                   void *priv);
 
+/*
+ * The handler only touches its own device, so it may render on a worker
+ * thread, in parallel with other handlers, while the emulation thread waits.
+ */
+#define SOUND_HANDLER_THREAD_SAFE 1
+
+extern void sound_add_handler_ex(void (*get_buffer)(int32_t *buffer,
+                                                    int len, void *priv),
+                                 void *priv, int flags);
+
+extern void music_add_handler_ex(void (*get_buffer)(int32_t *buffer,
+                                                    int len, void *priv),
+                                 void *priv, int flags);
+
+extern void wavetable_add_handler_ex(void (*get_buffer)(int32_t *buffer,
+                                                        int len, void *priv),
+                                     void *priv, int flags);
+
 extern void sound_set_cd_audio_filter(void (*filter)(int     channel,
                                                      double *buffer, void *priv),
                                       void *priv);
@@ -98,6 +116,7 @@ extern void sound_reset(void);
 extern void sound_card_reset(void);
 
 extern void sound_cd_thread_end(void);
+extern void sound_workers_end(void);
 extern void sound_cd_thread_reset(void);
 
 extern void sound_fdd_thread_init(void);
@@ -109,6 +128,16 @@ extern void sound_hdd_thread_end(void);
 extern void sound_cdrom_activity_thread_init(void);
 extern void sound_cdrom_activity_thread_end(void);
 
+#define SOUND_CAPTURE_SOUND 0
+#define SOUND_CAPTURE_MUSIC 1
+#define SOUND_CAPTURE_WT    2
+#define SOUND_CAPTURE_MIDI  3
+#define SOUND_CAPTURE_MAX   4
+
+extern void sound_capture_write(int stream, const int32_t *buf, int frames);
+extern void sound_capture_set_freq(int stream, int freq);
+extern void sound_capture_close(void);
+
 extern void closeal(void);
 extern void inital(void);
 extern void givealbuffer(const void *buf);
@@ -25,4 +25,26 @@ typedef struct wav_header_t {
  * sample_count receives the number of stereo sample pairs */
 int16_t *sound_load_wav(const char *filename, int *sample_count);
 
+/* Polyphase resampler: devices push frames at their native rate and pull
+ * them back at the output rate. */
+typedef struct resampler_t resampler_t;
+
+resampler_t *resampler_init(double in_rate, double out_rate);
+void         resampler_set_rate(resampler_t *rs, double in_rate, double out_rate);
+void         resampler_reset(resampler_t *rs);
+void         resampler_close(resampler_t *rs);
+void         resampler_push(resampler_t *rs, int32_t l, int32_t r);
+void         resampler_get(resampler_t *rs, int32_t *buffer, int frames);
+
+/* Block mixing and conversion kernels, see sound_mix.c. Call
+ * sound_mix_init() once to pick the best version for the host CPU. */
+extern void (*sound_mix_int32)(int32_t *dst, const int32_t *src, int len);
+extern void (*sound_int32_to_float)(float *dst, const int32_t *src, int len);
+extern void (*sound_int32_to_int16)(int16_t *dst, const int32_t *src, int len);
+
+void sound_mix_init(void);
+void sound_s16_to_double(double *dst, const int16_t *src, int frames, const double m[4], const double gain[2]);
+void sound_mix_double_to_float(float *dst, const double *src, int len);
+void sound_mix_double_to_int16(int16_t *dst, const double *src, int len);
+
 #endif /* SOUND_UTIL_H */
\ No newline at end of file
@@ -75,6 +75,9 @@ extern int fdi2raw_get_num_sector(FDI *fdi);
 
 extern int fdi2raw_get_tpi(FDI *fdi);
 
+/// @returns whether @c track was decoded from flux-level data, whose weak bits make every revolution differ.
+extern int fdi2raw_get_lowlevel(FDI *fdi, int track);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1761,6 +1761,36 @@ mem_write_phys(void *src, uint32_t addr, int transfer_size)
     }
 }
 
+/*
+ * Host pointer to len bytes of guest physical memory, if the whole range is
+ * plain RAM that the bus sees as one contiguous block; NULL otherwise. Lets
+ * bus masters copy a buffer in one go instead of going through the mappings.
+ */
+uint8_t *
+mem_get_phys_ptr(uint32_t addr, uint32_t len, int write)
+{
+    mem_mapping_t **bus = write ? write_mapping_bus : read_mapping_bus;
+    uint8_t        *ret = NULL;
+
+    if (!len || ((addr + len - 1) < addr))
+        return NULL;
+
+    for (uint32_t a = addr; (a - addr) < len; a = (a & MEM_GRANULARITY_BASE) + MEM_GRANULARITY_SIZE) {
+        const mem_mapping_t *map = bus[a >> MEM_GRANULARITY_BITS];
+
+        if (!map || !map->exec || (write ? (map->write_b != mem_write_ram) : (map->read_b != mem_read_ram)))
+            return NULL;
+
+        uint8_t *p = &(map->exec[(a - map->base) & map->mask]);
+        if (!ret)
+            ret = p;
+        else if (p != (ret + (a - addr)))
+            return NULL;
+    }
+
+    return ret;
+}
+
 uint8_t
 mem_read_ram(uint32_t addr, UNUSED(void *priv))
 {
@@ -0,0 +1,840 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          In-memory capture ring for the emulated network cards.
+ *
+ *          Frames the cards send and receive are recorded with a
+ *          timestamp into a fixed ring of slots, optionally through a
+ *          filter using a subset of the tcpdump expression syntax:
+ *
+ *            [src|dst] host <a.b.c.d>    ether [src|dst] host <mac>
+ *            [src|dst] net <a.b.c.d/len> [src|dst] port <n>
+ *            ether proto <n>  arp  rarp  ip  ip6  proto <n>
+ *            tcp  udp  icmp   vlan [<id>]  broadcast  multicast
+ *            less <n>  greater <n>  inbound  outbound
+ *
+ *          combined with and/&&, or/||, not/! and parentheses. The
+ *          ring can be exported as a pcapng file at any time.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/thread.h>
+#include <86box/timer.h>
+#include <86box/network.h>
+#include <86box/net_capture.h>
+
+#define CAPTURE_FILTER_NODES 64
+#define CAPTURE_FILTER_DEPTH 32 /* nested "not" and "(", bounds the parser's recursion */
+
+#define CAPTURE_DIR_SRC      1
+#define CAPTURE_DIR_DST      2
+#define CAPTURE_DIR_ANY      (CAPTURE_DIR_SRC | CAPTURE_DIR_DST)
+
+#define CAPTURE_VLAN_ANY     0xffffffff
+
+enum {
+    CF_AND = 0,
+    CF_OR,
+    CF_NOT,
+    CF_ETHER_HOST,
+    CF_ETHER_PROTO,
+    CF_HOST,
+    CF_NET,
+    CF_IP_PROTO,
+    CF_PORT,
+    CF_VLAN,
+    CF_BROADCAST,
+    CF_MULTICAST,
+    CF_LESS,
+    CF_GREATER,
+    CF_INBOUND,
+    CF_OUTBOUND
+};
+
+typedef struct capture_node_t {
+    uint8_t  type;
+    uint8_t  dir;
+    int16_t  left;
+    int16_t  right;
+    uint32_t value;
+    uint32_t mask;
+    uint8_t  mac[6];
+} capture_node_t;
+
+typedef struct capture_parser_t {
+    const char     *p;
+    char            tok[64];
+    capture_node_t *nodes;
+    int             count;
+    int             depth;
+    char           *err;
+    int             err_size;
+} capture_parser_t;
+
+/* Fields of a frame the filter looks at, decoded once per frame. */
+typedef struct capture_info_t {
+    const uint8_t *data;
+    int            len;
+    int            dir;
+    uint16_t       ethertype;
+    int            vlan;
+    int            ip;
+    uint32_t       ip_src;
+    uint32_t       ip_dst;
+    uint8_t        ip_proto;
+    int            ports;
+    uint16_t       port_src;
+    uint16_t       port_dst;
+} capture_info_t;
+
+typedef struct capture_rec_t {
+    uint64_t ts; /* ns since the epoch */
+    uint16_t card;
+    uint8_t  dir;
+    uint16_t caplen;
+    uint16_t len;
+} capture_rec_t;
+
+atomic_uint net_capture_cards = 0;
+
+static mutex_t       *capture_mutex;
+static capture_rec_t *capture_recs;
+static uint8_t       *capture_data;
+static int            capture_slots;
+static uint64_t       capture_head; /* frames recorded since the last start or clear */
+static uint64_t       capture_overwritten;
+static capture_node_t capture_filter[CAPTURE_FILTER_NODES];
+static int            capture_filter_root = -1;
+
+#ifdef ENABLE_NET_CAPTURE_LOG
+int net_capture_do_log = ENABLE_NET_CAPTURE_LOG;
+
+static void
+net_capture_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (net_capture_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define net_capture_log(fmt, ...)
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Filter expressions.                                                 */
+/* ------------------------------------------------------------------ */
+static void
+capture_error(capture_parser_t *ps, const char *msg)
+{
+    if (ps->err && !ps->err[0])
+        snprintf(ps->err, ps->err_size, "%s near \"%s\"", msg, ps->tok);
+}
+
+/* Read the next token into ps->tok; returns 0 at the end of the input. */
+static int
+capture_next(capture_parser_t *ps)
+{
+    const char *p = ps->p;
+    int         n = 0;
+
+    while (isspace((unsigned char) *p))
+        p++;
+
+    if (!*p) {
+        ps->tok[0] = '\0';
+        ps->p      = p;
+        return 0;
+    }
+
+    if ((p[0] == '&' && p[1] == '&') || (p[0] == '|' && p[1] == '|')) {
+        ps->tok[n++] = *p++;
+        ps->tok[n++] = *p++;
+    } else if ((*p == '(') || (*p == ')') || (*p == '!'))
+        ps->tok[n++] = *p++;
+    else {
+        while (*p && !isspace((unsigned char) *p) && !strchr("()!&|", *p)) {
+            if (n < (int) (sizeof(ps->tok) - 1))
+                ps->tok[n++] = *p;
+            p++;
+        }
+    }
+
+    ps->tok[n] = '\0';
+    ps->p      = p;
+    return 1;
+}
+
+static int
+capture_peek(capture_parser_t *ps, const char *word)
+{
+    const char *save = ps->p;
+    char        tok[64];
+    int         ret;
+
+    memcpy(tok, ps->tok, sizeof(tok));
+    ret = capture_next(ps) && !strcmp(ps->tok, word);
+    ps->p = save;
+    memcpy(ps->tok, tok, sizeof(tok));
+
+    return ret;
+}
+
+static int
+capture_node(capture_parser_t *ps, int type)
+{
+    if (ps->count >= CAPTURE_FILTER_NODES) {
+        capture_error(ps, "Filter is too long");
+        return -1;
+    }
+
+    capture_node_t *node = &ps->nodes[ps->count];
+    memset(node, 0, sizeof(capture_node_t));
+    node->type  = type;
+    node->dir   = CAPTURE_DIR_ANY;
+    node->left  = -1;
+    node->right = -1;
+
+    return ps->count++;
+}
+
+static int
+capture_number(capture_parser_t *ps, uint32_t max, uint32_t *val)
+{
+    char *end;
+
+    if (!capture_next(ps))
+        return 0;
+
+    unsigned long v = strtoul(ps->tok, &end, 0);
+    if (*end || (end == ps->tok) || (v > max))
+        return 0;
+
+    *val = v;
+    return 1;
+}
+
+static int
+capture_ipv4(const char *s, uint32_t *addr, int *bits)
+{
+    unsigned a, b, c, d;
+    int      n = -1;
+    char     tail;
+
+    if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) == 4)
+        n = 32;
+    else if ((sscanf(s, "%u.%u.%u.%u/%d%c", &a, &b, &c, &d, &n, &tail) != 5) || (n < 0) || (n > 32))
+        return 0;
+
+    if ((a > 255) || (b > 255) || (c > 255) || (d > 255) || (!bits && (n != 32)))
+        return 0;
+
+    *addr = (a << 24) | (b << 16) | (c << 8) | d;
+    if (bits)
+        *bits = n;
+    return 1;
+}
+
+static int capture_expr(capture_parser_t *ps);
+
+static int
+capture_primitive(capture_parser_t *ps)
+{
+    uint8_t  dir = CAPTURE_DIR_ANY;
+    int      ether = 0;
+    uint32_t val;
+    int      bits;
+    int      n;
+
+    if (!strcmp(ps->tok, "ether")) {
+        ether = 1;
+        if (!capture_next(ps))
+            goto fail;
+        if (!strcmp(ps->tok, "proto")) {
+            if ((n = capture_node(ps, CF_ETHER_PROTO)) < 0)
+                return -1;
+            if (!capture_number(ps, 0xffff, &ps->nodes[n].value))
+                goto fail;
+            return n;
+        }
+    }
+
+    if (!strcmp(ps->tok, "src") || !strcmp(ps->tok, "dst")) {
+        dir = (ps->tok[0] == 's') ? CAPTURE_DIR_SRC : CAPTURE_DIR_DST;
+        if (!capture_next(ps))
+            goto fail;
+    }
+
+    if (!strcmp(ps->tok, "host")) {
+        if (!capture_next(ps))
+            goto fail;
+        if (ether) {
+            unsigned m[6];
+            char     tail;
+
+            if ((n = capture_node(ps, CF_ETHER_HOST)) < 0)
+                return -1;
+            if (sscanf(ps->tok, "%x:%x:%x:%x:%x:%x%c", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &tail) != 6)
+                goto fail;
+            for (int i = 0; i < 6; i++)
+                ps->nodes[n].mac[i] = m[i];
+        } else {
+            if ((n = capture_node(ps, CF_HOST)) < 0)
+                return -1;
+            if (!capture_ipv4(ps->tok, &ps->nodes[n].value, NULL))
+                goto fail;
+        }
+        ps->nodes[n].dir = dir;
+        return n;
+    }
+
+    if (ether)
+        goto fail;
+
+    if (!strcmp(ps->tok, "net")) {
+        if (!capture_next(ps) || ((n = capture_node(ps, CF_NET)) < 0))
+            goto fail;
+        if (!capture_ipv4(ps->tok, &val, &bits))
+            goto fail;
+        ps->nodes[n].mask  = bits ? (0xffffffff << (32 - bits)) : 0;
+        ps->nodes[n].value = val & ps->nodes[n].mask;
+        ps->nodes[n].dir   = dir;
+        return n;
+    }
+
+    if (!strcmp(ps->tok, "port")) {
+        if ((n = capture_node(ps, CF_PORT)) < 0)
+            return -1;
+        if (!capture_number(ps, 0xffff, &ps->nodes[n].value))
+            goto fail;
+        ps->nodes[n].dir = dir;
+        return n;
+    }
+
+    if (dir != CAPTURE_DIR_ANY)
+        goto fail;
+
+    static const struct {
+        const char *name;
+        int         type;
+        uint32_t    value;
+    } words[] = {
+        { "arp",       CF_ETHER_PROTO, 0x0806 },
+        { "rarp",      CF_ETHER_PROTO, 0x8035 },
+        { "ip",        CF_ETHER_PROTO, 0x0800 },
+        { "ip6",       CF_ETHER_PROTO, 0x86dd },
+        { "icmp",      CF_IP_PROTO,    1      },
+        { "tcp",       CF_IP_PROTO,    6      },
+        { "udp",       CF_IP_PROTO,    17     },
+        { "broadcast", CF_BROADCAST,   0      },
+        { "multicast", CF_MULTICAST,   0      },
+        { "inbound",   CF_INBOUND,     0      },
+        { "outbound",  CF_OUTBOUND,    0      }
+    };
+
+    for (size_t i = 0; i < (sizeof(words) / sizeof(words[0])); i++) {
+        if (!strcmp(ps->tok, words[i].name)) {
+            if ((n = capture_node(ps, words[i].type)) < 0)
+                return -1;
+            ps->nodes[n].value = words[i].value;
+            return n;
+        }
+    }
+
+    if (!strcmp(ps->tok, "proto") || !strcmp(ps->tok, "less") || !strcmp(ps->tok, "greater")) {
+        int type = (ps->tok[0] == 'p') ? CF_IP_PROTO : ((ps->tok[0] == 'l') ? CF_LESS : CF_GREATER);
+
+        if ((n = capture_node(ps, type)) < 0)
+            return -1;
+        if (!capture_number(ps, (type == CF_IP_PROTO) ? 0xff : 0xffff, &ps->nodes[n].value))
+            goto fail;
+        return n;
+    }
+
+    if (!strcmp(ps->tok, "vlan")) {
+        if ((n = capture_node(ps, CF_VLAN)) < 0)
+            return -1;
+        ps->nodes[n].value = CAPTURE_VLAN_ANY;
+
+        /* The VLAN id is optional. */
+        const char *save = ps->p;
+        char        tok[64];
+        memcpy(tok, ps->tok, sizeof(tok));
+        if (!capture_number(ps, 4095, &ps->nodes[n].value)) {
+            ps->nodes[n].value = CAPTURE_VLAN_ANY;
+            ps->p              = save;
+            memcpy(ps->tok, tok, sizeof(tok));
+        }
+        return n;
+    }
+
+fail:
+    capture_error(ps, "Invalid filter");
+    return -1;
+}
+
+/* Enter a "not" or "(", the caller decrements depth again. */
+static int
+capture_nest(capture_parser_t *ps)
+{
+    if (ps->depth >= CAPTURE_FILTER_DEPTH) {
+        capture_error(ps, "Filter is nested too deeply");
+        return 0;
+    }
+
+    ps->depth++;
+    return 1;
+}
+
+static int
+capture_factor(capture_parser_t *ps)
+{
+    int n;
+
+    if (!capture_next(ps)) {
+        capture_error(ps, "Unexpected end of filter");
+        return -1;
+    }
+
+    if (!strcmp(ps->tok, "not") || !strcmp(ps->tok, "!")) {
+        if (!capture_nest(ps))
+            return -1;
+        int child = capture_factor(ps);
+        ps->depth--;
+        if ((child < 0) || ((n = capture_node(ps, CF_NOT)) < 0))
+            return -1;
+        ps->nodes[n].left = child;
+        return n;
+    }
+
+    if (!strcmp(ps->tok, "(")) {
+        if (!capture_nest(ps))
+            return -1;
+        n = capture_expr(ps);
+        ps->depth--;
+        if (n < 0)
+            return -1;
+        if (!capture_next(ps) || strcmp(ps->tok, ")")) {
+            capture_error(ps, "Missing )");
+            return -1;
+        }
+        return n;
+    }
+
+    return capture_primitive(ps);
+}
+
+static int
+capture_binary(capture_parser_t *ps, int type, const char *word, const char *sym, int (*operand)(capture_parser_t *))
+{
+    int left = operand(ps);
+
+    while ((left >= 0) && (capture_peek(ps, word) || capture_peek(ps, sym))) {
+        int n;
+
+        capture_next(ps);
+        int right = operand(ps);
+        if ((right < 0) || ((n = capture_node(ps, type)) < 0))
+            return -1;
+        ps->nodes[n].left  = left;
+        ps->nodes[n].right = right;
+        left               = n;
+    }
+
+    return left;
+}
+
+static int
+capture_term(capture_parser_t *ps)
+{
+    return capture_binary(ps, CF_AND, "and", "&&", capture_factor);
+}
+
+static int
+capture_expr(capture_parser_t *ps)
+{
+    return capture_binary(ps, CF_OR, "or", "||", capture_term);
+}
+
+/* Compile a filter into nodes; returns the root node, or -1 with err set. */
+static int
+capture_compile(const char *filter, capture_node_t *nodes, char *err, int err_size)
+{
+    capture_parser_t ps = {
+        .p        = filter,
+        .nodes    = nodes,
+        .err      = err,
+        .err_size = err_size
+    };
+
+    err[0]   = '\0';
+    int root = capture_expr(&ps);
+    if ((root >= 0) && capture_next(&ps)) {
+        capture_error(&ps, "Unexpected token");
+        return -1;
+    }
+
+    return root;
+}
+
+static void
+capture_decode(capture_info_t *info)
+{
+    const uint8_t *d   = info->data;
+    int            off = 14;
+
+    info->vlan = -1;
+    if (info->len < 14)
+        return;
+
+    info->ethertype = (d[12] << 8) | d[13];
+    if ((info->ethertype == 0x8100) && (info->len >= 18)) {
+        info->vlan      = ((d[14] & 0x0f) << 8) | d[15];
+        info->ethertype = (d[16] << 8) | d[17];
+        off             = 18;
+    }
+
+    if ((info->ethertype != 0x0800) || (info->len < (off + 20)) || ((d[off] >> 4) != 4))
+        return;
+
+    int ihl        = (d[off] & 0x0f) * 4;
+    info->ip       = 1;
+    info->ip_proto = d[off + 9];
+    info->ip_src   = (d[off + 12] << 24) | (d[off + 13] << 16) | (d[off + 14] << 8) | d[off + 15];
+    info->ip_dst   = (d[off + 16] << 24) | (d[off + 17] << 16) | (d[off + 18] << 8) | d[off + 19];
+
+    /* Ports are only in the first fragment. */
+    if (((info->ip_proto == 6) || (info->ip_proto == 17)) && !(((d[off + 6] & 0x1f) << 8) | d[off + 7]) &&
+        (ihl >= 20) && (info->len >= (off + ihl + 4))) {
+        info->ports    = 1;
+        info->port_src = (d[off + ihl] << 8) | d[off + ihl + 1];
+        info->port_dst = (d[off + ihl + 2] << 8) | d[off + ihl + 3];
+    }
+}
+
+static int
+capture_match(const capture_node_t *nodes, int idx, const capture_info_t *info)
+{
+    const capture_node_t *node = &nodes[idx];
+
+    switch (node->type) {
+        case CF_AND:
+            return capture_match(nodes, node->left, info) && capture_match(nodes, node->right, info);
+        case CF_OR:
+            return capture_match(nodes, node->left, info) || capture_match(nodes, node->right, info);
+        case CF_NOT:
+            return !capture_match(nodes, node->left, info);
+        case CF_ETHER_HOST:
+            if (info->len < 12)
+                return 0;
+            return ((node->dir & CAPTURE_DIR_SRC) && !memcmp(info->data + 6, node->mac, 6)) ||
+                   ((node->dir & CAPTURE_DIR_DST) && !memcmp(info->data, node->mac, 6));
+        case CF_ETHER_PROTO:
+            return info->ethertype == node->value;
+        case CF_HOST:
+            return info->ip && (((node->dir & CAPTURE_DIR_SRC) && (info->ip_src == node->value)) ||
+                                ((node->dir & CAPTURE_DIR_DST) && (info->ip_dst == node->value)));
+        case CF_NET:
+            return info->ip && (((node->dir & CAPTURE_DIR_SRC) && ((info->ip_src & node->mask) == node->value)) ||
+                                ((node->dir & CAPTURE_DIR_DST) && ((info->ip_dst & node->mask) == node->value)));
+        case CF_IP_PROTO:
+            return info->ip && (info->ip_proto == node->value);
+        case CF_PORT:
+            return info->ports && (((node->dir & CAPTURE_DIR_SRC) && (info->port_src == node->value)) ||
+                                   ((node->dir & CAPTURE_DIR_DST) && (info->port_dst == node->value)));
+        case CF_VLAN:
+            return (info->vlan >= 0) && ((node->value == CAPTURE_VLAN_ANY) || (info->vlan == (int) node->value));
+        case CF_BROADCAST:
+            return (info->len >= 6) && !memcmp(info->data, "\xff\xff\xff\xff\xff\xff", 6);
+        case CF_MULTICAST:
+            return (info->len >= 1) && (info->data[0] & 1);
+        case CF_LESS:
+            return info->len <= (int) node->value;
+        case CF_GREATER:
+            return info->len >= (int) node->value;
+        case CF_INBOUND:
+            return info->dir == NET_CAPTURE_IN;
+        case CF_OUTBOUND:
+            return info->dir == NET_CAPTURE_OUT;
+
+        default:
+            return 0;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Capture ring.                                                       */
+/* ------------------------------------------------------------------ */
+static void
+capture_free(void)
+{
+    free(capture_recs);
+    free(capture_data);
+    capture_recs  = NULL;
+    capture_data  = NULL;
+    capture_slots = 0;
+}
+
+int
+net_capture_start(uint32_t cards, int slots, const char *filter, char *err, int err_size)
+{
+    capture_node_t nodes[CAPTURE_FILTER_NODES];
+    int            root = -1;
+
+    if (filter && filter[0] && ((root = capture_compile(filter, nodes, err, err_size)) < 0))
+        return -1;
+
+    if (slots <= 0)
+        slots = NET_CAPTURE_SLOTS_DEFAULT;
+    slots = MIN(slots, NET_CAPTURE_SLOTS_MAX);
+
+    if (!capture_mutex)
+        capture_mutex = thread_create_mutex();
+
+    atomic_store(&net_capture_cards, 0);
+    thread_wait_mutex(capture_mutex);
+
+    if (slots != capture_slots) {
+        capture_free();
+        capture_recs = calloc(slots, sizeof(capture_rec_t));
+        capture_data = malloc((size_t) slots * NET_CAPTURE_SNAPLEN);
+        if (!capture_recs || !capture_data) {
+            capture_free();
+            thread_release_mutex(capture_mutex);
+            snprintf(err, err_size, "Out of memory");
+            return -1;
+        }
+        capture_slots = slots;
+    }
+
+    capture_head        = 0;
+    capture_overwritten = 0;
+    capture_filter_root = root;
+    if (root >= 0)
+        memcpy(capture_filter, nodes, sizeof(capture_filter));
+
+    thread_release_mutex(capture_mutex);
+    atomic_store(&net_capture_cards, cards);
+
+    net_capture_log("Network capture: started on cards %08X, %d slots, filter \"%s\"\n", cards, slots, filter ? filter : "");
+    return 0;
+}
+
+/* Stop recording; what was captured stays available for export. */
+void
+net_capture_stop(void)
+{
+    atomic_store(&net_capture_cards, 0);
+}
+
+void
+net_capture_clear(void)
+{
+    if (!capture_mutex)
+        return;
+
+    thread_wait_mutex(capture_mutex);
+    capture_head        = 0;
+    capture_overwritten = 0;
+    thread_release_mutex(capture_mutex);
+}
+
+int
+net_capture_status(uint32_t *cards, int *slots, uint32_t *count, uint64_t *overwritten)
+{
+    *cards = atomic_load(&net_capture_cards);
+    if (!capture_mutex) {
+        *slots       = 0;
+        *count       = 0;
+        *overwritten = 0;
+        return 0;
+    }
+
+    thread_wait_mutex(capture_mutex);
+    *slots       = capture_slots;
+    *count       = (uint32_t) MIN(capture_head, (uint64_t) capture_slots);
+    *overwritten = capture_overwritten;
+    thread_release_mutex(capture_mutex);
+
+    return 1;
+}
+
+void
+net_capture_frame(int card_num, int dir, const uint8_t *data, int len)
+{
+    struct timespec ts;
+
+    if (len <= 0)
+        return;
+
+    thread_wait_mutex(capture_mutex);
+
+    if (capture_filter_root >= 0) {
+        capture_info_t info = { .data = data, .len = len, .dir = dir };
+
+        capture_decode(&info);
+        if (!capture_match(capture_filter, capture_filter_root, &info)) {
+            thread_release_mutex(capture_mutex);
+            return;
+        }
+    }
+
+    if (capture_slots) {
+        timespec_get(&ts, TIME_UTC);
+        uint32_t       slot = (uint32_t) (capture_head % capture_slots);
+        capture_rec_t *rec  = &capture_recs[slot];
+
+        if (capture_head >= (uint64_t) capture_slots)
+            capture_overwritten++;
+
+        rec->ts     = ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+        rec->card   = card_num;
+        rec->dir    = dir;
+        rec->len    = len;
+        rec->caplen = MIN(len, NET_CAPTURE_SNAPLEN);
+        memcpy(&capture_data[(size_t) slot * NET_CAPTURE_SNAPLEN], data, rec->caplen);
+
+        capture_head++;
+    }
+    thread_release_mutex(capture_mutex);
+}
+
+/* ------------------------------------------------------------------ */
+/* pcapng export.                                                      */
+/* ------------------------------------------------------------------ */
+static uint8_t *
+pcapng_put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+    return p + 4;
+}
+
+static uint8_t *
+pcapng_put16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, 2);
+    return p + 2;
+}
+
+#define PCAPNG_SHB_LEN 28
+#define PCAPNG_IDB_LEN (20 + 12 + 8 + 4) /* header, if_name (up to 8), if_tsresol, end */
+#define PCAPNG_EPB_LEN (28 + 8 + 4 + 4)  /* header, epb_flags, end, trailer */
+
+/*
+ * Export the ring, oldest frame first, as a pcapng file with one
+ * interface per card; the caller frees the buffer.
+ */
+uint8_t *
+net_capture_export(size_t *len)
+{
+    uint8_t *buf;
+    uint8_t *p;
+    size_t   size = PCAPNG_SHB_LEN + (NET_CARD_MAX * PCAPNG_IDB_LEN);
+
+    *len = 0;
+    if (!capture_mutex)
+        return NULL;
+
+    thread_wait_mutex(capture_mutex);
+
+    uint32_t count = (uint32_t) MIN(capture_head, (uint64_t) capture_slots);
+    uint32_t first = (capture_head >= (uint64_t) capture_slots) ? (uint32_t) (capture_head % capture_slots) : 0;
+
+    for (uint32_t i = 0; i < count; i++)
+        size += PCAPNG_EPB_LEN + ((capture_recs[(first + i) % capture_slots].caplen + 3) & ~3);
+
+    buf = p = malloc(size);
+    if (!buf) {
+        thread_release_mutex(capture_mutex);
+        return NULL;
+    }
+
+    /* Section header. */
+    p = pcapng_put32(p, 0x0a0d0d0a);
+    p = pcapng_put32(p, PCAPNG_SHB_LEN);
+    p = pcapng_put32(p, 0x1a2b3c4d);
+    p = pcapng_put16(p, 1);
+    p = pcapng_put16(p, 0);
+    p = pcapng_put32(p, 0xffffffff); /* section length unknown */
+    p = pcapng_put32(p, 0xffffffff);
+    p = pcapng_put32(p, PCAPNG_SHB_LEN);
+
+    /* One interface per card, so the interface id is the card number. */
+    for (int c = 0; c < NET_CARD_MAX; c++) {
+        char     name[8];
+        uint16_t name_len;
+        uint32_t idb_len;
+
+        snprintf(name, sizeof(name), "net%d", c);
+        name_len = strlen(name);
+        idb_len  = PCAPNG_IDB_LEN - 8 + ((name_len + 3) & ~3);
+
+        p = pcapng_put32(p, 1);
+        p = pcapng_put32(p, idb_len);
+        p = pcapng_put16(p, 1); /* LINKTYPE_ETHERNET */
+        p = pcapng_put16(p, 0);
+        p = pcapng_put32(p, NET_CAPTURE_SNAPLEN);
+        p = pcapng_put16(p, 2); /* if_name, padded to 32 bits */
+        p = pcapng_put16(p, name_len);
+        memset(p, 0, (name_len + 3) & ~3);
+        memcpy(p, name, name_len);
+        p += (name_len + 3) & ~3;
+        p = pcapng_put16(p, 9); /* if_tsresol: nanoseconds */
+        p = pcapng_put16(p, 1);
+        memset(p, 0, 4);
+        p[0] = 9;
+        p += 4;
+        p = pcapng_put32(p, 0); /* opt_endofopt */
+        p = pcapng_put32(p, idb_len);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t             slot    = (first + i) % capture_slots;
+        const capture_rec_t *rec     = &capture_recs[slot];
+        uint32_t             padded  = (rec->caplen + 3) & ~3;
+        uint32_t             blk_len = PCAPNG_EPB_LEN + padded;
+
+        p = pcapng_put32(p, 6);
+        p = pcapng_put32(p, blk_len);
+        p = pcapng_put32(p, rec->card);
+        p = pcapng_put32(p, rec->ts >> 32);
+        p = pcapng_put32(p, rec->ts & 0xffffffff);
+        p = pcapng_put32(p, rec->caplen);
+        p = pcapng_put32(p, rec->len);
+        memcpy(p, &capture_data[(size_t) slot * NET_CAPTURE_SNAPLEN], rec->caplen);
+        memset(p + rec->caplen, 0, padded - rec->caplen);
+        p += padded;
+        p = pcapng_put16(p, 2); /* epb_flags: direction */
+        p = pcapng_put16(p, 4);
+        p = pcapng_put32(p, rec->dir);
+        p = pcapng_put32(p, 0);
+        p = pcapng_put32(p, blk_len);
+    }
+
+    thread_release_mutex(capture_mutex);
+
+    *len = p - buf;
+    return buf;
+}
@@ -429,29 +429,31 @@ modem_data_mode_process_byte(modem_t *modem, uint8_t data)
 static void
 host_to_modem_cb(void *priv)
 {
-    modem_t *modem = (modem_t *) priv;
+    modem_t       *modem = (modem_t *) priv;
+    Fifo8         *fifo  = NULL;
+    const uint8_t *buf;
+    uint32_t       num;
+    int            count = 0;
 
     if (modem->in_warmup || (modem->serial == NULL))
         goto no_write_to_machine;
 
-    if ((modem->serial->type >= SERIAL_16550) && modem->serial->fifo_enabled) {
-        if (fifo_get_full(modem->serial->rcvr_fifo)) {
-            goto no_write_to_machine;
-        }
-    } else {
-        if (modem->serial->lsr & 1) {
-            goto no_write_to_machine;
-        }
-    }
-
     if (!((modem->serial->mctrl & 2) || modem->flowcontrol != 3))
         goto no_write_to_machine;
 
-    if (modem->mode == MODEM_MODE_DATA && fifo8_num_used(&modem->rx_data) && !modem->cooldown) {
-        serial_write_fifo(modem->serial, fifo8_pop(&modem->rx_data));
-    } else if (fifo8_num_used(&modem->data_pending)) {
-        uint8_t val = fifo8_pop(&modem->data_pending);
-        serial_write_fifo(modem->serial, val);
+    if (modem->mode == MODEM_MODE_DATA && fifo8_num_used(&modem->rx_data) && !modem->cooldown)
+        fifo = &modem->rx_data;
+    else if (fifo8_num_used(&modem->data_pending))
+        fifo = &modem->data_pending;
+
+    /* Give the UART as much as it can take at once, instead of a byte per tick. */
+    if (fifo) {
+        num = MIN(fifo8_num_used(fifo), (uint32_t) serial_rx_space(modem->serial));
+        if (num) {
+            buf   = fifo8_peek_bufptr(fifo, num, &num);
+            count = serial_write_fifo_buf(modem->serial, buf, num);
+            fifo8_drop(fifo, count);
+        }
     }
 
     if (fifo8_num_used(&modem->data_pending) == 0) {
@@ -459,7 +461,8 @@ host_to_modem_cb(void *priv)
     }
 
 no_write_to_machine:
-    timer_on_auto(&modem->host_to_serial_timer, (1000000.0 / (double) modem->baudrate) * (double) 9);
+    /* Wait as long as the burst takes on the line, so the DTE rate still holds. */
+    timer_on_auto(&modem->host_to_serial_timer, (1000000.0 / (double) modem->baudrate) * (double) 9 * (double) MAX(count, 1));
 }
 
 static void
@@ -1448,7 +1451,7 @@ modem_cmdpause_timer_callback(void *priv)
             }
         }
         if (modem->connected) {
-            uint8_t buffer[16];
+            uint8_t buffer[1024];
             int     wouldblock = 0;
             int     recv       = MIN(modem->rx_data.capacity - modem->rx_data.num, sizeof(buffer));
             int     res        = plat_netsocket_receive(modem->clientsocket, buffer, recv, &wouldblock);
@@ -49,7 +49,7 @@ enum {
  * excluding NET_EVENT_RX. */
 #define NET_EVENT_TX_MAX NET_EVENT_RX
 
-#define NULL_PKT_BATCH NET_QUEUE_LEN
+#define NULL_PKT_BATCH NET_BATCH_LEN
 
 typedef struct net_null_t {
     uint8_t    mac_addr[6];
@@ -57,7 +57,6 @@ typedef struct net_null_t {
     thread_t  *poll_tid;
     net_evt_t  tx_event;
     net_evt_t  stop_event;
-    netpkt_t   pkt;
     netpkt_t   pktv[NULL_PKT_BATCH];
 } net_null_t;
 
@@ -104,9 +103,12 @@ net_null_thread(void *priv)
 
             case NET_EVENT_TX:
                 net_event_clear(&net_null->tx_event);
-                int packets = network_tx_popv(net_null->card, net_null->pktv, NULL_PKT_BATCH);
-                for (int i = 0; i < packets; i++) {
-                    net_null_log("Null Network: Ignoring TX packet (%d bytes)\n", net_null->pktv[i].len);
+                int packets;
+                while ((packets = network_tx_peekv(net_null->card, net_null->pktv, NULL_PKT_BATCH)) > 0) {
+                    for (int i = 0; i < packets; i++) {
+                        net_null_log("Null Network: Ignoring TX packet (%d bytes)\n", net_null->pktv[i].len);
+                    }
+                    network_tx_release(net_null->card, packets);
                 }
                 break;
 
@@ -144,9 +146,12 @@ net_null_thread(void *priv)
         if (pfd[NET_EVENT_TX].revents & POLLIN) {
             net_event_clear(&net_null->tx_event);
 
-            int packets = network_tx_popv(net_null->card, net_null->pktv, NULL_PKT_BATCH);
-            for (int i = 0; i < packets; i++) {
-                net_null_log("Null Network: Ignoring TX packet (%d bytes)\n", net_null->pktv[i].len);
+            int packets;
+            while ((packets = network_tx_peekv(net_null->card, net_null->pktv, NULL_PKT_BATCH)) > 0) {
+                for (int i = 0; i < packets; i++) {
+                    net_null_log("Null Network: Ignoring TX packet (%d bytes)\n", net_null->pktv[i].len);
+                }
+                network_tx_release(net_null->card, packets);
             }
         }
     }
@@ -164,11 +169,6 @@ net_null_init(const netcard_t *card, const uint8_t *mac_addr, UNUSED(void *priv)
     net_null->card       = (netcard_t *) card;
     memcpy(net_null->mac_addr, mac_addr, sizeof(net_null->mac_addr));
 
-    for (int i = 0; i < NULL_PKT_BATCH; i++) {
-        net_null->pktv[i].data = calloc(1, NET_MAX_FRAME);
-    }
-    net_null->pkt.data = calloc(1, NET_MAX_FRAME);
-
     net_event_init(&net_null->tx_event);
     net_event_init(&net_null->stop_event);
     net_null->poll_tid = thread_create(net_null_thread, net_null);
@@ -203,11 +203,6 @@ net_null_close(void *priv)
     thread_wait(net_null->poll_tid);
     net_null_log("Null Network: thread ended\n");
 
-    for (int i = 0; i < NULL_PKT_BATCH; i++) {
-        free(net_null->pktv[i].data);
-    }
-    free(net_null->pkt.data);
-
     net_event_close(&net_null->tx_event);
     net_event_close(&net_null->stop_event);
 
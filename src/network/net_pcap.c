@@ -68,7 +68,7 @@
 #include <86box/network.h>
 #include <86box/net_event.h>
 
-#define PCAP_PKT_BATCH NET_QUEUE_LEN
+#define PCAP_PKT_BATCH NET_BATCH_LEN
 
 enum {
     NET_EVENT_STOP = 0,
@@ -137,8 +137,10 @@ typedef struct {
     thread_t  *poll_tid;
     net_evt_t  tx_event;
     net_evt_t  stop_event;
-    netpkt_t   pkt;
     netpkt_t   pktv[PCAP_PKT_BATCH];
+    netpkt_t   rxv[PCAP_PKT_BATCH];
+    int        rx_slots;
+    int        rx_count;
     uint8_t    mac_addr[6];
 #ifdef _WIN32
     struct pcap_send_queue *pcap_queue;
@@ -233,10 +235,33 @@ static void
 net_pcap_rx_handler(uint8_t *user, const struct pcap_pkthdr *h, const uint8_t *bytes)
 {
     net_pcap_t *pcap = (net_pcap_t *) user;
-    memcpy(pcap->pkt.data, bytes, h->caplen);
-    pcap->pkt.len = h->caplen;
-    if (!(net_cards_conf[pcap->card->card_num].link_state & NET_LINK_DOWN))
-        network_rx_put_pkt(pcap->card, &pcap->pkt);
+
+    /* No room left in the RX queue, drop the packet. */
+    if (pcap->rx_count >= pcap->rx_slots) {
+        network_rx_dropped(pcap->card, 1);
+        return;
+    }
+
+    netpkt_t *pkt = &pcap->rxv[pcap->rx_count++];
+    if ((net_cards_conf[pcap->card->card_num].link_state & NET_LINK_DOWN) || (h->caplen > NET_MAX_FRAME)) {
+        pkt->len = 0;
+    } else {
+        memcpy(pkt->data, bytes, h->caplen);
+        pkt->len = h->caplen;
+    }
+}
+
+/* Receive a batch of packets straight into the card's RX queue. */
+static void
+net_pcap_rx(net_pcap_t *pcap)
+{
+    pcap->rx_slots = network_rx_reserve(pcap->card, pcap->rxv, PCAP_PKT_BATCH);
+    pcap->rx_count = 0;
+
+    f_pcap_dispatch(pcap->pcap, pcap->rx_slots ? pcap->rx_slots : 1, net_pcap_rx_handler, (unsigned char *) pcap);
+    network_count_syscalls(pcap->card, 1);
+
+    network_rx_commit(pcap->card, pcap->rxv, pcap->rx_count);
 }
 
 /* Send a packet to the Pcap interface. */
@@ -274,6 +299,7 @@ net_pcap_thread(void *priv)
     struct pcap_pkthdr h;
     while (run) {
         int ret = WaitForMultipleObjects(NET_EVENT_MAX, events, FALSE, INFINITE);
+        network_count_syscalls(pcap->card, 1);
 
         switch (ret - WAIT_OBJECT_0) {
             case NET_EVENT_STOP:
@@ -284,18 +310,22 @@ net_pcap_thread(void *priv)
             case NET_EVENT_TX:
                 net_event_clear(&pcap->tx_event);
                 if (!(net_cards_conf[pcap->card->card_num].link_state & NET_LINK_DOWN)) {
-                    int packets = network_tx_popv(pcap->card, pcap->pktv, PCAP_PKT_BATCH);
-                    for (int i = 0; i < packets; i++) {
-                        h.caplen = pcap->pktv[i].len;
-                        f_pcap_sendqueue_queue(pcap->pcap_queue, &h, pcap->pktv[i].data);
+                    int packets;
+                    while ((packets = network_tx_peekv(pcap->card, pcap->pktv, PCAP_PKT_BATCH)) > 0) {
+                        for (int i = 0; i < packets; i++) {
+                            h.caplen = pcap->pktv[i].len;
+                            f_pcap_sendqueue_queue(pcap->pcap_queue, &h, pcap->pktv[i].data);
+                        }
+                        f_pcap_sendqueue_transmit(pcap->pcap, pcap->pcap_queue, 0);
+                        pcap->pcap_queue->len = 0;
+                        network_tx_release(pcap->card, packets);
+                        network_count_syscalls(pcap->card, 1);
                     }
-                    f_pcap_sendqueue_transmit(pcap->pcap, pcap->pcap_queue, 0);
                 }
-                pcap->pcap_queue->len = 0;
                 break;
 
             case NET_EVENT_RX:
-                f_pcap_dispatch(pcap->pcap, PCAP_PKT_BATCH, net_pcap_rx_handler, (unsigned char *) pcap);
+                net_pcap_rx(pcap);
                 break;
 
             default:
@@ -326,6 +356,7 @@ net_pcap_thread(void *priv)
     /* As long as the channel is open.. */
     while (1) {
         poll(pfd, NET_EVENT_MAX, -1);
+        network_count_syscalls(pcap->card, 1);
 
         if (pfd[NET_EVENT_STOP].revents & POLLIN) {
             net_event_clear(&pcap->stop_event);
@@ -335,16 +366,20 @@ net_pcap_thread(void *priv)
         if (pfd[NET_EVENT_TX].revents & POLLIN) {
             net_event_clear(&pcap->tx_event);
 
-            int packets = network_tx_popv(pcap->card, pcap->pktv, PCAP_PKT_BATCH);
-            if (!(net_cards_conf[pcap->card->card_num].link_state & NET_LINK_DOWN)) {
-                for (int i = 0; i < packets; i++) {
-                    net_pcap_in(pcap->pcap, pcap->pktv[i].data, pcap->pktv[i].len);
+            int packets;
+            while ((packets = network_tx_peekv(pcap->card, pcap->pktv, PCAP_PKT_BATCH)) > 0) {
+                if (!(net_cards_conf[pcap->card->card_num].link_state & NET_LINK_DOWN)) {
+                    for (int i = 0; i < packets; i++) {
+                        net_pcap_in(pcap->pcap, pcap->pktv[i].data, pcap->pktv[i].len);
+                    }
+                    network_count_syscalls(pcap->card, packets);
                 }
+                network_tx_release(pcap->card, packets);
             }
         }
 
         if (pfd[NET_EVENT_RX].revents & POLLIN) {
-            f_pcap_dispatch(pcap->pcap, PCAP_PKT_BATCH, net_pcap_rx_handler, (unsigned char *) pcap);
+            net_pcap_rx(pcap);
         }
     }
 
@@ -523,14 +558,9 @@ net_pcap_init(const netcard_t *card, const uint8_t *mac_addr, void *priv, char *
     }
 
 #ifdef _WIN32
-    pcap->pcap_queue = f_pcap_sendqueue_alloc(PCAP_PKT_BATCH * NET_MAX_FRAME);
+    pcap->pcap_queue = f_pcap_sendqueue_alloc(PCAP_PKT_BATCH * (sizeof(struct pcap_pkthdr) + NET_MAX_FRAME));
 #endif
 
-    for (int i = 0; i < PCAP_PKT_BATCH; i++) {
-        pcap->pktv[i].data = calloc(1, NET_MAX_FRAME);
-    }
-    pcap->pkt.data = calloc(1, NET_MAX_FRAME);
-
     net_event_init(&pcap->tx_event);
     net_event_init(&pcap->stop_event);
     pcap->poll_tid = thread_create(net_pcap_thread, pcap);
@@ -557,11 +587,6 @@ net_pcap_close(void *priv)
     thread_wait(pcap->poll_tid);
     pcap_log("PCAP: thread ended\n");
 
-    for (int i = 0; i < PCAP_PKT_BATCH; i++) {
-        free(pcap->pktv[i].data);
-    }
-    free(pcap->pkt.data);
-
 #ifdef _WIN32
     f_pcap_sendqueue_destroy((void *) pcap->pcap_queue);
 #endif
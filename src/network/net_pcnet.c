@@ -236,8 +236,6 @@ typedef struct {
     uint16_t aMII[MII_MAX_REG];
     /** The loopback transmit buffer (avoid stack allocations). */
     uint8_t abLoopBuf[4096];
-    /** The recv buffer. */
-    uint8_t abRecvBuf[4096];
     /** Size of a RX/TX descriptor (8 or 16 bytes according to SWSTYLE */
     int iLog2DescSize;
     /** Bits 16..23 in 16-bit mode */
@@ -1206,6 +1204,23 @@ pcnetCalcPacketLen(nic_t *dev, int cb)
     return cbPacket;
 }
 
+/* Write bytes off..off+cb of a received frame followed by its tail to guest memory. */
+static void
+pcnetRxWrite(nic_t *dev, uint32_t addr, const uint8_t *buf, int body, const uint8_t *tail, int off, int cb)
+{
+    if (off < body) {
+        int n = MIN(cb, body - off);
+
+        dma_bm_write(addr, buf + off, n, dev->transfer_size);
+        addr += n;
+        off += n;
+        cb -= n;
+    }
+
+    if (cb > 0)
+        dma_bm_write(addr, tail + (off - body), cb, dev->transfer_size);
+}
+
 /**
  * Write data into guest receive buffers.
  */
@@ -1277,7 +1292,9 @@ pcnetReceiveNoSync(void *priv, uint8_t *buf, int size)
             const RTNETETHERHDR *pEth   = (RTNETETHERHDR *) buf;
             int                  fStrip = 0;
             size_t               len_802_3;
-            uint8_t             *src  = &dev->abRecvBuf[8];
+            uint8_t              tail[68]; /* Padding and FCS. */
+            int                  body = 0;
+            int                  off  = 0;
             uint32_t             crda = CSR_CRDA(dev);
             uint32_t             next_crda;
             RMD                  rmd;
@@ -1298,24 +1315,29 @@ pcnetReceiveNoSync(void *priv, uint8_t *buf, int size)
                 fStrip = 1;
             }
 
-            memcpy(src, buf, size);
+            /* The frame goes to guest memory straight from the RX queue, only
+             * the padding and FCS are built here. */
+            body = size;
 
             if (!fStrip) {
+                uint32_t       fcs = UINT32_MAX;
+                const uint8_t *p   = buf;
+
+                while (p != &buf[body])
+                    CRC(fcs, *p++);
+
                 /* In loopback mode, Runt Packed Accept is always enabled internally;
                  * don't do any padding because guest may be looping back very short packets.
                  */
                 if (!CSR_LOOP(dev))
-                    while (size < 60)
-                        src[size++] = 0;
-
-                uint32_t       fcs = UINT32_MAX;
-                const uint8_t *p   = src;
-
-                while (p != &src[size])
-                    CRC(fcs, *p++);
+                    while (size < 60) {
+                        tail[size++ - body] = 0;
+                        CRC(fcs, 0);
+                    }
 
                 /* FCS at the end of the packet */
-                ((uint32_t *) &src[size])[0] = htonl(fcs);
+                fcs = htonl(fcs);
+                memcpy(&tail[size - body], &fcs, 4);
                 size += 4;
             }
 
@@ -1342,7 +1364,7 @@ pcnetReceiveNoSync(void *priv, uint8_t *buf, int size)
              *  - we don't cache any register state beyond this point
              */
 
-            dma_bm_write(rbadr, src, cbBuf, dev->transfer_size);
+            pcnetRxWrite(dev, rbadr, buf, body, tail, off, cbBuf);
 
             /* RX disabled in the meantime? If so, abort RX. */
             if (CSR_DRX(dev) || CSR_STOP(dev) || CSR_SPND(dev)) {
@@ -1359,7 +1381,7 @@ pcnetReceiveNoSync(void *priv, uint8_t *buf, int size)
             } else
                 iRxDesc = CSR_RCVRC(dev);
 
-            src += cbBuf;
+            off += cbBuf;
             size -= cbBuf;
 
             while (size > 0) {
@@ -1385,7 +1407,7 @@ pcnetReceiveNoSync(void *priv, uint8_t *buf, int size)
                 /* We have to leave the critical section here or we risk deadlocking
                  * with EMT when the write is to an unallocated page or has an access
                  * handler associated with it. See above for additional comments. */
-                dma_bm_write(rbadr2, src, cbBuf, dev->transfer_size);
+                pcnetRxWrite(dev, rbadr2, buf, body, tail, off, cbBuf);
 
                 /* RX disabled in the meantime? If so, abort RX. */
                 if (CSR_DRX(dev) || CSR_STOP(dev) || CSR_SPND(dev)) {
@@ -1403,7 +1425,7 @@ pcnetReceiveNoSync(void *priv, uint8_t *buf, int size)
                     iRxDesc = CSR_RCVRC(dev);
                 }
 
-                src += cbBuf;
+                off += cbBuf;
                 size -= cbBuf;
             }
 
@@ -1461,6 +1483,53 @@ pcnetXmitFailTMDGeneric(nic_t *dev, TMD *pTmd)
     dev->aCSR[0] |= 0x8000 | 0x2000; /* ERR | CERR */
 }
 
+/*
+ * Pick the buffer a frame of len bytes is gathered into: straight into the
+ * TX queue when possible, so the frame is only copied once on its way out.
+ */
+static uint8_t *
+pcnetXmitBuf(nic_t *dev, int fLoopback, int len)
+{
+    uint8_t *buf = NULL;
+
+    if (!fLoopback && (len <= NET_MAX_FRAME))
+        buf = network_tx_reserve(dev->netcard);
+
+    return buf ? buf : dev->abLoopBuf;
+}
+
+/*
+ * Append cb bytes from guest memory to the frame. A frame that outgrows the
+ * TX queue slot moves to abLoopBuf, where network_tx() drops it as before.
+ */
+static uint8_t *
+pcnetXmitGather(nic_t *dev, uint8_t *buf, uint32_t addr, int cb)
+{
+    if ((buf != dev->abLoopBuf) && ((dev->xmit_pos + cb) > NET_MAX_FRAME)) {
+        memcpy(dev->abLoopBuf, buf, dev->xmit_pos);
+        buf = dev->abLoopBuf;
+    }
+
+    dma_bm_read(addr, buf + dev->xmit_pos, cb, dev->transfer_size);
+    dev->xmit_pos += cb;
+
+    return buf;
+}
+
+static void
+pcnetXmitFrame(nic_t *dev, uint8_t *buf, int fLoopback)
+{
+    if (fLoopback) {
+        if (HOST_IS_OWNER(CSR_CRST(dev)))
+            pcnetRdtePoll(dev);
+
+        pcnetReceiveNoSync(dev, buf, dev->xmit_pos);
+    } else if (buf != dev->abLoopBuf)
+        network_tx_commit(dev->netcard, dev->xmit_pos);
+    else
+        network_tx(dev->netcard, buf, dev->xmit_pos);
+}
+
 /**
  * Actually try transmit frames.
  *
@@ -1510,18 +1579,13 @@ pcnetAsyncTransmit(nic_t *dev)
                  * ENP = 1).'' That means that the first buffer might have a
                  * zero length if it is not the last one in the chain. */
                 if (cb <= MAX_FRAME) {
-                    dev->xmit_pos = cb;
-                    dma_bm_read(PHYSADDR(dev, tmd.tmd0.tbadr), dev->abLoopBuf, cb, dev->transfer_size);
+                    uint8_t *xmit_buf = pcnetXmitBuf(dev, fLoopback, cb);
 
-                    if (fLoopback) {
-                        if (HOST_IS_OWNER(CSR_CRST(dev)))
-                            pcnetRdtePoll(dev);
+                    dev->xmit_pos = cb;
+                    dma_bm_read(PHYSADDR(dev, tmd.tmd0.tbadr), xmit_buf, cb, dev->transfer_size);
 
-                        pcnetReceiveNoSync(dev, dev->abLoopBuf, dev->xmit_pos);
-                    } else {
-                        pcnet_log(3, "%s: pcnetAsyncTransmit: transmit loopbuf stp and enp, xmit pos = %d\n", dev->name, dev->xmit_pos);
-                        network_tx(dev->netcard, dev->abLoopBuf, dev->xmit_pos);
-                    }
+                    pcnet_log(3, "%s: pcnetAsyncTransmit: transmit stp and enp, xmit pos = %d\n", dev->name, dev->xmit_pos);
+                    pcnetXmitFrame(dev, xmit_buf, fLoopback);
                 } else if (cb == 4096) {
                     /* The Windows NT4 pcnet driver sometimes marks the first
                      * unused descriptor as owned by us. Ignore that (by
@@ -1576,9 +1640,12 @@ pcnetAsyncTransmit(nic_t *dev)
              * waste time finding out how much space we actually need even if
              * we could reliably do that on SMP guests.
              */
-            unsigned cb   = 4096 - tmd.tmd1.bcnt;
-            dev->xmit_pos = pcnetCalcPacketLen(dev, cb);
-            dma_bm_read(PHYSADDR(dev, tmd.tmd0.tbadr), dev->abLoopBuf, cb, dev->transfer_size);
+            unsigned cb        = 4096 - tmd.tmd1.bcnt;
+            uint8_t *xmit_buf  = pcnetXmitBuf(dev, fLoopback, pcnetCalcPacketLen(dev, cb));
+            int      xmit_drop = 0;
+
+            dev->xmit_pos = 0;
+            xmit_buf      = pcnetXmitGather(dev, xmit_buf, PHYSADDR(dev, tmd.tmd0.tbadr), cb);
 
             for (;;) {
                 /*
@@ -1615,25 +1682,20 @@ pcnetAsyncTransmit(nic_t *dev)
                  */
                 pcnetTmdLoad(dev, &tmd, PHYSADDR(dev, CSR_CXDA(dev)), 0);
                 cb = 4096 - tmd.tmd1.bcnt;
-                if (dev->xmit_pos + cb <= MAX_FRAME) { /** @todo this used to be ... + cb < MAX_FRAME. */
-                    int off       = dev->xmit_pos;
-                    dev->xmit_pos = cb + off;
-                    dma_bm_read(PHYSADDR(dev, tmd.tmd0.tbadr), dev->abLoopBuf + off, cb, dev->transfer_size);
-                }
+                if (dev->xmit_pos + cb <= MAX_FRAME) /** @todo this used to be ... + cb < MAX_FRAME. */
+                    xmit_buf = pcnetXmitGather(dev, xmit_buf, PHYSADDR(dev, tmd.tmd0.tbadr), cb);
+                else
+                    xmit_drop = 1; /* Never send a frame with a chunk missing. */
 
                 /*
                  * Done already?
                  */
                 if (tmd.tmd1.enp) {
-                    if (fLoopback) {
-                        if (HOST_IS_OWNER(CSR_CRST(dev)))
-                            pcnetRdtePoll(dev);
-
-                        pcnet_log(3, "%s: pcnetAsyncTransmit: receive loopback enp\n", dev->name);
-                        pcnetReceiveNoSync(dev, dev->abLoopBuf, dev->xmit_pos);
+                    if (xmit_drop) {
+                        pcnet_log(1, "%s: pcnetAsyncTransmit: frame too big -> dropping\n", dev->name);
                     } else {
-                        pcnet_log(3, "%s: pcnetAsyncTransmit: transmit loopbuf enp\n", dev->name);
-                        network_tx(dev->netcard, dev->abLoopBuf, dev->xmit_pos);
+                        pcnet_log(3, "%s: pcnetAsyncTransmit: transmit enp\n", dev->name);
+                        pcnetXmitFrame(dev, xmit_buf, fLoopback);
                     }
 
                     /* Write back the TMD, pass it to the host */
@@ -642,6 +642,66 @@ net_crc32_le(const uint8_t *p, int len)
 }
 
 #define ETH_ALEN 6
+
+/* C+ receive checksum offload results, reported in the descriptor */
+#define CP_RX_PROTO_TCP  (1 << 16)
+#define CP_RX_PROTO_UDP  (2 << 16)
+#define CP_RX_PROTO_IP   (3 << 16)
+#define CP_RX_PROTO_MASK (3 << 16)
+/* IP checksum error flag */
+#define CP_RX_STATUS_IPF (1 << 15)
+/* UDP checksum error flag */
+#define CP_RX_STATUS_UDPF (1 << 14)
+/* TCP checksum error flag */
+#define CP_RX_STATUS_TCPF (1 << 13)
+
+/*
+ * Check the IPv4, TCP and UDP checksums of a received frame the way the
+ * C+ receiver does, so that the guest driver can skip doing it itself.
+ */
+static uint32_t
+rtl8139_rx_csum(const uint8_t *buf, int size)
+{
+    int      off = ETH_ALEN * 2;
+    uint32_t status;
+
+    if ((size >= (off + VLAN_HLEN)) && (buf[off] == 0x81) && (buf[off + 1] == 0x00))
+        off += VLAN_HLEN;
+    if ((size < (off + 2 + 20)) || (buf[off] != 0x08) || (buf[off + 1] != 0x00))
+        return 0;
+    off += 2;
+
+    const uint8_t *ip      = buf + off;
+    int            hlen    = (ip[0] & 0x0f) << 2;
+    int            tot_len = (ip[2] << 8) | ip[3];
+    if (((ip[0] >> 4) != 4) || (hlen < 20) || (tot_len < hlen) || ((off + tot_len) > size))
+        return 0;
+
+    status = CP_RX_PROTO_IP;
+    if (network_csum_fold(network_csum_add(ip, hlen, 0)) != 0xffff)
+        status |= CP_RX_STATUS_IPF;
+
+    /* Fragments can't be checked on their own. */
+    if (((ip[6] << 8) | ip[7]) & 0x3fff)
+        return status;
+
+    const uint8_t *l4     = ip + hlen;
+    int            l4_len = tot_len - hlen;
+    uint32_t       sum    = network_csum_add(ip + 12, 8, ip[9] + l4_len);
+    if ((ip[9] == 6) && (l4_len >= 20)) {
+        status = CP_RX_PROTO_TCP | (status & CP_RX_STATUS_IPF);
+        if (network_csum_fold(network_csum_add(l4, l4_len, sum)) != 0xffff)
+            status |= CP_RX_STATUS_TCPF;
+    } else if ((ip[9] == 17) && (l4_len >= 8)) {
+        status = CP_RX_PROTO_UDP | (status & CP_RX_STATUS_IPF);
+        /* A zero UDP checksum means the sender didn't compute one. */
+        if ((l4[6] || l4[7]) && (network_csum_fold(network_csum_add(l4, l4_len, sum)) != 0xffff))
+            status |= CP_RX_STATUS_UDPF;
+    }
+
+    return status;
+}
+
 static int
 rtl8139_do_receive(void *priv, uint8_t *buf, int size_)
 {
@@ -884,9 +944,9 @@ rtl8139_do_receive(void *priv, uint8_t *buf, int size_)
             dma_bm_write(rx_addr, buf, size, 1);
         }
 
-        if (s->CpCmd & CPlusRxChkSum) {
-            /* do some packet checksumming */
-        }
+        rxdw0 &= ~(CP_RX_PROTO_MASK | CP_RX_STATUS_IPF | CP_RX_STATUS_UDPF | CP_RX_STATUS_TCPF);
+        if (s->CpCmd & CPlusRxChkSum)
+            rxdw0 |= rtl8139_rx_csum(buf, size_);
 
         /* write checksum */
         val = (net_crc32_le(buf, size_));
@@ -906,12 +966,6 @@ rtl8139_do_receive(void *priv, uint8_t *buf, int size_)
 #define CP_RX_STATUS_RUNT (1 << 19)
 /* crc error flag */
 #define CP_RX_STATUS_CRC (1 << 18)
-/* IP checksum error flag */
-#define CP_RX_STATUS_IPF (1 << 15)
-/* UDP checksum error flag */
-#define CP_RX_STATUS_UDPF (1 << 14)
-/* TCP checksum error flag */
-#define CP_RX_STATUS_TCPF (1 << 13)
 
         /* transfer ownership to target */
         rxdw0 &= ~CP_RX_OWN;
@@ -1540,12 +1594,13 @@ rtl8139_RxConfig_read(RTL8139State *s)
 void
 rtl8139_network_rx_put(netcard_t *card, uint8_t *bufp, int len)
 {
-    (void) network_rx_put(card, bufp, len);
+    (void) network_loopback(card, bufp, len);
 }
 
 static void
 rtl8139_transfer_frame(RTL8139State *s, uint8_t *buf, int size,
-                       UNUSED(int do_interrupt), const uint8_t *dot1q_buf)
+                       UNUSED(int do_interrupt), const uint8_t *dot1q_buf,
+                       int csum_start, int csum_offset)
 {
     void (*network_func)(netcard_t *, uint8_t *, int) = (TxLoopBack == (s->TxConfig & TxLoopBack)) ? rtl8139_network_rx_put : network_tx;
     if (!size) {
@@ -1553,10 +1608,39 @@ rtl8139_transfer_frame(RTL8139State *s, uint8_t *buf, int size,
         return;
     }
 
+    /* A looped back frame never reaches a host that could finish the checksum. */
+    if (csum_start && (network_func != network_tx)) {
+        network_csum_finish(buf, size, csum_start, csum_offset);
+        csum_start = 0;
+    }
+
     if (dot1q_buf && size >= ETH_ALEN * 2) {
-        network_func(s->nic, buf, ETH_ALEN * 2);
-        network_func(s->nic, (uint8_t *) dot1q_buf, VLAN_HLEN);
-        network_func(s->nic, buf + ETH_ALEN * 2, size - ETH_ALEN * 2);
+        /* Insert the tag after the addresses, gathering one frame. */
+        netpkt_t pkt_vec[3] = {
+            { buf, ETH_ALEN * 2, csum_start ? (csum_start + VLAN_HLEN) : 0, csum_offset },
+            { (uint8_t *) dot1q_buf, VLAN_HLEN },
+            { buf + ETH_ALEN * 2, size - ETH_ALEN * 2 }
+        };
+
+        if (network_func == network_tx)
+            network_txv(s->nic, pkt_vec, 3);
+        else if ((size + VLAN_HLEN) <= NET_MAX_FRAME) {
+            uint8_t frame[NET_MAX_FRAME];
+            int     len = 0;
+
+            for (int i = 0; i < 3; i++) {
+                memcpy(frame + len, pkt_vec[i].data, pkt_vec[i].len);
+                len += pkt_vec[i].len;
+            }
+            network_func(s->nic, frame, len);
+        }
+        return;
+    }
+
+    if (csum_start) {
+        netpkt_t pkt = { buf, size, csum_start, csum_offset };
+
+        network_txv(s->nic, &pkt, 1);
         return;
     }
 
@@ -1587,13 +1671,21 @@ rtl8139_transmit_one(RTL8139State *s, int descriptor)
     rtl8139_log("+++ transmit reading %d bytes from host memory at 0x%08x\n",
                 txsize, s->TxAddr[descriptor]);
 
-    dma_bm_read(s->TxAddr[descriptor], txbuffer, txsize, 1);
+    /* Gather the frame straight into the TX queue when we can. */
+    uint8_t *slot = NULL;
+    if ((TxLoopBack != (s->TxConfig & TxLoopBack)) && txsize && (txsize <= NET_MAX_FRAME))
+        slot = network_tx_reserve(s->nic);
+
+    dma_bm_read(s->TxAddr[descriptor], slot ? slot : txbuffer, txsize, 1);
 
     /* Mark descriptor as transferred */
     s->TxStatus[descriptor] |= TxHostOwns;
     s->TxStatus[descriptor] |= TxStatOK;
 
-    rtl8139_transfer_frame(s, txbuffer, txsize, 0, NULL);
+    if (slot)
+        network_tx_commit(s->nic, txsize);
+    else
+        rtl8139_transfer_frame(s, txbuffer, txsize, 0, NULL, 0, 0);
 
     rtl8139_log("+++ transmitted %d bytes from descriptor %d\n", txsize,
                 descriptor);
@@ -1880,6 +1972,10 @@ rtl8139_cplus_transmit_one(RTL8139State *s)
         s->cplus_txbuffer_offset = 0;
         s->cplus_txbuffer_len    = 0;
 
+        /* TCP/UDP checksum left for the host backend, if it can take it */
+        int tx_csum_start  = 0;
+        int tx_csum_offset = 0;
+
         if (txdw0 & (CP_TX_IPCS | CP_TX_UDPCS | CP_TX_TCPCS | CP_TX_LGSEN)) {
             rtl8139_log("+++ C+ mode offloaded task checksum\n");
 
@@ -1961,15 +2057,9 @@ rtl8139_cplus_transmit_one(RTL8139State *s)
                 /* maximum IP header length is 60 bytes */
                 uint8_t saved_ip_header[60];
 
-                /* save IP header template; data area is used in tcp checksum calculation */
+                /* save IP header template */
                 memcpy(saved_ip_header, eth_payload_data, hlen);
 
-                /* a placeholder for checksum calculation routine in tcp case */
-                uint8_t *data_to_checksum = eth_payload_data + hlen - 12;
-#if 0
-                size_t   data_to_checksum_len = eth_payload_len  - hlen + 12;
-#endif
-
                 /* pointer to TCP header */
                 tcp_header *p_tcp_hdr = (tcp_header *) (eth_payload_data + hlen);
 
@@ -2004,13 +2094,6 @@ rtl8139_cplus_transmit_one(RTL8139State *s)
                                 ldl_be_p(&p_tcp_hdr->th_seq));
 #endif
 
-                    /* add 4 TCP pseudoheader fields */
-                    /* copy IP source and destination fields */
-                    memcpy(data_to_checksum, saved_ip_header + 12, 8);
-
-                    rtl8139_log("+++ C+ mode TSO calculating TCP checksum for "
-                                "packet with %d bytes data\n", tcp_hlen + chunk_size);
-
                     if (tcp_send_offset) {
                         memcpy((uint8_t *) p_tcp_hdr + tcp_hlen, (uint8_t *) p_tcp_hdr + tcp_hlen + tcp_send_offset, chunk_size);
                     }
@@ -2022,18 +2105,10 @@ rtl8139_cplus_transmit_one(RTL8139State *s)
                         TCP_HEADER_CLEAR_FLAGS(p_tcp_hdr, TH_PUSH | TH_FIN);
                     }
 
-                    /* recalculate TCP checksum */
-                    ip_pseudo_header *p_tcpip_hdr = (ip_pseudo_header *) data_to_checksum;
-                    p_tcpip_hdr->zeros            = 0;
-                    p_tcpip_hdr->ip_proto         = IP_PROTO_TCP;
-                    p_tcpip_hdr->ip_payload       = cpu_to_be16(tcp_hlen + chunk_size);
-
-                    p_tcp_hdr->th_sum = 0;
-
-                    int tcp_checksum = ip_checksum(data_to_checksum, tcp_hlen + chunk_size + 12);
-                    rtl8139_log("+++ C+ mode TSO TCP checksum %04x\n", tcp_checksum);
-
-                    p_tcp_hdr->th_sum = tcp_checksum;
+                    /* seed the TCP checksum with the pseudo-header, the rest is summed on the way out */
+                    uint16_t tcp_seed = network_csum_fold(network_csum_add(saved_ip_header + 12, 8,
+                                                                           IP_PROTO_TCP + tcp_hlen + chunk_size));
+                    p_tcp_hdr->th_sum = cpu_to_be16(tcp_seed);
 
                     /* restore IP header */
                     memcpy(eth_payload_data, saved_ip_header, hlen);
@@ -2053,7 +2128,8 @@ rtl8139_cplus_transmit_one(RTL8139State *s)
                     rtl8139_log("+++ C+ mode TSO transferring packet size %d\n",
                                 tso_send_size);
                     rtl8139_transfer_frame(s, saved_buffer, tso_send_size,
-                                           0, (uint8_t *) dot1q_buffer);
+                                           0, (uint8_t *) dot1q_buffer, ETH_HLEN + hlen,
+                                           __builtin_offsetof(tcp_header, th_sum));
 
                     /* add transferred count to TCP sequence number */
 #if 0
@@ -2068,57 +2144,32 @@ rtl8139_cplus_transmit_one(RTL8139State *s)
             } else if (!(txdw0 & CP_TX_LGSEN) && (txdw0 & (CP_TX_TCPCS | CP_TX_UDPCS))) {
                 rtl8139_log("+++ C+ mode need TCP or UDP checksum\n");
 
-                /* maximum IP header length is 60 bytes */
-                uint8_t saved_ip_header[60];
-                memcpy(saved_ip_header, eth_payload_data, hlen);
-
-                uint8_t *data_to_checksum = eth_payload_data + hlen - 12;
-#if 0
-                size_t   data_to_checksum_len = eth_payload_len  - hlen + 12;
-#endif
-
-                /* add 4 TCP pseudoheader fields */
-                /* copy IP source and destination fields */
-                memcpy(data_to_checksum, saved_ip_header + 12, 8);
-
-                if ((txdw0 & CP_TX_TCPCS) && ip_protocol == IP_PROTO_TCP) {
-                    rtl8139_log("+++ C+ mode calculating TCP checksum for "
-                                "packet with %d bytes data\n", ip_data_len);
-
-                    ip_pseudo_header *p_tcpip_hdr = (ip_pseudo_header *) data_to_checksum;
-                    p_tcpip_hdr->zeros            = 0;
-                    p_tcpip_hdr->ip_proto         = IP_PROTO_TCP;
-                    p_tcpip_hdr->ip_payload       = cpu_to_be16(ip_data_len);
-
-                    tcp_header *p_tcp_hdr = (tcp_header *) (data_to_checksum + 12);
-
-                    p_tcp_hdr->th_sum = 0;
-
-                    int tcp_checksum = ip_checksum(data_to_checksum, ip_data_len + 12);
-                    rtl8139_log("+++ C+ mode TCP checksum %04x\n", tcp_checksum);
-
-                    p_tcp_hdr->th_sum = tcp_checksum;
-                } else if ((txdw0 & CP_TX_UDPCS) && ip_protocol == IP_PROTO_UDP) {
-                    rtl8139_log("+++ C+ mode calculating UDP checksum for "
-                                "packet with %d bytes data\n", ip_data_len);
-
-                    ip_pseudo_header *p_udpip_hdr = (ip_pseudo_header *) data_to_checksum;
-                    p_udpip_hdr->zeros            = 0;
-                    p_udpip_hdr->ip_proto         = IP_PROTO_UDP;
-                    p_udpip_hdr->ip_payload       = cpu_to_be16(ip_data_len);
-
-                    udp_header *p_udp_hdr = (udp_header *) (data_to_checksum + 12);
-
-                    p_udp_hdr->uh_sum = 0;
-
-                    int udp_checksum = ip_checksum(data_to_checksum, ip_data_len + 12);
-                    rtl8139_log("+++ C+ mode UDP checksum %04x\n", udp_checksum);
-
-                    p_udp_hdr->uh_sum = udp_checksum;
+                int csum_offset = 0;
+                if ((txdw0 & CP_TX_TCPCS) && ip_protocol == IP_PROTO_TCP)
+                    csum_offset = __builtin_offsetof(tcp_header, th_sum);
+                else if ((txdw0 & CP_TX_UDPCS) && ip_protocol == IP_PROTO_UDP)
+                    csum_offset = __builtin_offsetof(udp_header, uh_sum);
+
+                if (csum_offset && (ip_data_len >= (csum_offset + 2))) {
+                    int csum_start = ETH_HLEN + hlen;
+                    int l4_end     = csum_start + ip_data_len;
+
+                    rtl8139_log("+++ C+ mode %s checksum for packet with %d bytes data\n",
+                                (ip_protocol == IP_PROTO_TCP) ? "TCP" : "UDP", ip_data_len);
+
+                    /* Seed the checksum with the pseudo-header. */
+                    uint16_t seed = network_csum_fold(network_csum_add(eth_payload_data + 12, 8,
+                                                                       ip_protocol + ip_data_len));
+                    saved_buffer[csum_start + csum_offset]     = seed >> 8;
+                    saved_buffer[csum_start + csum_offset + 1] = seed & 0xff;
+
+                    /* Padding after the IP datagram must stay out of the sum. */
+                    if (l4_end == saved_size) {
+                        tx_csum_start  = csum_start;
+                        tx_csum_offset = csum_offset;
+                    } else
+                        network_csum_finish(saved_buffer, l4_end, csum_start, csum_offset);
                 }
-
-                /* restore IP header */
-                memcpy(eth_payload_data, saved_ip_header, hlen);
             }
         }
 
@@ -2129,7 +2180,7 @@ skip_offload:
         rtl8139_log("+++ C+ mode transmitting %d bytes packet\n", saved_size);
 
         rtl8139_transfer_frame(s, saved_buffer, saved_size, 1,
-                               (uint8_t *) dot1q_buffer);
+                               (uint8_t *) dot1q_buffer, tx_csum_start, tx_csum_offset);
 
         /* restore card space if there was no recursion and reset offset */
         if (!s->cplus_txbuffer) {
@@ -17,6 +17,7 @@
  *          Copyright 2017-2019 Fred N. van Kempen.
  *          Copyright 2020 RichardG.
  */
+#include <errno.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -46,10 +47,16 @@
 #    include <ws2tcpip.h>
 #else
 #    include <poll.h>
+#    include <unistd.h>
+#    include <sys/socket.h>
+#    ifdef __linux__
+#        include <sys/epoll.h>
+#        define SLIRP_USE_EPOLL
+#    endif
 #endif
 #include <86box/net_event.h>
 
-#define SLIRP_PKT_BATCH NET_QUEUE_LEN
+#define SLIRP_PKT_BATCH NET_BATCH_LEN
 
 enum {
     NET_EVENT_STOP = 0,
@@ -58,6 +65,15 @@ enum {
     NET_EVENT_MAX
 };
 
+#ifdef SLIRP_USE_EPOLL
+typedef struct slirp_fd_t {
+    uint32_t iter;       /* fill round the fd was last added in */
+    int      idx;        /* its pollfd index in that round */
+    int      events;     /* events it is registered for */
+    int      registered;
+} slirp_fd_t;
+#endif
+
 typedef struct net_slirp_t {
     Slirp *        slirp;
     uint8_t        mac_addr[6];
@@ -66,10 +82,14 @@ typedef struct net_slirp_t {
     net_evt_t      rx_event;
     net_evt_t      tx_event;
     net_evt_t      stop_event;
-    netpkt_t       pkt;
     netpkt_t       pkt_tx_v[SLIRP_PKT_BATCH];
     int            during_tx;
     int            recv_on_tx;
+    int            during_poll;
+    netpkt_t       pkt_rx_v[SLIRP_PKT_BATCH]; /* RX slots filled while polling */
+    int            rx_slots;
+    int            rx_used;
+    int            sockbuf;                   /* host socket buffer size, 0 for the default */
 #ifdef _WIN32
     HANDLE         sock_event;
 #else
@@ -77,6 +97,17 @@ typedef struct net_slirp_t {
     uint32_t       pfd_size;
     struct pollfd *pfd;
 #endif
+#ifdef SLIRP_USE_EPOLL
+    int            epfd;
+    uint32_t       iter;     /* fill round, to spot fds libslirp stopped asking about */
+    slirp_fd_t    *fds;      /* indexed by fd */
+    int            fds_size;
+    int           *reg;      /* fds currently in the epoll set */
+    int            reg_len;
+    int            reg_size;
+    int            epoll_failed;      /* an fd of this round is missing from the set */
+    int            epoll_failed_last; /* same, for the previous round */
+#endif
 } net_slirp_t;
 
 /* Pulled off from libslirp code. This is only needed for modem. */
@@ -153,6 +184,26 @@ net_slirp_timer_mod(void *timer, int64_t expire_timer, UNUSED(void *opaque))
     timer_on_auto(timer, expire_timer * 1000);
 }
 
+#ifdef SLIRP_USE_EPOLL
+static void
+net_slirp_epoll_del(net_slirp_t *slirp, int fd)
+{
+    if ((fd < 0) || (fd >= slirp->fds_size) || !slirp->fds[fd].registered)
+        return;
+
+    epoll_ctl(slirp->epfd, EPOLL_CTL_DEL, fd, NULL);
+    slirp->fds[fd].registered = 0;
+
+    for (int i = 0; i < slirp->reg_len; i++) {
+        if (slirp->reg[i] == fd) {
+            slirp->reg[i] = slirp->reg[--slirp->reg_len];
+            break;
+        }
+    }
+}
+#endif
+
+/* libslirp tells us about every host socket it opens; size its buffers here. */
 static void
 #if SLIRP_CHECK_VERSION(4, 9, 0)
 net_slirp_register_poll_socket(slirp_os_socket fd, void *opaque)
@@ -160,8 +211,12 @@ net_slirp_register_poll_socket(slirp_os_socket fd, void *opaque)
 net_slirp_register_poll_fd(int fd, void *opaque)
 #endif
 {
-    (void) fd;
-    (void) opaque;
+    const net_slirp_t *slirp = (net_slirp_t *) opaque;
+
+    if (slirp->sockbuf > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char *) &slirp->sockbuf, sizeof(slirp->sockbuf));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (const char *) &slirp->sockbuf, sizeof(slirp->sockbuf));
+    }
 }
 
 static void
@@ -171,8 +226,13 @@ net_slirp_unregister_poll_socket(slirp_os_socket fd, void *opaque)
 net_slirp_unregister_poll_fd(int fd, void *opaque)
 #endif
 {
+#ifdef SLIRP_USE_EPOLL
+    /* The fd number may be reused right away, so forget it now. */
+    net_slirp_epoll_del((net_slirp_t *) opaque, fd);
+#else
     (void) fd;
     (void) opaque;
+#endif
 }
 
 static void
@@ -181,6 +241,14 @@ net_slirp_notify(void *opaque)
     (void) opaque;
 }
 
+static void
+net_slirp_rx_flush(net_slirp_t *slirp)
+{
+    network_rx_commit(slirp->card, slirp->pkt_rx_v, slirp->rx_used);
+    slirp->rx_used  = 0;
+    slirp->rx_slots = 0;
+}
+
 #if SLIRP_CHECK_VERSION(4, 8, 0)
 slirp_ssize_t
 #else
@@ -192,15 +260,25 @@ net_slirp_send_packet(const void *qp, size_t pkt_len, void *opaque)
 
     slirp_log("SLiRP: received %d-byte packet\n", pkt_len);
 
-    memcpy(slirp->pkt.data, (uint8_t *) qp, pkt_len);
-    slirp->pkt.len = pkt_len;
-
     if (!(net_cards_conf[slirp->card->card_num].link_state & NET_LINK_DOWN)) {
         if (slirp->during_tx) {
-            network_rx_on_tx_put_pkt(slirp->card, &slirp->pkt);
+            network_rx_on_tx_put(slirp->card, (uint8_t *) qp, pkt_len);
             slirp->recv_on_tx = 1;
+        } else if (slirp->during_poll) {
+            /* Collect what one poll round produces and queue it together. */
+            if (slirp->rx_used == slirp->rx_slots) {
+                net_slirp_rx_flush(slirp);
+                slirp->rx_slots = network_rx_reserve(slirp->card, slirp->pkt_rx_v, SLIRP_PKT_BATCH);
+            }
+            if ((slirp->rx_used < slirp->rx_slots) && (pkt_len <= NET_MAX_FRAME)) {
+                netpkt_t *pkt = &slirp->pkt_rx_v[slirp->rx_used++];
+
+                memcpy(pkt->data, qp, pkt_len);
+                pkt->len = pkt_len;
+            } else
+                network_rx_dropped(slirp->card, 1);
         } else
-            network_rx_put_pkt(slirp->card, &slirp->pkt);
+            network_rx_put(slirp->card, (uint8_t *) qp, pkt_len);
     }
 
     return pkt_len;
@@ -229,6 +307,98 @@ net_slirp_add_poll(int fd, int events, void *opaque)
     return fd;
 }
 #else
+#    ifdef SLIRP_USE_EPOLL
+/*
+ * Keep the epoll set in step with what libslirp asks for in this round;
+ * only fds that are new or want different events cost a syscall. The
+ * POLL* and EPOLL* event bits are the same on Linux.
+ */
+static void
+net_slirp_epoll_fail(net_slirp_t *slirp, int fd, const char *what)
+{
+    /* Only report the start of a run of failed rounds. */
+    if (!slirp->epoll_failed && !slirp->epoll_failed_last)
+        pclog("SLiRP: unable to %s fd %d for epoll (%s), falling back to poll()\n", what, fd, strerror(errno));
+
+    slirp->epoll_failed = 1;
+}
+
+static void
+net_slirp_epoll_add(net_slirp_t *slirp, int fd, int idx, int events)
+{
+    if (fd >= slirp->fds_size) {
+        int         size = MAX(fd + 1, slirp->fds_size * 2);
+        slirp_fd_t *fds  = realloc(slirp->fds, size * sizeof(slirp_fd_t));
+        if (!fds) {
+            net_slirp_epoll_fail(slirp, fd, "track");
+            return;
+        }
+        memset(&fds[slirp->fds_size], 0, (size - slirp->fds_size) * sizeof(slirp_fd_t));
+        slirp->fds      = fds;
+        slirp->fds_size = size;
+    }
+
+    slirp_fd_t *sfd = &slirp->fds[fd];
+    sfd->iter       = slirp->iter;
+    sfd->idx        = idx;
+
+    if (sfd->registered && (sfd->events == events))
+        return;
+
+    struct epoll_event ev = { .events = events, .data.fd = fd };
+    if (sfd->registered) {
+        if (epoll_ctl(slirp->epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+            net_slirp_epoll_fail(slirp, fd, "modify");
+            return;
+        }
+    } else {
+        if (slirp->reg_len >= slirp->reg_size) {
+            int  size = slirp->reg_size ? (slirp->reg_size * 2) : 64;
+            int *reg  = realloc(slirp->reg, size * sizeof(int));
+            if (!reg) {
+                net_slirp_epoll_fail(slirp, fd, "track");
+                return;
+            }
+            slirp->reg      = reg;
+            slirp->reg_size = size;
+        }
+        if (epoll_ctl(slirp->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            net_slirp_epoll_fail(slirp, fd, "add");
+            return;
+        }
+        slirp->reg[slirp->reg_len++] = fd;
+        sfd->registered              = 1;
+    }
+    sfd->events = events;
+}
+
+static int
+net_slirp_epoll_wait(net_slirp_t *slirp, int timeout)
+{
+    struct epoll_event ev[SLIRP_PKT_BATCH];
+    int                ret;
+
+    /* Drop whatever libslirp no longer wants to hear about. */
+    for (int i = slirp->reg_len - 1; i >= 0; i--) {
+        int fd = slirp->reg[i];
+        if (slirp->fds[fd].iter != slirp->iter)
+            net_slirp_epoll_del(slirp, fd);
+    }
+
+    for (uint32_t i = 0; i < slirp->pfd_len; i++)
+        slirp->pfd[i].revents = 0;
+
+    ret = epoll_wait(slirp->epfd, ev, SLIRP_PKT_BATCH, timeout);
+    for (int i = 0; i < ret; i++) {
+        const slirp_fd_t *sfd = &slirp->fds[ev[i].data.fd];
+        if (sfd->iter == slirp->iter)
+            slirp->pfd[sfd->idx].revents = ev[i].events & 0xffff;
+    }
+
+    return ret;
+}
+#    endif
+
 static int
 #    if SLIRP_CHECK_VERSION(4, 9, 0)
 net_slirp_add_poll(slirp_os_socket fd, int events, void *opaque)
@@ -261,6 +431,9 @@ net_slirp_add_poll(int fd, int events, void *opaque)
         if (events & SLIRP_POLL_HUP)
             pevents |= POLLHUP;
         slirp->pfd[idx].events = pevents;
+#    ifdef SLIRP_USE_EPOLL
+        net_slirp_epoll_add(slirp, fd, idx, pevents);
+#    endif
         return idx;
     } else
         return -1;
@@ -358,21 +531,32 @@ net_slirp_in_available(void *priv)
     net_event_set(&slirp->tx_event);
 }
 
+/* Move replies generated while transmitting to the RX queue, a batch at a time. */
 static void
 net_slirp_rx_deferred_packets(net_slirp_t *slirp)
 {
-    int packets = 0;
-
-    if (slirp->recv_on_tx) {
-        do {
-            packets = network_rx_on_tx_popv(slirp->card, slirp->pkt_tx_v, SLIRP_PKT_BATCH);
-            if (!(net_cards_conf[slirp->card->card_num].link_state & NET_LINK_DOWN)) {
-                for (int i = 0; i < packets; i++)
-                     network_rx_put_pkt(slirp->card, &(slirp->pkt_tx_v[i]));
+    netpkt_t rx_vec[SLIRP_PKT_BATCH];
+    int      packets;
+
+    if (!slirp->recv_on_tx)
+        return;
+
+    while ((packets = network_rx_on_tx_peekv(slirp->card, slirp->pkt_tx_v, SLIRP_PKT_BATCH)) > 0) {
+        int slots = 0;
+
+        if (!(net_cards_conf[slirp->card->card_num].link_state & NET_LINK_DOWN)) {
+            slots = network_rx_reserve(slirp->card, rx_vec, packets);
+            for (int i = 0; i < slots; i++) {
+                memcpy(rx_vec[i].data, slirp->pkt_tx_v[i].data, slirp->pkt_tx_v[i].len);
+                rx_vec[i].len = slirp->pkt_tx_v[i].len;
             }
-        } while (packets > 0);
-        slirp->recv_on_tx = 0;
+            network_rx_commit(slirp->card, rx_vec, slots);
+            if (slots < packets)
+                network_rx_dropped(slirp->card, packets - slots);
+        }
+        network_rx_on_tx_release(slirp->card, packets);
     }
+    slirp->recv_on_tx = 0;
 }
 
 #ifdef _WIN32
@@ -400,6 +584,7 @@ net_slirp_thread(void *priv)
             timeout = INFINITE;
 
         int ret = WaitForMultipleObjects(3, events, FALSE, (DWORD) timeout);
+        network_count_syscalls(slirp->card, 1);
         switch (ret - WAIT_OBJECT_0) {
             case NET_EVENT_STOP:
                 run = false;
@@ -408,10 +593,13 @@ net_slirp_thread(void *priv)
             case NET_EVENT_TX:
                 {
                     slirp->during_tx = 1;
-                    int packets = network_tx_popv(slirp->card, slirp->pkt_tx_v, SLIRP_PKT_BATCH);
-                    if (!(net_cards_conf[slirp->card->card_num].link_state & NET_LINK_DOWN)) {
-                        for (int i = 0; i < packets; i++)
-                            net_slirp_in(slirp, slirp->pkt_tx_v[i].data, slirp->pkt_tx_v[i].len);
+                    int packets;
+                    while ((packets = network_tx_peekv(slirp->card, slirp->pkt_tx_v, SLIRP_PKT_BATCH)) > 0) {
+                        if (!(net_cards_conf[slirp->card->card_num].link_state & NET_LINK_DOWN)) {
+                            for (int i = 0; i < packets; i++)
+                                net_slirp_in(slirp, slirp->pkt_tx_v[i].data, slirp->pkt_tx_v[i].len);
+                        }
+                        network_tx_release(slirp->card, packets);
                     }
                     slirp->during_tx = 0;
 
@@ -420,7 +608,10 @@ net_slirp_thread(void *priv)
                 break;
 
             default:
+                slirp->during_poll = 1;
                 slirp_pollfds_poll(slirp->slirp, ret == WAIT_FAILED, net_slirp_get_revents, slirp);
+                slirp->during_poll = 0;
+                net_slirp_rx_flush(slirp);
                 break;
         }
     }
@@ -441,6 +632,10 @@ net_slirp_thread(void *priv)
         uint32_t timeout = -1;
 
         slirp->pfd_len = 0;
+#    ifdef SLIRP_USE_EPOLL
+        slirp->epoll_failed_last = slirp->epoll_failed;
+        slirp->epoll_failed      = 0;
+#    endif
         net_slirp_add_poll(net_event_get_fd(&slirp->stop_event), SLIRP_POLL_IN, slirp);
         net_slirp_add_poll(net_event_get_fd(&slirp->tx_event), SLIRP_POLL_IN, slirp);
 
@@ -450,9 +645,23 @@ net_slirp_thread(void *priv)
         slirp_pollfds_fill(slirp->slirp, &timeout, net_slirp_add_poll, slirp);
 #    endif
 
+#    ifdef SLIRP_USE_EPOLL
+        int ret;
+        if (slirp->epoll_failed) {
+            /* The epoll set is incomplete, poll everything this round. */
+            ret = poll(slirp->pfd, slirp->pfd_len, timeout);
+        } else
+            ret = net_slirp_epoll_wait(slirp, (int) timeout);
+        slirp->iter++;
+#    else
         int ret = poll(slirp->pfd, slirp->pfd_len, timeout);
+#    endif
+        network_count_syscalls(slirp->card, 1);
 
+        slirp->during_poll = 1;
         slirp_pollfds_poll(slirp->slirp, (ret < 0), net_slirp_get_revents, slirp);
+        slirp->during_poll = 0;
+        net_slirp_rx_flush(slirp);
 
         if (slirp->pfd[NET_EVENT_STOP].revents & POLLIN) {
             net_event_clear(&slirp->stop_event);
@@ -463,10 +672,13 @@ net_slirp_thread(void *priv)
             net_event_clear(&slirp->tx_event);
 
             slirp->during_tx = 1;
-            int packets = network_tx_popv(slirp->card, slirp->pkt_tx_v, SLIRP_PKT_BATCH);
-            if (!(net_cards_conf[slirp->card->card_num].link_state & NET_LINK_DOWN)) {
-                for (int i = 0; i < packets; i++)
-                    net_slirp_in(slirp, slirp->pkt_tx_v[i].data, slirp->pkt_tx_v[i].len);
+            int packets;
+            while ((packets = network_tx_peekv(slirp->card, slirp->pkt_tx_v, SLIRP_PKT_BATCH)) > 0) {
+                if (!(net_cards_conf[slirp->card->card_num].link_state & NET_LINK_DOWN)) {
+                    for (int i = 0; i < packets; i++)
+                        net_slirp_in(slirp, slirp->pkt_tx_v[i].data, slirp->pkt_tx_v[i].len);
+                }
+                network_tx_release(slirp->card, packets);
             }
             slirp->during_tx = 0;
 
@@ -489,10 +701,21 @@ net_slirp_init(const netcard_t *card, const uint8_t *mac_addr, UNUSED(void *priv
     memcpy(slirp->mac_addr, mac_addr, sizeof(slirp->mac_addr));
     slirp->card = (netcard_t *) card;
 
+    slirp->sockbuf = MIN(net_cards_conf[card->card_num].slirp_sockbuf, NET_SLIRP_SOCKBUF_MAX) * 1024;
+
 #ifndef _WIN32
     slirp->pfd_size = 16 * sizeof(struct pollfd);
     slirp->pfd      = calloc(1, slirp->pfd_size);
 #endif
+#ifdef SLIRP_USE_EPOLL
+    slirp->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (slirp->epfd < 0) {
+        snprintf(netdrv_errbuf, NET_DRV_ERRBUF_SIZE, "SLiRP could not create an epoll instance");
+        free(slirp->pfd);
+        free(slirp);
+        return NULL;
+    }
+#endif
 
     struct in_addr net;
     struct in_addr host;
@@ -562,6 +785,12 @@ net_slirp_init(const netcard_t *card, const uint8_t *mac_addr, UNUSED(void *priv
     if (!slirp->slirp) {
         slirp_log("SLiRP: initialization failed\n");
         snprintf(netdrv_errbuf, NET_DRV_ERRBUF_SIZE, "SLiRP initialization failed");
+#ifdef SLIRP_USE_EPOLL
+        close(slirp->epfd);
+#endif
+#ifndef _WIN32
+        free(slirp->pfd);
+#endif
         free(slirp);
         return NULL;
     }
@@ -596,10 +825,6 @@ net_slirp_init(const netcard_t *card, const uint8_t *mac_addr, UNUSED(void *priv
         i++;
     }
 
-    for (int i = 0; i < SLIRP_PKT_BATCH; i++) {
-        slirp->pkt_tx_v[i].data = calloc(1, NET_MAX_FRAME);
-    }
-    slirp->pkt.data = calloc(1, NET_MAX_FRAME);
     net_event_init(&slirp->rx_event);
     net_event_init(&slirp->tx_event);
     net_event_init(&slirp->stop_event);
@@ -659,10 +884,15 @@ net_slirp_close(void *priv)
     net_event_close(&slirp->tx_event);
     net_event_close(&slirp->rx_event);
     slirp_cleanup(slirp->slirp);
-    for (int i = 0; i < SLIRP_PKT_BATCH; i++) {
-        free(slirp->pkt_tx_v[i].data);
-    }
-    free(slirp->pkt.data);
+
+#ifdef SLIRP_USE_EPOLL
+    close(slirp->epfd);
+    free(slirp->fds);
+    free(slirp->reg);
+#endif
+#ifndef _WIN32
+    free(slirp->pfd);
+#endif
     free(slirp);
 }
 
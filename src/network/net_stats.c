@@ -0,0 +1,157 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Per-card network statistics.
+ *
+ *          The counters are updated from the frame paths in network.c
+ *          and by the host backends, and read back as JSON so that an
+ *          external tool can tell which machines are network-bound.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/timer.h>
+#include <86box/network.h>
+#include <86box/net_stats.h>
+#include <cJSON.h>
+
+netstats_t net_stats[NET_CARD_MAX];
+
+/*
+ * Counter values at the last reset. The counters themselves are only
+ * ever written by their one writer, which would put back its old value
+ * over a reset done from another thread; instead the readers subtract
+ * this snapshot.
+ */
+static netstats_t net_stats_base[NET_CARD_MAX];
+
+static const char *net_stats_types[] = {
+    "none", "slirp", "pcap", "vde", "tap", "nlswitch", "nrswitch"
+};
+
+static void
+net_stats_clear(int card_num)
+{
+    netstat_t *stat = (netstat_t *) &net_stats[card_num];
+    netstat_t *base = (netstat_t *) &net_stats_base[card_num];
+
+    for (size_t i = 0; i < (sizeof(netstats_t) / sizeof(netstat_t)); i++)
+        atomic_store_explicit(&base[i], atomic_load_explicit(&stat[i], memory_order_relaxed), memory_order_relaxed);
+
+    /*
+       A maximum can't be subtracted. Zeroing it is safe, the writer only
+       ever stores a fresh sample into it, never a stale running value.
+     */
+    atomic_store_explicit(&net_stats[card_num].rx_latency_max, 0, memory_order_relaxed);
+    atomic_store_explicit(&net_stats_base[card_num].rx_latency_max, 0, memory_order_relaxed);
+}
+
+/* Reset one card's counters, or all of them for a negative card_num. */
+void
+net_stats_reset(int card_num)
+{
+    for (int i = 0; i < NET_CARD_MAX; i++) {
+        if ((card_num < 0) || (card_num == i))
+            net_stats_clear(i);
+    }
+}
+
+/* Returns a counter of net_stats[] relative to its value at the last reset. */
+static double
+net_stats_get(netstat_t *stat)
+{
+    const netstat_t *base = (netstat_t *) ((uint8_t *) net_stats_base + ((uint8_t *) stat - (uint8_t *) net_stats));
+
+    return (double) (atomic_load_explicit(stat, memory_order_relaxed) - atomic_load_explicit(base, memory_order_relaxed));
+}
+
+static void
+net_stats_add_hist(cJSON *obj, const char *name, netstat_t *hist)
+{
+    cJSON *array = cJSON_AddArrayToObject(obj, name);
+
+    for (int i = 0; i < NET_STATS_BUCKETS; i++)
+        cJSON_AddItemToArray(array, cJSON_CreateNumber(net_stats_get(&hist[i])));
+}
+
+static cJSON *
+net_stats_card(int card_num)
+{
+    netstats_t *stats    = &net_stats[card_num];
+    int         net_type = net_cards_conf[card_num].net_type;
+    cJSON      *card     = cJSON_CreateObject();
+    cJSON      *dir;
+    cJSON      *lat;
+    double      frames;
+
+    cJSON_AddNumberToObject(card, "card", card_num);
+    cJSON_AddStringToObject(card, "device", network_card_get_internal_name(net_cards_conf[card_num].device_num));
+    if ((net_type >= 0) && (net_type < (int) (sizeof(net_stats_types) / sizeof(net_stats_types[0]))))
+        cJSON_AddStringToObject(card, "backend", net_stats_types[net_type]);
+    cJSON_AddBoolToObject(card, "link", !(net_cards_conf[card_num].link_state & (NET_LINK_DOWN | NET_LINK_TEMP_DOWN)));
+
+    dir = cJSON_AddObjectToObject(card, "rx");
+    cJSON_AddNumberToObject(dir, "frames", net_stats_get(&stats->rx_frames));
+    cJSON_AddNumberToObject(dir, "bytes", net_stats_get(&stats->rx_bytes));
+    cJSON_AddNumberToObject(dir, "dropped", net_stats_get(&stats->rx_dropped));
+    cJSON_AddNumberToObject(dir, "refused", net_stats_get(&stats->rx_refused));
+    net_stats_add_hist(dir, "queue_depth", stats->rx_depth);
+
+    dir = cJSON_AddObjectToObject(card, "tx");
+    cJSON_AddNumberToObject(dir, "frames", net_stats_get(&stats->tx_frames));
+    cJSON_AddNumberToObject(dir, "bytes", net_stats_get(&stats->tx_bytes));
+    cJSON_AddNumberToObject(dir, "dropped", net_stats_get(&stats->tx_dropped));
+    net_stats_add_hist(dir, "queue_depth", stats->tx_depth);
+
+    cJSON_AddNumberToObject(card, "syscalls", net_stats_get(&stats->syscalls));
+
+    /* Loopback frames are not timed, so count the histogram instead of rx_frames. */
+    frames = 0.0;
+    for (int i = 0; i < NET_STATS_BUCKETS; i++)
+        frames += net_stats_get(&stats->rx_latency[i]);
+    lat = cJSON_AddObjectToObject(card, "rx_latency_us");
+    cJSON_AddNumberToObject(lat, "mean", frames ? (net_stats_get(&stats->rx_latency_sum) / frames) : 0.0);
+    cJSON_AddNumberToObject(lat, "max", net_stats_get(&stats->rx_latency_max));
+    net_stats_add_hist(lat, "histogram", stats->rx_latency);
+
+    return card;
+}
+
+/*
+ * Render the counters of one card, or of every configured card for a
+ * negative card_num, as a single line of JSON. The caller frees it.
+ */
+char *
+net_stats_json(int card_num)
+{
+    cJSON *root  = cJSON_CreateObject();
+    cJSON *cards = cJSON_AddArrayToObject(root, "cards");
+    char  *json;
+
+    cJSON_AddStringToObject(root, "histogram", "log2");
+    for (int i = 0; i < NET_CARD_MAX; i++) {
+        if ((card_num >= 0) ? (card_num == i) : network_dev_available(i))
+            cJSON_AddItemToArray(cards, net_stats_card(i));
+    }
+
+    json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    return json;
+}
@@ -12,6 +12,9 @@
  *
  *          Copyright 2026 RichardG.
  */
+#ifdef __linux__
+#    define _GNU_SOURCE /* recvmmsg/sendmmsg */
+#endif
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -36,6 +39,7 @@
 #    include <arpa/inet.h>
 #    include <ifaddrs.h>
 #    include <net/if.h>
+#    include <sys/uio.h>
 #endif
 #define HAVE_STDARG_H
 #include <86box/86box.h>
@@ -51,7 +55,12 @@
 #include <86box/bswap.h>
 #include <shathree.h>
 
-#define SWITCH_PKT_BATCH NET_QUEUE_LEN
+#define SWITCH_PKT_BATCH NET_BATCH_LEN
+
+/* Linux can move a whole batch of datagrams per system call. */
+#ifdef __linux__
+#    define SWITCH_USE_MMSG
+#endif
 
 #define SWITCH_MULTICAST_GROUP 0xefff5056 /* 239.255.80.86 */
 #define SWITCH_MULTICAST_PORT  8086
@@ -99,6 +108,11 @@ typedef struct net_switch_t {
 #ifdef _WIN32
     HANDLE         sock_event;
 #endif
+#ifdef SWITCH_USE_MMSG
+    struct mmsghdr msgs[SWITCH_PKT_BATCH];
+    struct iovec   iovs[SWITCH_PKT_BATCH][2];
+    uint8_t        hash_rx[SWITCH_PKT_BATCH][32];
+#endif
 } net_switch_t;
 
 #ifdef ENABLE_SWITCH_LOG
@@ -333,6 +347,201 @@ retry:
     }
 }
 
+#define MAC_FORMAT "(%02X:%02X:%02X:%02X:%02X:%02X -> %02X:%02X:%02X:%02X:%02X:%02X)"
+#define MAC_FORMAT_ARGS(p) (p)[6], (p)[7], (p)[8], (p)[9], (p)[10], (p)[11], (p)[0], (p)[1], (p)[2], (p)[3], (p)[4], (p)[5]
+
+/* Send a batch of frames through all known host interfaces. */
+static void
+net_switch_send(net_switch_t *netswitch, netpkt_t *pkt_vec, int packets)
+{
+    for (int i = 0; i < packets; i++)
+        netswitch_log("Network Switch: sending %d-byte packet " MAC_FORMAT "\n",
+                      pkt_vec[i].len, MAC_FORMAT_ARGS(pkt_vec[i].data));
+
+#ifdef SWITCH_USE_MMSG
+    /* The secret hash goes out as a separate iovec, so frames are sent straight from the queue. */
+    int iovlen = netswitch->secret_enabled ? 2 : 1;
+    for (int i = 0; i < packets; i++) {
+        struct iovec *iov = netswitch->iovs[i];
+        if (netswitch->secret_enabled) {
+            iov->iov_base = netswitch->secret_hash;
+            iov->iov_len  = sizeof(netswitch->secret_hash);
+            iov++;
+        }
+        iov->iov_base = pkt_vec[i].data;
+        iov->iov_len  = pkt_vec[i].len;
+
+        memset(&netswitch->msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+        netswitch->msgs[i].msg_hdr.msg_iov    = netswitch->iovs[i];
+        netswitch->msgs[i].msg_hdr.msg_iovlen = iovlen;
+    }
+
+    for (net_switch_hostaddr_t *hostaddr = netswitch->hostaddrs; hostaddr; hostaddr = hostaddr->next) {
+        for (int i = 0; i < packets; i++) {
+            netswitch->msgs[i].msg_hdr.msg_name    = &hostaddr->addr_tx.sa;
+            netswitch->msgs[i].msg_hdr.msg_namelen = sizeof(hostaddr->addr_tx.sin);
+        }
+
+        int sent = 0;
+        while (sent < packets) {
+            int ret = sendmmsg(hostaddr->socket_tx, &netswitch->msgs[sent], packets - sent, 0);
+            network_count_syscalls(netswitch->card, 1);
+            if (ret <= 0) {
+                netswitch_log("Network Switch: sendmmsg error (%d)\n", ret);
+                break;
+            }
+            sent += ret;
+        }
+    }
+#else
+    for (int i = 0; i < packets; i++) {
+        int orig_len = pkt_vec[i].len;
+        int send_len = orig_len;
+        uint8_t augmented[sizeof(netswitch->secret_hash) + NET_MAX_FRAME];
+        if (netswitch->secret_enabled) {
+            send_len = orig_len + sizeof(netswitch->secret_hash);
+
+            /* Build header with secret hash */
+            uint8_t *hdr = augmented;
+            memcpy(hdr, netswitch->secret_hash, sizeof(netswitch->secret_hash));
+            memcpy(augmented + sizeof(netswitch->secret_hash),
+                   pkt_vec[i].data, orig_len);
+        }
+
+        /* Send through all known host interfaces. */
+        for (net_switch_hostaddr_t *hostaddr = netswitch->hostaddrs; hostaddr; hostaddr = hostaddr->next) {
+            if (netswitch->secret_enabled)
+                sendto(hostaddr->socket_tx, (char *) augmented, send_len, 0,
+                       &hostaddr->addr_tx.sa, sizeof(hostaddr->addr_tx.sa));
+            else
+                sendto(hostaddr->socket_tx, (char *) pkt_vec[i].data,
+                       send_len, 0, &hostaddr->addr_tx.sa, sizeof(hostaddr->addr_tx.sa));
+            network_count_syscalls(netswitch->card, 1);
+        }
+    }
+#endif
+}
+
+/* Decide whether a received frame (secret hash already stripped) is for us. */
+static int
+net_switch_rx_accept(net_switch_t *netswitch, uint8_t *data, int len)
+{
+    if ((AS_U64(data[6]) & le64_to_cpu(0xffffffffffffULL)) == netswitch->mac_addr_u64) {
+        /* A packet we've sent has looped back, drop it. */
+        return 0;
+    } else if (!(net_cards_conf[netswitch->card->card_num].link_state & NET_LINK_DOWN) && (netswitch->promisc || /* promiscuous mode? */
+               (data[0] & 1) || /* broadcast packet? */
+               ((AS_U64(data[0]) & le64_to_cpu(0xffffffffffffULL)) == netswitch->mac_addr_u64))) { /* packet for me? */
+        netswitch_log("Network Switch: receiving %d-byte packet " MAC_FORMAT "\n",
+                      len, MAC_FORMAT_ARGS(data));
+        return 1;
+    }
+
+    netswitch_log("Network Switch: dropping %d-byte packet " MAC_FORMAT "\n",
+                  len, MAC_FORMAT_ARGS(data));
+    return 0;
+}
+
+/* Receive a single datagram into pkt, returning the frame length or 0 to drop it. */
+static int
+net_switch_recv_one(net_switch_t *netswitch)
+{
+    ssize_t len;
+
+    network_count_syscalls(netswitch->card, 1);
+    if (netswitch->secret_enabled) {
+        len = recv(netswitch->socket_rx, (char *) netswitch->pkt.data, NET_MAX_FRAME + sizeof(netswitch->secret_hash), 0);
+        if (len < (ssize_t) (sizeof(netswitch->secret_hash) + 12)) {
+            netswitch_log("Network Switch: recv error (%d)\n", (int) len);
+            return 0;
+        }
+
+        if (memcmp(netswitch->pkt.data, netswitch->secret_hash, sizeof(netswitch->secret_hash)) != 0) {
+            /* This packet contains a different secret hash, ignore it. */
+            return 0;
+        }
+
+        len -= sizeof(netswitch->secret_hash);
+        memmove(netswitch->pkt.data, netswitch->pkt.data + sizeof(netswitch->secret_hash), len);
+    } else {
+        len = recv(netswitch->socket_rx, (char *) netswitch->pkt.data, NET_MAX_FRAME, 0);
+        if (len < 12) {
+            netswitch_log("Network Switch: recv error (%d)\n", (int) len);
+            return 0;
+        }
+    }
+
+    if (!net_switch_rx_accept(netswitch, netswitch->pkt.data, len))
+        return 0;
+
+    netswitch->pkt.len = len;
+    return len;
+}
+
+#ifdef SWITCH_USE_MMSG
+/*
+ * Receive every pending datagram, up to a batch, straight into the card's
+ * RX queue. Rejected frames are committed empty so the batch stays in order.
+ */
+static void
+net_switch_recv_batch(net_switch_t *netswitch)
+{
+    netpkt_t pkt_vec[SWITCH_PKT_BATCH];
+    int      slots = network_rx_reserve(netswitch->card, pkt_vec, SWITCH_PKT_BATCH);
+
+    if (!slots) {
+        /* Queue full; still take one datagram off the socket. */
+        if (net_switch_recv_one(netswitch))
+            network_rx_dropped(netswitch->card, 1);
+        return;
+    }
+
+    int iovlen = netswitch->secret_enabled ? 2 : 1;
+    for (int i = 0; i < slots; i++) {
+        struct iovec *iov = netswitch->iovs[i];
+        if (netswitch->secret_enabled) {
+            iov->iov_base = netswitch->hash_rx[i];
+            iov->iov_len  = sizeof(netswitch->secret_hash);
+            iov++;
+        }
+        iov->iov_base = pkt_vec[i].data;
+        iov->iov_len  = NET_MAX_FRAME;
+
+        memset(&netswitch->msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+        netswitch->msgs[i].msg_hdr.msg_iov    = netswitch->iovs[i];
+        netswitch->msgs[i].msg_hdr.msg_iovlen = iovlen;
+    }
+
+    int received = recvmmsg(netswitch->socket_rx, netswitch->msgs, slots, MSG_DONTWAIT, NULL);
+    network_count_syscalls(netswitch->card, 1);
+    if (received <= 0) {
+        netswitch_log("Network Switch: recvmmsg error (%d)\n", received);
+        return;
+    }
+
+    for (int i = 0; i < received; i++) {
+        int len = netswitch->msgs[i].msg_len;
+
+        if (netswitch->secret_enabled) {
+            if ((len < (int) (sizeof(netswitch->secret_hash) + 12)) ||
+                (memcmp(netswitch->hash_rx[i], netswitch->secret_hash, sizeof(netswitch->secret_hash)) != 0)) {
+                /* Runt, or a packet with a different secret hash; ignore it. */
+                pkt_vec[i].len = 0;
+                continue;
+            }
+            len -= sizeof(netswitch->secret_hash);
+        } else if (len < 12) {
+            pkt_vec[i].len = 0;
+            continue;
+        }
+
+        pkt_vec[i].len = net_switch_rx_accept(netswitch, pkt_vec[i].data, len) ? len : 0;
+    }
+
+    network_rx_commit(netswitch->card, pkt_vec, received);
+}
+#endif
+
 static void
 net_switch_thread(void *priv)
 {
@@ -361,17 +570,18 @@ net_switch_thread(void *priv)
 #endif
 
     int packets;
-    ssize_t len;
 #ifdef _WIN32
     uint8_t run = 1;
     while (run) {
         int ret = WaitForMultipleObjects(NET_EVENT_MAX, events, FALSE, INFINITE);
+        network_count_syscalls(netswitch->card, 1);
         switch (ret - WAIT_OBJECT_0) {
             case NET_EVENT_STOP:
                 run = 0;
 #else
     while (1) {
         poll(pfd, NET_EVENT_MAX, -1);
+        network_count_syscalls(netswitch->card, 1);
         if (pfd[NET_EVENT_STOP].revents & POLLIN) {
 #endif
             net_event_clear(&netswitch->stop_event);
@@ -385,47 +595,21 @@ net_switch_thread(void *priv)
 #endif
             net_event_clear(&netswitch->tx_event);
             netswitch->during_tx = 1;
-            packets = network_tx_popv(netswitch->card, netswitch->pkt_tx_v, SWITCH_PKT_BATCH);
-            if (!(net_cards_conf[netswitch->card->card_num].link_state & NET_LINK_DOWN)) {
-                for (int i = 0; i < packets; i++) {
-                    int orig_len = netswitch->pkt_tx_v[i].len;
-                    int send_len = orig_len;
-                    uint8_t augmented[sizeof(netswitch->secret_hash) + NET_MAX_FRAME];
-                    if (netswitch->secret_enabled) {
-                        send_len = orig_len + sizeof(netswitch->secret_hash);
-
-                        /* Build header with secret hash */
-                        uint8_t *hdr = augmented;
-                        memcpy(hdr, netswitch->secret_hash, sizeof(netswitch->secret_hash));
-                        memcpy(augmented + sizeof(netswitch->secret_hash),
-                               netswitch->pkt_tx_v[i].data, orig_len);
-                    }
-
-#define MAC_FORMAT "(%02X:%02X:%02X:%02X:%02X:%02X -> %02X:%02X:%02X:%02X:%02X:%02X)"
-#define MAC_FORMAT_ARGS(p) (p)[6], (p)[7], (p)[8], (p)[9], (p)[10], (p)[11], (p)[0], (p)[1], (p)[2], (p)[3], (p)[4], (p)[5]
-                    netswitch_log("Network Switch: sending %d-byte packet " MAC_FORMAT "\n",
-                                  netswitch->pkt_tx_v[i].len,
-                                  MAC_FORMAT_ARGS(&netswitch->pkt_tx_v[i].data[netswitch->secret_enabled]));
-
-                    /* Send through all known host interfaces. */
-                    for (net_switch_hostaddr_t *hostaddr = netswitch->hostaddrs; hostaddr; hostaddr = hostaddr->next)
-                        if (netswitch->secret_enabled)
-                            sendto(hostaddr->socket_tx, (char *) augmented, send_len, 0,
-                                   &hostaddr->addr_tx.sa, sizeof(hostaddr->addr_tx.sa));
-                        else
-                            sendto(hostaddr->socket_tx, (char *) netswitch->pkt_tx_v[i].data,
-                                   send_len, 0, &hostaddr->addr_tx.sa, sizeof(hostaddr->addr_tx.sa));
-                }
+            while ((packets = network_tx_peekv(netswitch->card, netswitch->pkt_tx_v, SWITCH_PKT_BATCH)) > 0) {
+                if (!(net_cards_conf[netswitch->card->card_num].link_state & NET_LINK_DOWN))
+                    net_switch_send(netswitch, netswitch->pkt_tx_v, packets);
+                network_tx_release(netswitch->card, packets);
             }
             netswitch->during_tx = 0;
 
             if (netswitch->recv_on_tx) {
                 do {
-                    packets = network_rx_on_tx_popv(netswitch->card, netswitch->pkt_tx_v, SWITCH_PKT_BATCH);
+                    packets = network_rx_on_tx_peekv(netswitch->card, netswitch->pkt_tx_v, SWITCH_PKT_BATCH);
                     if (!(net_cards_conf[netswitch->card->card_num].link_state & NET_LINK_DOWN)) {
                         for (int i = 0; i < packets; i++)
                             network_rx_put_pkt(netswitch->card, &(netswitch->pkt_tx_v[i]));
                     }
+                    network_rx_on_tx_release(netswitch->card, packets);
                 } while (packets > 0);
                 netswitch->recv_on_tx = 0;
             }
@@ -437,49 +621,18 @@ net_switch_thread(void *priv)
         }
         if (pfd[NET_EVENT_RX].revents & POLLIN) {
 #endif
-            if (netswitch->secret_enabled) {
-                len = recv(netswitch->socket_rx, (char *) netswitch->pkt.data, NET_MAX_FRAME + sizeof(netswitch->secret_hash), 0);
-                if (len < (sizeof(netswitch->secret_hash) + 12)) {
-                    netswitch_log("Network Switch: recv error (%d)\n", len);
-                    continue;
-                }
-
-                if (memcmp(netswitch->pkt.data, netswitch->secret_hash, sizeof(netswitch->secret_hash)) != 0) {
-                    /* This packet contains a different secret hash, ignore it. */
-                    continue;
-                } else {
-                    memmove(netswitch->pkt.data,
-                            netswitch->pkt.data + sizeof(netswitch->secret_hash),
-                            len - sizeof(netswitch->secret_hash));
-                    len -= sizeof(netswitch->secret_hash);
-                    netswitch->pkt.len = len;
-                }
-            } else {
-                len = recv(netswitch->socket_rx, (char *) netswitch->pkt.data, NET_MAX_FRAME, 0);
-                if (len < 12) {
-                    netswitch_log("Network Switch: recv error (%d)\n", len);
-                    continue;
-                }
-            }
-
-            if ((AS_U64(netswitch->pkt.data[netswitch->secret_enabled + 6]) & le64_to_cpu(0xffffffffffffULL)) == netswitch->mac_addr_u64) {
-                /* A packet we've sent has looped back, drop it. */
-            } else if (!(net_cards_conf[netswitch->card->card_num].link_state & NET_LINK_DOWN) && (netswitch->promisc || /* promiscuous mode? */
-                       (netswitch->pkt.data[0] & 1) || /* broadcast packet? */
-                       ((AS_U64(netswitch->pkt.data[0]) & le64_to_cpu(0xffffffffffffULL)) == netswitch->mac_addr_u64))) { /* packet for me? */
-                netswitch_log("Network Switch: receiving %d-byte packet " MAC_FORMAT "\n",
-                              len, MAC_FORMAT_ARGS(netswitch->pkt.data));
-                netswitch->pkt.len = len;
+#ifdef SWITCH_USE_MMSG
+            net_switch_recv_batch(netswitch);
+#else
+            if (net_switch_recv_one(netswitch)) {
                 if (netswitch->during_tx) {
                     network_rx_on_tx_put_pkt(netswitch->card, &netswitch->pkt);
                     netswitch->recv_on_tx = 1;
                 } else {
                     network_rx_put_pkt(netswitch->card, &netswitch->pkt);
                 }
-            } else {
-                netswitch_log("Network Switch: dropping %d-byte packet " MAC_FORMAT "\n",
-                              len, MAC_FORMAT_ARGS(netswitch->pkt.data));
             }
+#endif
 #ifdef _WIN32
                 break;
 #endif
@@ -551,9 +704,7 @@ net_switch_init(const netcard_t *card, const uint8_t *mac_addr, void *priv, char
         goto fail;
     }
 
-    for (int i = 0; i < SWITCH_PKT_BATCH; i++)
-        netswitch->pkt_tx_v[i].data = calloc(1, NET_MAX_FRAME);
-    netswitch->pkt.data = calloc(1, NET_MAX_FRAME);
+    netswitch->pkt.data = calloc(1, sizeof(netswitch->secret_hash) + NET_MAX_FRAME);
     net_event_init(&netswitch->tx_event);
     net_event_init(&netswitch->stop_event);
 #ifdef _WIN32
@@ -601,8 +752,6 @@ net_switch_close(void *priv)
         close(netswitch->socket_rx);
     net_event_close(&netswitch->stop_event);
     net_event_close(&netswitch->tx_event);
-    for (int i = 0; i < SWITCH_PKT_BATCH; i++)
-        free(netswitch->pkt_tx_v[i].data);
     free(netswitch->pkt.data);
     free(netswitch);
 }
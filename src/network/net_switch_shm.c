@@ -0,0 +1,749 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Shared memory transport for the local network switch.
+ *
+ *          Every VM on the host attaches a port to a shared memory
+ *          segment named after the switch secret. Each port owns a
+ *          bounded multi-producer ring which the other ports write
+ *          frames into directly, so frames between local VMs never go
+ *          through the kernel; a futex is only used to wake a port
+ *          that has gone to sleep. Forwarding is decided by the
+ *          sending port, from a MAC table it learns off the frames it
+ *          receives, with per-port VLANs and flood rate limiting.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#    include <linux/futex.h>
+#    include <sys/syscall.h>
+#endif
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/plat.h>
+#include <86box/thread.h>
+#include <86box/timer.h>
+#include <86box/network.h>
+
+#define SHM_SWITCH_MAGIC       0x53423638 /* "86BS" */
+#define SHM_SWITCH_VERSION     3
+#define SHM_SWITCH_PORTS       32
+#define SHM_SWITCH_RING        128    /* frames per port, power of 2 */
+#define SHM_SWITCH_FDB         256    /* learned addresses per port, power of 2 */
+#define SHM_SWITCH_FDB_PROBE   8
+#define SHM_SWITCH_FDB_AGE     300000 /* ms */
+#define SHM_SWITCH_FLOOD_PPS   8000   /* flooded frames per second per port */
+#define SHM_SWITCH_FLOOD_BURST 256
+#define SHM_SWITCH_NATIVE_VLAN 1
+#define SHM_SWITCH_STALL_MS    10     /* before skipping a slot whose producer has died */
+#define SHM_SWITCH_CLAIM_MS    1000   /* before skipping a slot whatever its producer is doing */
+
+/* Slot states, as the offset of seq from the position the slot is used for. */
+#define SHM_SLOT_FREE          0 /* the producer of this position may claim it */
+#define SHM_SLOT_READY         1 /* published, for the consumer */
+#define SHM_SLOT_CLAIMED       2 /* being filled by a producer */
+#define SHM_SLOT_ABANDONED     3 /* skipped by the consumer while still claimed */
+#define SHM_SLOT_LEFT          4 /* abandoned, and its producer has let go since */
+
+typedef struct shm_slot_t {
+    atomic_uint seq;
+    uint16_t    len;
+    uint16_t    vlan;
+    uint8_t     src_port;
+    uint8_t     pad[3];
+    atomic_int  claimer;             /* pid of the producer filling it, 0 otherwise */
+    uint8_t     data[NET_MAX_FRAME]; /* untagged frame */
+} shm_slot_t;
+
+typedef struct shm_port_t {
+    atomic_int  owner;      /* pid of the attached process, 0 if free */
+    atomic_uint generation; /* bumped on every attach */
+    atomic_uint vlan;       /* access VLAN, 0 for a trunk port */
+    atomic_uint head;       /* next slot to be claimed by a producer */
+    atomic_uint waiting;    /* consumer is asleep on the futex */
+    uint32_t    tail;       /* consumer only */
+    uint8_t     pad[40];
+    shm_slot_t  slots[SHM_SWITCH_RING];
+} shm_port_t;
+
+typedef struct shm_switch_t {
+    atomic_uint magic;
+    uint32_t    version;
+    uint32_t    ports;
+    uint32_t    ring;
+    uint8_t     pad[48];
+    shm_port_t  port[SHM_SWITCH_PORTS];
+} shm_switch_t;
+
+typedef struct shm_fdb_t {
+    uint8_t  mac[6];
+    uint16_t vlan;
+    uint8_t  port;
+    uint8_t  valid;
+    uint32_t generation;
+    uint32_t last_seen;
+} shm_fdb_t;
+
+typedef struct net_switch_shm_t {
+    shm_switch_t *sw;
+    shm_port_t   *port;
+    int           port_num;
+    uint16_t      vlan;
+    uint8_t       promisc;
+    uint8_t       mac_addr[6];
+    netcard_t    *card;
+    int           pid;
+    thread_t     *poll_tid;
+    volatile int  stop;
+
+    /* Receive thread only: the unpublished slot the ring is waiting on. */
+    int           stalled;
+    uint32_t      stall_tail;
+    uint32_t      stall_since;
+
+    /* Learned by the receive thread, used by the transmit path. */
+    mutex_t      *fdb_mutex;
+    shm_fdb_t     fdb[SHM_SWITCH_FDB];
+
+    /* Transmit path only. */
+    uint32_t      flood_tokens;
+    uint32_t      flood_stamp;
+} net_switch_shm_t;
+
+#ifdef ENABLE_SWITCH_SHM_LOG
+int switch_shm_do_log = ENABLE_SWITCH_SHM_LOG;
+
+static void
+switch_shm_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (switch_shm_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define switch_shm_log(fmt, ...)
+#endif
+
+#ifdef __linux__
+static void
+net_switch_shm_sleep(atomic_uint *addr)
+{
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = 100 * 1000000 };
+
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAIT, 1, &ts, NULL, 0);
+}
+
+static void
+net_switch_shm_wakeup(atomic_uint *addr)
+{
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+#else
+/* No cross-process futex here, so sleeping ports poll instead. */
+static void
+net_switch_shm_sleep(UNUSED(atomic_uint *addr))
+{
+    plat_delay_ms(1);
+}
+
+static void
+net_switch_shm_wakeup(UNUSED(atomic_uint *addr))
+{
+    //
+}
+#endif
+
+static uint32_t
+net_switch_shm_hash(const uint8_t *data, int len, uint32_t hash)
+{
+    for (int i = 0; i < len; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+
+    return hash;
+}
+
+static int
+net_switch_shm_pid_alive(int pid)
+{
+    return (kill(pid, 0) == 0) || (errno != ESRCH);
+}
+
+static int
+net_switch_shm_port_alive(shm_port_t *port)
+{
+    int owner = atomic_load(&port->owner);
+
+    return owner && net_switch_shm_pid_alive(owner);
+}
+
+static inline uint32_t
+net_switch_shm_slot_state(uint32_t seq, uint32_t pos)
+{
+    return (seq - pos) & (SHM_SWITCH_RING - 1);
+}
+
+static int
+net_switch_shm_port_accepts(shm_port_t *port, uint16_t vlan)
+{
+    uint32_t port_vlan = atomic_load_explicit(&port->vlan, memory_order_relaxed);
+
+    return !port_vlan || (port_vlan == vlan);
+}
+
+/* Find the table entry for a MAC address, or a slot to learn it into. */
+static shm_fdb_t *
+net_switch_shm_fdb_find(net_switch_shm_t *vs, const uint8_t *mac, uint16_t vlan, int create)
+{
+    uint32_t   now    = plat_get_ticks();
+    uint32_t   hash   = net_switch_shm_hash(mac, 6, 2166136261u) ^ vlan;
+    shm_fdb_t *victim = NULL;
+
+    for (int i = 0; i < SHM_SWITCH_FDB_PROBE; i++) {
+        shm_fdb_t *entry = &vs->fdb[(hash + i) & (SHM_SWITCH_FDB - 1)];
+
+        if (entry->valid && ((now - entry->last_seen) >= SHM_SWITCH_FDB_AGE))
+            entry->valid = 0;
+
+        if (entry->valid && (entry->vlan == vlan) && !memcmp(entry->mac, mac, 6))
+            return entry;
+
+        if (!victim || (victim->valid && (!entry->valid || (entry->last_seen < victim->last_seen))))
+            victim = entry;
+    }
+
+    return create ? victim : NULL;
+}
+
+static void
+net_switch_shm_learn(net_switch_shm_t *vs, const shm_slot_t *slot)
+{
+    if (slot->data[6] & 1)
+        return;
+
+    shm_fdb_t *entry = net_switch_shm_fdb_find(vs, &slot->data[6], slot->vlan, 1);
+
+    memcpy(entry->mac, &slot->data[6], 6);
+    entry->vlan       = slot->vlan;
+    entry->port       = slot->src_port;
+    entry->generation = atomic_load(&vs->sw->port[slot->src_port].generation);
+    entry->last_seen  = plat_get_ticks();
+    entry->valid      = 1;
+}
+
+/*
+ * Lock-free bounded multi-producer enqueue into another port's ring. A
+ * producer claims the slot through its seq, the same word the consumer's
+ * reaper works on, before it touches anything else; head is moved on
+ * afterwards, by whoever gets there first. A slot the consumer gives up
+ * on stays ours until we let go of it, and nobody else uses it until then.
+ */
+static int
+net_switch_shm_enqueue(net_switch_shm_t *vs, shm_port_t *dst, uint16_t vlan, const uint8_t *data, int len)
+{
+    uint32_t    pos = atomic_load_explicit(&dst->head, memory_order_relaxed);
+    uint32_t    seq;
+    shm_slot_t *slot;
+
+    for (;;) {
+        slot        = &dst->slots[pos & (SHM_SWITCH_RING - 1)];
+        seq         = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int32_t dif = (int32_t) (seq - pos);
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&slot->seq, &seq, pos + SHM_SLOT_CLAIMED,
+                                                      memory_order_acquire, memory_order_relaxed)) {
+                seq = pos;
+                atomic_compare_exchange_strong_explicit(&dst->head, &seq, pos + 1,
+                                                        memory_order_relaxed, memory_order_relaxed);
+                break;
+            }
+        } else if ((dif > 0) || (net_switch_shm_slot_state(seq, pos) >= SHM_SLOT_ABANDONED)) {
+            /* Already claimed for this position, or held by a producer from an
+               earlier lap that nobody uses it for; move head past it. */
+            if (atomic_compare_exchange_weak_explicit(&dst->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                pos++;
+        } else
+            return 0; /* ring full */
+    }
+
+    atomic_store_explicit(&slot->claimer, vs->pid, memory_order_relaxed);
+    memcpy(slot->data, data, len);
+    slot->len      = len;
+    slot->vlan     = vlan;
+    slot->src_port = vs->port_num;
+
+    seq = pos + SHM_SLOT_CLAIMED;
+    if (atomic_compare_exchange_strong_explicit(&slot->seq, &seq, pos + SHM_SLOT_READY,
+                                                memory_order_release, memory_order_relaxed))
+        return 1;
+
+    /* The consumer skipped us meanwhile; hand the slot back to it. */
+    atomic_store_explicit(&slot->seq, pos + SHM_SLOT_LEFT, memory_order_release);
+    return 0;
+}
+
+static void
+net_switch_shm_wake_ports(net_switch_shm_t *vs, uint32_t ports)
+{
+    if (!ports)
+        return;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    for (int i = 0; ports; i++, ports >>= 1) {
+        if ((ports & 1) && atomic_exchange(&vs->sw->port[i].waiting, 0)) {
+            net_switch_shm_wakeup(&vs->sw->port[i].waiting);
+            network_count_syscalls(vs->card, 1);
+        }
+    }
+}
+
+/* Token bucket for flooded frames, so one guest can't storm every port. */
+static int
+net_switch_shm_flood_allowed(net_switch_shm_t *vs)
+{
+    uint32_t now   = plat_get_ticks();
+    uint32_t added = (now - vs->flood_stamp) * SHM_SWITCH_FLOOD_PPS / 1000;
+
+    if (added) {
+        vs->flood_tokens = MIN(vs->flood_tokens + added, SHM_SWITCH_FLOOD_BURST);
+        vs->flood_stamp  = now;
+    }
+
+    if (!vs->flood_tokens)
+        return 0;
+
+    vs->flood_tokens--;
+    return 1;
+}
+
+/* Forward one frame from the guest; returns the mask of ports written to. */
+static uint32_t
+net_switch_shm_forward(net_switch_shm_t *vs, uint8_t *data, int len)
+{
+    uint8_t  frame[NET_MAX_FRAME];
+    uint16_t vlan;
+    uint32_t ports = 0;
+
+    if (len < 14)
+        return 0;
+
+    if ((data[12] == 0x81) && (data[13] == 0x00)) {
+        /* Only trunk ports take tagged frames; the tag is carried out of band. */
+        if (vs->vlan || (len < 18))
+            return 0;
+        vlan = ((data[14] & 0x0f) << 8) | data[15];
+        if (!vlan)
+            vlan = SHM_SWITCH_NATIVE_VLAN;
+        memcpy(frame, data, 12);
+        memcpy(frame + 12, data + 16, len - 16);
+        data = frame;
+        len -= 4;
+    } else
+        vlan = vs->vlan ? vs->vlan : SHM_SWITCH_NATIVE_VLAN;
+
+    if (!(data[0] & 1)) {
+        /* Known unicast destination: send it to that port only. */
+        shm_fdb_t *entry = net_switch_shm_fdb_find(vs, data, vlan, 0);
+        if (entry) {
+            shm_port_t *dst = &vs->sw->port[entry->port];
+            if ((entry->generation == atomic_load(&dst->generation)) && atomic_load(&dst->owner)) {
+                if ((entry->port != vs->port_num) && net_switch_shm_port_accepts(dst, vlan) &&
+                    net_switch_shm_enqueue(vs, dst, vlan, data, len))
+                    ports |= 1 << entry->port;
+                return ports;
+            }
+            entry->valid = 0;
+        }
+    }
+
+    /* Broadcast, multicast or unknown unicast: flood the VLAN. */
+    if (!net_switch_shm_flood_allowed(vs))
+        return 0;
+
+    for (int i = 0; i < SHM_SWITCH_PORTS; i++) {
+        shm_port_t *dst = &vs->sw->port[i];
+        if ((i == vs->port_num) || !atomic_load_explicit(&dst->owner, memory_order_relaxed) ||
+            !net_switch_shm_port_accepts(dst, vlan))
+            continue;
+        if (net_switch_shm_enqueue(vs, dst, vlan, data, len))
+            ports |= 1 << i;
+    }
+
+    return ports;
+}
+
+/* The card timer calls this on the emulation thread; forward straight away. */
+static void
+net_switch_shm_in_available(void *priv)
+{
+    net_switch_shm_t *vs = (net_switch_shm_t *) priv;
+    netpkt_t          pkt_vec[NET_BATCH_LEN];
+    uint32_t          ports = 0;
+    int               packets;
+
+    while ((packets = network_tx_peekv(vs->card, pkt_vec, NET_BATCH_LEN)) > 0) {
+        if (!(net_cards_conf[vs->card->card_num].link_state & NET_LINK_DOWN)) {
+            thread_wait_mutex(vs->fdb_mutex);
+            for (int i = 0; i < packets; i++)
+                ports |= net_switch_shm_forward(vs, pkt_vec[i].data, pkt_vec[i].len);
+            thread_release_mutex(vs->fdb_mutex);
+        }
+        network_tx_release(vs->card, packets);
+    }
+
+    net_switch_shm_wake_ports(vs, ports);
+}
+
+static inline shm_slot_t *
+net_switch_shm_peek(shm_port_t *port)
+{
+    shm_slot_t *slot = &port->slots[port->tail & (SHM_SWITCH_RING - 1)];
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != (port->tail + SHM_SLOT_READY))
+        return NULL;
+
+    return slot;
+}
+
+/* Move pending frames from our port into the card's RX queue; returns the frame count. */
+static int
+net_switch_shm_rx(net_switch_shm_t *vs)
+{
+    shm_port_t *port = vs->port;
+    netpkt_t    pkt_vec[NET_BATCH_LEN];
+    int         slots;
+    int         count = 0;
+    shm_slot_t *slot;
+
+    if (!net_switch_shm_peek(port))
+        return 0;
+
+    slots = network_rx_reserve(vs->card, pkt_vec, NET_BATCH_LEN);
+    if (!slots) {
+        /* The card is behind; leave the frames in the switch for now. */
+        plat_delay_ms(1);
+        return 1;
+    }
+
+    int link_down = !!(net_cards_conf[vs->card->card_num].link_state & NET_LINK_DOWN);
+
+    thread_wait_mutex(vs->fdb_mutex);
+    while ((count < slots) && (slot = net_switch_shm_peek(port))) {
+        netpkt_t *pkt = &pkt_vec[count++];
+        int       len = slot->len;
+
+        pkt->len = 0;
+        if ((len >= 14) && (len <= NET_MAX_FRAME) && (slot->src_port < SHM_SWITCH_PORTS)) {
+            net_switch_shm_learn(vs, slot);
+
+            if (link_down) {
+                /* Drop it. */
+            } else if (!vs->promisc && !(slot->data[0] & 1) && memcmp(slot->data, vs->mac_addr, 6)) {
+                /* Flooded unicast for someone else. */
+            } else if (!vs->vlan && (slot->vlan != SHM_SWITCH_NATIVE_VLAN)) {
+                /* Trunk port: put the tag back. */
+                if ((len + 4) <= NET_MAX_FRAME) {
+                    memcpy(pkt->data, slot->data, 12);
+                    pkt->data[12] = 0x81;
+                    pkt->data[13] = 0x00;
+                    pkt->data[14] = slot->vlan >> 8;
+                    pkt->data[15] = slot->vlan & 0xff;
+                    memcpy(pkt->data + 16, slot->data + 12, len - 12);
+                    pkt->len = len + 4;
+                }
+            } else {
+                memcpy(pkt->data, slot->data, len);
+                pkt->len = len;
+            }
+        }
+
+        atomic_store_explicit(&slot->claimer, 0, memory_order_relaxed);
+        atomic_store_explicit(&slot->seq, port->tail + SHM_SWITCH_RING, memory_order_release);
+        port->tail++;
+    }
+    thread_release_mutex(vs->fdb_mutex);
+
+    network_rx_commit(vs->card, pkt_vec, count);
+
+    return count;
+}
+
+/*
+ * A producer that stops between claiming a slot and publishing it would
+ * block our ring for good. Once the slot at the tail has been claimed for
+ * a while, skip it if its producer is gone, or, whatever it is doing, once
+ * the longer timeout has passed. The skipped slot stays with its producer
+ * until it lets go, and is skipped on every lap until then. Returns 1 if
+ * the tail moved.
+ */
+static int
+net_switch_shm_reap(net_switch_shm_t *vs)
+{
+    shm_port_t *port = vs->port;
+    shm_slot_t *slot = &port->slots[port->tail & (SHM_SWITCH_RING - 1)];
+    uint32_t    now  = plat_get_ticks();
+    uint32_t    seq  = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    int         claimer;
+
+    if ((int32_t) (seq - port->tail) < 0) {
+        /* Abandoned on an earlier lap; producers move head past it, then so do we. */
+        if (atomic_load_explicit(&port->head, memory_order_relaxed) == port->tail)
+            return 0;
+
+        if (net_switch_shm_slot_state(seq, port->tail) == SHM_SLOT_LEFT) {
+            atomic_store_explicit(&slot->claimer, 0, memory_order_relaxed);
+            atomic_store_explicit(&slot->seq, port->tail + SHM_SWITCH_RING, memory_order_release);
+        }
+        port->tail++;
+        vs->stalled = 0;
+        return 1;
+    }
+
+    /* Free or already published. */
+    if (seq != (port->tail + SHM_SLOT_CLAIMED)) {
+        vs->stalled = 0;
+        return 0;
+    }
+
+    if (!vs->stalled || (vs->stall_tail != port->tail)) {
+        vs->stalled     = 1;
+        vs->stall_tail  = port->tail;
+        vs->stall_since = now;
+        return 0;
+    }
+
+    claimer = atomic_load_explicit(&slot->claimer, memory_order_relaxed);
+    if ((now - vs->stall_since) < (claimer && !net_switch_shm_pid_alive(claimer) ? SHM_SWITCH_STALL_MS : SHM_SWITCH_CLAIM_MS))
+        return 0;
+
+    if (!atomic_compare_exchange_strong_explicit(&slot->seq, &seq, port->tail + SHM_SLOT_ABANDONED,
+                                                 memory_order_relaxed, memory_order_relaxed))
+        return 0; /* published after all */
+
+    switch_shm_log("Shared Switch: skipped slot %u of port %d, claimed by pid %d\n",
+                   port->tail, vs->port_num, claimer);
+    port->tail++;
+    vs->stalled = 0;
+
+    return 1;
+}
+
+static void
+net_switch_shm_thread(void *priv)
+{
+    net_switch_shm_t *vs   = (net_switch_shm_t *) priv;
+    shm_port_t       *port = vs->port;
+
+    switch_shm_log("Shared Switch: polling started on port %d\n", vs->port_num);
+
+    while (!vs->stop) {
+        if (net_switch_shm_rx(vs) || net_switch_shm_reap(vs))
+            continue;
+
+        /* Nothing pending; tell producers to wake us, then check once more. */
+        atomic_store(&port->waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!net_switch_shm_peek(port) && !vs->stop) {
+            net_switch_shm_sleep(&port->waiting);
+            network_count_syscalls(vs->card, 1);
+        }
+        atomic_store(&port->waiting, 0);
+    }
+
+    switch_shm_log("Shared Switch: polling stopped\n");
+}
+
+/* Open or create the switch segment; the creator initializes it. */
+static shm_switch_t *
+net_switch_shm_map(const char *name, char *netdrv_errbuf)
+{
+    int          created = 1;
+    struct stat  st;
+    shm_switch_t *sw;
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if ((fd < 0) && (errno == EEXIST)) {
+        created = 0;
+        fd      = shm_open(name, O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        snprintf(netdrv_errbuf, NET_DRV_ERRBUF_SIZE, "Could not open shared switch %s (%s)\n", name, strerror(errno));
+        return NULL;
+    }
+
+    if (created) {
+        if (ftruncate(fd, sizeof(shm_switch_t)) < 0) {
+            snprintf(netdrv_errbuf, NET_DRV_ERRBUF_SIZE, "Could not size shared switch %s (%s)\n", name, strerror(errno));
+            close(fd);
+            shm_unlink(name);
+            return NULL;
+        }
+    } else {
+        /* Give the creator a moment to size the segment. */
+        for (int i = 0; (fstat(fd, &st) == 0) && (st.st_size < (off_t) sizeof(shm_switch_t)) && (i < 100); i++)
+            plat_delay_ms(10);
+        if ((fstat(fd, &st) < 0) || (st.st_size != (off_t) sizeof(shm_switch_t))) {
+            snprintf(netdrv_errbuf, NET_DRV_ERRBUF_SIZE, "Shared switch %s has an unexpected layout\n", name);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    sw = mmap(NULL, sizeof(shm_switch_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (sw == MAP_FAILED) {
+        snprintf(netdrv_errbuf, NET_DRV_ERRBUF_SIZE, "Could not map shared switch %s (%s)\n", name, strerror(errno));
+        return NULL;
+    }
+
+    if (created) {
+        sw->version = SHM_SWITCH_VERSION;
+        sw->ports   = SHM_SWITCH_PORTS;
+        sw->ring    = SHM_SWITCH_RING;
+        for (int i = 0; i < SHM_SWITCH_PORTS; i++) {
+            for (uint32_t j = 0; j < SHM_SWITCH_RING; j++)
+                atomic_init(&sw->port[i].slots[j].seq, j);
+        }
+        atomic_store_explicit(&sw->magic, SHM_SWITCH_MAGIC, memory_order_release);
+    } else {
+        for (int i = 0; (atomic_load_explicit(&sw->magic, memory_order_acquire) != SHM_SWITCH_MAGIC) && (i < 100); i++)
+            plat_delay_ms(10);
+        if ((atomic_load_explicit(&sw->magic, memory_order_acquire) != SHM_SWITCH_MAGIC) ||
+            (sw->version != SHM_SWITCH_VERSION) || (sw->ports != SHM_SWITCH_PORTS) || (sw->ring != SHM_SWITCH_RING)) {
+            snprintf(netdrv_errbuf, NET_DRV_ERRBUF_SIZE, "Shared switch %s has an unexpected layout\n", name);
+            munmap(sw, sizeof(shm_switch_t));
+            return NULL;
+        }
+    }
+
+    return sw;
+}
+
+/* Take over a free port, or one left behind by a process that has died. */
+static int
+net_switch_shm_attach(net_switch_shm_t *vs)
+{
+    int pid = vs->pid;
+
+    for (int i = 0; i < SHM_SWITCH_PORTS; i++) {
+        shm_port_t *port  = &vs->sw->port[i];
+        int         owner = atomic_load(&port->owner);
+
+        if (owner && net_switch_shm_port_alive(port))
+            continue;
+        if (!atomic_compare_exchange_strong(&port->owner, &owner, pid))
+            continue;
+
+        vs->port     = port;
+        vs->port_num = i;
+        atomic_store(&port->vlan, vs->vlan);
+        atomic_fetch_add(&port->generation, 1);
+
+        /* Discard whatever was sent to the previous owner. */
+        shm_slot_t *slot;
+        while ((slot = net_switch_shm_peek(port))) {
+            atomic_store_explicit(&slot->claimer, 0, memory_order_relaxed);
+            atomic_store_explicit(&slot->seq, port->tail + SHM_SWITCH_RING, memory_order_release);
+            port->tail++;
+        }
+
+        return i;
+    }
+
+    return -1;
+}
+
+void *
+net_switch_shm_init(const netcard_t *card, const uint8_t *mac_addr, void *priv, char *netdrv_errbuf)
+{
+    netcard_conf_t *netcard = (netcard_conf_t *) priv;
+    char            name[64];
+
+    net_switch_shm_t *vs = calloc(1, sizeof(net_switch_shm_t));
+    memcpy(vs->mac_addr, mac_addr, sizeof(vs->mac_addr));
+    vs->card         = (netcard_t *) card;
+    vs->pid          = (int) getpid();
+    vs->promisc      = !!netcard->promisc_mode;
+    vs->vlan         = (netcard->vlan < 4095) ? netcard->vlan : SHM_SWITCH_NATIVE_VLAN;
+    vs->flood_tokens = SHM_SWITCH_FLOOD_BURST;
+    vs->flood_stamp  = plat_get_ticks();
+
+    /* Switches with different secrets live in different segments. */
+    snprintf(name, sizeof(name), "/86box-switch-%08x",
+             net_switch_shm_hash((const uint8_t *) netcard->secret, strlen(netcard->secret), 2166136261u));
+    vs->sw = net_switch_shm_map(name, netdrv_errbuf);
+    if (!vs->sw) {
+        free(vs);
+        return NULL;
+    }
+
+    if (net_switch_shm_attach(vs) < 0) {
+        snprintf(netdrv_errbuf, NET_DRV_ERRBUF_SIZE, "All %d ports of shared switch %s are in use\n", SHM_SWITCH_PORTS, name);
+        munmap(vs->sw, sizeof(shm_switch_t));
+        free(vs);
+        return NULL;
+    }
+    switch_shm_log("Shared Switch: attached to port %d of %s, VLAN %d\n", vs->port_num, name, vs->vlan);
+
+    vs->fdb_mutex = thread_create_mutex();
+    vs->poll_tid  = thread_create(net_switch_shm_thread, vs);
+
+    return vs;
+}
+
+static void
+net_switch_shm_close(void *priv)
+{
+    if (!priv)
+        return;
+
+    net_switch_shm_t *vs = (net_switch_shm_t *) priv;
+
+    switch_shm_log("Shared Switch: closing\n");
+
+    vs->stop = 1;
+    atomic_store(&vs->port->waiting, 0);
+    net_switch_shm_wakeup(&vs->port->waiting);
+    thread_wait(vs->poll_tid);
+
+    /* The segment itself stays around for other VMs to join later. */
+    atomic_store(&vs->port->owner, 0);
+    munmap(vs->sw, sizeof(shm_switch_t));
+
+    thread_close_mutex(vs->fdb_mutex);
+    free(vs);
+}
+
+const netdrv_t net_switch_shm_drv = {
+    .notify_in = &net_switch_shm_in_available,
+    .init      = &net_switch_shm_init,
+    .close     = &net_switch_shm_close,
+    .priv      = NULL
+};
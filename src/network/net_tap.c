@@ -60,11 +60,13 @@
 #include <fcntl.h>
 #include <sys/select.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #include <linux/if_arp.h>
 #include <linux/sockios.h>
+#include <linux/virtio_net.h>
 
 #define HAVE_STDARG_H
 
@@ -77,14 +79,18 @@
 #include <86box/network.h>
 #include <86box/net_event.h>
 
+// Number of queues requested from a multi-queue capable TUN driver
+#define TAP_QUEUES 2
+
 typedef struct net_tap_t {
-    int        fd; // tap device file descriptor
+    int        fd[TAP_QUEUES]; // tap queue file descriptors
+    int        queues;         // number of queues actually opened
+    int        vnet_hdr;       // frames carry a virtio_net_hdr
     netcard_t *card;
     thread_t  *poll_tid;
     net_evt_t  tx_event;
     net_evt_t  stop_event;
-    netpkt_t   pkt_rx;
-    netpkt_t   pkts_tx[NET_QUEUE_LEN];
+    netpkt_t   pkts_tx[NET_BATCH_LEN];
 } net_tap_t;
 
 #ifdef ENABLE_TAP_LOG
@@ -119,60 +125,124 @@ static void tap_log(const char *fmt, ...)
         } while (0)
 #endif
 
+// Pick a TX queue from the MAC and IPv4 addresses so each flow stays in order
+static int net_tap_tx_queue(const net_tap_t *tap, const netpkt_t *pkt)
+{
+    if (tap->queues == 1 || pkt->len < 14) {
+        return 0;
+    }
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 12; i++) {
+        hash = (hash ^ pkt->data[i]) * 16777619u;
+    }
+    if (pkt->len >= 34 && pkt->data[12] == 0x08 && pkt->data[13] == 0x00) {
+        for (int i = 26; i < 34; i++) {
+            hash = (hash ^ pkt->data[i]) * 16777619u;
+        }
+    }
+    return hash % tap->queues;
+}
+
+// Read every pending frame on a queue straight into the card's RX queue
+static void net_tap_rx(net_tap_t *tap, int fd)
+{
+    netpkt_t pkts_rx[NET_BATCH_LEN];
+    int      slots = network_rx_reserve(tap->card, pkts_rx, NET_BATCH_LEN);
+    int      count = 0;
+    // No offloads were enabled towards us, so the header carries nothing we need
+    struct virtio_net_hdr hdr;
+    struct iovec          iov[2] = { { &hdr, sizeof(hdr) }, { NULL, NET_MAX_FRAME } };
+    int                   hdr_len = tap->vnet_hdr ? sizeof(hdr) : 0;
+    if (!slots) {
+        // RX queue is full, drop the frame
+        uint8_t discard[sizeof(hdr) + NET_MAX_FRAME];
+        if (read(fd, discard, sizeof(discard)) < 0) {
+            tap_log("TAP: read error: %s\n", strerror(errno));
+        } else {
+            network_rx_dropped(tap->card, 1);
+        }
+        network_count_syscalls(tap->card, 1);
+        return;
+    }
+    while (count < slots) {
+        iov[1].iov_base = pkts_rx[count].data;
+        ssize_t len = readv(fd, &iov[!hdr_len], 1 + !!hdr_len);
+        network_count_syscalls(tap->card, 1);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                tap_log("TAP: read error: %s\n", strerror(errno));
+            }
+            break;
+        }
+        pkts_rx[count++].len = (len > hdr_len) ? (len - hdr_len) : 0;
+    }
+    network_rx_commit(tap->card, pkts_rx, count);
+}
+
 static void net_tap_thread(void *priv) {
     enum {
         NET_EVENT_STOP = 0,
         NET_EVENT_TX,
         NET_EVENT_RX,
-        NET_EVENT_TAP,
-        NET_EVENT_MAX,
+        NET_EVENT_MAX = NET_EVENT_RX + TAP_QUEUES,
     };
     net_tap_t *tap = priv;
     tap_log("TAP: poll thread started.\n");
     struct pollfd pfd[NET_EVENT_MAX];
+    int nfds = NET_EVENT_RX + tap->queues;
     pfd[NET_EVENT_STOP].fd = net_event_get_fd(&tap->stop_event);
     pfd[NET_EVENT_STOP].events = POLLIN | POLLPRI;
 
     pfd[NET_EVENT_TX].fd = net_event_get_fd(&tap->tx_event);
     pfd[NET_EVENT_TX].events = POLLIN | POLLPRI;
 
-    pfd[NET_EVENT_RX].fd = tap->fd;
-    pfd[NET_EVENT_RX].events = POLLIN | POLLPRI;
-
-    pfd[NET_EVENT_TAP].fd = tap->fd;
-    pfd[NET_EVENT_TAP].events = POLLERR | POLLHUP | POLLPRI;
-    fcntl(tap->fd, F_SETFL, O_NONBLOCK);
+    // Errors and hangups are always reported, no need to ask for them
+    for (int q = 0; q < tap->queues; q++) {
+        pfd[NET_EVENT_RX + q].fd = tap->fd[q];
+        pfd[NET_EVENT_RX + q].events = POLLIN | POLLPRI;
+        fcntl(tap->fd[q], F_SETFL, O_NONBLOCK);
+    }
     while(1) {
-        ssize_t ret = poll(pfd, NET_EVENT_MAX, -1);
+        ssize_t ret = poll(pfd, nfds, -1);
+        network_count_syscalls(tap->card, 1);
         if (ret < 0) {
             tap_log("TAP: poll error: %s\n", strerror(errno));
             net_event_set(&tap->stop_event);
             break;
         }
-        if (pfd[NET_EVENT_TAP].revents) {
-            tap_log("TAP: tap close/error event received.\n");
-            net_event_set(&tap->stop_event);
+        for (int q = 0; q < tap->queues; q++) {
+            if (pfd[NET_EVENT_RX + q].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                tap_log("TAP: tap close/error event received.\n");
+                net_event_set(&tap->stop_event);
+            }
         }
         if (pfd[NET_EVENT_TX].revents & POLLIN) {
             net_event_clear(&tap->tx_event);
-            int packets = network_tx_popv(tap->card, tap->pkts_tx,
-                                          NET_QUEUE_LEN);
-            for(int i = 0; i < packets; i++) {
-                netpkt_t *pkt = &tap->pkts_tx[i];
-                ssize_t ret = write(tap->fd, pkt->data, pkt->len);
-                if (ret < 0) {
-                    tap_log("TAP: write error: %s\n", strerror(errno));
+            int packets;
+            while ((packets = network_tx_peekv(tap->card, tap->pkts_tx, NET_BATCH_LEN)) > 0) {
+                for(int i = 0; i < packets; i++) {
+                    netpkt_t             *pkt    = &tap->pkts_tx[i];
+                    struct virtio_net_hdr hdr    = { 0 };
+                    struct iovec          iov[2] = { { &hdr, sizeof(hdr) }, { pkt->data, pkt->len } };
+                    // Leave a pending checksum to the host stack
+                    if (pkt->csum_start) {
+                        hdr.flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+                        hdr.csum_start  = pkt->csum_start;
+                        hdr.csum_offset = pkt->csum_offset;
+                    }
+                    ssize_t ret = writev(tap->fd[net_tap_tx_queue(tap, pkt)], &iov[!tap->vnet_hdr], 1 + !!tap->vnet_hdr);
+                    if (ret < 0) {
+                        tap_log("TAP: write error: %s\n", strerror(errno));
+                    }
                 }
+                network_tx_release(tap->card, packets);
+                network_count_syscalls(tap->card, packets);
             }
         }
-        if (pfd[NET_EVENT_RX].revents & POLLIN) {
-            ssize_t len = read(tap->fd, tap->pkt_rx.data, NET_MAX_FRAME);
-            if (len < 0) {
-                tap_log("TAP: read error: %s\n", strerror(errno));
-                continue;
+        for (int q = 0; q < tap->queues; q++) {
+            if (pfd[NET_EVENT_RX + q].revents & POLLIN) {
+                net_tap_rx(tap, tap->fd[q]);
             }
-            tap->pkt_rx.len = len;
-            network_rx_put_pkt(tap->card, &tap->pkt_rx);
         }
         if (pfd[NET_EVENT_STOP].revents & POLLIN) {
             net_event_clear(&tap->stop_event);
@@ -192,12 +262,8 @@ void net_tap_close(void *priv)
     tap_log("TAP: waiting for poll thread to exit.\n");
     thread_wait(tap->poll_tid);
     tap_log("TAP: poll thread exited.\n");
-    for(int i = 0; i < NET_QUEUE_LEN; i++) {
-        free(tap->pkts_tx[i].data);
-    }
-    free(tap->pkt_rx.data);
-    if (tap->fd >= 0) {
-        close(tap->fd);
+    for (int q = 0; q < tap->queues; q++) {
+        close(tap->fd[q]);
     }
     free(tap);
 }
@@ -220,28 +286,84 @@ void net_tap_error(char *errbuf, const char* format, ...)
         } \
     } while (0)
 
-// Returns -ERRNO so we can get an idea what's wrong
-int net_tap_alloc(const uint8_t *mac_addr, const char* bridge_dev)
+// Opens up to TAP_QUEUES queues into fds and returns how many, or -ERRNO
+// so we can get an idea what's wrong. vnet_hdr is set if the frames carry
+// a virtio_net_hdr, which lets the host stack fill in our checksums.
+int net_tap_alloc(const uint8_t *mac_addr, const char* bridge_dev, int *fds, int *vnet_hdr)
 {
     int fd;
+    int queues = 1;
     struct ifreq ifr = {0};
     if ((fd = open("/dev/net/tun", O_RDWR)) < 0) {
         tap_log("TAP: open error: %s\n", strerror(errno));
         return -errno;
     }
-    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    // Ask for a multi-queue device first, older kernels reject the flag
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR | IFF_MULTI_QUEUE;
     int err;
-    if ((err = ioctl(fd, TUNSETIFF, &ifr)) < 0) {
+    if ((err = ioctl(fd, TUNSETIFF, &ifr)) < 0 && errno == EINVAL) {
+        tap_log("TAP: multi-queue not supported, using a single queue.\n");
+        ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR;
+        err = ioctl(fd, TUNSETIFF, &ifr);
+    }
+    if (err < 0 && errno == EINVAL) {
+        tap_log("TAP: virtio-net headers not supported, checksums stay in the emulator.\n");
+        ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+        err = ioctl(fd, TUNSETIFF, &ifr);
+    }
+    if (err < 0) {
         tap_log("TAP: ioctl TUNSETIFF error: %s\n", strerror(errno));
         close(fd);
         return -errno;
     }
+    fds[0] = fd;
+    *vnet_hdr = !!(ifr.ifr_flags & IFF_VNET_HDR);
+    if (*vnet_hdr) {
+        // Plain header, and no offloads towards us: the cards can't take oversized frames
+        int hdr_size = sizeof(struct virtio_net_hdr);
+        if (ioctl(fd, TUNSETVNETHDRSZ, &hdr_size) < 0 || ioctl(fd, TUNSETOFFLOAD, 0) < 0) {
+            tap_log("TAP: unable to set up virtio-net headers, checksums stay in the emulator: %s\n", strerror(errno));
+            // The header is a device flag, so recreate the device without it
+            close(fd);
+            if ((fd = open("/dev/net/tun", O_RDWR)) < 0) {
+                tap_log("TAP: open error: %s\n", strerror(errno));
+                return -errno;
+            }
+            ifr.ifr_flags = IFF_TAP | IFF_NO_PI | (ifr.ifr_flags & IFF_MULTI_QUEUE);
+            if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+                tap_log("TAP: ioctl TUNSETIFF error: %s\n", strerror(errno));
+                close(fd);
+                return -errno;
+            }
+            fds[0]    = fd;
+            *vnet_hdr = 0;
+        }
+    }
+    // Attach the remaining queues to the same interface
+    if (ifr.ifr_flags & IFF_MULTI_QUEUE) {
+        for (; queues < TAP_QUEUES; queues++) {
+            struct ifreq ifr_queue = ifr;
+            int          qfd       = open("/dev/net/tun", O_RDWR);
+            if (qfd < 0) {
+                break;
+            }
+            if (ioctl(qfd, TUNSETIFF, &ifr_queue) < 0) {
+                tap_log("TAP: unable to attach queue %d: %s\n", queues, strerror(errno));
+                close(qfd);
+                break;
+            }
+            fds[queues] = qfd;
+        }
+    }
     // Create a socket for ioctl operations
     int sock;
     if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        err = -errno;
         tap_log("TAP: socket error: %s\n", strerror(errno));
-        close(fd);
-        return -errno;
+        for (int q = 0; q < queues; q++) {
+            close(fds[q]);
+        }
+        return err;
     }
     // Bring the interface up
     tap_log("TAP: Bringing interface '%s' up.\n", ifr.ifr_name);
@@ -275,13 +397,16 @@ int net_tap_alloc(const uint8_t *mac_addr, const char* bridge_dev)
     }
     // close the socket we used for ioctl operations
     close(sock);
-    tap_log("Allocated tap device %s\n", ifr.ifr_name);
-    return fd;
+    tap_log("Allocated tap device %s with %d queue(s)\n", ifr.ifr_name, queues);
+    return queues;
     // cleanup point used by ioctl_or_fail macro
 fail:
+    err = -errno;
     close(sock);
-    close(fd);
-    return -errno;
+    for (int q = 0; q < queues; q++) {
+        close(fds[q]);
+    }
+    return err;
 }
 
 void net_tap_in_available(void *priv)
@@ -298,9 +423,11 @@ net_tap_init(
         char *netdrv_errbuf)
 {
     const char *bridge_dev = (void *) priv;
-    int tap_fd = net_tap_alloc(mac_addr, bridge_dev);
-    if (tap_fd < 0) {
-        if (tap_fd == -EPERM) {
+    int tap_fds[TAP_QUEUES];
+    int vnet_hdr = 0;
+    int queues = net_tap_alloc(mac_addr, bridge_dev, tap_fds, &vnet_hdr);
+    if (queues < 0) {
+        if (queues == -EPERM) {
             net_tap_error(
                     netdrv_errbuf,
                     "No permissions to allocate tap device. "
@@ -310,7 +437,7 @@ net_tap_init(
             net_tap_error(
                     netdrv_errbuf,
                     "Unable to allocate TAP device: %s",
-                    strerror(-tap_fd));
+                    strerror(-queues));
         }
         return NULL;
     }
@@ -320,25 +447,22 @@ net_tap_init(
     if (!tap) {
         goto alloc_fail;
     }
-    tap->pkt_rx.data = calloc(1, NET_MAX_FRAME);
-    if (!tap->pkt_rx.data) {
-        goto alloc_fail;
+    memcpy(tap->fd, tap_fds, queues * sizeof(int));
+    tap->queues   = queues;
+    tap->vnet_hdr = vnet_hdr;
+    tap->card     = (netcard_t *) card;
+    if (vnet_hdr) {
+        tap->card->offload |= NET_OFFLOAD_CSUM;
     }
-    for(int i = 0; i < NET_QUEUE_LEN; i++) {
-        tap->pkts_tx[i].data = calloc(1, NET_MAX_FRAME);
-        if (!tap->pkts_tx[i].data) {
-            goto alloc_fail;
-        }
-    }
-    tap->fd   = tap_fd;
-    tap->card = (netcard_t *) card;
     net_event_init(&tap->tx_event);
     net_event_init(&tap->stop_event);
     tap->poll_tid = thread_create(net_tap_thread, tap);
     return tap;
 alloc_fail:
     net_tap_error(netdrv_errbuf, "Failed to allocate memory");
-    close(tap_fd);
+    for (int q = 0; q < queues; q++) {
+        close(tap_fds[q]);
+    }
     free(tap);
     return NULL;
 }
@@ -46,7 +46,7 @@
 #include <86box/network.h>
 #include <86box/net_event.h>
 
-#define VDE_PKT_BATCH NET_QUEUE_LEN
+#define VDE_PKT_BATCH NET_BATCH_LEN
 #define VDE_DESCRIPTION "86Box virtual card"
 
 enum {
@@ -140,6 +140,7 @@ static void net_vde_thread(void *priv) {
 
     while(1) {
         poll(pfd, NET_EVENT_MAX, -1);
+        network_count_syscalls(vde->card, 1);
 
         // Acvity in the control handle means the link is closed
         // We send ourselves a STOP event
@@ -150,14 +151,18 @@ static void net_vde_thread(void *priv) {
         // There are packets queued to transmit
         if (pfd[NET_EVENT_TX].revents & POLLIN) {
             net_event_clear(&vde->tx_event);
-            int packets = network_tx_popv(vde->card, vde->pktv, VDE_PKT_BATCH);
-            if (!(net_cards_conf[vde->card->card_num].link_state & NET_LINK_DOWN)) {
-                for (int i=0; i<packets; i++) {
-                    int nc = f_vde_send(vde->vdeconn, vde->pktv[i].data,vde->pktv[i].len, 0 );
-                    if (nc == 0) {
-                        vde_log("VDE: Problem, no bytes sent.\n");
+            int packets;
+            while ((packets = network_tx_peekv(vde->card, vde->pktv, VDE_PKT_BATCH)) > 0) {
+                if (!(net_cards_conf[vde->card->card_num].link_state & NET_LINK_DOWN)) {
+                    for (int i=0; i<packets; i++) {
+                        int nc = f_vde_send(vde->vdeconn, vde->pktv[i].data,vde->pktv[i].len, 0 );
+                        if (nc == 0) {
+                            vde_log("VDE: Problem, no bytes sent.\n");
+                        }
                     }
+                    network_count_syscalls(vde->card, packets);
                 }
+                network_tx_release(vde->card, packets);
             }
         }
 
@@ -165,6 +170,7 @@ static void net_vde_thread(void *priv) {
         if (pfd[NET_EVENT_RX].revents & POLLIN) {
             int nc = f_vde_recv(vde->vdeconn, vde->pkt.data, NET_MAX_FRAME, 0);
             vde->pkt.len = nc;
+            network_count_syscalls(vde->card, 1);
             if (!(net_cards_conf[vde->card->card_num].link_state & NET_LINK_DOWN))
                 network_rx_put_pkt(vde->card, &vde->pkt);
         }
@@ -208,8 +214,6 @@ int net_vde_prepare(void) {
 // Close a VDE socket connection
 //-
 void net_vde_close(void *priv) {
-    int i;
-
     if (!priv)  return;
 
     net_vde_t *vde = (net_vde_t *) priv;
@@ -220,9 +224,6 @@ void net_vde_close(void *priv) {
     vde_log("VDE: Thread finished.\n");
 
     // Free all the mallocs!
-    for(i=0;i<VDE_PKT_BATCH; i++) {
-        free(vde->pktv[i].data);
-    }
     free(vde->pkt.data);
     f_vde_close(vde->vdeconn);
     net_event_close(&vde->tx_event);
@@ -290,9 +291,6 @@ void *net_vde_init(const netcard_t *card, const uint8_t *mac_addr, void *priv, c
     }
     vde_log("VDE: Socket opened (%s).\n", socket_name);
 
-    for(uint8_t i = 0; i < VDE_PKT_BATCH; i++) {
-        vde->pktv[i].data = calloc(1, NET_MAX_FRAME);
-    }
     vde->pkt.data = calloc(1,NET_MAX_FRAME);
     net_event_init(&vde->tx_event);
     net_event_init(&vde->stop_event);
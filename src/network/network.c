@@ -63,6 +63,8 @@
 #include <86box/ui.h>
 #include <86box/timer.h>
 #include <86box/network.h>
+#include <86box/net_capture.h>
+#include <86box/net_stats.h>
 #include <86box/net_ne2000.h>
 #include <86box/net_pcnet.h>
 #include <86box/net_wd8003.h>
@@ -132,6 +134,11 @@ network_devmap_t network_devmap = {0};
 int  network_ndev;
 netdev_t network_devs[NET_HOST_INTF_MAX];
 
+/* Cards with a stopped timer, and those the host wants woken up. */
+static netcard_t  *network_cards[NET_CARD_MAX];
+static atomic_uint network_sleeping;
+static atomic_uint network_wake;
+
 /* Local variables. */
 #ifdef ENABLE_NETWORK_LOG
 int             network_do_log = ENABLE_NETWORK_LOG;
@@ -274,113 +281,324 @@ network_init(void)
 #endif
 }
 
-void
-network_queue_init(netqueue_t *queue)
+/* Slots are padded so that every frame starts on its own cache line. */
+#define NET_SLOT_SIZE ((NET_MAX_FRAME + 63) & ~63)
+
+/*
+ * Lock-free single-producer/single-consumer frame ring.
+ *
+ * The frames live in one preallocated slab; head and tail are free
+ * running counters, masked on access. The producer fills the slot at
+ * prod and makes it visible to the consumer by publishing prod into
+ * head, which lets the TX side hold frames back until the card timer
+ * paces them out.
+ */
+struct netqueue_t {
+    /* Producer side. */
+    atomic_uint head;
+    uint32_t    prod;
+    uint8_t     pad[56];
+
+    /* Consumer side. */
+    atomic_uint tail;
+
+    /* Read-only after init. */
+    uint32_t    mask;
+    int        *lens;
+    uint64_t   *stamps; /* host arrival time per slot, RX queue only */
+    uint32_t   *csum;   /* pending checksum per slot, TX queue only */
+    uint8_t    *slab;
+};
+
+#define QUEUE_STAMPS 1
+#define QUEUE_CSUM   2
+
+static uint32_t
+network_queue_depth(int len)
 {
-    queue->head = queue->tail = 0;
-    for (int i = 0; i < NET_QUEUE_LEN; i++) {
-        queue->packets[i].data = calloc(1, NET_MAX_FRAME);
-        queue->packets[i].len  = 0;
-    }
+    uint32_t depth = NET_QUEUE_LEN_MIN;
+
+    if (len <= 0)
+        len = NET_QUEUE_LEN_DEFAULT;
+    else if (len > NET_QUEUE_LEN_MAX)
+        len = NET_QUEUE_LEN_MAX;
+
+    while (depth < (uint32_t) len)
+        depth <<= 1;
+
+    return depth;
 }
 
-static bool
-network_queue_full(netqueue_t *queue)
+static netqueue_t *
+network_queue_init(uint32_t depth, int flags)
 {
-    return ((queue->head + 1) & NET_QUEUE_LEN_MASK) == queue->tail;
+    netqueue_t *queue = calloc(1, sizeof(netqueue_t));
+
+    queue->mask = depth - 1;
+    queue->lens = calloc(depth, sizeof(int));
+    queue->slab = malloc((size_t) depth * NET_SLOT_SIZE);
+    if (flags & QUEUE_STAMPS)
+        queue->stamps = calloc(depth, sizeof(uint64_t));
+    if (flags & QUEUE_CSUM)
+        queue->csum = calloc(depth, sizeof(uint32_t));
+    if (!queue->lens || !queue->slab || ((flags & QUEUE_STAMPS) && !queue->stamps) || ((flags & QUEUE_CSUM) && !queue->csum))
+        fatal("NETWORK: unable to allocate a %u-frame queue\n", depth);
+
+    return queue;
 }
 
-static bool
-network_queue_empty(netqueue_t *queue)
+static void
+network_queue_close(netqueue_t *queue)
 {
-    return (queue->head == queue->tail);
+    if (!queue)
+        return;
+
+    free(queue->slab);
+    free(queue->stamps);
+    free(queue->csum);
+    free(queue->lens);
+    free(queue);
 }
 
-static inline void
-network_swap_packet(netpkt_t *pkt1, netpkt_t *pkt2)
+static inline uint8_t *
+network_queue_slot(netqueue_t *queue, uint32_t index)
 {
-    netpkt_t tmp = *pkt2;
-    *pkt2        = *pkt1;
-    *pkt1        = tmp;
+    return queue->slab + (size_t) (index & queue->mask) * NET_SLOT_SIZE;
 }
 
-int
-network_queue_put(netqueue_t *queue, uint8_t *data, int len)
+/* Producer: copy a frame into the next free slot without publishing it. */
+static int
+network_queue_write(netqueue_t *queue, const uint8_t *data, int len)
 {
-    if (len == 0 || len > NET_MAX_FRAME || network_queue_full(queue)) {
+    if (len <= 0 || len > NET_MAX_FRAME) {
+        network_log("Discarded packet of len=%d.\n", len);
         return 0;
     }
 
-    netpkt_t *pkt = &queue->packets[queue->head];
-    memcpy(pkt->data, data, len);
-    pkt->len    = len;
-    queue->head = (queue->head + 1) & NET_QUEUE_LEN_MASK;
+    if ((queue->prod - atomic_load_explicit(&queue->tail, memory_order_acquire)) > queue->mask) {
+        network_log("Discarded %d bytes packet because the queue is full.\n", len);
+        return 0;
+    }
+
+    memcpy(network_queue_slot(queue, queue->prod), data, len);
+    queue->lens[queue->prod & queue->mask] = len;
+    if (queue->csum)
+        queue->csum[queue->prod & queue->mask] = 0;
+    queue->prod++;
     return 1;
 }
 
-int
-network_queue_put_swap(netqueue_t *queue, netpkt_t *src_pkt)
-{
-    if (src_pkt->len == 0 || src_pkt->len > NET_MAX_FRAME || network_queue_full(queue)) {
-#ifdef DEBUG
-        if (src_pkt->len == 0) {
-            network_log("Discarded zero length packet.\n");
-        } else if (src_pkt->len > NET_MAX_FRAME) {
-            network_log("Discarded oversized packet of len=%d.\n", src_pkt->len);
-        } else {
-            network_log("Discarded %d bytes packet because the queue is full.\n", src_pkt->len);
-        }
-#endif
-        return 0;
-    }
+/* Producer: the slot the next frame goes into, or NULL if the queue is full. */
+static inline uint8_t *
+network_queue_next(netqueue_t *queue)
+{
+    if ((queue->prod - atomic_load_explicit(&queue->tail, memory_order_acquire)) > queue->mask)
+        return NULL;
 
-    netpkt_t *dst_pkt = &queue->packets[queue->head];
-    network_swap_packet(src_pkt, dst_pkt);
+    return network_queue_slot(queue, queue->prod);
+}
 
-    queue->head = (queue->head + 1) & NET_QUEUE_LEN_MASK;
-    return 1;
+static inline void
+network_queue_publish(netqueue_t *queue)
+{
+    atomic_store_explicit(&queue->head, queue->prod, memory_order_release);
 }
 
 static int
-network_queue_get_swap(netqueue_t *queue, netpkt_t *dst_pkt)
+network_queue_put(netqueue_t *queue, const uint8_t *data, int len)
 {
-    if (network_queue_empty(queue))
+    if (!network_queue_write(queue, data, len))
         return 0;
 
-    netpkt_t *src_pkt = &queue->packets[queue->tail];
-    network_swap_packet(src_pkt, dst_pkt);
-    queue->tail = (queue->tail + 1) & NET_QUEUE_LEN_MASK;
+    network_queue_publish(queue);
     return 1;
 }
 
+/* Producer: hand out up to vec_size free slots to be filled in place. */
 static int
-network_queue_move(netqueue_t *dst_q, netqueue_t *src_q)
+network_queue_reserve(netqueue_t *queue, netpkt_t *pkt_vec, int vec_size)
 {
-    if (network_queue_empty(src_q))
-        return 0;
+    uint32_t used  = queue->prod - atomic_load_explicit(&queue->tail, memory_order_acquire);
+    int      count = (int) (queue->mask + 1 - used);
 
-    if (network_queue_full(dst_q)) {
-        return 0;
+    if (count > vec_size)
+        count = vec_size;
+
+    for (int i = 0; i < count; i++) {
+        pkt_vec[i].data        = network_queue_slot(queue, queue->prod + i);
+        pkt_vec[i].len         = 0;
+        pkt_vec[i].csum_start  = 0;
+        pkt_vec[i].csum_offset = 0;
     }
 
-    netpkt_t *src_pkt = &src_q->packets[src_q->tail];
-    netpkt_t *dst_pkt = &dst_q->packets[dst_q->head];
+    return count;
+}
 
-    network_swap_packet(src_pkt, dst_pkt);
-    dst_q->head = (dst_q->head + 1) & NET_QUEUE_LEN_MASK;
-    src_q->tail = (src_q->tail + 1) & NET_QUEUE_LEN_MASK;
+/* Producer: publish reserved slots; bad lengths are left as empty frames. */
+static void
+network_queue_commit(netqueue_t *queue, const netpkt_t *pkt_vec, int count)
+{
+    for (int i = 0; i < count; i++) {
+        int len = pkt_vec[i].len;
 
-    return dst_pkt->len;
+        queue->lens[queue->prod & queue->mask] = (len > 0 && len <= NET_MAX_FRAME) ? len : 0;
+        queue->prod++;
+    }
+
+    if (count)
+        network_queue_publish(queue);
+}
+
+/* Consumer: point up to vec_size entries at the oldest published frames. */
+static int
+network_queue_peekv(netqueue_t *queue, netpkt_t *pkt_vec, int vec_size)
+{
+    uint32_t tail  = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head  = atomic_load_explicit(&queue->head, memory_order_acquire);
+    int      count = 0;
+
+    while ((tail != head) && (count < vec_size)) {
+        uint32_t csum = queue->csum ? queue->csum[tail & queue->mask] : 0;
+
+        pkt_vec[count].data        = network_queue_slot(queue, tail);
+        pkt_vec[count].len         = queue->lens[tail & queue->mask];
+        pkt_vec[count].csum_start  = csum >> 16;
+        pkt_vec[count].csum_offset = csum & 0xffff;
+        count++;
+        tail++;
+    }
+
+    return count;
+}
+
+/* Consumer: give the oldest count frames back to the producer. */
+static inline void
+network_queue_release(netqueue_t *queue, int count)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&queue->tail, tail + count, memory_order_release);
+}
+
+static inline bool
+network_queue_empty(netqueue_t *queue)
+{
+    return atomic_load(&queue->head) == atomic_load(&queue->tail);
 }
 
+/*
+ * Put an idle card to sleep. The backend checks the sleeping mask after
+ * publishing a frame, so the fences make sure that either it sees the
+ * card asleep or the card sees its frame.
+ */
+static bool
+network_card_sleep(netcard_t *card)
+{
+    uint32_t bit = 1 << card->card_num;
+
+    if (card->queues[NET_QUEUE_TX]->prod != atomic_load_explicit(&card->queues[NET_QUEUE_TX]->head, memory_order_relaxed))
+        return false;
+
+    atomic_fetch_or(&network_sleeping, bit);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!network_queue_empty(card->queues[NET_QUEUE_RX]) || !network_queue_empty(card->queues[NET_QUEUE_LOOPBACK])) {
+        atomic_fetch_and(&network_sleeping, ~bit);
+        return false;
+    }
+
+    return true;
+}
+
+/* Restart a sleeping card's timer; emulation thread only. */
+static void
+network_card_wake(netcard_t *card)
+{
+    uint32_t bit = 1 << card->card_num;
+
+    if (atomic_fetch_and(&network_sleeping, ~bit) & bit)
+        timer_on_auto(&card->timer, 1);
+}
+
+/* Ask the emulation thread to wake a sleeping card; any thread. */
+static void
+network_card_kick(uint16_t card_num)
+{
+    uint32_t bit = 1 << card_num;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&network_sleeping) & bit)
+        atomic_fetch_or(&network_wake, bit);
+}
+
+/* Called from the emulation loop to restart cards that the host has woken. */
 void
-network_queue_clear(netqueue_t *queue)
+network_wake_cards(void)
+{
+    uint32_t wake = atomic_exchange(&network_wake, 0);
+
+    for (int i = 0; wake && (i < NET_CARD_MAX); i++, wake >>= 1) {
+        if ((wake & 1) && network_cards[i])
+            network_card_wake(network_cards[i]);
+    }
+}
+
+/* Account for the time a frame spent between the host and the card. */
+static void
+network_rx_latency(netstats_t *stats, uint64_t now, uint64_t stamp)
+{
+    uint64_t us = (now > stamp) ? (((now - stamp) * 1000000) / timer_freq) : 0;
+
+    net_stats_add(&stats->rx_latency_sum, us);
+    net_stats_hist(stats->rx_latency, us);
+    if (us > atomic_load_explicit(&stats->rx_latency_max, memory_order_relaxed))
+        atomic_store_explicit(&stats->rx_latency_max, us, memory_order_relaxed);
+}
+
+/*
+ * Hand frames from a ring to the card. Returns 0 once the card refuses
+ * a frame, which then stays queued for the next timer tick. Empty slots
+ * left by backends that filter in place do not count against the budget.
+ */
+static int
+network_rx_deliver(netcard_t *card, netqueue_t *queue, int *budget, uint32_t *rx_bytes)
 {
-    for (int i = 0; i < NET_QUEUE_LEN; i++) {
-        free(queue->packets[i].data);
-        queue->packets[i].len = 0;
+    netstats_t *stats = &net_stats[card->card_num];
+    netpkt_t    pkt_vec[NET_BATCH_LEN];
+    uint64_t    now = 0;
+    int         packets;
+
+    while ((*budget > 0) && (packets = network_queue_peekv(queue, pkt_vec, NET_BATCH_LEN)) > 0) {
+        uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        int      done = 0;
+
+        if (queue->stamps && !now)
+            now = plat_timer_read();
+
+        for (; (done < packets) && (*budget > 0); done++) {
+            netpkt_t *pkt = &pkt_vec[done];
+
+            if (pkt->len == 0)
+                continue;
+
+            if (!card->rx(card->card_drv, pkt->data, pkt->len)) {
+                net_stats_add(&stats->rx_refused, 1);
+                network_queue_release(queue, done);
+                return 0;
+            }
+            net_capture(card->card_num, NET_CAPTURE_IN, pkt->data, pkt->len);
+            network_dump_packet(pkt);
+            net_stats_add(&stats->rx_frames, 1);
+            net_stats_add(&stats->rx_bytes, pkt->len);
+            if (queue->stamps)
+                network_rx_latency(stats, now, queue->stamps[(tail + done) & queue->mask]);
+            *rx_bytes += pkt->len;
+            (*budget)--;
+        }
+
+        network_queue_release(queue, done);
     }
-    queue->tail = queue->head = 0;
+
+    return 1;
 }
 
 static void
@@ -395,46 +613,53 @@ network_rx_queue(void *priv)
         card->link_state = new_link_state;
     }
 
-    uint32_t rx_bytes = 0;
-    for (int i = 0; i < NET_QUEUE_LEN; i++) {
-        if (card->queued_pkt.len == 0) {
-            thread_wait_mutex(card->rx_mutex);
-            int res = network_queue_get_swap(&card->queues[NET_QUEUE_RX], &card->queued_pkt);
-            thread_release_mutex(card->rx_mutex);
-            if (!res)
-                break;
-        }
-
-        network_dump_packet(&card->queued_pkt);
-        int res = card->rx(card->card_drv, card->queued_pkt.data, card->queued_pkt.len);
-        if (!res)
-            break;
-        rx_bytes += card->queued_pkt.len;
-        card->queued_pkt.len = 0;
-    }
+    netqueue_t *rx    = card->queues[NET_QUEUE_RX];
+    netqueue_t *tx    = card->queues[NET_QUEUE_TX];
+    netstats_t *stats = &net_stats[card->card_num];
+    net_stats_hist(stats->rx_depth, atomic_load_explicit(&rx->head, memory_order_acquire) - atomic_load_explicit(&rx->tail, memory_order_relaxed));
+    net_stats_hist(stats->tx_depth, tx->prod - atomic_load_explicit(&tx->tail, memory_order_acquire));
 
-    /* Transmission. */
-    uint32_t tx_bytes = 0;
-    thread_wait_mutex(card->tx_mutex);
-    for (int i = 0; i < NET_QUEUE_LEN; i++) {
-        uint32_t bytes = network_queue_move(&card->queues[NET_QUEUE_TX_HOST], &card->queues[NET_QUEUE_TX_VM]);
-        if (!bytes)
-            break;
-        tx_bytes += bytes;
-    }
-    thread_release_mutex(card->tx_mutex);
+    uint32_t rx_bytes = 0;
+    int      budget   = NET_BATCH_LEN;
+    int      accepted = network_rx_deliver(card, card->queues[NET_QUEUE_LOOPBACK], &budget, &rx_bytes);
+    if (accepted)
+        accepted = network_rx_deliver(card, rx, &budget, &rx_bytes);
+
+    /* Transmission: release the frames queued by the card since the last tick. */
+    uint32_t    head     = atomic_load_explicit(&tx->head, memory_order_relaxed);
+    uint32_t    tx_bytes = 0;
+    for (int i = 0; (i < NET_BATCH_LEN) && (head != tx->prod); i++, head++)
+        tx_bytes += tx->lens[head & tx->mask];
     if (tx_bytes) {
+        atomic_store_explicit(&tx->head, head, memory_order_release);
+
         /* Notify host that a packet is available in the TX queue */
         card->host_drv.notify_in(card->host_drv.priv);
     }
 
-    double timer_period = card->byte_period * (rx_bytes > tx_bytes ? rx_bytes : tx_bytes);
-    if (timer_period < 200)
-        timer_period = 200;
+    bool activity = rx_bytes || tx_bytes;
+
+    /* Nothing left to do: stop the timer until the host or the card queues a frame. */
+    if (!activity && accepted && network_card_sleep(card)) {
+        if (card->led_timer & 0x80000000) {
+            ui_sb_update_icon(SB_NETWORK | card->card_num, 0);
+            ui_sb_update_icon_write(SB_NETWORK | card->card_num, 0);
+        }
+        card->led_timer = 0;
+        return;
+    }
+
+    double timer_period;
+    if (net_cards_conf[card->card_num].fast_link)
+        timer_period = NET_PERIOD_FAST;
+    else {
+        timer_period = card->byte_period * (rx_bytes > tx_bytes ? rx_bytes : tx_bytes);
+        if (timer_period < 200)
+            timer_period = 200;
+    }
 
     timer_on_auto(&card->timer, timer_period);
 
-    bool activity = rx_bytes || tx_bytes;
     bool led_on   = card->led_timer & 0x80000000;
     if ((activity && !led_on) || (card->led_timer & 0x7fffffff) >= 150000) {
         ui_sb_update_icon(SB_NETWORK | card->card_num, !!(rx_bytes));
@@ -445,6 +670,15 @@ network_rx_queue(void *priv)
     card->led_timer += timer_period;
 }
 
+static void
+network_queues_close(netcard_t *card)
+{
+    for (int i = 0; i < NET_QUEUE_COUNT; i++) {
+        network_queue_close(card->queues[i]);
+        card->queues[i] = NULL;
+    }
+}
+
 /*
  * Attach a network card to the system.
  *
@@ -455,23 +689,24 @@ network_rx_queue(void *priv)
 netcard_t *
 network_attach(void *card_drv, uint8_t *mac, NETRXCB rx, NETSETLINKSTATE set_link_state)
 {
-    netcard_t *card       = calloc(1, sizeof(netcard_t));
-    int net_type          = net_cards_conf[net_card_current].net_type;
-    card->queued_pkt.data = calloc(1, NET_MAX_FRAME);
-    card->card_drv        = card_drv;
-    card->rx              = rx;
-    card->set_link_state  = set_link_state;
-    card->tx_mutex        = thread_create_mutex();
-    card->rx_mutex        = thread_create_mutex();
-    card->card_num        = net_card_current;
-    card->byte_period     = NET_PERIOD_10M;
+    netcard_t *card      = calloc(1, sizeof(netcard_t));
+    int net_type         = net_cards_conf[net_card_current].net_type;
+    uint32_t depth       = network_queue_depth(net_cards_conf[net_card_current].queue_len);
+    card->card_drv       = card_drv;
+    card->rx             = rx;
+    card->set_link_state = set_link_state;
+    card->card_num       = net_card_current;
+    card->byte_period    = NET_PERIOD_10M;
 
     char net_drv_error[NET_DRV_ERRBUF_SIZE];
     wchar_t tempmsg[NET_DRV_ERRBUF_SIZE * 2];
 
-    for (int i = 0; i < NET_QUEUE_COUNT; i++) {
-        network_queue_init(&card->queues[i]);
-    }
+    card->queues[NET_QUEUE_RX]       = network_queue_init(depth, QUEUE_STAMPS);
+    card->queues[NET_QUEUE_TX]       = network_queue_init(depth, QUEUE_CSUM);
+    card->queues[NET_QUEUE_RX_ON_TX] = network_queue_init(depth, 0);
+    card->queues[NET_QUEUE_LOOPBACK] = network_queue_init(NET_BATCH_LEN, 0);
+    net_stats_reset(card->card_num);
+    network_log("NETWORK: card %d using %u-frame queues\n", card->card_num, depth);
 
     if ((!strcmp(network_card_get_internal_name(net_cards_conf[net_card_current].device_num), "modem") ||
          !strcmp(network_card_get_internal_name(net_cards_conf[net_card_current].device_num), "plip")) && (net_type >= NET_TYPE_PCAP)) {
@@ -504,6 +739,10 @@ network_attach(void *card_drv, uint8_t *mac, NETRXCB rx, NETSETLINKSTATE set_lin
         case NET_TYPE_NLSWITCH:
         case NET_TYPE_NRSWITCH:
             card->host_drv      = net_switch_drv;
+#ifdef HAS_SHM_SWITCH
+            if ((net_cards_conf[net_card_current].net_type == NET_TYPE_NLSWITCH) && net_cards_conf[net_card_current].switch_shm)
+                card->host_drv = net_switch_shm_drv;
+#endif
             card->host_drv.priv = card->host_drv.init(card, mac, &net_cards_conf[net_card_current], net_drv_error);
             break;
         default:
@@ -533,13 +772,7 @@ network_attach(void *card_drv, uint8_t *mac, NETRXCB rx, NETSETLINKSTATE set_lin
         // If null fails, something is very wrong
         // Clean up and fatal
         if(!card->host_drv.priv) {
-            thread_close_mutex(card->tx_mutex);
-            thread_close_mutex(card->rx_mutex);
-            for (int i = 0; i < NET_QUEUE_COUNT; i++) {
-                network_queue_clear(&card->queues[i]);
-            }
-
-            free(card->queued_pkt.data);
+            network_queues_close(card);
             free(card);
             // Placeholder - insert the error message
             fatal("Error initializing the network device: Null driver initialization failed\n");
@@ -548,6 +781,8 @@ network_attach(void *card_drv, uint8_t *mac, NETRXCB rx, NETSETLINKSTATE set_lin
 
     }
 
+    network_cards[card->card_num] = card;
+    atomic_fetch_and(&network_sleeping, ~(1 << card->card_num));
     timer_add(&card->timer, network_rx_queue, card, 0);
     timer_on_auto(&card->timer, 100);
 
@@ -560,13 +795,10 @@ netcard_close(netcard_t *card)
     timer_stop(&card->timer);
     card->host_drv.close(card->host_drv.priv);
 
-    thread_close_mutex(card->tx_mutex);
-    thread_close_mutex(card->rx_mutex);
-    for (int i = 0; i < NET_QUEUE_COUNT; i++) {
-        network_queue_clear(&card->queues[i]);
-    }
+    network_cards[card->card_num] = NULL;
+    atomic_fetch_and(&network_sleeping, ~(1 << card->card_num));
 
-    free(card->queued_pkt.data);
+    network_queues_close(card);
     free(card);
 }
 
@@ -612,103 +844,269 @@ network_reset(void)
     }
 }
 
-/* Queue a packet for transmission to one of the network providers. */
+/*
+ * Queue a packet for transmission to one of the network providers.
+ *
+ * The frame is not visible to the provider until the card timer
+ * releases it, which is what paces the guest to the link speed.
+ */
 void
 network_tx(netcard_t *card, uint8_t *bufp, int len)
 {
-    network_queue_put(&card->queues[NET_QUEUE_TX_VM], bufp, len);
+    netstats_t *stats = &net_stats[card->card_num];
+
+    if (!network_queue_write(card->queues[NET_QUEUE_TX], bufp, len)) {
+        net_stats_add(&stats->tx_dropped, 1);
+        return;
+    }
+
+    net_capture(card->card_num, NET_CAPTURE_OUT, bufp, len);
+    net_stats_add(&stats->tx_frames, 1);
+    net_stats_add(&stats->tx_bytes, len);
+    network_card_wake(card);
 }
 
-int
-network_tx_pop(netcard_t *card, netpkt_t *out_pkt)
+/*
+ * Let a card gather a frame straight into the TX queue: fill the slot
+ * returned by network_tx_reserve() (NET_MAX_FRAME bytes, NULL if the queue
+ * is full), then queue it with network_tx_commit(). Nothing else may be
+ * transmitted on the card in between.
+ */
+uint8_t *
+network_tx_reserve(netcard_t *card)
 {
-    int ret = 0;
+    return network_queue_next(card->queues[NET_QUEUE_TX]);
+}
 
-    thread_wait_mutex(card->tx_mutex);
-    ret = network_queue_get_swap(&card->queues[NET_QUEUE_TX_HOST], out_pkt);
-    thread_release_mutex(card->tx_mutex);
+/*
+ * Queue the frame in the reserved slot. A pending checksum is left to the
+ * backend if it can do it, and otherwise filled in here.
+ */
+static void
+network_tx_queue(netcard_t *card, int len, int csum_start, int csum_offset)
+{
+    netqueue_t *queue = card->queues[NET_QUEUE_TX];
+    netstats_t *stats = &net_stats[card->card_num];
+    uint8_t    *slot;
 
-    return ret;
+    if ((len <= 0) || (len > NET_MAX_FRAME) || !(slot = network_queue_next(queue))) {
+        network_log("Discarded packet of len=%d.\n", len);
+        net_stats_add(&stats->tx_dropped, 1);
+        return;
+    }
+
+    if (csum_start && ((csum_start + csum_offset + 2) > len))
+        csum_start = 0;
+    if (csum_start && !(card->offload & NET_OFFLOAD_CSUM)) {
+        network_csum_finish(slot, len, csum_start, csum_offset);
+        csum_start = 0;
+    }
+
+    net_capture(card->card_num, NET_CAPTURE_OUT, slot, len);
+    net_stats_add(&stats->tx_frames, 1);
+    net_stats_add(&stats->tx_bytes, len);
+    queue->lens[queue->prod & queue->mask] = len;
+    queue->csum[queue->prod & queue->mask] = csum_start ? ((csum_start << 16) | csum_offset) : 0;
+    queue->prod++;
+    network_card_wake(card);
 }
 
-int
-network_tx_popv(netcard_t *card, netpkt_t *pkt_vec, int vec_size)
+void
+network_tx_commit(netcard_t *card, int len)
 {
-    int pkt_count = 0;
+    network_tx_queue(card, len, 0, 0);
+}
+
+/*
+ * Transmit a frame made up of several pieces, gathered into the TX queue.
+ * The checksum fields of the first piece describe the whole frame.
+ */
+void
+network_txv(netcard_t *card, const netpkt_t *pkt_vec, int vec_size)
+{
+    uint8_t *slot = network_tx_reserve(card);
+    int      len  = 0;
+
+    if (!slot) {
+        network_log("Discarded packet because the queue is full.\n");
+        net_stats_add(&net_stats[card->card_num].tx_dropped, 1);
+        return;
+    }
 
-    netqueue_t *queue = &card->queues[NET_QUEUE_TX_HOST];
-    thread_wait_mutex(card->tx_mutex);
     for (int i = 0; i < vec_size; i++) {
-        if (!network_queue_get_swap(queue, pkt_vec))
-            break;
-        network_dump_packet(pkt_vec);
-        pkt_count++;
-        pkt_vec++;
+        if ((len + pkt_vec[i].len) > NET_MAX_FRAME) {
+            network_log("Discarded oversized packet.\n");
+            net_stats_add(&net_stats[card->card_num].tx_dropped, 1);
+            return;
+        }
+        memcpy(slot + len, pkt_vec[i].data, pkt_vec[i].len);
+        len += pkt_vec[i].len;
     }
-    thread_release_mutex(card->tx_mutex);
 
-    return pkt_count;
+    network_tx_queue(card, len, pkt_vec[0].csum_start, pkt_vec[0].csum_offset);
 }
 
-int
-network_rx_put(netcard_t *card, uint8_t *bufp, int len)
+/* Add data to a running ones' complement sum. */
+uint32_t
+network_csum_add(const uint8_t *data, int len, uint32_t sum)
+{
+    uint64_t acc = sum;
+    int      i   = 0;
+
+    /* Four bytes at a time into a wide accumulator, folded once at the end. */
+    for (; (i + 4) <= len; i += 4)
+        acc += ((uint32_t) data[i] << 24) | ((uint32_t) data[i + 1] << 16) | ((uint32_t) data[i + 2] << 8) | data[i + 3];
+    for (; (i + 2) <= len; i += 2)
+        acc += ((uint32_t) data[i] << 8) | data[i + 1];
+    if (i < len)
+        acc += (uint32_t) data[i] << 8;
+
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    return (uint32_t) acc;
+}
+
+uint16_t
+network_csum_fold(uint32_t sum)
 {
-    int ret = 0;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t) sum;
+}
 
-    thread_wait_mutex(card->rx_mutex);
-    ret = network_queue_put(&card->queues[NET_QUEUE_RX], bufp, len);
-    thread_release_mutex(card->rx_mutex);
+/* Fill in a pending checksum, see netpkt_t. */
+void
+network_csum_finish(uint8_t *frame, int len, int csum_start, int csum_offset)
+{
+    uint16_t csum = ~network_csum_fold(network_csum_add(frame + csum_start, len - csum_start, 0));
 
-    return ret;
+    frame[csum_start + csum_offset]     = csum >> 8;
+    frame[csum_start + csum_offset + 1] = csum & 0xff;
 }
 
+/* Loop a transmitted frame back to the card, from the card's own context. */
 int
-network_rx_on_tx_popv(netcard_t *card, netpkt_t *pkt_vec, int vec_size)
+network_loopback(netcard_t *card, uint8_t *bufp, int len)
 {
-    int pkt_count = 0;
-
-    netqueue_t *queue = &card->queues[NET_QUEUE_RX_ON_TX];
-    for (int i = 0; i < vec_size; i++) {
-        if (!network_queue_get_swap(queue, pkt_vec))
-            break;
-        network_dump_packet(pkt_vec);
-        pkt_count++;
-        pkt_vec++;
-    }
+    if (!network_queue_put(card->queues[NET_QUEUE_LOOPBACK], bufp, len))
+        return 0;
 
-    return pkt_count;
+    network_card_wake(card);
+    return 1;
 }
 
+/*
+ * Batch drain of the TX queue. The returned packets point straight into
+ * the queue and stay valid until network_tx_release() gives them back.
+ */
 int
-network_rx_on_tx_put(netcard_t *card, uint8_t *bufp, int len)
+network_tx_peekv(netcard_t *card, netpkt_t *pkt_vec, int vec_size)
 {
-    int ret = 0;
+    int packets = network_queue_peekv(card->queues[NET_QUEUE_TX], pkt_vec, vec_size);
 
-    ret = network_queue_put(&card->queues[NET_QUEUE_RX_ON_TX], bufp, len);
+#ifdef ENABLE_NETWORK_LOG
+    for (int i = 0; i < packets; i++)
+        network_dump_packet(&pkt_vec[i]);
+#endif
 
-    return ret;
+    return packets;
+}
+
+void
+network_tx_release(netcard_t *card, int count)
+{
+    network_queue_release(card->queues[NET_QUEUE_TX], count);
 }
 
 int
-network_rx_on_tx_put_pkt(netcard_t *card, netpkt_t *pkt)
+network_rx_put(netcard_t *card, uint8_t *bufp, int len)
 {
-    int ret = 0;
+    netqueue_t *queue = card->queues[NET_QUEUE_RX];
 
-    ret = network_queue_put_swap(&card->queues[NET_QUEUE_RX_ON_TX], pkt);
+    if (!network_queue_write(queue, bufp, len)) {
+        net_stats_add(&net_stats[card->card_num].rx_dropped, 1);
+        return 0;
+    }
 
-    return ret;
+    queue->stamps[(queue->prod - 1) & queue->mask] = plat_timer_read();
+    network_queue_publish(queue);
+    network_card_kick(card->card_num);
+    return 1;
 }
 
 int
 network_rx_put_pkt(netcard_t *card, netpkt_t *pkt)
 {
-    int ret = 0;
+    return network_rx_put(card, pkt->data, pkt->len);
+}
+
+/*
+ * Let a backend receive straight into the RX queue: reserve free slots,
+ * fill in data and len, then commit the ones that were used, in order.
+ */
+int
+network_rx_reserve(netcard_t *card, netpkt_t *pkt_vec, int vec_size)
+{
+    return network_queue_reserve(card->queues[NET_QUEUE_RX], pkt_vec, vec_size);
+}
+
+void
+network_rx_commit(netcard_t *card, const netpkt_t *pkt_vec, int count)
+{
+    netqueue_t *queue = card->queues[NET_QUEUE_RX];
+    uint64_t    now;
+
+    if (!count)
+        return;
+
+    now = plat_timer_read();
+    for (int i = 0; i < count; i++)
+        queue->stamps[(queue->prod + i) & queue->mask] = now;
+
+    network_queue_commit(queue, pkt_vec, count);
+    network_card_kick(card->card_num);
+}
+
+/*
+ * Backend side; account for host I/O calls made on behalf of the card.
+ * Some backends also make them from the emulation thread, so this one
+ * counter takes a real atomic add.
+ */
+void
+network_count_syscalls(const netcard_t *card, int count)
+{
+    atomic_fetch_add_explicit(&net_stats[card->card_num].syscalls, count, memory_order_relaxed);
+}
 
-    thread_wait_mutex(card->rx_mutex);
-    ret = network_queue_put_swap(&card->queues[NET_QUEUE_RX], pkt);
-    thread_release_mutex(card->rx_mutex);
+/* Backend side; account for frames thrown away because the RX queue was full. */
+void
+network_rx_dropped(const netcard_t *card, int count)
+{
+    net_stats_add(&net_stats[card->card_num].rx_dropped, count);
+}
 
-    return ret;
+int
+network_rx_on_tx_peekv(netcard_t *card, netpkt_t *pkt_vec, int vec_size)
+{
+    return network_queue_peekv(card->queues[NET_QUEUE_RX_ON_TX], pkt_vec, vec_size);
+}
+
+void
+network_rx_on_tx_release(netcard_t *card, int count)
+{
+    network_queue_release(card->queues[NET_QUEUE_RX_ON_TX], count);
+}
+
+int
+network_rx_on_tx_put(netcard_t *card, uint8_t *bufp, int len)
+{
+    return network_queue_put(card->queues[NET_QUEUE_RX_ON_TX], bufp, len);
+}
+
+int
+network_rx_on_tx_put_pkt(netcard_t *card, netpkt_t *pkt)
+{
+    return network_queue_put(card->queues[NET_QUEUE_RX_ON_TX], pkt->data, pkt->len);
 }
 
 void
@@ -722,6 +1120,9 @@ network_connect(int id, int connect)
     } else {
         net_cards_conf[id].link_state |= NET_LINK_DOWN;
     }
+
+    /* The card timer picks up link state changes. */
+    network_card_kick(id);
 }
 
 int
@@ -54,31 +54,17 @@ plat_serpt_close(void *priv)
     CloseHandle((HANDLE) dev->master_fd);
 }
 
-static void
-plat_serpt_write_vcon(serial_passthrough_t *dev, uint8_t data)
+/* Returns how much was written; the caller keeps the rest for later. */
+static int
+plat_serpt_write_vcon(serial_passthrough_t *dev, const uint8_t *data, int len)
 {
-#if 0
-    fd_set wrfds;
-    int res;
-#endif
-
-    /* We cannot use select here, this would block the hypervisor! */
-#if 0
-    FD_ZERO(&wrfds);
-    FD_SET(ctx->master_fd, &wrfds);
-
-    res = select(ctx->master_fd + 1, NULL, &wrfds, NULL, NULL);
+    DWORD bytesWritten = 0;
 
-    if (res <= 0)
-        return;
-#endif
+    /* We cannot wait for the pipe here, this would block the hypervisor! */
+    if (!WriteFile((HANDLE) dev->master_fd, data, len, &bytesWritten, NULL))
+        return 0;
 
-    /* just write it out */
-#if 0
-    fwrite(dev->master_fd, &data, 1);
-#endif
-    DWORD bytesWritten = 0;
-    WriteFile((HANDLE) dev->master_fd, &data, 1, &bytesWritten, NULL);
+    return (int) bytesWritten;
 }
 
 void
@@ -167,8 +153,8 @@ plat_serpt_set_params(void *priv)
     }
 }
 
-void
-plat_serpt_write(void *priv, uint8_t data)
+int
+plat_serpt_write(void *priv, const uint8_t *data, int len)
 {
     serial_passthrough_t *dev = (serial_passthrough_t *) priv;
 
@@ -176,23 +162,27 @@ plat_serpt_write(void *priv, uint8_t data)
         case SERPT_MODE_NPIPE_SRV:
         case SERPT_MODE_NPIPE_CLNT:
         case SERPT_MODE_HOSTSER:
-            plat_serpt_write_vcon(dev, data);
-            break;
+            return plat_serpt_write_vcon(dev, data, len);
         default:
             break;
     }
+    return 0;
 }
 
-uint8_t
-plat_serpt_read_vcon(serial_passthrough_t *dev, uint8_t *data)
+/* The pipes are PIPE_NOWAIT and the port has no read timeout, so this never waits. */
+static int
+plat_serpt_read_vcon(serial_passthrough_t *dev, uint8_t *data, int len)
 {
     DWORD bytesRead = 0;
-    ReadFile((HANDLE) dev->master_fd, data, 1, &bytesRead, NULL);
-    return !!bytesRead;
+
+    if (!ReadFile((HANDLE) dev->master_fd, data, len, &bytesRead, NULL))
+        return 0;
+
+    return (int) bytesRead;
 }
 
 int
-plat_serpt_read(void *priv, uint8_t *data)
+plat_serpt_read(void *priv, uint8_t *data, int len)
 {
     serial_passthrough_t *dev = (serial_passthrough_t *) priv;
     int                   res = 0;
@@ -201,7 +191,7 @@ plat_serpt_read(void *priv, uint8_t *data)
         case SERPT_MODE_NPIPE_SRV:
         case SERPT_MODE_NPIPE_CLNT:
         case SERPT_MODE_HOSTSER:
-            res = plat_serpt_read_vcon(dev, data);
+            res = plat_serpt_read_vcon(dev, data, len);
             break;
         default:
             break;
@@ -1,4 +1,5 @@
 /* some code borrowed from scummvm */
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +22,11 @@
 #define RENDER_RATE                100
 #define BUFFER_SEGMENTS            10
 
+/* Deterministic mode. */
+#define FS_EVENTS  1024 /* queued MIDI messages */
+#define FS_OUT_LEN 4096 /* rendered frames, a few render periods */
+#define FS_CHUNK   1024 /* frames passed on at once, fits a capture block */
+
 /* Check the FluidSynth version to determine wheteher to use the older reverb/chorus
    control functions that were deprecated in 2.2.0, or their newer replacements */
 #if (FLUIDSYNTH_VERSION_MAJOR < 2) || ((FLUIDSYNTH_VERSION_MAJOR == 2) && (FLUIDSYNTH_VERSION_MINOR < 2))
@@ -30,6 +36,13 @@
 extern void givealbuffer_midi(void *buf, uint32_t size);
 extern void al_set_midi(int freq, int buf_size);
 
+typedef struct fluidsynth_event_t {
+    uint32_t     ts; /* in synth frames */
+    uint32_t     msg;
+    uint8_t     *sysex; /* owned by the queue, NULL for a short message */
+    unsigned int len;
+} fluidsynth_event_t;
+
 typedef struct fluidsynth {
     fluid_settings_t *settings;
     fluid_synth_t    *synth;
@@ -44,6 +57,25 @@ typedef struct fluidsynth {
     int       midi_pos;
 
     int on;
+
+    /*
+       Deterministic mode: messages are stamped with the emulated time and
+       the thread renders exactly up to the emulated clock, which the poll
+       routine advances once per render period. The emulation thread then
+       takes each finished period back for output and capture, waiting for
+       the synth if it falls behind instead of dropping audio.
+     */
+    int                deterministic;
+    fluidsynth_event_t events[FS_EVENTS];
+    atomic_uint        ev_head;  /* advanced by the emulation thread */
+    atomic_uint        ev_tail;  /* advanced by the synth thread */
+    atomic_uint        clock;    /* emulated time, in synth frames */
+    atomic_uint        rendered; /* frames written to out */
+    float             *out;
+    event_t           *done_event;
+    uint64_t           samples;   /* emulation thread, in SOUND_FREQ samples */
+    uint32_t           collected; /* emulation thread, frames passed on */
+    int                out_pos;   /* emulation thread, frames in buffer */
 } fluidsynth_t;
 
 fluidsynth_t fsdev;
@@ -54,14 +86,21 @@ fluidsynth_available(void)
     return 1;
 }
 
+static void fluidsynth_poll_deterministic(fluidsynth_t *data);
+static void fluidsynth_render(fluidsynth_t *data);
+
 void
 fluidsynth_poll(void)
 {
     fluidsynth_t *data = &fsdev;
+    data->samples++;
     data->midi_pos++;
     if (data->midi_pos == SOUND_FREQ / RENDER_RATE) {
         data->midi_pos = 0;
-        thread_set_event(data->event);
+        if (data->deterministic)
+            fluidsynth_poll_deterministic(data);
+        else
+            thread_set_event(data->event);
     }
 }
 
@@ -78,7 +117,11 @@ fluidsynth_thread(void *param)
         thread_wait_event(data->event, -1);
         thread_reset_event(data->event);
 
-        if (sound_is_float) {
+        if (data->deterministic) {
+            if (data->synth)
+                fluidsynth_render(data);
+            thread_set_event(data->done_event);
+        } else if (sound_is_float) {
             float *buf = (float *) ((uint8_t *) data->buffer + buf_pos);
             memset(buf, 0, buf_size);
             if (data->synth)
@@ -102,13 +145,9 @@ fluidsynth_thread(void *param)
     }
 }
 
-void
-fluidsynth_msg(uint8_t *msg)
+static void
+fluidsynth_play_msg(fluidsynth_t *data, uint32_t val)
 {
-    fluidsynth_t *data = &fsdev;
-
-    uint32_t val = *((uint32_t *) msg);
-
     uint32_t param2 = (uint8_t) ((val >> 16) & 0xFF);
     uint32_t param1 = (uint8_t) ((val >> 8) & 0xFF);
     uint8_t  cmd    = (uint8_t) (val & 0xF0);
@@ -142,12 +181,153 @@ fluidsynth_msg(uint8_t *msg)
     }
 }
 
+/* Deterministic mode. */
+static uint32_t
+fluidsynth_now(const fluidsynth_t *data)
+{
+    return (uint32_t) ((data->samples * data->samplerate) / SOUND_FREQ);
+}
+
+static void
+fluidsynth_queue(fluidsynth_t *data, uint32_t msg, const uint8_t *sysex, unsigned int len)
+{
+    unsigned int        head = atomic_load_explicit(&data->ev_head, memory_order_relaxed);
+    fluidsynth_event_t *ev;
+
+    /* Messages must not be lost; let the synth catch up. */
+    while ((head - atomic_load_explicit(&data->ev_tail, memory_order_acquire)) >= FS_EVENTS) {
+        thread_set_event(data->event);
+        plat_delay_ms(1);
+    }
+
+    ev        = &data->events[head % FS_EVENTS];
+    ev->ts    = fluidsynth_now(data);
+    ev->msg   = msg;
+    ev->len   = len;
+    ev->sysex = NULL;
+    if (sysex != NULL) {
+        ev->sysex = malloc(len);
+        memcpy(ev->sysex, sysex, len);
+    }
+
+    atomic_store_explicit(&data->ev_head, head + 1, memory_order_release);
+}
+
+/* Renders up to the emulated clock, playing each message at its own frame. */
+static void
+fluidsynth_render(fluidsynth_t *data)
+{
+    const uint32_t target = atomic_load_explicit(&data->clock, memory_order_acquire);
+    unsigned int   tail   = atomic_load_explicit(&data->ev_tail, memory_order_relaxed);
+    uint32_t       pos    = atomic_load_explicit(&data->rendered, memory_order_relaxed);
+
+    for (;;) {
+        const unsigned int  head = atomic_load_explicit(&data->ev_head, memory_order_acquire);
+        fluidsynth_event_t *ev   = &data->events[tail % FS_EVENTS];
+        uint32_t            end  = target;
+        float              *buf;
+
+        if ((tail != head) && ((int32_t) (ev->ts - pos) <= 0)) {
+            if (ev->sysex != NULL) {
+                fluid_synth_sysex(data->synth, (const char *) ev->sysex, ev->len, 0, 0, 0, 0);
+                free(ev->sysex);
+                ev->sysex = NULL;
+            } else
+                fluidsynth_play_msg(data, ev->msg);
+            atomic_store_explicit(&data->ev_tail, ++tail, memory_order_release);
+            continue;
+        }
+
+        if ((tail != head) && ((int32_t) (ev->ts - end) < 0))
+            end = ev->ts;
+        if ((int32_t) (end - pos) <= 0)
+            break;
+
+        /* Stop at the end of the ring, the next pass wraps around. */
+        end = pos + MIN(end - pos, FS_OUT_LEN - (pos % FS_OUT_LEN));
+        buf = &data->out[(pos % FS_OUT_LEN) * 2];
+        memset(buf, 0, (end - pos) * 2 * sizeof(float));
+        fluid_synth_write_float(data->synth, end - pos, buf, 0, 2, buf, 1, 2);
+
+        pos = end;
+        atomic_store_explicit(&data->rendered, pos, memory_order_release);
+    }
+}
+
+/* Passes one finished render period on to the host output and the capture. */
+static void
+fluidsynth_output(fluidsynth_t *data, uint32_t end)
+{
+    const int buf_frames = (int) (data->buf_size / (2 * (sound_is_float ? sizeof(float) : sizeof(int16_t))));
+    int32_t   capture[FS_CHUNK * 2];
+
+    while ((int32_t) (end - data->collected) > 0) {
+        const int    len = MIN(MIN((int) (end - data->collected), FS_OUT_LEN - (int) (data->collected % FS_OUT_LEN)),
+                               MIN(buf_frames - data->out_pos, FS_CHUNK));
+        const float *src = &data->out[(data->collected % FS_OUT_LEN) * 2];
+
+        for (int c = 0; c < (len * 2); c++) {
+            capture[c] = (int32_t) (src[c] * 32768.0f);
+            if (sound_is_float)
+                data->buffer[(data->out_pos * 2) + c] = src[c];
+            else if (capture[c] > 32767)
+                data->buffer_int16[(data->out_pos * 2) + c] = 32767;
+            else if (capture[c] < -32768)
+                data->buffer_int16[(data->out_pos * 2) + c] = -32768;
+            else
+                data->buffer_int16[(data->out_pos * 2) + c] = (int16_t) capture[c];
+        }
+        sound_capture_write(SOUND_CAPTURE_MIDI, capture, len);
+
+        data->collected += len;
+        data->out_pos += len;
+        if (data->out_pos >= buf_frames) {
+            if (sound_is_float)
+                givealbuffer_midi(data->buffer, data->buf_size / sizeof(float));
+            else
+                givealbuffer_midi(data->buffer_int16, data->buf_size / sizeof(int16_t));
+            data->out_pos = 0;
+        }
+    }
+}
+
+static void
+fluidsynth_poll_deterministic(fluidsynth_t *data)
+{
+    const uint32_t prev = atomic_load_explicit(&data->clock, memory_order_relaxed);
+
+    atomic_store_explicit(&data->clock, fluidsynth_now(data), memory_order_release);
+    thread_set_event(data->event);
+
+    /* The previous period has had a whole period to render. */
+    while ((int32_t) (atomic_load_explicit(&data->rendered, memory_order_acquire) - prev) < 0) {
+        thread_wait_event(data->done_event, 1);
+        thread_reset_event(data->done_event);
+    }
+
+    fluidsynth_output(data, prev);
+}
+
+void
+fluidsynth_msg(uint8_t *msg)
+{
+    fluidsynth_t *data = &fsdev;
+
+    if (data->deterministic)
+        fluidsynth_queue(data, *((uint32_t *) msg), NULL, 0);
+    else
+        fluidsynth_play_msg(data, *((uint32_t *) msg));
+}
+
 void
 fluidsynth_sysex(uint8_t *data, unsigned int len)
 {
     fluidsynth_t *d = &fsdev;
 
-    fluid_synth_sysex(d->synth, (const char *) data, len, 0, 0, 0, 0);
+    if (d->deterministic)
+        fluidsynth_queue(d, 0, data, len);
+    else
+        fluid_synth_sysex(d->synth, (const char *) data, len, 0, 0, 0, 0);
 }
 
 void *
@@ -278,6 +458,13 @@ fluidsynth_init(UNUSED(const device_t *info))
 
     al_set_midi(data->samplerate, data->buf_size);
 
+    data->deterministic = (data->synth != NULL) && device_get_config_int("deterministic");
+    if (data->deterministic) {
+        data->out        = calloc(FS_OUT_LEN * 2, sizeof(float));
+        data->done_event = thread_create_event();
+        sound_capture_set_freq(SOUND_CAPTURE_MIDI, data->samplerate);
+    }
+
     dev = calloc(1, sizeof(midi_device_t));
 
     dev->play_msg   = fluidsynth_msg;
@@ -330,6 +517,15 @@ fluidsynth_close(void *priv)
         free(data->buffer_int16);
         data->buffer_int16 = NULL;
     }
+
+    if (data->deterministic) {
+        for (unsigned int c = data->ev_tail; c != data->ev_head; c++)
+            free(data->events[c % FS_EVENTS].sysex);
+        free(data->out);
+        data->out = NULL;
+        thread_destroy_event(data->done_event);
+        data->done_event = NULL;
+    }
 }
 
 static const device_config_t fluidsynth_config[] = {
@@ -536,6 +732,17 @@ static const device_config_t fluidsynth_config[] = {
         .selection      = { { 0 } },
         .bios           = { { 0 } }
     },
+    {
+        .name           = "deterministic",
+        .description    = "Deterministic rendering",
+        .type           = CONFIG_BINARY,
+        .default_string = NULL,
+        .default_int    = 0,
+        .file_filter    = NULL,
+        .spinner        = { 0 },
+        .selection      = { { 0 } },
+        .bios           = { { 0 } }
+    },
     { .name = "", .description = "", .type = CONFIG_END }
   // clang-format on
 };
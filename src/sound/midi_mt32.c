@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -164,6 +165,14 @@ static float   *buffer       = NULL;
 static int16_t *buffer_int16 = NULL;
 static int      midi_pos     = 0;
 
+/*
+   The synth runs on its own thread and renders up to the emulated time,
+   plus one segment of lookahead. Messages are stamped with that same
+   lookahead so they always land ahead of what has been rendered, at the
+   sample the emulation sent them instead of the next segment boundary.
+ */
+static uint64_t    midi_samples = 0; /* emulation thread, SOUND_FREQ samples */
+static atomic_uint mt32_clock;       /* emulated time, in output frames */
 static mt32emu_report_handler_version
 get_mt32_report_handler_version(UNUSED(mt32emu_report_handler_i i))
 {
@@ -198,12 +207,27 @@ mt32_stream_int16(int16_t *stream, int len)
         mt32emu_render_bit16s(context, stream, len);
 }
 
+static uint32_t
+mt32_now(void)
+{
+    return (uint32_t) ((midi_samples * samplerate) / SOUND_FREQ);
+}
+
+/* Timestamp, in synth samples, for a message sent now. */
+static uint32_t
+mt32_timestamp(void)
+{
+    return mt32emu_convert_output_to_synth_timestamp(context, mt32_now() + (samplerate / RENDER_RATE));
+}
+
 void
 mt32_poll(void)
 {
+    midi_samples++;
     midi_pos++;
     if (midi_pos == SOUND_FREQ / RENDER_RATE) {
         midi_pos = 0;
+        atomic_store_explicit(&mt32_clock, mt32_now(), memory_order_release);
         thread_set_event(event);
     }
 }
@@ -211,10 +235,12 @@ mt32_poll(void)
 static void
 mt32_thread(UNUSED(void *param))
 {
-    int      buf_pos = 0;
-    int      bsize   = buf_size / BUFFER_SEGMENTS;
-    float   *buf;
-    int16_t *buf16;
+    const int frame   = 2 * (sound_is_float ? sizeof(float) : sizeof(int16_t));
+    const int frames  = buf_size / frame;
+    int       buf_pos = 0;
+    uint32_t  done    = 0;
+    uint32_t  target;
+    int       len;
 
     thread_set_event(start_event);
 
@@ -222,22 +248,23 @@ mt32_thread(UNUSED(void *param))
         thread_wait_event(event, -1);
         thread_reset_event(event);
 
-        if (sound_is_float) {
-            buf = (float *) ((uint8_t *) buffer + buf_pos);
-            memset(buf, 0, bsize);
-            mt32_stream(buf, bsize / (2 * sizeof(float)));
-            buf_pos += bsize;
-            if (buf_pos >= buf_size) {
-                givealbuffer_midi(buffer, buf_size / sizeof(float));
-                buf_pos = 0;
-            }
-        } else {
-            buf16 = (int16_t *) ((uint8_t *) buffer_int16 + buf_pos);
-            memset(buf16, 0, bsize);
-            mt32_stream_int16(buf16, bsize / (2 * sizeof(int16_t)));
-            buf_pos += bsize;
-            if (buf_pos >= buf_size) {
-                givealbuffer_midi(buffer_int16, buf_size / sizeof(int16_t));
+        target = atomic_load_explicit(&mt32_clock, memory_order_acquire) + (samplerate / RENDER_RATE);
+
+        while (mt32_on && ((int32_t) (target - done) > 0)) {
+            len = MIN((int) (target - done), frames - buf_pos);
+
+            if (sound_is_float)
+                mt32_stream(&buffer[buf_pos * 2], len);
+            else
+                mt32_stream_int16(&buffer_int16[buf_pos * 2], len);
+
+            done += len;
+            buf_pos += len;
+            if (buf_pos >= frames) {
+                if (sound_is_float)
+                    givealbuffer_midi(buffer, buf_size / sizeof(float));
+                else
+                    givealbuffer_midi(buffer_int16, buf_size / sizeof(int16_t));
                 buf_pos = 0;
             }
         }
@@ -248,14 +275,14 @@ void
 mt32_msg(uint8_t *val)
 {
     if (context)
-        mt32_check("mt32emu_play_msg", mt32emu_play_msg(context, *(uint32_t *) val), MT32EMU_RC_OK);
+        mt32_check("mt32emu_play_msg_at", mt32emu_play_msg_at(context, *(uint32_t *) val, mt32_timestamp()), MT32EMU_RC_OK);
 }
 
 void
 mt32_sysex(uint8_t *data, unsigned int len)
 {
     if (context)
-        mt32_check("mt32emu_play_sysex", mt32emu_play_sysex(context, data, len), MT32EMU_RC_OK);
+        mt32_check("mt32emu_play_sysex_at", mt32emu_play_sysex_at(context, data, len, mt32_timestamp()), MT32EMU_RC_OK);
 }
 
 void *
@@ -306,7 +333,10 @@ mt32emu_init(char *control_rom, char *pcm_rom)
 
     midi_out_init(dev);
 
-    mt32_on = 1;
+    mt32_on      = 1;
+    midi_pos     = 0;
+    midi_samples = 0;
+    atomic_init(&mt32_clock, 0);
 
     start_event = thread_create_event();
 
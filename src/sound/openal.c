@@ -15,6 +15,7 @@
  *          Copyright 2016-2019 Miran Grca.
  */
 #include <math.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +32,7 @@
 #include <86box/86box.h>
 #include <86box/midi.h>
 #include <86box/sound.h>
+#include <86box/thread.h>
 #include <86box/plat_unused.h>
 
 #define FREQ   SOUND_FREQ
@@ -45,15 +47,53 @@
 #define I_CDROM_ACTIVITY  6
 #define I_MIDI            7
 
-ALuint        buffers[4];                /* front and back buffers */
-ALuint        buffers_music[4];          /* front and back buffers */
-ALuint        buffers_wt[4];             /* front and back buffers */
-ALuint        buffers_cd[4];             /* front and back buffers */
-ALuint        buffers_fdd[4];            /* front and back buffers */
-ALuint        buffers_hdd[4];            /* front and back buffers */
-ALuint        buffers_midi[4];           /* front and back buffers */
-ALuint        buffers_cdrom_activity[4]; /* front and back buffers */
-static ALuint source[8];                 /* audio sources */
+/*
+ * The emulation thread only copies its blocks into a per-source ring and
+ * never calls into OpenAL. A dedicated output thread moves them from the
+ * rings into the source queues. It keeps as many blocks queued as the
+ * current target asks for. The target grows on an underrun and shrinks
+ * again after a quiet spell. A slight change of source pitch absorbs the
+ * drift between the emulated and the host clocks.
+ */
+#define AL_RING_BLOCKS   8    /* blocks waiting on the emulation side */
+#define AL_BUFFERS       6    /* OpenAL buffers per source */
+#define AL_TARGET_MIN    2
+#define AL_TARGET_MAX    AL_BUFFERS
+#define AL_POLL_MS       5
+#define AL_SETTLE_POLLS  2000 /* about ten seconds without an underrun */
+#define AL_PITCH_DRIFT   0.005f
+
+typedef struct al_block_t {
+    uint8_t *data;
+    size_t   data_size; /* allocated, in bytes */
+    int      size;      /* in samples */
+    int      freq;
+    int      is_float;
+} al_block_t;
+
+typedef struct al_ring_t {
+    /* Shared, single producer and single consumer. A block's data is only
+       ever reallocated by the emulation thread while the block is free. */
+    al_block_t   blocks[AL_RING_BLOCKS];
+    atomic_uint  head; /* advanced by the emulation thread */
+    atomic_uint  tail; /* advanced by the output thread */
+
+    /* Output thread only. */
+    ALuint       buffers[AL_BUFFERS];
+    ALuint       free[AL_BUFFERS];
+    int          free_count;
+    int          queued;
+    int          target;
+    int          settle;
+    int          playing;
+    float        pitch;
+} al_ring_t;
+
+static al_ring_t     rings[8];
+static ALuint        source[8]; /* audio sources */
+static thread_t     *al_thread;
+static event_t      *al_thread_stop;
+static volatile int  al_thread_on = 0;
 
 static int         midi_freq     = 44100;
 static int         midi_buf_size = 4410;
@@ -101,23 +141,167 @@ alutExit(ALvoid)
     }
 }
 
+/* Sized for the usual block; a larger one grows its block in givealbuffer_common(). */
+static void
+al_ring_init(al_ring_t *ring, ALuint src, int max_size, int freq)
+{
+    void *silence = calloc(max_size, sizeof(float));
+
+    for (int i = 0; i < AL_RING_BLOCKS; i++) {
+        ring->blocks[i].data      = (uint8_t *) calloc(max_size, sizeof(float));
+        ring->blocks[i].data_size = ring->blocks[i].data ? (max_size * sizeof(float)) : 0;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+    alGenBuffers(AL_BUFFERS, ring->buffers);
+    for (int i = 0; i < AL_TARGET_MIN; i++) {
+        if (sound_is_float)
+            alBufferData(ring->buffers[i], AL_FORMAT_STEREO_FLOAT32, silence, max_size * (int) sizeof(float), freq);
+        else
+            alBufferData(ring->buffers[i], AL_FORMAT_STEREO16, silence, max_size * (int) sizeof(int16_t), freq);
+    }
+    alSourceQueueBuffers(src, AL_TARGET_MIN, ring->buffers);
+
+    ring->free_count = 0;
+    for (int i = AL_TARGET_MIN; i < AL_BUFFERS; i++)
+        ring->free[ring->free_count++] = ring->buffers[i];
+
+    ring->queued  = AL_TARGET_MIN;
+    ring->target  = AL_TARGET_MIN;
+    ring->settle  = 0;
+    ring->playing = 1;
+    ring->pitch   = 1.0f;
+
+    alSourcePlay(src);
+
+    free(silence);
+}
+
+static void
+al_ring_close(al_ring_t *ring)
+{
+    alDeleteBuffers(AL_BUFFERS, ring->buffers);
+    for (int i = 0; i < AL_RING_BLOCKS; i++) {
+        free(ring->blocks[i].data);
+        ring->blocks[i].data      = NULL;
+        ring->blocks[i].data_size = 0;
+    }
+}
+
+extern bool fast_forward;
+
+/* Output thread: move the waiting blocks into the source queue and steer its latency. */
+static void
+al_ring_service(al_ring_t *ring, ALuint src)
+{
+    ALint        processed = 0;
+    ALint        state;
+    ALuint       buffer;
+    unsigned int head;
+    unsigned int tail;
+    int          fill;
+    float        pitch;
+
+    alGetSourcei(src, AL_BUFFERS_PROCESSED, &processed);
+    while (processed-- > 0) {
+        alSourceUnqueueBuffers(src, 1, &buffer);
+        ring->free[ring->free_count++] = buffer;
+        ring->queued--;
+    }
+
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    while ((tail != head) && ring->free_count) {
+        const al_block_t *block = &ring->blocks[tail % AL_RING_BLOCKS];
+
+        buffer = ring->free[--ring->free_count];
+        if (block->is_float)
+            alBufferData(buffer, AL_FORMAT_STEREO_FLOAT32, block->data, block->size * (int) sizeof(float), block->freq);
+        else
+            alBufferData(buffer, AL_FORMAT_STEREO16, block->data, block->size * (int) sizeof(int16_t), block->freq);
+        alSourceQueueBuffers(src, 1, &buffer);
+        ring->queued++;
+        tail++;
+    }
+
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+    alGetSourcei(src, AL_SOURCE_STATE, &state);
+    if (state != AL_PLAYING) {
+        /* Ran dry, ask for more headroom and hold off until it is there. */
+        if (ring->playing && !fast_forward && (ring->target < AL_TARGET_MAX))
+            ring->target++;
+        ring->playing = 0;
+        ring->settle  = 0;
+
+        if (ring->queued && (ring->queued >= ring->target)) {
+            alSourcePlay(src);
+            ring->playing = 1;
+        }
+        return;
+    }
+
+    if (++ring->settle >= AL_SETTLE_POLLS) {
+        ring->settle = 0;
+        if (ring->target > AL_TARGET_MIN)
+            ring->target--;
+    }
+
+    /* Blocks still waiting in the ring are latency all the same. */
+    fill = ring->queued + (int) (head - tail);
+    if (fill > (ring->target + 1))
+        pitch = 1.0f + AL_PITCH_DRIFT;
+    else if (fill < ring->target)
+        pitch = 1.0f - AL_PITCH_DRIFT;
+    else
+        pitch = 1.0f;
+
+    if (pitch != ring->pitch) {
+        alSourcef(src, AL_PITCH, pitch);
+        ring->pitch = pitch;
+    }
+}
+
+static void
+al_output_thread(UNUSED(void *priv))
+{
+    float gain = -1.0f;
+
+    while (al_thread_on) {
+        const float new_gain = sound_muted ? 0.0f : (float) pow(10.0, (double) sound_gain / 20.0);
+
+        if (new_gain != gain) {
+            alListenerf(AL_GAIN, new_gain);
+            gain = new_gain;
+        }
+
+        for (int i = 0; i < sources; i++)
+            al_ring_service(&rings[i], source[i]);
+
+        thread_wait_event(al_thread_stop, AL_POLL_MS);
+    }
+}
+
 void
 closeal(void)
 {
     if (!initialized)
         return;
 
+    al_thread_on = 0;
+    thread_set_event(al_thread_stop);
+    thread_wait(al_thread);
+    thread_destroy_event(al_thread_stop);
+    al_thread      = NULL;
+    al_thread_stop = NULL;
+
     alSourceStopv(sources, source);
     alDeleteSources(sources, source);
 
-    if (sources >= 8)
-        alDeleteBuffers(4, buffers_midi);
-    alDeleteBuffers(4, buffers_cdrom_activity);
-    alDeleteBuffers(4, buffers_fdd);
-    alDeleteBuffers(4, buffers_hdd);
-    alDeleteBuffers(4, buffers_cd);
-    alDeleteBuffers(4, buffers_music);
-    alDeleteBuffers(4, buffers);
+    for (int i = 0; i < sources; i++)
+        al_ring_close(&rings[i]);
 
     alutExit();
 
@@ -127,23 +311,6 @@ closeal(void)
 void
 inital(void)
 {
-    float   *buf                    = NULL;
-    float   *music_buf              = NULL;
-    float   *wt_buf                 = NULL;
-    float   *cd_buf                 = NULL;
-    float   *midi_buf               = NULL;
-    float   *fdd_buf                = NULL;
-    float   *hdd_buf                = NULL;
-    float   *cdrom_activity_buf     = NULL;
-    int16_t *buf_int16              = NULL;
-    int16_t *music_buf_int16        = NULL;
-    int16_t *wt_buf_int16           = NULL;
-    int16_t *cd_buf_int16           = NULL;
-    int16_t *midi_buf_int16         = NULL;
-    int16_t *fdd_buf_int16          = NULL;
-    int16_t *hdd_buf_int16          = NULL;
-    int16_t *cdrom_activity_buf_int16 = NULL;
-
     int init_midi = 0;
 
     if (initialized)
@@ -158,215 +325,69 @@ inital(void)
                           MIDI buffer and source, otherwise, do not. */
 
     sources = 7 + !!init_midi;
-    if (sound_is_float) {
-        buf              = (float *) calloc((BUFLEN << 1), sizeof(float));
-        music_buf        = (float *) calloc((MUSICBUFLEN << 1), sizeof(float));
-        wt_buf           = (float *) calloc((WTBUFLEN << 1), sizeof(float));
-        cd_buf           = (float *) calloc((CD_BUFLEN << 1), sizeof(float));
-        fdd_buf          = (float *) calloc((BUFLEN << 1), sizeof(float));
-        hdd_buf          = (float *) calloc((BUFLEN << 1), sizeof(float));
-        cdrom_activity_buf = (float *) calloc((BUFLEN << 1), sizeof(float));
-        if (init_midi)
-            midi_buf = (float *) calloc(midi_buf_size, sizeof(float));
-    } else {
-        buf_int16              = (int16_t *) calloc((BUFLEN << 1), sizeof(int16_t));
-        music_buf_int16        = (int16_t *) calloc((MUSICBUFLEN << 1), sizeof(int16_t));
-        wt_buf_int16           = (int16_t *) calloc((WTBUFLEN << 1), sizeof(int16_t));
-        cd_buf_int16           = (int16_t *) calloc((CD_BUFLEN << 1), sizeof(int16_t));
-        fdd_buf_int16          = (int16_t *) calloc((BUFLEN << 1), sizeof(int16_t));
-        hdd_buf_int16          = (int16_t *) calloc((BUFLEN << 1), sizeof(int16_t));
-        cdrom_activity_buf_int16 = (int16_t *) calloc((BUFLEN << 1), sizeof(int16_t));
-        if (init_midi)
-            midi_buf_int16 = (int16_t *) calloc(midi_buf_size, sizeof(int16_t));
-    }
-
-    alGenBuffers(4, buffers);
-    alGenBuffers(4, buffers_cd);
-    alGenBuffers(4, buffers_fdd);
-    alGenBuffers(4, buffers_hdd);
-    alGenBuffers(4, buffers_music);
-    alGenBuffers(4, buffers_wt);
-    alGenBuffers(4, buffers_cdrom_activity);
-    if (init_midi)
-        alGenBuffers(4, buffers_midi);
 
     // Create sources: 0=main, 1=music, 2=wt, 3=cd, 4=fdd, 5=hdd, 6=cdrom_activity, 7=midi(optional)
-    if (init_midi)
-        alGenSources(8, source);
-    else
-        alGenSources(7, source);
-
-    alSource3f(source[I_NORMAL], AL_POSITION, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_NORMAL], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_NORMAL], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-    alSourcef(source[I_NORMAL], AL_ROLLOFF_FACTOR, 0.0f);
-    alSourcei(source[I_NORMAL], AL_SOURCE_RELATIVE, AL_TRUE);
-
-    alSource3f(source[I_MUSIC], AL_POSITION, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_MUSIC], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_MUSIC], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-    alSourcef(source[I_MUSIC], AL_ROLLOFF_FACTOR, 0.0f);
-    alSourcei(source[I_MUSIC], AL_SOURCE_RELATIVE, AL_TRUE);
-
-    alSource3f(source[I_WT], AL_POSITION, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_WT], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_WT], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-    alSourcef(source[I_WT], AL_ROLLOFF_FACTOR, 0.0f);
-    alSourcei(source[I_WT], AL_SOURCE_RELATIVE, AL_TRUE);
-
-    alSource3f(source[I_CD], AL_POSITION, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_CD], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_CD], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-    alSourcef(source[I_CD], AL_ROLLOFF_FACTOR, 0.0f);
-    alSourcei(source[I_CD], AL_SOURCE_RELATIVE, AL_TRUE);
-
-    alSource3f(source[I_FDD], AL_POSITION, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_FDD], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_FDD], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-    alSourcef(source[I_FDD], AL_ROLLOFF_FACTOR, 0.0f);
-    alSourcei(source[I_FDD], AL_SOURCE_RELATIVE, AL_TRUE);
-
-    alSource3f(source[I_HDD], AL_POSITION, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_HDD], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_HDD], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-    alSourcef(source[I_HDD], AL_ROLLOFF_FACTOR, 0.0f);
-    alSourcei(source[I_HDD], AL_SOURCE_RELATIVE, AL_TRUE);
-
-    alSource3f(source[I_CDROM_ACTIVITY], AL_POSITION, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_CDROM_ACTIVITY], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-    alSource3f(source[I_CDROM_ACTIVITY], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-    alSourcef(source[I_CDROM_ACTIVITY], AL_ROLLOFF_FACTOR, 0.0f);
-    alSourcei(source[I_CDROM_ACTIVITY], AL_SOURCE_RELATIVE, AL_TRUE);
-
-    if (init_midi) {
-        alSource3f(source[I_MIDI], AL_POSITION, 0.0f, 0.0f, 0.0f);
-        alSource3f(source[I_MIDI], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-        alSource3f(source[I_MIDI], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
-        alSourcef(source[I_MIDI], AL_ROLLOFF_FACTOR, 0.0f);
-        alSourcei(source[I_MIDI], AL_SOURCE_RELATIVE, AL_TRUE);
+    alGenSources(sources, source);
+
+    for (int i = 0; i < sources; i++) {
+        alSource3f(source[i], AL_POSITION, 0.0f, 0.0f, 0.0f);
+        alSource3f(source[i], AL_VELOCITY, 0.0f, 0.0f, 0.0f);
+        alSource3f(source[i], AL_DIRECTION, 0.0f, 0.0f, 0.0f);
+        alSourcef(source[i], AL_ROLLOFF_FACTOR, 0.0f);
+        alSourcei(source[i], AL_SOURCE_RELATIVE, AL_TRUE);
     }
 
-    if (sound_is_float) {
-        memset(buf, 0, BUFLEN * 2 * sizeof(float));
-        memset(cd_buf, 0, CD_BUFLEN * 2 * sizeof(float));
-        memset(music_buf, 0, MUSICBUFLEN * 2 * sizeof(float));
-        memset(wt_buf, 0, WTBUFLEN * 2 * sizeof(float));
-        memset(fdd_buf, 0, BUFLEN * 2 * sizeof(float));
-        memset(hdd_buf, 0, BUFLEN * 2 * sizeof(float));
-        memset(cdrom_activity_buf, 0, BUFLEN * 2 * sizeof(float));
-        if (init_midi)
-            memset(midi_buf, 0, midi_buf_size * sizeof(float));
-    } else {
-        memset(buf_int16, 0, BUFLEN * 2 * sizeof(int16_t));
-        memset(cd_buf_int16, 0, CD_BUFLEN * 2 * sizeof(int16_t));
-        memset(music_buf_int16, 0, MUSICBUFLEN * 2 * sizeof(int16_t));
-        memset(wt_buf_int16, 0, WTBUFLEN * 2 * sizeof(int16_t));
-        memset(fdd_buf_int16, 0, BUFLEN * 2 * sizeof(int16_t));
-        memset(hdd_buf_int16, 0, BUFLEN * 2 * sizeof(int16_t));
-        memset(cdrom_activity_buf_int16, 0, BUFLEN * 2 * sizeof(int16_t));
-        if (init_midi)
-            memset(midi_buf_int16, 0, midi_buf_size * sizeof(int16_t));
-    }
-
-    for (uint8_t c = 0; c < 4; c++) {
-        if (sound_is_float) {
-            alBufferData(buffers[c], AL_FORMAT_STEREO_FLOAT32, buf, BUFLEN * 2 * sizeof(float), FREQ);
-            alBufferData(buffers_music[c], AL_FORMAT_STEREO_FLOAT32, music_buf, MUSICBUFLEN * 2 * sizeof(float), MUSIC_FREQ);
-            alBufferData(buffers_wt[c], AL_FORMAT_STEREO_FLOAT32, wt_buf, WTBUFLEN * 2 * sizeof(float), WT_FREQ);
-            alBufferData(buffers_cd[c], AL_FORMAT_STEREO_FLOAT32, cd_buf, CD_BUFLEN * 2 * sizeof(float), CD_FREQ);
-            alBufferData(buffers_fdd[c], AL_FORMAT_STEREO_FLOAT32, fdd_buf, BUFLEN * 2 * sizeof(float), FREQ);
-            alBufferData(buffers_hdd[c], AL_FORMAT_STEREO_FLOAT32, hdd_buf, BUFLEN * 2 * sizeof(float), FREQ);
-            alBufferData(buffers_cdrom_activity[c], AL_FORMAT_STEREO_FLOAT32, cdrom_activity_buf, BUFLEN * 2 * sizeof(float), FREQ);
-            if (init_midi)
-                alBufferData(buffers_midi[c], AL_FORMAT_STEREO_FLOAT32, midi_buf, midi_buf_size * (int) sizeof(float), midi_freq);
-        } else {
-            alBufferData(buffers[c], AL_FORMAT_STEREO16, buf_int16, BUFLEN * 2 * sizeof(int16_t), FREQ);
-            alBufferData(buffers_music[c], AL_FORMAT_STEREO16, music_buf_int16, MUSICBUFLEN * 2 * sizeof(int16_t), MUSIC_FREQ);
-            alBufferData(buffers_wt[c], AL_FORMAT_STEREO16, wt_buf_int16, WTBUFLEN * 2 * sizeof(int16_t), WT_FREQ);
-            alBufferData(buffers_cd[c], AL_FORMAT_STEREO16, cd_buf_int16, CD_BUFLEN * 2 * sizeof(int16_t), CD_FREQ);
-            alBufferData(buffers_fdd[c], AL_FORMAT_STEREO16, fdd_buf_int16, BUFLEN * 2 * sizeof(int16_t), FREQ);
-            alBufferData(buffers_hdd[c], AL_FORMAT_STEREO16, hdd_buf_int16, BUFLEN * 2 * sizeof(int16_t), FREQ);
-            alBufferData(buffers_cdrom_activity[c], AL_FORMAT_STEREO16, cdrom_activity_buf_int16, BUFLEN * 2 * sizeof(int16_t), FREQ);
-            if (init_midi)
-                alBufferData(buffers_midi[c], AL_FORMAT_STEREO16, midi_buf_int16, midi_buf_size * (int) sizeof(int16_t), midi_freq);
-        }
-    }
-
-    alSourceQueueBuffers(source[I_NORMAL], 4, buffers);
-    alSourceQueueBuffers(source[I_MUSIC], 4, buffers_music);
-    alSourceQueueBuffers(source[I_WT], 4, buffers_wt);
-    alSourceQueueBuffers(source[I_CD], 4, buffers_cd);
-    alSourceQueueBuffers(source[I_FDD], 4, buffers_fdd);
-    alSourceQueueBuffers(source[I_HDD], 4, buffers_hdd);
-    alSourceQueueBuffers(source[I_CDROM_ACTIVITY], 4, buffers_cdrom_activity);
+    al_ring_init(&rings[I_NORMAL], source[I_NORMAL], BUFLEN << 1, FREQ);
+    al_ring_init(&rings[I_MUSIC], source[I_MUSIC], MUSICBUFLEN << 1, MUSIC_FREQ);
+    al_ring_init(&rings[I_WT], source[I_WT], WTBUFLEN << 1, WT_FREQ);
+    al_ring_init(&rings[I_CD], source[I_CD], CD_BUFLEN << 1, CD_FREQ);
+    al_ring_init(&rings[I_FDD], source[I_FDD], BUFLEN << 1, FREQ);
+    al_ring_init(&rings[I_HDD], source[I_HDD], BUFLEN << 1, FREQ);
+    al_ring_init(&rings[I_CDROM_ACTIVITY], source[I_CDROM_ACTIVITY], BUFLEN << 1, FREQ);
     if (init_midi)
-        alSourceQueueBuffers(source[I_MIDI], 4, buffers_midi);
-    alSourcePlay(source[I_NORMAL]);
-    alSourcePlay(source[I_MUSIC]);
-    alSourcePlay(source[I_WT]);
-    alSourcePlay(source[I_CD]);
-    alSourcePlay(source[I_FDD]);
-    alSourcePlay(source[I_HDD]);
-    alSourcePlay(source[I_CDROM_ACTIVITY]);
-    if (init_midi)
-        alSourcePlay(source[I_MIDI]);
-
-    if (sound_is_float) {
-        if (init_midi)
-            free(midi_buf);
-        free(cd_buf);
-        free(wt_buf);
-        free(music_buf);
-        free(buf);
-        free(fdd_buf);
-        free(hdd_buf);
-        free(cdrom_activity_buf);
-    } else {
-        if (init_midi)
-            free(midi_buf_int16);
-        free(cd_buf_int16);
-        free(wt_buf_int16);
-        free(music_buf_int16);
-        free(buf_int16);
-        free(fdd_buf_int16);
-        free(hdd_buf_int16);
-        free(cdrom_activity_buf_int16);
-    }
+        al_ring_init(&rings[I_MIDI], source[I_MIDI], midi_buf_size, midi_freq);
+
+    al_thread_stop = thread_create_event();
+    al_thread_on   = 1;
+    al_thread      = thread_create(al_output_thread, NULL);
 
     initialized = 1;
 }
 
-extern bool fast_forward;
+/* Emulation thread: copy the block into the ring, dropping it if the ring is full. */
 void
 givealbuffer_common(const void *buf, const uint8_t src, const int size, const int freq)
 {
-    int    processed;
-    int    state;
-    ALuint buffer;
+    al_ring_t   *ring = &rings[src];
+    al_block_t  *block;
+    unsigned int head;
+    size_t       bytes = size * (sound_is_float ? sizeof(float) : sizeof(int16_t));
 
     if (!initialized || fast_forward)
         return;
 
-    alGetSourcei(source[src], AL_SOURCE_STATE, &state);
-
-    if (state == 0x1014) {
-        alSourcePlay(source[src]);
-    }
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if ((head - atomic_load_explicit(&ring->tail, memory_order_acquire)) >= AL_RING_BLOCKS)
+        return;
 
-    alGetSourcei(source[src], AL_BUFFERS_PROCESSED, &processed);
-    if (processed >= 1) {
-        const double gain = (sound_muted) ? 0.0 : pow(10.0, (double) sound_gain / 20.0);
-        alListenerf(AL_GAIN, (float) gain);
+    /* The output thread doesn't look at this block until head moves on,
+       so a device handing over more than it announced can grow it. */
+    block = &ring->blocks[head % AL_RING_BLOCKS];
+    if (bytes > block->data_size) {
+        uint8_t *data = (uint8_t *) realloc(block->data, bytes);
 
-        alSourceUnqueueBuffers(source[src], 1, &buffer);
+        if (data == NULL)
+            return;
+        block->data      = data;
+        block->data_size = bytes;
+    }
 
-        if (sound_is_float)
-            alBufferData(buffer, AL_FORMAT_STEREO_FLOAT32, buf, size * (int) sizeof(float), freq);
-        else
-            alBufferData(buffer, AL_FORMAT_STEREO16, buf, size * (int) sizeof(int16_t), freq);
+    block->size     = size;
+    block->freq     = freq;
+    block->is_float = sound_is_float;
+    memcpy(block->data, buf, bytes);
 
-        alSourceQueueBuffers(source[src], 1, &buffer);
-    }
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
 }
 
 void
@@ -129,7 +129,7 @@ adlib_init(UNUSED(const device_t *info))
                   adlib->opl.read, NULL, NULL,
                   adlib->opl.write, NULL, NULL,
                   adlib->opl.priv);
-    music_add_handler(adlib_get_buffer, adlib);
+    music_add_handler_ex(adlib_get_buffer, adlib, SOUND_HANDLER_THREAD_SAFE);
     return adlib;
 }
 
@@ -1750,6 +1750,41 @@ emu8k_vol_slide(emu8k_slide_t *slide, int32_t target)
     return slide->last;
 }
 
+static inline void
+emu8k_voice_advance(emu8k_voice_t *emu_voice)
+{
+    emu_voice->addr.addr += ((uint64_t) emu_voice->cpf_curr_pitch) << 18;
+    if (emu_voice->addr.addr >= emu_voice->loop_end.addr) {
+        emu_voice->addr.int_address -= (emu_voice->loop_end.int_address - emu_voice->loop_start.int_address);
+        emu_voice->addr.int_address &= EMU8K_MEM_ADDRESS_MASK;
+    }
+}
+
+/*
+ * A voice with its envelope engine off and its volume settled at zero
+ * makes no sound and its targets cannot change during the block, so only
+ * its play position has to be kept moving. Drivers park the voices they
+ * are not using like this, which is most of the 32 most of the time.
+ */
+static int
+emu8k_voice_idle(emu8k_t *emu8k, emu8k_voice_t *emu_voice)
+{
+    if (emu_voice->env_engine_on || emu_voice->cvcf_curr_volume || emu_voice->vtft_vol_target || emu_voice->volumeslide.last)
+        return 0;
+
+    if (emu_voice->cpf_curr_pitch || emu_voice->ptrx_pit_target || (emu_voice->addr.addr >= emu_voice->loop_end.addr)) {
+        for (int pos = emu8k->pos; pos < wavetable_pos_global; pos++) {
+            emu8k_voice_advance(emu_voice);
+            emu_voice->cpf_curr_pitch = emu_voice->ptrx_pit_target;
+        }
+    } else
+        emu_voice->cpf_curr_pitch = emu_voice->ptrx_pit_target;
+
+    emu_voice->cvcf_curr_filt_ctoff = emu_voice->vtft_filter_target;
+
+    return 1;
+}
+
 #if 0
 int32_t old_pitch[32] = { 0 };
 int32_t old_cut[32]   = { 0 };
@@ -1776,7 +1811,9 @@ emu8k_update(emu8k_t *emu8k)
         emu_voice = &emu8k->voice[c];
         buf       = &emu8k->buffer[emu8k->pos * 2];
 
-        for (pos = emu8k->pos; pos < wavetable_pos_global; pos++) {
+        pos = emu8k_voice_idle(emu8k, emu_voice) ? wavetable_pos_global : emu8k->pos;
+
+        for (; pos < wavetable_pos_global; pos++) {
             int32_t dat;
 
             if (emu_voice->cvcf_curr_volume) {
@@ -2091,11 +2128,7 @@ emu8k_update(emu8k_t *emu8k)
             -In programs that use the awe, they generally set the loop address as "loopaddress -1" to compensate for the above.
             (Note: I am already using address+1 in the interpolators so these things are already as they should.)
             */
-            emu_voice->addr.addr += ((uint64_t) emu_voice->cpf_curr_pitch) << 18;
-            if (emu_voice->addr.addr >= emu_voice->loop_end.addr) {
-                emu_voice->addr.int_address -= (emu_voice->loop_end.int_address - emu_voice->loop_start.int_address);
-                emu_voice->addr.int_address &= EMU8K_MEM_ADDRESS_MASK;
-            }
+            emu8k_voice_advance(emu_voice);
 
             /* TODO: How and when are the target and current values updated */
             emu_voice->cpf_curr_pitch       = emu_voice->ptrx_pit_target;
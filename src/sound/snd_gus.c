@@ -16,6 +16,7 @@
 #include <86box/gameport.h>
 #include <86box/pic.h>
 #include <86box/sound.h>
+#include <86box/sound_util.h>
 #include "cpu.h"
 #include <86box/timer.h>
 #include <86box/snd_ad1848.h>
@@ -112,8 +113,7 @@ typedef struct gus_t {
     int32_t out_l;
     int32_t out_r;
 
-    int16_t buffer[2][SOUNDBUFLEN];
-    int     pos;
+    resampler_t *resampler; /* GF1 rate to SOUND_FREQ */
 
     pc_timer_t samp_timer;
     uint64_t   samp_latch;
@@ -198,6 +198,16 @@ double ics2101_pan[] = { 0.35481, 0.35481, 0.35481, 0.37584, 0.47315, 0.53088, 0
 void    gus_write(uint16_t addr, uint8_t val, void *priv);
 uint8_t gus_read(uint16_t addr, void *priv);
 
+/* The GF1 output rate drops as more voices are enabled. */
+static void
+gus_update_rate(gus_t *gus)
+{
+    const double freq = (gus->voices < 14) ? 44100.0 : (double) gusfreqs[gus->voices - 14];
+
+    gus->samp_latch = (uint64_t) (TIMER_USEC * (1000000.0 / freq));
+    resampler_set_rate(gus->resampler, freq, SOUND_FREQ);
+}
+
 void
 gus_update_int_status(gus_t *gus)
 {
@@ -462,11 +472,7 @@ gus_write(uint16_t addr, uint8_t val, void *priv)
                     if (gus->voices < 14)
                         gus->voices = 14;
                     gus->global = val;
-                    if (gus->voices < 14)
-                        gus->samp_latch = (uint64_t) (TIMER_USEC * (1000000.0 / 44100.0));
-                    else
-                        gus->samp_latch = (uint64_t) (TIMER_USEC *
-                                                      (1000000.0 / gusfreqs[gus->voices - 14]));
+                    gus_update_rate(gus);
                     break;
 
                 case 0x41: /*DMA*/
@@ -1105,23 +1111,11 @@ gus_poll_timer_2(void *priv)
     gus_update_int_status(gus);
 }
 
+/* Hand the frame of the last GF1 tick to the resampler, once per tick. */
 static void
 gus_update(gus_t *gus)
 {
-    for (; gus->pos < sound_pos_global; gus->pos++) {
-        if (gus->out_l < -32768)
-            gus->buffer[0][gus->pos] = -32768;
-        else if (gus->out_l > 32767)
-            gus->buffer[0][gus->pos] = 32767;
-        else
-            gus->buffer[0][gus->pos] = gus->out_l;
-        if (gus->out_r < -32768)
-            gus->buffer[1][gus->pos] = -32768;
-        else if (gus->out_r > 32767)
-            gus->buffer[1][gus->pos] = 32767;
-        else
-            gus->buffer[1][gus->pos] = gus->out_r;
-    }
+    resampler_push(gus->resampler, MIN(MAX(gus->out_l, -32768), 32767), MIN(MAX(gus->out_r, -32768), 32767));
 }
 
 void
@@ -1332,18 +1326,21 @@ gus_ics2101_filter(void *priv, int channel, double *out_l, double *out_r)
 static void
 gus_get_buffer(int32_t *buffer, int len, void *priv)
 {
-    gus_t *gus = (gus_t *) priv;
+    gus_t  *gus = (gus_t *) priv;
+    int32_t gf1[SOUNDBUFLEN * 2];
 
     if ((gus->type == GUS_MAX) && (gus->max_ctrl))
         ad1848_update(&gus->ad1848);
 
-    gus_update(gus);
+    memset(gf1, 0, len * 2 * sizeof(int32_t));
+    resampler_get(gus->resampler, gf1, len);
+
     for (int c = 0; c < len * 2; c += 2) {
         double temp_l = 0.0;
         double temp_r = 0.0;
         if ((gus->type == GUS_CLASSIC_37) || (gus->type == GUS_MAX)) {
-            temp_l = (double) gus->buffer[0][c >> 1];
-            temp_r = (double) gus->buffer[1][c >> 1];
+            temp_l = (double) gf1[c];
+            temp_r = (double) gf1[c + 1];
             if (gus->type == GUS_MAX) {
                 if (gus->max_ctrl) {
                     buffer[c]     += (int32_t) (gus->ad1848.buffer[c] / 2);
@@ -1355,15 +1352,13 @@ gus_get_buffer(int32_t *buffer, int len, void *priv)
             buffer[c]     += (int32_t) temp_l;
             buffer[c + 1] += (int32_t) temp_r;
         } else {
-            buffer[c]     += (int32_t) gus->buffer[0][c >> 1];
-            buffer[c + 1] += (int32_t) gus->buffer[1][c >> 1];
+            buffer[c]     += gf1[c];
+            buffer[c + 1] += gf1[c + 1];
         }
     }
 
     if ((gus->type == GUS_MAX) && (gus->max_ctrl))
         gus->ad1848.pos = 0;
-
-    gus->pos = 0;
 }
 
 void
@@ -1428,6 +1423,7 @@ gus_reset(void *priv)
         return;
 
     memset(gus->ram, 0x00, (gus->gus_end_ram));
+    resampler_reset(gus->resampler);
 
     for (c = 0; c < 32; c++) {
         gus->ctrl[c]  = 1;
@@ -1442,7 +1438,7 @@ gus_reset(void *priv)
 
     gus->voices = 14;
 
-    gus->samp_latch = (uint64_t) (TIMER_USEC * (1000000.0 / 44100.0));
+    gus_update_rate(gus);
 
     gus->t1l = gus->t2l = 0xff;
 
@@ -1533,6 +1529,7 @@ gus_init(UNUSED(const device_t *info))
 
     gus->gus_end_ram = 1 << (18 + gus_ram);
     gus->ram         = (uint8_t *) calloc(1, gus->gus_end_ram);
+    gus->resampler   = resampler_init(44100.0, SOUND_FREQ);
 
     for (c = 0; c < 32; c++) {
         gus->ctrl[c]  = 1;
@@ -1547,7 +1544,7 @@ gus_init(UNUSED(const device_t *info))
 
     gus->voices = 14;
 
-    gus->samp_latch = (uint64_t) (TIMER_USEC * (1000000.0 / 44100.0));
+    gus_update_rate(gus);
 
     gus->t1l = gus->t2l = 0xff;
 
@@ -1605,7 +1602,7 @@ gus_init(UNUSED(const device_t *info))
     timer_add(&gus->timer_1, gus_poll_timer_1, gus, 1);
     timer_add(&gus->timer_2, gus_poll_timer_2, gus, 1);
 
-    sound_add_handler(gus_get_buffer, gus);
+    sound_add_handler_ex(gus_get_buffer, gus, SOUND_HANDLER_THREAD_SAFE);
 
     if ((gus->type != GUS_ACE) && (device_get_config_int("receive_input")))
         midi_in_handler(1, gus_input_msg, gus_input_sysex, gus);
@@ -1618,6 +1615,7 @@ gus_close(void *priv)
 {
     gus_t *gus = (gus_t *) priv;
 
+    resampler_close(gus->resampler);
     free(gus->ram);
     free(gus);
 }
@@ -1627,10 +1625,7 @@ gus_speed_changed(void *priv)
 {
     gus_t *gus = (gus_t *) priv;
 
-    if (gus->voices < 14)
-        gus->samp_latch = (uint64_t) (TIMER_USEC * (1000000.0 / 44100.0));
-    else
-        gus->samp_latch = (uint64_t) (TIMER_USEC * (1000000.0 / gusfreqs[gus->voices - 14]));
+    gus_update_rate(gus);
 
     if ((gus->type == GUS_MAX) && (gus->max_ctrl))
         ad1848_speed_changed(&gus->ad1848);
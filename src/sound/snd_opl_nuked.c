@@ -364,6 +364,31 @@ OPL3_EnvelopeCalcSin7(uint16_t phase, uint16_t envelope)
     return (OPL3_EnvelopeCalcExp(out + (envelope << 3)) ^ neg);
 }
 
+/*
+ * The exponent table is 11 bits wide, so from an attenuation of 0x180
+ * (0xc00 once shifted) every waveform rounds to zero and only its sign
+ * is left. That covers keyed-off and very quiet operators, which are
+ * most of the 36 at any time, without touching the sine tables.
+ */
+#define EG_SILENT 0x180
+
+static inline int16_t
+OPL3_EnvelopeCalcSign(uint8_t wf, uint16_t phase)
+{
+    switch (wf) {
+        case 0:
+        case 6:
+        case 7:
+            return (phase & 0x0200) ? -1 : 0;
+
+        case 4:
+            return ((phase & 0x0300) == 0x0100) ? -1 : 0;
+
+        default:
+            return 0;
+    }
+}
+
 static const envelope_sinfunc envelope_sin[8] = {
     OPL3_EnvelopeCalcSin0,
     OPL3_EnvelopeCalcSin1,
@@ -412,6 +437,13 @@ OPL3_EnvelopeCalc(opl3_slot *slot)
 
     slot->eg_out = slot->eg_rout + (slot->reg_tl << 2)
                  + (slot->eg_ksl >> kslshift[slot->reg_ksl]) + *slot->trem;
+
+    // Keyed off and fully released: nothing below would change
+    if (!slot->key && slot->eg_gen == envelope_gen_num_release && slot->eg_rout == 0x1ff) {
+        slot->pg_reset = 0;
+        return;
+    }
+
     if (slot->key && slot->eg_gen == envelope_gen_num_release) {
         reset    = 1;
         reg_rate = slot->reg_ar;
@@ -548,7 +580,6 @@ OPL3_PhaseGenerate(opl3_slot *slot)
     uint16_t   f_num;
     uint32_t   basefreq;
     uint8_t    rm_xor;
-    uint8_t    n_bit;
     uint32_t   noise;
     uint16_t   phase;
 
@@ -580,7 +611,7 @@ OPL3_PhaseGenerate(opl3_slot *slot)
     slot->pg_phase += (basefreq * mt[slot->reg_mult]) >> 1;
 
     // Rhythm mode
-    noise              = chip->noise;
+    noise              = chip->noise >> slot->slot_num; // as the LFSR was when this slot's turn came
     slot->pg_phase_out = phase;
     if (slot->slot_num == 13) { // hh
         chip->rm_hh_bit2 = (phase >> 2) & 1;
@@ -619,10 +650,18 @@ OPL3_PhaseGenerate(opl3_slot *slot)
                 break;
         }
     }
+}
 
-    n_bit = ((noise >> 14) ^ noise) & 0x01;
-
-    chip->noise = (noise >> 1) | (n_bit << 22);
+/*
+ * The noise LFSR steps once per slot, 36 times a sample. With taps 14
+ * bits apart, nine steps only ever read bits that were there at the start,
+ * so they can be taken in one go. The phase generator reads the bit the
+ * register would have had at its slot instead, which is the same value.
+ */
+static inline uint32_t
+OPL3_NoiseStep9(uint32_t noise)
+{
+    return (noise >> 9) | (((noise ^ (noise >> 14)) & 0x1ff) << 14);
 }
 
 // Slot
@@ -679,7 +718,12 @@ OPL3_SlotWriteE0(opl3_slot *slot, uint8_t data)
 static void
 OPL3_SlotGenerate(opl3_slot *slot)
 {
-    slot->out = envelope_sin[slot->reg_wf](slot->pg_phase_out + *slot->mod, slot->eg_out);
+    uint16_t phase = slot->pg_phase_out + *slot->mod;
+
+    if (slot->eg_out >= EG_SILENT)
+        slot->out = OPL3_EnvelopeCalcSign(slot->reg_wf, phase);
+    else
+        slot->out = envelope_sin[slot->reg_wf](phase, slot->eg_out);
 }
 
 static void
@@ -1047,12 +1091,26 @@ OPL3_ChannelSet4Op(opl3_chip *chip, uint8_t data)
     }
 }
 
+/*
+ * The envelope and phase generators of a slot only read its own state and
+ * the chip-wide LFOs, never another slot's output, so they are run for all
+ * 36 slots up front, in slot order to keep the noise LFSR sequence. The
+ * output stage keeps the original order, which the modulation and the
+ * channel sample delay depend on.
+ */
+static inline void
+OPL3_ProcessSlotsEG(opl3_chip *chip)
+{
+    for (uint8_t i = 0; i < 36; i++) {
+        OPL3_EnvelopeCalc(&chip->slot[i]);
+        OPL3_PhaseGenerate(&chip->slot[i]);
+    }
+}
+
 static void
 OPL3_ProcessSlot(opl3_slot *slot)
 {
     OPL3_SlotCalcFB(slot);
-    OPL3_EnvelopeCalc(slot);
-    OPL3_PhaseGenerate(slot);
     OPL3_SlotGenerate(slot);
 }
 
@@ -1071,6 +1129,9 @@ OPL3_Generate4Ch(void *priv, int32_t *buf4)
     buf4[1] = chip->mixbuff[1];
     buf4[3] = chip->mixbuff[3];
 
+    OPL3_ProcessSlotsEG(chip);
+    chip->noise = OPL3_NoiseStep9(OPL3_NoiseStep9(OPL3_NoiseStep9(OPL3_NoiseStep9(chip->noise))));
+
 #if OPL_QUIRK_CHANNELSAMPLEDELAY
     for (i = 0; i < 15; i++)
 #else
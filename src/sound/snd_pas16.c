@@ -2397,6 +2397,8 @@ pas16_close(void *priv)
 {
     pas16_t *pas16 = (pas16_t *) priv;
 
+    sb_dsp_close(&pas16->dsp);
+
     free(pas16);
 
     pas16_next = 0;
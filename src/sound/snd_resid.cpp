@@ -1,3 +1,4 @@
+#include <atomic>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -5,27 +6,179 @@
 
 #include "resid-fp/sid.h"
 #include <86box/plat.h>
+#include <86box/thread.h>
 #include <86box/snd_resid.h>
 
 #define RESID_FREQ 48000
 
+/*
+   The SID is clocked on its own thread. The emulation thread only queues
+   register accesses stamped with their sample position; the thread renders
+   up to the last position it has been told about, and sid_fillbuf() hands
+   back the previous block, so the mixer normally never waits.
+ */
+#define SID_EVENTS   1024 /* queued register accesses */
+#define SID_OUT_LEN  8192 /* rendered samples, more than two sound blocks */
+#define SID_CHUNK    2048 /* largest single sid->clock() call, in samples */
+
+enum {
+    SID_EV_WRITE = 0,
+    SID_EV_READ,
+    SID_EV_RESET
+};
+
 using reSIDfp::SID;
 
+typedef struct sid_event_t {
+    uint32_t ts;
+    uint8_t  type;
+    uint8_t  addr;
+    uint8_t  val;
+} sid_event_t;
+
 typedef struct psid_t {
     /* resid sid implementation */
     SID    *sid;
     int16_t last_sample;
+
+    sid_event_t           events[SID_EVENTS];
+    std::atomic<uint32_t> ev_head; /* advanced by the emulation thread */
+    std::atomic<uint32_t> ev_tail; /* advanced by the SID thread */
+
+    std::atomic<uint32_t> avail;    /* all accesses before this sample are queued */
+    std::atomic<uint32_t> rendered; /* samples written to out[] */
+    int16_t               out[SID_OUT_LEN];
+
+    std::atomic<uint32_t> reads_done;
+    std::atomic<uint8_t>  read_val;
+    uint32_t              reads; /* emulation thread only */
+
+    uint32_t block_start; /* emulation thread only */
+    int      prev_len;
+
+    thread_t         *thread;
+    event_t          *wake;
+    event_t          *done;
+    std::atomic<int>  on;
 } psid_t;
 
-psid_t *psid;
+#define CLOCK_DELTA(n) (int) (((14318180.0 * n) / 16.0) / (float) RESID_FREQ)
+
+static void
+sid_render(psid_t *psid, int len)
+{
+    int16_t  buf[SID_CHUNK + 16];
+    uint32_t pos = psid->rendered.load(std::memory_order_relaxed);
+    int      x   = CLOCK_DELTA(len);
+
+    for (int c = 0; c < len; c++)
+        buf[c] = psid->last_sample;
+
+    if (!psid->sid->clock(x, buf))
+        buf[0] = psid->last_sample;
+    psid->last_sample = buf[0];
+
+    for (int c = 0; c < len; c++)
+        psid->out[(pos + c) % SID_OUT_LEN] = buf[c];
+
+    psid->rendered.store(pos + len, std::memory_order_release);
+}
+
+static void
+sid_apply(psid_t *psid, const sid_event_t *ev)
+{
+    switch (ev->type) {
+        case SID_EV_WRITE:
+            psid->sid->write(ev->addr, ev->val);
+            break;
+
+        case SID_EV_READ:
+            psid->read_val.store(psid->sid->read(ev->addr), std::memory_order_relaxed);
+            psid->reads_done.fetch_add(1, std::memory_order_release);
+            thread_set_event(psid->done);
+            break;
+
+        case SID_EV_RESET:
+            psid->sid->reset();
+            for (uint8_t c = 0; c < 32; c++)
+                psid->sid->write(c, 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Renders everything the emulation thread has vouched for, applying accesses in order. */
+static void
+sid_run(psid_t *psid)
+{
+    const uint32_t avail = psid->avail.load(std::memory_order_acquire);
+    uint32_t       tail  = psid->ev_tail.load(std::memory_order_relaxed);
+
+    for (;;) {
+        const uint32_t head = psid->ev_head.load(std::memory_order_acquire);
+        const uint32_t pos  = psid->rendered.load(std::memory_order_relaxed);
+        uint32_t       end  = avail;
+
+        if ((tail != head) && ((int32_t) (psid->events[tail % SID_EVENTS].ts - pos) <= 0)) {
+            sid_apply(psid, &psid->events[tail % SID_EVENTS]);
+            psid->ev_tail.store(++tail, std::memory_order_release);
+            continue;
+        }
+
+        if ((tail != head) && ((int32_t) (psid->events[tail % SID_EVENTS].ts - end) < 0))
+            end = psid->events[tail % SID_EVENTS].ts;
+        if ((int32_t) (end - pos) <= 0)
+            break;
+
+        sid_render(psid, ((end - pos) > SID_CHUNK) ? SID_CHUNK : (int) (end - pos));
+    }
+}
+
+static void
+sid_thread(void *priv)
+{
+    psid_t *psid = (psid_t *) priv;
+
+    while (psid->on.load(std::memory_order_relaxed)) {
+        thread_wait_event(psid->wake, -1);
+        thread_reset_event(psid->wake);
+
+        sid_run(psid);
+        thread_set_event(psid->done);
+    }
+}
+
+static void
+sid_queue(psid_t *psid, uint8_t type, uint16_t addr, uint8_t val, uint32_t ts)
+{
+    uint32_t     head = psid->ev_head.load(std::memory_order_relaxed);
+    sid_event_t *ev;
+
+    /* Accesses must not be lost; let the SID thread drain the queue. */
+    while ((head - psid->ev_tail.load(std::memory_order_acquire)) >= SID_EVENTS) {
+        psid->avail.store(ts, std::memory_order_release);
+        thread_set_event(psid->wake);
+        plat_delay_ms(1);
+    }
+
+    ev       = &psid->events[head % SID_EVENTS];
+    ev->ts   = ts;
+    ev->type = type;
+    ev->addr = addr & 0x1f;
+    ev->val  = val;
+    psid->ev_head.store(head + 1, std::memory_order_release);
+}
 
 void *
 sid_init(uint8_t type, double range)
 {
     reSIDfp::SamplingMethod method         = reSIDfp::RESAMPLE;
     float                   cycles_per_sec = 14318180.0 / 16.0;
+    psid_t                 *psid;
 
-    psid      = new psid_t;
+    psid      = new psid_t();
     psid->sid = new SID;
 	psid->sid->setFilter6581Range(range);
 	psid->sid->reset();
@@ -56,54 +209,91 @@ sid_init(uint8_t type, double range)
 
     psid->sid->input(0);
 
+    psid->wake   = thread_create_event();
+    psid->done   = thread_create_event();
+    psid->on     = 1;
+    psid->thread = thread_create(sid_thread, psid);
+
     return (void *) psid;
 }
 
 void
-sid_close(UNUSED(void *priv))
+sid_close(void *priv)
 {
+    psid_t *psid = (psid_t *) priv;
+
+    psid->on = 0;
+    thread_set_event(psid->wake);
+    thread_wait(psid->thread);
+    thread_destroy_event(psid->wake);
+    thread_destroy_event(psid->done);
+
     delete psid->sid;
-#if 0
-    free(psid);
-#endif
+    delete psid;
 }
 
 void
-sid_reset(UNUSED(void *priv))
+sid_reset(void *priv)
 {
-    psid->sid->reset();
+    psid_t *psid = (psid_t *) priv;
 
-    for (uint8_t c = 0; c < 32; c++)
-        psid->sid->write(c, 0);
+    sid_queue(psid, SID_EV_RESET, 0, 0, psid->avail.load(std::memory_order_relaxed));
 }
 
+/* Register reads depend on the voice 3 state, so they wait for the SID thread to get there. */
 uint8_t
-sid_read(uint16_t addr, UNUSED(void *priv))
+sid_read(uint16_t addr, int pos, void *priv)
 {
-    return psid->sid->read(addr & 0x1f);
-}
+    psid_t        *psid = (psid_t *) priv;
+    const uint32_t ts   = psid->block_start + pos;
 
-void
-sid_write(uint16_t addr, uint8_t val, UNUSED(void *priv))
-{
-    psid->sid->write(addr & 0x1f, val);
-}
+    thread_reset_event(psid->done);
+    sid_queue(psid, SID_EV_READ, addr, 0, ts);
+    psid->avail.store(ts, std::memory_order_release);
+    thread_set_event(psid->wake);
 
-#define CLOCK_DELTA(n) (int) (((14318180.0 * n) / 16.0) / (float) RESID_FREQ)
+    psid->reads++;
+    while ((int32_t) (psid->reads_done.load(std::memory_order_acquire) - psid->reads) < 0) {
+        thread_wait_event(psid->done, -1);
+        thread_reset_event(psid->done);
+    }
 
-static void
-fillbuf2(int &count, int16_t *buf, UNUSED(int len))
+    return psid->read_val.load(std::memory_order_relaxed);
+}
+
+void
+sid_write(uint16_t addr, uint8_t val, int pos, void *priv)
 {
-    int c = psid->sid->clock(count, buf);
+    psid_t        *psid = (psid_t *) priv;
+    const uint32_t ts   = psid->block_start + pos;
 
-    if (!c)
-        *buf = psid->last_sample;
-    psid->last_sample = *buf;
+    sid_queue(psid, SID_EV_WRITE, addr, val, ts);
+    psid->avail.store(ts, std::memory_order_release);
 }
+
+/*
+   Ends the current block of len samples and returns the previous one,
+   which the SID thread has had a whole block to render.
+ */
 void
-sid_fillbuf(int16_t *buf, int len, UNUSED(void *priv))
+sid_fillbuf(int16_t *buf, int len, void *priv)
 {
-    int x = CLOCK_DELTA(len);
+    psid_t        *psid  = (psid_t *) priv;
+    const uint32_t start = psid->block_start - psid->prev_len;
 
-    fillbuf2(x, buf, len);
-}
\ No newline at end of file
+    psid->block_start += len;
+    psid->avail.store(psid->block_start, std::memory_order_release);
+
+    while ((int32_t) (psid->rendered.load(std::memory_order_acquire) - (start + psid->prev_len)) < 0) {
+        thread_reset_event(psid->done);
+        thread_set_event(psid->wake);
+        thread_wait_event(psid->done, 1);
+    }
+
+    thread_set_event(psid->wake);
+
+    for (int c = 0; c < len; c++)
+        buf[c] = (c < psid->prev_len) ? psid->out[(start + c) % SID_OUT_LEN] : 0;
+
+    psid->prev_len = len;
+}
@@ -3385,7 +3385,7 @@ sb_16_init(UNUSED(const device_t *info))
                   sb_ct1745_mixer_write, NULL, NULL, sb);
     sound_add_handler(sb_get_buffer_sb16_awe32, sb);
     if (sb->opl_enabled)
-        music_add_handler(sb_get_music_buffer_sb16_awe32, sb);
+        music_add_handler_ex(sb_get_music_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
     sound_set_cd_audio_filter(sb16_awe32_filter_cd_audio, sb);
     if (device_get_config_int("control_pc_speaker"))
         sound_set_pc_speaker_filter(sb16_awe32_filter_pc_speaker, sb);
@@ -3432,7 +3432,7 @@ sb_16_reply_mca_init(UNUSED(const device_t *info))
     sb->mixer_enabled            = 1;
     sb->mixer_sb16.output_filter = 1;
     sound_add_handler(sb_get_buffer_sb16_awe32, sb);
-    music_add_handler(sb_get_music_buffer_sb16_awe32, sb);
+    music_add_handler_ex(sb_get_music_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
     sound_set_cd_audio_filter(sb16_awe32_filter_cd_audio, sb);
     if (device_get_config_int("control_pc_speaker"))
         sound_set_pc_speaker_filter(sb16_awe32_filter_pc_speaker, sb);
@@ -3485,7 +3485,7 @@ sb_16_pnp_init(UNUSED(const device_t *info))
     sb->mixer_enabled            = 1;
     sb->mixer_sb16.output_filter = 1;
     sound_add_handler(sb_get_buffer_sb16_awe32, sb);
-    music_add_handler(sb_get_music_buffer_sb16_awe32, sb);
+    music_add_handler_ex(sb_get_music_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
     sound_set_cd_audio_filter(sb16_awe32_filter_cd_audio, sb);
     if (device_get_config_int("control_pc_speaker"))
         sound_set_pc_speaker_filter(sb16_awe32_filter_pc_speaker, sb);
@@ -3589,7 +3589,7 @@ sb_vibra16_pnp_init(UNUSED(const device_t *info))
     sb->mixer_enabled            = 1;
     sb->mixer_sb16.output_filter = 1;
     sound_add_handler(sb_get_buffer_sb16_awe32, sb);
-    music_add_handler(sb_get_music_buffer_sb16_awe32, sb);
+    music_add_handler_ex(sb_get_music_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
     sound_set_cd_audio_filter(sb16_awe32_filter_cd_audio, sb);
     if (device_get_config_int("control_pc_speaker"))
         sound_set_pc_speaker_filter(sb16_awe32_filter_pc_speaker, sb);
@@ -3685,7 +3685,7 @@ sb_16_compat_init(const device_t *info)
     sb->opl_enabled   = 1;
     sb->mixer_enabled = 1;
     sound_add_handler(sb_get_buffer_sb16_awe32, sb);
-    music_add_handler(sb_get_music_buffer_sb16_awe32, sb);
+    music_add_handler_ex(sb_get_music_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
 
     sb->mpu = (mpu_t *) calloc(1, sizeof(mpu_t));
     mpu401_init(sb->mpu, 0, 0, M_UART, (int) (intptr_t) info->local);
@@ -3790,8 +3790,8 @@ sb_awe32_init(UNUSED(const device_t *info))
                   sb_ct1745_mixer_write, NULL, NULL, sb);
     sound_add_handler(sb_get_buffer_sb16_awe32, sb);
     if (sb->opl_enabled)
-        music_add_handler(sb_get_music_buffer_sb16_awe32, sb);
-    wavetable_add_handler(sb_get_wavetable_buffer_sb16_awe32, sb);
+        music_add_handler_ex(sb_get_music_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
+    wavetable_add_handler_ex(sb_get_wavetable_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
     sound_set_cd_audio_filter(sb16_awe32_filter_cd_audio, sb);
     if (device_get_config_int("control_pc_speaker"))
         sound_set_pc_speaker_filter(sb16_awe32_filter_pc_speaker, sb);
@@ -3823,7 +3823,7 @@ sb_goldfinch_init(const device_t *info)
     goldfinch_t *goldfinch   = calloc(1, sizeof(goldfinch_t));
     int          onboard_ram = device_get_config_int("onboard_ram");
 
-    wavetable_add_handler(sb_get_wavetable_buffer_goldfinch, goldfinch);
+    wavetable_add_handler_ex(sb_get_wavetable_buffer_goldfinch, goldfinch, SOUND_HANDLER_THREAD_SAFE);
 
     emu8k_init(&goldfinch->emu8k, 0, onboard_ram);
 
@@ -3883,8 +3883,8 @@ sb_awe32_pnp_init(const device_t *info)
     sb->mixer_enabled            = 1;
     sb->mixer_sb16.output_filter = 1;
     sound_add_handler(sb_get_buffer_sb16_awe32, sb);
-    music_add_handler(sb_get_music_buffer_sb16_awe32, sb);
-    wavetable_add_handler(sb_get_wavetable_buffer_sb16_awe32, sb);
+    music_add_handler_ex(sb_get_music_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
+    wavetable_add_handler_ex(sb_get_wavetable_buffer_sb16_awe32, sb, SOUND_HANDLER_THREAD_SAFE);
     sound_set_cd_audio_filter(sb16_awe32_filter_cd_audio, sb);
     if (device_get_config_int("control_pc_speaker"))
         sound_set_pc_speaker_filter(sb16_awe32_filter_pc_speaker, sb);
@@ -53,6 +53,10 @@ enum {
 void pollsb(void *priv);
 void sb_poll_i(void *priv);
 
+static void sb_dsp_block_sync(sb_dsp_t *dsp);
+static void sb_dsp_block_arm(sb_dsp_t *dsp, int running);
+static void sb_dsp_dma_sync(void *priv);
+
 static int sbe2dat[4][9] = {
     {  0x01, -0x02, -0x04,  0x08, -0x10,  0x20,  0x40, -0x80, -106 },
     { -0x01,  0x02, -0x04,  0x08,  0x10, -0x20,  0x40, -0x80,  165 },
@@ -515,6 +519,7 @@ sb_dsp_reset(sb_dsp_t *dsp)
 
     timer_disable(&dsp->output_timer);
     timer_disable(&dsp->input_timer);
+    dsp->block_mode = 0;
 
     dsp->sb_command = 0;
 
@@ -572,6 +577,8 @@ sb_doreset(sb_dsp_t *dsp)
 void
 sb_dsp_speed_changed(sb_dsp_t *dsp)
 {
+    sb_dsp_block_sync(dsp);
+
     if (dsp->sb_timeo < 256)
         dsp->sblatcho = (double) (TIMER_USEC * (256 - dsp->sb_timeo));
     else
@@ -581,6 +588,8 @@ sb_dsp_speed_changed(sb_dsp_t *dsp)
         dsp->sblatchi = (double) (TIMER_USEC * (256 - dsp->sb_timei));
     else
         dsp->sblatchi = ((double) TIMER_USEC * (1000000.0 / (double) (dsp->sb_timei - 256)));
+
+    sb_dsp_block_arm(dsp, timer_is_enabled(&dsp->output_timer));
 }
 
 void
@@ -1922,11 +1931,9 @@ sb_do_reset(sb_dsp_t *dsp, const uint8_t v)
     }
 }
 
-void
-sb_write(uint16_t addr, uint8_t val, void *priv)
+static void
+sb_dsp_write(uint16_t addr, uint8_t val, sb_dsp_t *dsp)
 {
-    sb_dsp_t *dsp = (sb_dsp_t *) priv;
-
     /* Sound Blasters prior to Sound Blaster 16 alias the I/O ports. */
     if ((dsp->sb_type < SB16_DSP_404) && (IS_NOT_ESS(dsp) || ((addr & 0xF) != 0xE)))
         addr &= 0xfffe;
@@ -2010,6 +2017,17 @@ sb_write(uint16_t addr, uint8_t val, void *priv)
     }
 }
 
+void
+sb_write(uint16_t addr, uint8_t val, void *priv)
+{
+    sb_dsp_t *dsp = (sb_dsp_t *) priv;
+
+    /* Commands see the playback state as of now and may change it. */
+    sb_dsp_block_sync(dsp);
+    sb_dsp_write(addr, val, dsp);
+    sb_dsp_block_arm(dsp, timer_is_enabled(&dsp->output_timer));
+}
+
 uint8_t
 sb_read(uint16_t addr, void *priv)
 {
@@ -2250,6 +2268,7 @@ sb_dsp_init(sb_dsp_t *dsp, int type, int subtype, void *parent)
     sb_doreset(dsp);
 
     timer_add(&dsp->output_timer, pollsb, dsp, 0);
+    dma_add_sync_handler(sb_dsp_dma_sync, dsp);
     timer_add(&dsp->input_timer, sb_poll_i, dsp, 0);
     timer_add(&dsp->wb_timer, NULL, dsp, 0);
     timer_add(&dsp->irq_timer, sb_dsp_irq_poll, dsp, 0);
@@ -2321,6 +2340,7 @@ sb_dsp_set_real_opl(sb_dsp_t *dsp, uint8_t has_real_opl)
 void
 sb_dsp_set_stereo(sb_dsp_t *dsp, int stereo)
 {
+    sb_dsp_block_sync(dsp);
     dsp->stereo = stereo;
 }
 
@@ -2362,17 +2382,17 @@ sb_espcm_fifoctl_run(sb_dsp_t *dsp)
     }
 }
 
-void
-pollsb(void *priv)
+/* Plays one output sample; in block mode the caller has already filled the mix buffer. */
+static void
+sb_dsp_output_sample(sb_dsp_t *dsp)
 {
-    sb_dsp_t *dsp = (sb_dsp_t *) priv;
-    int       tempi;
-    int       ref;
-    int       data[2];
+    int tempi;
+    int ref;
+    int data[2];
 
-    timer_advance_u64(&dsp->output_timer, (uint64_t) dsp->sblatcho);
     if (dsp->sb_8_enable && dsp->sb_pausetime < 0 && dsp->sb_8_output) {
-        sb_dsp_update(dsp);
+        if (!dsp->block_mode)
+            sb_dsp_update(dsp);
 
         sb_dsp_log("8-bit format=%02x, pause=%x, length=%d.\n", dsp->sb_8_format, dsp->sb_8_pause, dsp->sb_8_length);
         switch (dsp->sb_8_format) {
@@ -2787,7 +2807,8 @@ pollsb(void *priv)
         }
     }
     if (dsp->sb_16_enable && !dsp->sb_16_pause && (dsp->sb_pausetime < 0LL) && dsp->sb_16_output) {
-        sb_dsp_update(dsp);
+        if (!dsp->block_mode)
+            sb_dsp_update(dsp);
 
         switch (dsp->sb_16_format) {
             case 0x00: /* Mono unsigned */
@@ -2873,6 +2894,190 @@ pollsb(void *priv)
     }
 }
 
+/*
+   Block mode.
+
+   Plain auto-init PCM playback does not need a timer event per sample:
+   nothing the guest can see changes between two IRQs except the DMA
+   address and count. While it is active, the output timer only fires at
+   the next IRQ boundary, and the samples in between are fetched in one go
+   whenever something needs them - the boundary itself, a DSP port write,
+   a DMA controller access (through dma_add_sync_handler()) or the mixer
+   asking for the buffer. block_offset keeps the due time of the next
+   sample on the same 32:32 clock the per-sample timer would have used, so
+   DMA reads, counters and IRQs land exactly where they did before. It is
+   kept relative to the output timer, so that it moves along when the
+   timers are rebased on a TSC write.
+ */
+#define SB_DSP_BLOCK_MAX 1024 /* samples, keeps the timer period well below a second */
+
+static int
+sb_dsp_block_eligible(const sb_dsp_t *dsp)
+{
+    if (IS_ESS(dsp) || dsp->ess_playback_mode || (dsp->sb_pausetime >= 0) ||
+        (dsp->dma_readb != sb_8_read_dma) || (dsp->dma_readw != sb_16_read_dma))
+        return 0;
+
+    if (dsp->sb_8_enable && dsp->sb_8_output && !dsp->sb_16_enable)
+        return dsp->sb_8_autoinit && !dsp->sb_8_pause && !(dsp->sb_8_format & ~0x30);
+
+    if (dsp->sb_16_enable && dsp->sb_16_output && !dsp->sb_8_enable)
+        return dsp->sb_16_autoinit && !dsp->sb_16_pause &&
+               (!(dsp->sb_16_format & ~0x30) || (dsp->sb_16_format == 0x36));
+
+    return 0;
+}
+
+/* Samples up to and including the one that raises the next IRQ. */
+static int
+sb_dsp_block_len(const sb_dsp_t *dsp)
+{
+    const int len    = dsp->sb_8_enable ? dsp->sb_8_length : dsp->sb_16_length;
+    const int format = dsp->sb_8_enable ? dsp->sb_8_format : dsp->sb_16_format;
+    int       ret    = (format & 0x20) ? ((len >> 1) + 1) : (len + 1);
+
+    return MAX(1, MIN(ret, SB_DSP_BLOCK_MAX));
+}
+
+static void
+sb_dsp_block_advance(uint64_t *ts_integer, uint32_t *ts_frac, uint64_t delay)
+{
+    const uint32_t frac_delay = delay & 0xffffffff;
+
+    if ((*ts_frac + frac_delay) < frac_delay)
+        (*ts_integer)++;
+    *ts_frac += frac_delay;
+    *ts_integer += delay >> 32;
+}
+
+/* Due time of the next sample. */
+static void
+sb_dsp_block_get(const sb_dsp_t *dsp, uint64_t *ts_integer, uint32_t *ts_frac)
+{
+    const uint32_t frac = (uint32_t) dsp->block_offset;
+
+    *ts_frac    = dsp->output_timer.ts_frac + frac;
+    *ts_integer = dsp->output_timer.ts_integer + (uint64_t) (dsp->block_offset >> 32) + (*ts_frac < frac);
+}
+
+static void
+sb_dsp_block_set(sb_dsp_t *dsp, uint64_t ts_integer, uint32_t ts_frac)
+{
+    dsp->block_offset = (int64_t) (((ts_integer - dsp->output_timer.ts_integer) << 32) +
+                                   ts_frac - dsp->output_timer.ts_frac);
+}
+
+static void
+sb_dsp_block_sync(sb_dsp_t *dsp)
+{
+    const uint64_t latch   = (uint64_t) dsp->sblatcho;
+    const int      pos     = dsp->pos;
+    const int      span    = sound_pos_global - pos;
+    int            samples = 0;
+    int            done    = 0;
+    uint64_t       ts_integer;
+    uint32_t       ts_frac;
+    uint64_t       next_integer;
+    uint32_t       next_frac;
+
+    if (!dsp->block_mode || !timer_is_enabled(&dsp->output_timer))
+        return;
+
+    sb_dsp_block_get(dsp, &ts_integer, &ts_frac);
+    next_integer = ts_integer;
+    next_frac    = ts_frac;
+
+    while ((int64_t) (ts_integer - tsc) <= 0) {
+        sb_dsp_block_advance(&ts_integer, &ts_frac, latch);
+        samples++;
+    }
+
+    /* Spread the samples evenly over the part of the mix buffer that has elapsed. */
+    for (; dsp->pos < sound_pos_global; dsp->pos++) {
+        const int due = (int) (((int64_t) (dsp->pos - pos + 1) * samples) / span);
+
+        for (; done < due; done++) {
+            sb_dsp_block_advance(&next_integer, &next_frac, latch);
+            sb_dsp_output_sample(dsp);
+        }
+
+        dsp->buffer[dsp->pos * 2]     = dsp->muted ? 0 : dsp->sbdatl;
+        dsp->buffer[dsp->pos * 2 + 1] = dsp->muted ? 0 : dsp->sbdatr;
+    }
+
+    for (; done < samples; done++) {
+        sb_dsp_block_advance(&next_integer, &next_frac, latch);
+        sb_dsp_output_sample(dsp);
+    }
+
+    sb_dsp_block_set(dsp, next_integer, next_frac);
+}
+
+static void
+sb_dsp_dma_sync(void *priv)
+{
+    sb_dsp_block_sync((sb_dsp_t *) priv);
+}
+
+/*
+   Enters or leaves block mode as the DSP state allows and points the output
+   timer at the next IRQ boundary. Must follow a sb_dsp_block_sync() with
+   nothing due; running tells whether the output timer is meant to be on.
+ */
+static void
+sb_dsp_block_arm(sb_dsp_t *dsp, int running)
+{
+    uint64_t next_integer;
+    uint32_t next_frac;
+    uint64_t ts_integer;
+    uint32_t ts_frac;
+
+    if (!running || !sb_dsp_block_eligible(dsp)) {
+        if (dsp->block_mode && running) {
+            /* Back to one timer event per sample, starting with the next one due. */
+            sb_dsp_block_get(dsp, &next_integer, &next_frac);
+            timer_disable(&dsp->output_timer);
+            dsp->output_timer.ts_integer = next_integer;
+            dsp->output_timer.ts_frac    = next_frac;
+            timer_enable(&dsp->output_timer);
+        }
+        dsp->block_mode = 0;
+        return;
+    }
+
+    if (!dsp->block_mode) {
+        dsp->block_offset = 0;
+        dsp->block_mode   = 1;
+    }
+
+    sb_dsp_block_get(dsp, &next_integer, &next_frac);
+    ts_integer = next_integer;
+    ts_frac    = next_frac;
+    sb_dsp_block_advance(&ts_integer, &ts_frac, (uint64_t) dsp->sblatcho * (sb_dsp_block_len(dsp) - 1));
+
+    timer_disable(&dsp->output_timer);
+    dsp->output_timer.ts_integer = ts_integer;
+    dsp->output_timer.ts_frac    = ts_frac;
+    timer_enable(&dsp->output_timer);
+    sb_dsp_block_set(dsp, next_integer, next_frac);
+}
+
+void
+pollsb(void *priv)
+{
+    sb_dsp_t *dsp = (sb_dsp_t *) priv;
+
+    if (dsp->block_mode) {
+        sb_dsp_block_sync(dsp);
+        sb_dsp_block_arm(dsp, 1);
+        return;
+    }
+
+    timer_advance_u64(&dsp->output_timer, (uint64_t) dsp->sblatcho);
+    sb_dsp_output_sample(dsp);
+    sb_dsp_block_arm(dsp, timer_is_enabled(&dsp->output_timer));
+}
+
 void
 sb_poll_i(void *priv)
 {
@@ -3098,6 +3303,8 @@ sb_poll_i(void *priv)
 void
 sb_dsp_update(sb_dsp_t *dsp)
 {
+    sb_dsp_block_sync(dsp);
+
     if (dsp->muted) {
         dsp->sbdatl = 0;
         dsp->sbdatr = 0;
@@ -3109,7 +3316,7 @@ sb_dsp_update(sb_dsp_t *dsp)
 }
 
 void
-sb_dsp_close(UNUSED(sb_dsp_t *dsp))
+sb_dsp_close(sb_dsp_t *dsp)
 {
-    //
+    dma_remove_sync_handler(dsp);
 }
@@ -17,7 +17,6 @@
 typedef struct ssi2001_t {
     void   *psid;
     int16_t buffer[SOUNDBUFLEN * 2];
-    int     pos;
     int     gameport_enabled;
 } ssi2001_t;
 
@@ -25,46 +24,31 @@ typedef struct entertainer_t {
     uint8_t regs;
 } entertainer_t;
 
-static void
-ssi2001_update(ssi2001_t *ssi2001)
-{
-    if (ssi2001->pos >= sound_pos_global)
-        return;
-
-    sid_fillbuf(&ssi2001->buffer[ssi2001->pos], sound_pos_global - ssi2001->pos, ssi2001->psid);
-    ssi2001->pos = sound_pos_global;
-}
-
 static void
 ssi2001_get_buffer(int32_t *buffer, int len, void *priv)
 {
     ssi2001_t *ssi2001 = (ssi2001_t *) priv;
 
-    ssi2001_update(ssi2001);
+    sid_fillbuf(ssi2001->buffer, len, ssi2001->psid);
 
     for (int c = 0; c < len * 2; c++)
         buffer[c] += ssi2001->buffer[c >> 1] / 2;
-
-    ssi2001->pos = 0;
 }
 
 static uint8_t
 ssi2001_read(uint16_t addr, void *priv)
 {
-    ssi2001_t *ssi2001 = (ssi2001_t *) priv;
+    const ssi2001_t *ssi2001 = (ssi2001_t *) priv;
 
-    ssi2001_update(ssi2001);
-
-    return sid_read(addr, priv);
+    return sid_read(addr, sound_pos_global, ssi2001->psid);
 }
 
 static void
 ssi2001_write(uint16_t addr, uint8_t val, void *priv)
 {
-    ssi2001_t *ssi2001 = (ssi2001_t *) priv;
+    const ssi2001_t *ssi2001 = (ssi2001_t *) priv;
 
-    ssi2001_update(ssi2001);
-    sid_write(addr, val, priv);
+    sid_write(addr, val, sound_pos_global, ssi2001->psid);
 }
 
 void *
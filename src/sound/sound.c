@@ -18,6 +18,7 @@
  */
 #include <math.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +37,7 @@
 #include <86box/timer.h>
 #include <86box/snd_mpu401.h>
 #include <86box/sound.h>
+#include <86box/sound_util.h>
 #include <86box/fdd_audio.h>
 #include <86box/hdd_audio.h>
 #include <86box/cdrom_audio.h>
@@ -46,18 +48,45 @@ typedef struct {
 
 typedef struct {
     void (*get_buffer)(int32_t *buffer, int len, void *priv);
-    void *priv;
+    void    *priv;
+    int      flags;
+    int32_t *buffer; /* private output of a thread-safe handler */
 } sound_handler_t;
 
+#define SOUND_HANDLERS_MAX 8
+#define SOUND_WORKERS      3
+
+/* A job is every thread-safe handler sharing one get_buffer, run in order. */
+typedef struct {
+    sound_handler_t *handlers;
+    int              num;
+    int              len;
+    int              jobs[SOUND_HANDLERS_MAX];
+    int              jobs_num;
+} sound_render_t;
+
+typedef struct {
+    thread_t       *thread;
+    event_t        *wake;
+    sound_render_t *render;
+    int             first; /* jobs first, first + stride, ... */
+    int             stride;
+} sound_worker_t;
+
 int sound_card_current[SOUND_CARD_MAX] = { 0, 0, 0, 0 };
 int sound_pos_global                   = 0;
 int music_pos_global                   = 0;
 int wavetable_pos_global               = 0;
 int sound_gain                         = 0;
 
-static sound_handler_t sound_handlers[8];
-static sound_handler_t music_handlers[8];
-static sound_handler_t wavetable_handlers[8];
+static sound_handler_t sound_handlers[SOUND_HANDLERS_MAX];
+static sound_handler_t music_handlers[SOUND_HANDLERS_MAX];
+static sound_handler_t wavetable_handlers[SOUND_HANDLERS_MAX];
+
+static sound_worker_t sound_workers[SOUND_WORKERS];
+static event_t       *sound_workers_done;
+static atomic_int     sound_workers_pending;
+static volatile int   sound_workers_on = 0;
 
 static double     cd_audio_volume_lut[256];
 
@@ -84,6 +113,7 @@ static pc_timer_t wavetable_poll_timer;
 static uint64_t   wavetable_poll_latch;
 
 static int16_t      cd_buffer[CDROM_NUM][CD_BUFLEN * 2];
+static double       cd_mix_buffer[CD_BUFLEN * 2];
 static float        cd_out_buffer[CD_BUFLEN * 2];
 static int16_t      cd_out_buffer_int16[CD_BUFLEN * 2];
 static unsigned int cd_vol_l;
@@ -304,11 +334,11 @@ sound_cd_clean_buffers(void)
 static void
 sound_cd_thread(UNUSED(void *param))
 {
-    int      temp_buffer[2];
     int      channel_select[2];
     double   audio_vol_l;
     double   audio_vol_r;
-    double   cd_buffer_temp[2] = { 0.0, 0.0 };
+    double   matrix[4];
+    double   gain[2];
 
     thread_set_event(sound_cd_start_event);
 
@@ -321,8 +351,6 @@ sound_cd_thread(UNUSED(void *param))
 
         sound_cd_clean_buffers();
 
-        temp_buffer[0] = temp_buffer[1] = 0;
-
         for (uint8_t i = 0; i < CDROM_NUM; i++) {
             /* Just in case the thread is in a loop when it gets terminated. */
             if (!cdaudioon)
@@ -351,63 +379,27 @@ sound_cd_thread(UNUSED(void *param))
                     channel_select[1] = 2;
                 }
 
-                // uint16_t *cddab = (uint16_t *) cdrom[i].raw_buffer;
-                for (int c = 0; c < CD_BUFLEN * 2; c += 2) {
-                    /* Apply ATAPI channel select */
-                    cd_buffer_temp[0] = cd_buffer_temp[1] = 0.0;
-
-                    if ((audio_vol_l != 0.0) && (channel_select[0] != 0)) {
-                        if (channel_select[0] & 1)
-                            /* Channel 0 => Port 0 */
-                            cd_buffer_temp[0] += ((double) cd_buffer[i][c]);
-                        if (channel_select[0] & 2)
-                            /* Channel 1 => Port 0 */
-                            cd_buffer_temp[0] += ((double) cd_buffer[i][c + 1]);
-
-                        /* Multiply Port 0 by Port 0 volume */
-                        cd_buffer_temp[0] *= audio_vol_l;
-                    }
-
-                    if ((audio_vol_r != 0.0) && (channel_select[1] != 0)) {
-                        if (channel_select[1] & 1)
-                            /* Channel 0 => Port 1 */
-                            cd_buffer_temp[1] += ((double) cd_buffer[i][c]);
-                        if (channel_select[1] & 2)
-                            /* Channel 1 => Port 1 */
-                            cd_buffer_temp[1] += ((double) cd_buffer[i][c + 1]);
-
-                        /* Multiply Port 1 by Port 1 volume */
-                        cd_buffer_temp[1] *= audio_vol_r;
-                    }
-
-                    /* Apply sound card CD volume and filters */
-                    if (filter_cd_audio != NULL) {
-                        filter_cd_audio(0, &(cd_buffer_temp[0]),
-                                        filter_cd_audio_p);
-                        filter_cd_audio(1, &(cd_buffer_temp[1]),
-                                        filter_cd_audio_p);
-                    }
-
-                    if (sound_is_float) {
-                        cd_out_buffer[c] += (float) (cd_buffer_temp[0] / 32768.0);
-                        cd_out_buffer[c + 1] += (float) (cd_buffer_temp[1] / 32768.0);
-                    } else {
-                        temp_buffer[0] = (int) trunc(cd_buffer_temp[0]);
-                        temp_buffer[1] = (int) trunc(cd_buffer_temp[1]);
-
-                        if (temp_buffer[0] > 32767)
-                            temp_buffer[0] = 32767;
-                        if (temp_buffer[0] < -32768)
-                            temp_buffer[0] = -32768;
-                        if (temp_buffer[1] > 32767)
-                            temp_buffer[1] = 32767;
-                        if (temp_buffer[1] < -32768)
-                            temp_buffer[1] = -32768;
-
-                        cd_out_buffer_int16[c]     += (int16_t) temp_buffer[0];
-                        cd_out_buffer_int16[c + 1] += (int16_t) temp_buffer[1];
+                /* Apply ATAPI channel select and the port volumes. */
+                matrix[0] = (channel_select[0] & 1) ? 1.0 : 0.0; /* Channel 0 => Port 0 */
+                matrix[1] = (channel_select[0] & 2) ? 1.0 : 0.0; /* Channel 1 => Port 0 */
+                matrix[2] = (channel_select[1] & 1) ? 1.0 : 0.0; /* Channel 0 => Port 1 */
+                matrix[3] = (channel_select[1] & 2) ? 1.0 : 0.0; /* Channel 1 => Port 1 */
+                gain[0]   = channel_select[0] ? audio_vol_l : 0.0;
+                gain[1]   = channel_select[1] ? audio_vol_r : 0.0;
+                sound_s16_to_double(cd_mix_buffer, cd_buffer[i], CD_BUFLEN, matrix, gain);
+
+                /* Apply sound card CD volume and filters */
+                if (filter_cd_audio != NULL) {
+                    for (int c = 0; c < CD_BUFLEN * 2; c += 2) {
+                        filter_cd_audio(0, &(cd_mix_buffer[c]), filter_cd_audio_p);
+                        filter_cd_audio(1, &(cd_mix_buffer[c + 1]), filter_cd_audio_p);
                     }
                 }
+
+                if (sound_is_float)
+                    sound_mix_double_to_float(cd_out_buffer, cd_mix_buffer, CD_BUFLEN * 2);
+                else
+                    sound_mix_double_to_int16(cd_out_buffer_int16, cd_mix_buffer, CD_BUFLEN * 2);
             }
         }
 
@@ -489,6 +481,8 @@ sound_init(void)
 {
     int available_cdrom_drives = 0;
 
+    sound_mix_init();
+
     outbuffer_ex       = NULL;
     outbuffer_ex_int16 = NULL;
 
@@ -546,28 +540,212 @@ sound_init(void)
     cd_thread_enable = available_cdrom_drives ? 1 : 0;
 }
 
+static void
+sound_add_handler_common(sound_handler_t *handlers, int *num, int len,
+                         void (*get_buffer)(int32_t *buffer, int len, void *priv), void *priv, int flags)
+{
+    sound_handler_t *handler = &handlers[*num];
+
+    handler->get_buffer = get_buffer;
+    handler->priv       = priv;
+    handler->flags      = flags;
+    if (flags & SOUND_HANDLER_THREAD_SAFE) {
+        handler->buffer = calloc(len * 2, sizeof(int32_t));
+        if (handler->buffer == NULL) {
+            /* Without a buffer of its own it renders on the emulation thread. */
+            sound_log("SOUND: Unable to allocate a render buffer for handler %d\n", *num);
+            handler->flags &= ~SOUND_HANDLER_THREAD_SAFE;
+        }
+    }
+    (*num)++;
+}
+
+void
+sound_add_handler_ex(void (*get_buffer)(int32_t *buffer, int len, void *priv), void *priv, int flags)
+{
+    sound_add_handler_common(sound_handlers, &sound_handlers_num, SOUNDBUFLEN, get_buffer, priv, flags);
+}
+
 void
 sound_add_handler(void (*get_buffer)(int32_t *buffer, int len, void *priv), void *priv)
 {
-    sound_handlers[sound_handlers_num].get_buffer = get_buffer;
-    sound_handlers[sound_handlers_num].priv       = priv;
-    sound_handlers_num++;
+    sound_add_handler_ex(get_buffer, priv, 0);
+}
+
+void
+music_add_handler_ex(void (*get_buffer)(int32_t *buffer, int len, void *priv), void *priv, int flags)
+{
+    sound_add_handler_common(music_handlers, &music_handlers_num, MUSICBUFLEN, get_buffer, priv, flags);
 }
 
 void
 music_add_handler(void (*get_buffer)(int32_t *buffer, int len, void *priv), void *priv)
 {
-    music_handlers[music_handlers_num].get_buffer = get_buffer;
-    music_handlers[music_handlers_num].priv       = priv;
-    music_handlers_num++;
+    music_add_handler_ex(get_buffer, priv, 0);
+}
+
+void
+wavetable_add_handler_ex(void (*get_buffer)(int32_t *buffer, int len, void *priv), void *priv, int flags)
+{
+    sound_add_handler_common(wavetable_handlers, &wavetable_handlers_num, WTBUFLEN, get_buffer, priv, flags);
 }
 
 void
 wavetable_add_handler(void (*get_buffer)(int32_t *buffer, int len, void *priv), void *priv)
 {
-    wavetable_handlers[wavetable_handlers_num].get_buffer = get_buffer;
-    wavetable_handlers[wavetable_handlers_num].priv       = priv;
-    wavetable_handlers_num++;
+    wavetable_add_handler_ex(get_buffer, priv, 0);
+}
+
+static void
+sound_clear_handlers(sound_handler_t *handlers, int *num)
+{
+    for (int c = 0; c < *num; c++)
+        free(handlers[c].buffer);
+
+    *num = 0;
+    memset(handlers, 0x00, SOUND_HANDLERS_MAX * sizeof(sound_handler_t));
+}
+
+static void
+sound_render_job(const sound_render_t *render, int job)
+{
+    int first = render->jobs[job];
+
+    for (int c = first; c < render->num; c++) {
+        sound_handler_t *handler = &render->handlers[c];
+
+        if ((handler->flags & SOUND_HANDLER_THREAD_SAFE) && (handler->get_buffer == render->handlers[first].get_buffer)) {
+            memset(handler->buffer, 0x00, render->len * 2 * sizeof(int32_t));
+            handler->get_buffer(handler->buffer, render->len, handler->priv);
+        }
+    }
+}
+
+static void
+sound_worker_thread(void *priv)
+{
+    sound_worker_t *worker = (sound_worker_t *) priv;
+
+    while (sound_workers_on) {
+        thread_wait_event(worker->wake, -1);
+        thread_reset_event(worker->wake);
+
+        if (!sound_workers_on)
+            break;
+
+        for (int j = worker->first; j < worker->render->jobs_num; j += worker->stride)
+            sound_render_job(worker->render, j);
+
+        if (atomic_fetch_sub(&sound_workers_pending, 1) == 1)
+            thread_set_event(sound_workers_done);
+    }
+}
+
+static void
+sound_workers_init(void)
+{
+    sound_workers_done = thread_create_event();
+    sound_workers_on   = 1;
+
+    for (int i = 0; i < SOUND_WORKERS; i++) {
+        sound_workers[i].wake   = thread_create_event();
+        sound_workers[i].thread = thread_create(sound_worker_thread, &sound_workers[i]);
+    }
+}
+
+void
+sound_workers_end(void)
+{
+    if (!sound_workers_on)
+        return;
+
+    sound_workers_on = 0;
+
+    for (int i = 0; i < SOUND_WORKERS; i++) {
+        thread_set_event(sound_workers[i].wake);
+        thread_wait(sound_workers[i].thread);
+        thread_destroy_event(sound_workers[i].wake);
+        sound_workers[i].thread = NULL;
+        sound_workers[i].wake   = NULL;
+    }
+
+    thread_destroy_event(sound_workers_done);
+    sound_workers_done = NULL;
+}
+
+/*
+ * Run every handler of one poll into buffer. Handlers registered as
+ * thread-safe only touch their own device, so while the emulation thread
+ * is parked here they can render on the worker threads, each into its own
+ * buffer, and are added into the output afterwards. Handlers sharing a
+ * get_buffer may share static state (the filters are per file), so they
+ * are kept together on one thread. When this thread has handlers of its
+ * own to run, a single thread-safe job is already worth handing off.
+ */
+static void
+sound_render(sound_handler_t *handlers, int num, int32_t *buffer, int len)
+{
+    sound_render_t render = { .handlers = handlers, .num = num, .len = len };
+    int            unsafe = 0;
+    int            own;
+    int            workers;
+
+    memset(buffer, 0x00, len * 2 * sizeof(int32_t));
+
+    for (int c = 0; c < num; c++) {
+        int shared = 0;
+
+        if (!(handlers[c].flags & SOUND_HANDLER_THREAD_SAFE)) {
+            unsafe++;
+            continue;
+        }
+        for (int j = 0; j < render.jobs_num; j++)
+            shared |= (handlers[render.jobs[j]].get_buffer == handlers[c].get_buffer);
+        if (!shared)
+            render.jobs[render.jobs_num++] = c;
+    }
+
+    /*
+       With nothing else to do, this thread takes job 0 and every
+       (workers + 1)th after it; otherwise the workers get all the jobs.
+     */
+    own     = !unsafe;
+    workers = MIN(render.jobs_num - own, SOUND_WORKERS);
+
+    /* Nothing would run in parallel. */
+    if (workers < 1) {
+        for (int c = 0; c < num; c++)
+            handlers[c].get_buffer(buffer, len, handlers[c].priv);
+        return;
+    }
+
+    if (!sound_workers_on)
+        sound_workers_init();
+
+    atomic_store(&sound_workers_pending, workers);
+    for (int i = 0; i < workers; i++) {
+        sound_workers[i].render = &render;
+        sound_workers[i].first  = i + own;
+        sound_workers[i].stride = workers + own;
+        thread_set_event(sound_workers[i].wake);
+    }
+
+    for (int c = 0; c < num; c++) {
+        if (!(handlers[c].flags & SOUND_HANDLER_THREAD_SAFE))
+            handlers[c].get_buffer(buffer, len, handlers[c].priv);
+    }
+    if (own) {
+        for (int j = 0; j < render.jobs_num; j += workers + 1)
+            sound_render_job(&render, j);
+    }
+
+    thread_wait_event(sound_workers_done, -1);
+    thread_reset_event(sound_workers_done);
+
+    for (int c = 0; c < num; c++) {
+        if (handlers[c].flags & SOUND_HANDLER_THREAD_SAFE)
+            sound_mix_int32(buffer, handlers[c].buffer, len * 2);
+    }
 }
 
 void
@@ -597,31 +775,20 @@ sound_poll(UNUSED(void *priv))
 
     sound_pos_global++;
     if (sound_pos_global == SOUNDBUFLEN) {
-        int c;
-
-        memset(outbuffer, 0x00, SOUNDBUFLEN * 2 * sizeof(int32_t));
-
-        for (c = 0; c < sound_handlers_num; c++)
-            sound_handlers[c].get_buffer(outbuffer, SOUNDBUFLEN, sound_handlers[c].priv);
+        sound_render(sound_handlers, sound_handlers_num, outbuffer, SOUNDBUFLEN);
 
-        for (c = 0; c < SOUNDBUFLEN * 2; c++) {
-            if (sound_is_float)
-                outbuffer_ex[c] = ((float) outbuffer[c]) / (float) 32768.0;
-            else {
-                if (outbuffer[c] > 32767)
-                    outbuffer[c] = 32767;
-                if (outbuffer[c] < -32768)
-                    outbuffer[c] = -32768;
+        sound_capture_write(SOUND_CAPTURE_SOUND, outbuffer, SOUNDBUFLEN);
 
-                outbuffer_ex_int16[c] = (int16_t) outbuffer[c];
+        if (!sound_output_null) {
+            if (sound_is_float) {
+                sound_int32_to_float(outbuffer_ex, outbuffer, SOUNDBUFLEN * 2);
+                givealbuffer(outbuffer_ex);
+            } else {
+                sound_int32_to_int16(outbuffer_ex_int16, outbuffer, SOUNDBUFLEN * 2);
+                givealbuffer(outbuffer_ex_int16);
             }
         }
 
-        if (sound_is_float)
-            givealbuffer(outbuffer_ex);
-        else
-            givealbuffer(outbuffer_ex_int16);
-
         if (cd_thread_enable) {
             cd_buf_update--;
             if (!cd_buf_update) {
@@ -652,31 +819,20 @@ music_poll(UNUSED(void *priv))
 
     music_pos_global++;
     if (music_pos_global == MUSICBUFLEN) {
-        int c;
-
-        memset(outbuffer_m, 0x00, MUSICBUFLEN * 2 * sizeof(int32_t));
+        sound_render(music_handlers, music_handlers_num, outbuffer_m, MUSICBUFLEN);
 
-        for (c = 0; c < music_handlers_num; c++)
-            music_handlers[c].get_buffer(outbuffer_m, MUSICBUFLEN, music_handlers[c].priv);
+        sound_capture_write(SOUND_CAPTURE_MUSIC, outbuffer_m, MUSICBUFLEN);
 
-        for (c = 0; c < MUSICBUFLEN * 2; c++) {
-            if (sound_is_float)
-                outbuffer_m_ex[c] = ((float) outbuffer_m[c]) / (float) 32768.0;
-            else {
-                if (outbuffer_m[c] > 32767)
-                    outbuffer_m[c] = 32767;
-                if (outbuffer_m[c] < -32768)
-                    outbuffer_m[c] = -32768;
-
-                outbuffer_m_ex_int16[c] = (int16_t) outbuffer_m[c];
+        if (!sound_output_null) {
+            if (sound_is_float) {
+                sound_int32_to_float(outbuffer_m_ex, outbuffer_m, MUSICBUFLEN * 2);
+                givealbuffer_music(outbuffer_m_ex);
+            } else {
+                sound_int32_to_int16(outbuffer_m_ex_int16, outbuffer_m, MUSICBUFLEN * 2);
+                givealbuffer_music(outbuffer_m_ex_int16);
             }
         }
 
-        if (sound_is_float)
-            givealbuffer_music(outbuffer_m_ex);
-        else
-            givealbuffer_music(outbuffer_m_ex_int16);
-
         music_pos_global = 0;
     }
 }
@@ -688,31 +844,20 @@ wavetable_poll(UNUSED(void *priv))
 
     wavetable_pos_global++;
     if (wavetable_pos_global == WTBUFLEN) {
-        int c;
-
-        memset(outbuffer_w, 0x00, WTBUFLEN * 2 * sizeof(int32_t));
-
-        for (c = 0; c < wavetable_handlers_num; c++)
-            wavetable_handlers[c].get_buffer(outbuffer_w, WTBUFLEN, wavetable_handlers[c].priv);
+        sound_render(wavetable_handlers, wavetable_handlers_num, outbuffer_w, WTBUFLEN);
 
-        for (c = 0; c < WTBUFLEN * 2; c++) {
-            if (sound_is_float)
-                outbuffer_w_ex[c] = ((float) outbuffer_w[c]) / (float) 32768.0;
-            else {
-                if (outbuffer_w[c] > 32767)
-                    outbuffer_w[c] = 32767;
-                if (outbuffer_w[c] < -32768)
-                    outbuffer_w[c] = -32768;
+        sound_capture_write(SOUND_CAPTURE_WT, outbuffer_w, WTBUFLEN);
 
-                outbuffer_w_ex_int16[c] = (int16_t) outbuffer_w[c];
+        if (!sound_output_null) {
+            if (sound_is_float) {
+                sound_int32_to_float(outbuffer_w_ex, outbuffer_w, WTBUFLEN * 2);
+                givealbuffer_wt(outbuffer_w_ex);
+            } else {
+                sound_int32_to_int16(outbuffer_w_ex_int16, outbuffer_w, WTBUFLEN * 2);
+                givealbuffer_wt(outbuffer_w_ex_int16);
             }
         }
 
-        if (sound_is_float)
-            givealbuffer_wt(outbuffer_w_ex);
-        else
-            givealbuffer_wt(outbuffer_w_ex_int16);
-
         wavetable_pos_global = 0;
     }
 }
@@ -739,19 +884,17 @@ sound_reset(void)
     midi_out_device_init();
     midi_in_device_init();
 
-    inital();
+    if (!sound_output_null)
+        inital();
 
     timer_add(&sound_poll_timer, sound_poll, NULL, 1);
-    sound_handlers_num = 0;
-    memset(sound_handlers, 0x00, 8 * sizeof(sound_handler_t));
+    sound_clear_handlers(sound_handlers, &sound_handlers_num);
 
     timer_add(&music_poll_timer, music_poll, NULL, 1);
-    music_handlers_num = 0;
-    memset(music_handlers, 0x00, 8 * sizeof(sound_handler_t));
+    sound_clear_handlers(music_handlers, &music_handlers_num);
 
     timer_add(&wavetable_poll_timer, wavetable_poll, NULL, 1);
-    wavetable_handlers_num = 0;
-    memset(wavetable_handlers, 0x00, 8 * sizeof(sound_handler_t));
+    sound_clear_handlers(wavetable_handlers, &wavetable_handlers_num);
 
     filter_cd_audio   = NULL;
     filter_cd_audio_p = NULL;
@@ -0,0 +1,233 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Offline capture of the sound, music and wavetable mixes.
+ *
+ *          Each mix, and the output of a MIDI synth that supports it,
+ *          goes to its own 16-bit stereo WAV or FLAC file at its native
+ *          rate. The emulation thread only copies the blocks
+ *          into a ring; opening and encoding the files happen on a
+ *          background thread.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <sndfile.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/path.h>
+#include <86box/plat.h>
+#include <86box/thread.h>
+#include <86box/sound.h>
+#include <86box/plat_unused.h>
+
+#define CAPTURE_BLOCKS    32
+#define CAPTURE_BLOCK_LEN (MUSICBUFLEN * 2) /* the largest of the three mixes */
+#define CAPTURE_POLL_MS   10
+
+typedef struct capture_block_t {
+    int     stream;
+    int     frames;
+    int16_t data[CAPTURE_BLOCK_LEN];
+} capture_block_t;
+
+static struct {
+    const char *suffix;
+    int         freq;
+} capture_streams[SOUND_CAPTURE_MAX] = {
+    { "",       SOUND_FREQ },
+    { "-music", MUSIC_FREQ },
+    { "-wt",    WT_FREQ    },
+    { "-midi",  44100      } /* set by the synth, see sound_capture_set_freq() */
+};
+
+static capture_block_t *capture_ring;
+static atomic_uint      capture_head; /* advanced by the emulation thread */
+static atomic_uint      capture_tail; /* advanced by the capture thread */
+static SNDFILE         *capture_files[SOUND_CAPTURE_MAX];
+static int              capture_failed[SOUND_CAPTURE_MAX];
+static thread_t        *capture_thread;
+static event_t         *capture_stop;
+static volatile int     capture_on = 0;
+
+#ifdef ENABLE_SOUND_CAPTURE_LOG
+int sound_capture_do_log = ENABLE_SOUND_CAPTURE_LOG;
+
+static void
+sound_capture_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (sound_capture_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define sound_capture_log(fmt, ...)
+#endif
+
+/* "out.flac" becomes "out.flac", "out-music.flac", "out-wt.flac" and so on; no extension means WAV. */
+static SNDFILE *
+sound_capture_open(int stream)
+{
+    char        base[1024];
+    char        fn[1100];
+    char       *dot;
+    const char *ext = "wav";
+    SF_INFO     info = { 0 };
+    SNDFILE    *file;
+
+    snprintf(base, sizeof(base), "%s", sound_capture_path);
+    dot = path_get_extension(base);
+    if (*dot != '\0') {
+        ext     = dot;
+        dot[-1] = '\0';
+    }
+
+    snprintf(fn, sizeof(fn), "%s%s.%s", base, capture_streams[stream].suffix, ext);
+
+    info.samplerate = capture_streams[stream].freq;
+    info.channels   = 2;
+    info.format     = (!strcasecmp(ext, "flac") ? SF_FORMAT_FLAC : SF_FORMAT_WAV) | SF_FORMAT_PCM_16;
+
+    file = sf_open(fn, SFM_WRITE, &info);
+    if (file == NULL) {
+        pclog("Sound capture: unable to create \"%s\": %s\n", fn, sf_strerror(NULL));
+    } else {
+        sound_capture_log("Sound capture: writing \"%s\"\n", fn);
+    }
+
+    return file;
+}
+
+/* Returns the number of blocks written. */
+static int
+sound_capture_drain(void)
+{
+    unsigned int head = atomic_load_explicit(&capture_head, memory_order_acquire);
+    unsigned int tail = atomic_load_explicit(&capture_tail, memory_order_relaxed);
+    int          ret  = 0;
+
+    while (tail != head) {
+        const capture_block_t *block  = &capture_ring[tail % CAPTURE_BLOCKS];
+        const int              stream = block->stream;
+
+        if ((capture_files[stream] == NULL) && !capture_failed[stream]) {
+            capture_files[stream]  = sound_capture_open(stream);
+            capture_failed[stream] = (capture_files[stream] == NULL);
+        }
+
+        if (capture_files[stream] != NULL)
+            sf_writef_short(capture_files[stream], block->data, block->frames);
+
+        atomic_store_explicit(&capture_tail, ++tail, memory_order_release);
+        ret++;
+    }
+
+    return ret;
+}
+
+static void
+sound_capture_thread(UNUSED(void *priv))
+{
+    while (capture_on) {
+        if (!sound_capture_drain())
+            thread_wait_event(capture_stop, CAPTURE_POLL_MS);
+    }
+
+    sound_capture_drain();
+}
+
+static void
+sound_capture_init(void)
+{
+    capture_ring = (capture_block_t *) calloc(CAPTURE_BLOCKS, sizeof(capture_block_t));
+    atomic_init(&capture_head, 0);
+    atomic_init(&capture_tail, 0);
+
+    capture_stop   = thread_create_event();
+    capture_on     = 1;
+    capture_thread = thread_create(sound_capture_thread, NULL);
+}
+
+/*
+ * Queue one block of a mix. Unlike the host output, a capture must not
+ * lose audio, so a full ring makes the emulation wait for the encoder.
+ */
+void
+sound_capture_write(int stream, const int32_t *buf, int frames)
+{
+    capture_block_t *block;
+    unsigned int     head;
+
+    if (sound_capture_path[0] == '\0')
+        return;
+
+    if (!capture_on)
+        sound_capture_init();
+
+    head = atomic_load_explicit(&capture_head, memory_order_relaxed);
+    while ((head - atomic_load_explicit(&capture_tail, memory_order_acquire)) >= CAPTURE_BLOCKS)
+        plat_delay_ms(1);
+
+    block         = &capture_ring[head % CAPTURE_BLOCKS];
+    block->stream = stream;
+    block->frames = MIN(frames, CAPTURE_BLOCK_LEN / 2);
+    for (int c = 0; c < (block->frames * 2); c++) {
+        if (buf[c] > 32767)
+            block->data[c] = 32767;
+        else if (buf[c] < -32768)
+            block->data[c] = -32768;
+        else
+            block->data[c] = (int16_t) buf[c];
+    }
+
+    atomic_store_explicit(&capture_head, head + 1, memory_order_release);
+}
+
+/* Only takes effect for a stream whose file has not been opened yet. */
+void
+sound_capture_set_freq(int stream, int freq)
+{
+    capture_streams[stream].freq = freq;
+}
+
+void
+sound_capture_close(void)
+{
+    if (!capture_on)
+        return;
+
+    capture_on = 0;
+    thread_set_event(capture_stop);
+    thread_wait(capture_thread);
+    thread_destroy_event(capture_stop);
+    capture_thread = NULL;
+    capture_stop   = NULL;
+
+    for (int i = 0; i < SOUND_CAPTURE_MAX; i++) {
+        if (capture_files[i] != NULL) {
+            sf_close(capture_files[i]);
+            capture_files[i] = NULL;
+        }
+        capture_failed[i] = 0;
+    }
+
+    free(capture_ring);
+    capture_ring = NULL;
+}
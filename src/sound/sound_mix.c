@@ -0,0 +1,246 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Block kernels for mixing and converting the sound buffers.
+ *
+ *          Every kernel gives exactly the same result as the per-sample
+ *          code it replaced: the integer paths saturate the same way and
+ *          the floating point paths do the same operations in the same
+ *          order. SSE2 is used where the compiler targets it, and on
+ *          GCC and Clang the AVX2 versions are picked at run time.
+ *          Defining SOUND_MIX_NO_SIMD builds the plain C versions only,
+ *          which the tests in tests/ compare against.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if !defined(SOUND_MIX_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#    define SOUND_MIX_SSE2
+#    include <emmintrin.h>
+#endif
+#if defined(SOUND_MIX_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#    define SOUND_MIX_AVX2
+#    include <immintrin.h>
+#endif
+
+#include <86box/86box.h>
+#include <86box/sound_util.h>
+
+#ifdef SOUND_MIX_AVX2
+#    define AVX2 __attribute__((target("avx2")))
+#endif
+
+static void
+mix_int32_c(int32_t *dst, const int32_t *src, int len)
+{
+    int c = 0;
+
+#ifdef SOUND_MIX_SSE2
+    for (; c <= (len - 4); c += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &dst[c]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &src[c]);
+        _mm_storeu_si128((__m128i *) &dst[c], _mm_add_epi32(a, b));
+    }
+#endif
+
+    for (; c < len; c++)
+        dst[c] = (int32_t) ((uint32_t) dst[c] + (uint32_t) src[c]);
+}
+
+/* x / 32768.0f; scaling by a power of two is exact, so the multiply matches the divide. */
+static void
+int32_to_float_c(float *dst, const int32_t *src, int len)
+{
+    int c = 0;
+
+#ifdef SOUND_MIX_SSE2
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+    for (; c <= (len - 4); c += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &src[c]);
+        _mm_storeu_ps(&dst[c], _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+    }
+#endif
+
+    for (; c < len; c++)
+        dst[c] = ((float) src[c]) / (float) 32768.0;
+}
+
+static void
+int32_to_int16_c(int16_t *dst, const int32_t *src, int len)
+{
+    int c = 0;
+
+#ifdef SOUND_MIX_SSE2
+    for (; c <= (len - 8); c += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &src[c]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &src[c + 4]);
+        _mm_storeu_si128((__m128i *) &dst[c], _mm_packs_epi32(a, b));
+    }
+#endif
+
+    for (; c < len; c++) {
+        if (src[c] > 32767)
+            dst[c] = 32767;
+        else if (src[c] < -32768)
+            dst[c] = -32768;
+        else
+            dst[c] = (int16_t) src[c];
+    }
+}
+
+#ifdef SOUND_MIX_AVX2
+static AVX2 void
+mix_int32_avx2(int32_t *dst, const int32_t *src, int len)
+{
+    int c = 0;
+
+    for (; c <= (len - 8); c += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) &dst[c]);
+        __m256i b = _mm256_loadu_si256((const __m256i *) &src[c]);
+        _mm256_storeu_si256((__m256i *) &dst[c], _mm256_add_epi32(a, b));
+    }
+
+    mix_int32_c(&dst[c], &src[c], len - c);
+}
+
+static AVX2 void
+int32_to_float_avx2(float *dst, const int32_t *src, int len)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    int          c     = 0;
+
+    for (; c <= (len - 8); c += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) &src[c]);
+        _mm256_storeu_ps(&dst[c], _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+    }
+
+    int32_to_float_c(&dst[c], &src[c], len - c);
+}
+
+static AVX2 void
+int32_to_int16_avx2(int16_t *dst, const int32_t *src, int len)
+{
+    int c = 0;
+
+    for (; c <= (len - 16); c += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) &src[c]);
+        __m256i b = _mm256_loadu_si256((const __m256i *) &src[c + 8]);
+        /* The pack works per 128-bit lane, put the quarters back in order. */
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+        _mm256_storeu_si256((__m256i *) &dst[c], p);
+    }
+
+    int32_to_int16_c(&dst[c], &src[c], len - c);
+}
+#endif
+
+void (*sound_mix_int32)(int32_t *dst, const int32_t *src, int len)      = mix_int32_c;
+void (*sound_int32_to_float)(float *dst, const int32_t *src, int len)   = int32_to_float_c;
+void (*sound_int32_to_int16)(int16_t *dst, const int32_t *src, int len) = int32_to_int16_c;
+
+void
+sound_mix_init(void)
+{
+#ifdef SOUND_MIX_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        sound_mix_int32      = mix_int32_avx2;
+        sound_int32_to_float = int32_to_float_avx2;
+        sound_int32_to_int16 = int32_to_int16_avx2;
+    }
+#endif
+}
+
+/*
+ * dst[L] = (src[L] * m[0] + src[R] * m[1]) * gain[0], and likewise for R
+ * with m[2], m[3] and gain[1]. The matrix entries are 0.0 or 1.0, so the
+ * sums are exact; a gain of 0.0 gives +0.0 whatever the input.
+ */
+void
+sound_s16_to_double(double *dst, const int16_t *src, int frames, const double m[4], const double gain[2])
+{
+    int c = 0;
+
+#ifdef SOUND_MIX_SSE2
+    const __m128d ml   = _mm_set_pd(m[2], m[0]);
+    const __m128d mr   = _mm_set_pd(m[3], m[1]);
+    const __m128d g    = _mm_set_pd(gain[1], gain[0]);
+    const __m128d mask = _mm_cmpneq_pd(g, _mm_setzero_pd());
+
+    for (; c < frames; c++) {
+        __m128d l = _mm_set1_pd((double) src[c * 2]);
+        __m128d r = _mm_set1_pd((double) src[c * 2 + 1]);
+        __m128d s = _mm_add_pd(_mm_mul_pd(l, ml), _mm_mul_pd(r, mr));
+        _mm_storeu_pd(&dst[c * 2], _mm_and_pd(_mm_mul_pd(s, g), mask));
+    }
+#endif
+
+    for (; c < frames; c++) {
+        const double l = (double) src[c * 2];
+        const double r = (double) src[c * 2 + 1];
+
+        dst[c * 2]     = (gain[0] != 0.0) ? ((l * m[0] + r * m[1]) * gain[0]) : 0.0;
+        dst[c * 2 + 1] = (gain[1] != 0.0) ? ((l * m[2] + r * m[3]) * gain[1]) : 0.0;
+    }
+}
+
+/* dst[i] += (float) (src[i] / 32768.0) */
+void
+sound_mix_double_to_float(float *dst, const double *src, int len)
+{
+    int c = 0;
+
+#ifdef SOUND_MIX_SSE2
+    const __m128d scale = _mm_set1_pd(32768.0);
+
+    for (; c <= (len - 4); c += 4) {
+        __m128 lo = _mm_cvtpd_ps(_mm_div_pd(_mm_loadu_pd(&src[c]), scale));
+        __m128 hi = _mm_cvtpd_ps(_mm_div_pd(_mm_loadu_pd(&src[c + 2]), scale));
+        __m128 a  = _mm_movelh_ps(lo, hi);
+        _mm_storeu_ps(&dst[c], _mm_add_ps(_mm_loadu_ps(&dst[c]), a));
+    }
+#endif
+
+    for (; c < len; c++)
+        dst[c] += (float) (src[c] / 32768.0);
+}
+
+/* dst[i] += src[i] truncated and saturated to 16 bits; the add itself wraps. */
+void
+sound_mix_double_to_int16(int16_t *dst, const double *src, int len)
+{
+    int c = 0;
+
+#ifdef SOUND_MIX_SSE2
+    for (; c <= (len - 8); c += 8) {
+        __m128i a = _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_loadu_pd(&src[c])),
+                                       _mm_cvttpd_epi32(_mm_loadu_pd(&src[c + 2])));
+        __m128i b = _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_loadu_pd(&src[c + 4])),
+                                       _mm_cvttpd_epi32(_mm_loadu_pd(&src[c + 6])));
+        __m128i d = _mm_loadu_si128((const __m128i *) &dst[c]);
+        _mm_storeu_si128((__m128i *) &dst[c], _mm_add_epi16(d, _mm_packs_epi32(a, b)));
+    }
+#endif
+
+    for (; c < len; c++) {
+        int temp = (int) trunc(src[c]);
+
+        if (temp > 32767)
+            temp = 32767;
+        if (temp < -32768)
+            temp = -32768;
+
+        dst[c] = (int16_t) (dst[c] + temp);
+    }
+}
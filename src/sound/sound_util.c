@@ -1,14 +1,38 @@
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#endif
 
+#define HAVE_STDARG_H
 #include <86box/86box.h>
 #include <86box/mem.h>
 #include <86box/rom.h>
 #include <86box/plat.h>
 #include <86box/sound_util.h>
 
+#ifdef ENABLE_SOUND_UTIL_LOG
+int sound_util_do_log = ENABLE_SOUND_UTIL_LOG;
+
+static void
+sound_util_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (sound_util_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#    define sound_util_log(fmt, ...)
+#endif
+
 int16_t *
 sound_load_wav(const char *filename, int *sample_count)
 {
@@ -82,4 +106,215 @@ sound_load_wav(const char *filename, int *sample_count)
         *sample_count = output_samples;
 
     return output_data;
-}
\ No newline at end of file
+}
+
+/*
+ * Polyphase windowed-sinc resampler.
+ *
+ * A device pushes frames at its own rate and the sound handler pulls
+ * them at the output rate. Each output frame is a 16-tap FIR over the
+ * input, with the taps for the fractional position interpolated between
+ * two of 128 precomputed phases. The cutoff follows the lower of the
+ * two rates, so downsampling does not alias either.
+ *
+ * Pushes and pulls are not exactly balanced over one block because the
+ * device timer and the output timer drift, so a few frames of slack are
+ * kept. After every pull the step is trimmed by up to RESAMPLER_TRIM
+ * against the smoothed backlog, which keeps the two sides in step without
+ * dropping or repeating input. Only a backlog beyond RESAMPLER_RESYNC
+ * (a stalled output, say) is cut back in one go; the last frame is held
+ * when the input runs dry altogether.
+ */
+#define RESAMPLER_TAPS       16
+#define RESAMPLER_PHASE_BITS 7
+#define RESAMPLER_PHASES     (1 << RESAMPLER_PHASE_BITS)
+#define RESAMPLER_FRAC_BITS  (32 - RESAMPLER_PHASE_BITS)
+#define RESAMPLER_SIZE       2048 /* input frames kept, power of two */
+#define RESAMPLER_SLACK      4
+#define RESAMPLER_TRIM       0.005  /* largest step correction, relative */
+#define RESAMPLER_TRIM_GAIN  0.0005 /* correction per frame of backlog error */
+#define RESAMPLER_RESYNC     (RESAMPLER_SIZE / 4)
+
+struct resampler_t {
+    float    coefs[RESAMPLER_PHASES + 1][RESAMPLER_TAPS];
+    float    in[2][RESAMPLER_SIZE * 2]; /* mirrored, so a window never wraps */
+    uint32_t write;                     /* input frames pushed */
+    uint32_t read;                      /* first input frame of the window */
+    uint32_t frac;                      /* position past read, 0.32 */
+    uint64_t step;                      /* input frames per output frame, 32.32 */
+    double   ratio;                     /* nominal in_rate / out_rate */
+    double   backlog;                   /* smoothed backlog error, in frames */
+    double   cutoff;
+    int32_t  last[2];
+};
+
+static void
+resampler_make_coefs(resampler_t *rs)
+{
+    const double half = RESAMPLER_TAPS / 2;
+
+    for (int p = 0; p <= RESAMPLER_PHASES; p++) {
+        double sum = 0.0;
+        double c[RESAMPLER_TAPS];
+
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            const double x = (double) (k - (RESAMPLER_TAPS / 2 - 1)) - ((double) p / RESAMPLER_PHASES);
+            const double y = M_PI * rs->cutoff * x;
+            double       w = 0.0;
+
+            /* Blackman window over the span of the taps. */
+            if (fabs(x) < half)
+                w = 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2.0 * M_PI * x / half);
+
+            c[k] = w * ((x == 0.0) ? 1.0 : (sin(y) / y));
+            sum += c[k];
+        }
+
+        /* Unity gain at DC for every phase. */
+        for (int k = 0; k < RESAMPLER_TAPS; k++)
+            rs->coefs[p][k] = (float) (c[k] / sum);
+    }
+}
+
+/* Consume a little faster while a backlog builds up, a little slower while it runs low. */
+static void
+resampler_update_step(resampler_t *rs)
+{
+    const double trim = MIN(MAX(rs->backlog * RESAMPLER_TRIM_GAIN, -RESAMPLER_TRIM), RESAMPLER_TRIM);
+
+    rs->step = (uint64_t) (rs->ratio * (1.0 + trim) * 4294967296.0);
+}
+
+void
+resampler_set_rate(resampler_t *rs, double in_rate, double out_rate)
+{
+    const double cutoff = 0.9 * MIN(1.0, out_rate / in_rate);
+
+    rs->ratio = in_rate / out_rate;
+    resampler_update_step(rs);
+
+    if (cutoff != rs->cutoff) {
+        rs->cutoff = cutoff;
+        resampler_make_coefs(rs);
+    }
+}
+
+void
+resampler_reset(resampler_t *rs)
+{
+    memset(rs->in, 0, sizeof(rs->in));
+    rs->write   = RESAMPLER_TAPS + RESAMPLER_SLACK;
+    rs->read    = 0;
+    rs->frac    = 0;
+    rs->backlog = 0.0;
+    rs->last[0] = rs->last[1] = 0;
+}
+
+resampler_t *
+resampler_init(double in_rate, double out_rate)
+{
+    resampler_t *rs = (resampler_t *) calloc(1, sizeof(resampler_t));
+
+    resampler_set_rate(rs, in_rate, out_rate);
+    resampler_reset(rs);
+
+    return rs;
+}
+
+void
+resampler_close(resampler_t *rs)
+{
+    free(rs);
+}
+
+void
+resampler_push(resampler_t *rs, int32_t l, int32_t r)
+{
+    const uint32_t pos = rs->write & (RESAMPLER_SIZE - 1);
+
+    rs->in[0][pos] = rs->in[0][pos + RESAMPLER_SIZE] = (float) l;
+    rs->in[1][pos] = rs->in[1][pos + RESAMPLER_SIZE] = (float) r;
+    rs->write++;
+
+    /* Nobody is pulling, drop the oldest frame. */
+    if ((rs->write - rs->read) > (RESAMPLER_SIZE - RESAMPLER_TAPS))
+        rs->read++;
+}
+
+static inline void
+resampler_filter(const resampler_t *rs, const float *taps, int32_t *out)
+{
+    const uint32_t pos = rs->read & (RESAMPLER_SIZE - 1);
+    const float   *l   = &rs->in[0][pos];
+    const float   *r   = &rs->in[1][pos];
+    float          sum_l;
+    float          sum_r;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128 acc_l = _mm_setzero_ps();
+    __m128 acc_r = _mm_setzero_ps();
+
+    for (int k = 0; k < RESAMPLER_TAPS; k += 4) {
+        const __m128 c = _mm_loadu_ps(&taps[k]);
+
+        acc_l = _mm_add_ps(acc_l, _mm_mul_ps(c, _mm_loadu_ps(&l[k])));
+        acc_r = _mm_add_ps(acc_r, _mm_mul_ps(c, _mm_loadu_ps(&r[k])));
+    }
+
+    /* Horizontal sums: l0+l2, l1+l3, r0+r2, r1+r3, then the pairs. */
+    acc_l = _mm_add_ps(_mm_unpacklo_ps(acc_l, acc_r), _mm_unpackhi_ps(acc_l, acc_r));
+    acc_l = _mm_add_ps(acc_l, _mm_movehl_ps(acc_l, acc_l));
+    sum_l = _mm_cvtss_f32(acc_l);
+    sum_r = _mm_cvtss_f32(_mm_shuffle_ps(acc_l, acc_l, 1));
+#else
+    sum_l = sum_r = 0.0f;
+    for (int k = 0; k < RESAMPLER_TAPS; k++) {
+        sum_l += taps[k] * l[k];
+        sum_r += taps[k] * r[k];
+    }
+#endif
+
+    out[0] = (int32_t) lrintf(sum_l);
+    out[1] = (int32_t) lrintf(sum_r);
+}
+
+/* Add frames output-rate frames to an interleaved stereo buffer. */
+void
+resampler_get(resampler_t *rs, int32_t *buffer, int frames)
+{
+    float    taps[RESAMPLER_TAPS];
+    uint32_t left;
+
+    for (int c = 0; c < frames; c++) {
+        if ((rs->write - rs->read) >= RESAMPLER_TAPS) {
+            const uint32_t phase = rs->frac >> RESAMPLER_FRAC_BITS;
+            const float    t     = (float) (rs->frac & ((1u << RESAMPLER_FRAC_BITS) - 1)) * (1.0f / (float) (1u << RESAMPLER_FRAC_BITS));
+            const float   *c0    = rs->coefs[phase];
+            const float   *c1    = rs->coefs[phase + 1];
+            uint64_t       pos;
+
+            for (int k = 0; k < RESAMPLER_TAPS; k++)
+                taps[k] = c0[k] + ((c1[k] - c0[k]) * t);
+
+            resampler_filter(rs, taps, rs->last);
+
+            pos      = (uint64_t) rs->frac + rs->step;
+            rs->read += (uint32_t) (pos >> 32);
+            rs->frac = (uint32_t) pos;
+        }
+
+        buffer[c * 2] += rs->last[0];
+        buffer[c * 2 + 1] += rs->last[1];
+    }
+
+    left = rs->write - rs->read;
+    if (left > (RESAMPLER_TAPS + RESAMPLER_RESYNC)) {
+        /* Too far behind to trim back in; skip ahead, keeping the usual slack. */
+        sound_util_log("Resampler: %u frames behind, resynchronizing\n", left - RESAMPLER_TAPS);
+        rs->read    = rs->write - (RESAMPLER_TAPS + RESAMPLER_SLACK);
+        rs->backlog = 0.0;
+    } else
+        rs->backlog += (((double) left - (RESAMPLER_TAPS + RESAMPLER_SLACK)) - rs->backlog) * 0.125;
+
+    resampler_update_step(rs);
+}
@@ -0,0 +1,335 @@
+/*
+ * 86Box    A hypervisor and IBM PC system emulator that specializes in
+ *          running old operating systems and software designed for IBM
+ *          PC systems and compatibles from 1981 through fairly recent
+ *          system designs based on the PCI bus.
+ *
+ *          This file is part of the 86Box distribution.
+ *
+ *          Bit-exactness tests for the sound mixing kernels.
+ *
+ *          Every kernel is run on fixed edge values and on random input
+ *          of every length up to a few vectors, at unaligned offsets,
+ *          and the result is compared bit for bit against the per-sample
+ *          loops sound.c used before the kernels. The kernels are checked
+ *          as first set up, which is SSE2 or the plain C versions when
+ *          built with SOUND_MIX_NO_SIMD, and again after sound_mix_init()
+ *          if that picks other versions for the host CPU.
+ *
+ * Authors: 86Box contributors.
+ *
+ *          Copyright 2026 86Box contributors.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <86box/sound_util.h>
+
+#define TEST_LEN    4096
+#define TEST_ROUNDS 64
+#define TEST_OFFSET 3
+
+static const int32_t fixed_int32[] = {
+    0, 1, -1, 32767, 32768, -32768, -32769, 65535, -65536,
+    INT32_MAX, INT32_MIN, INT32_MAX - 1, INT32_MIN + 1, 0x40000000, -0x40000000,
+    16777216, 16777217, -16777217, 123456789, -987654321
+};
+
+static const double fixed_double[] = {
+    0.0, -0.0, 0.5, -0.5, 0.999, -0.999, 1.0, -1.0,
+    32767.0, 32767.9, 32768.0, -32768.0, -32768.9, -32769.0,
+    65535.5, -65536.5, 1e6, -1e6, 12345.678, -12345.678
+};
+
+static uint32_t rng_state = 0x86b0c5u;
+static int      failures;
+
+static uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+
+    return rng_state;
+}
+
+static void
+fill_int32(int32_t *buf, int len)
+{
+    for (int c = 0; c < len; c++) {
+        if ((rng() & 7) == 0)
+            buf[c] = fixed_int32[rng() % (sizeof(fixed_int32) / sizeof(fixed_int32[0]))];
+        else
+            buf[c] = ((int32_t) rng()) >> (rng() % 32);
+    }
+}
+
+static void
+fill_double(double *buf, int len)
+{
+    for (int c = 0; c < len; c++) {
+        if ((rng() & 7) == 0)
+            buf[c] = fixed_double[rng() % (sizeof(fixed_double) / sizeof(fixed_double[0]))];
+        else
+            buf[c] = ((double) (int32_t) rng()) / ((double) (1 << (rng() % 16)));
+    }
+}
+
+static void
+fill_int16(int16_t *buf, int len)
+{
+    for (int c = 0; c < len; c++)
+        buf[c] = (int16_t) rng();
+}
+
+static void
+fill_float(float *buf, int len)
+{
+    for (int c = 0; c < len; c++)
+        buf[c] = (rng() & 1) ? 0.0f : ((float) (int16_t) rng()) / 32768.0f;
+}
+
+static void
+check(const char *path, const char *kernel, int len, const void *a, const void *b, size_t size)
+{
+    if (memcmp(a, b, size)) {
+        if (failures < 20)
+            fprintf(stderr, "%s: %s differs at length %i\n", path, kernel, len);
+        failures++;
+    }
+}
+
+/* The loops below are the per-sample code from sound.c that the kernels replaced. */
+static void
+ref_mix_int32(int32_t *dst, const int32_t *src, int len)
+{
+    for (int c = 0; c < len; c++)
+        dst[c] = (int32_t) ((uint32_t) dst[c] + (uint32_t) src[c]);
+}
+
+static void
+ref_int32_to_float(float *dst, const int32_t *src, int len)
+{
+    for (int c = 0; c < len; c++)
+        dst[c] = ((float) src[c]) / (float) 32768.0;
+}
+
+static void
+ref_int32_to_int16(int16_t *dst, const int32_t *src, int len)
+{
+    for (int c = 0; c < len; c++) {
+        int32_t temp = src[c];
+
+        if (temp > 32767)
+            temp = 32767;
+        if (temp < -32768)
+            temp = -32768;
+
+        dst[c] = (int16_t) temp;
+    }
+}
+
+static void
+ref_cd_audio(double *dst, const int16_t *src, int frames, const int channel_select[2], double audio_vol_l, double audio_vol_r)
+{
+    for (int c = 0; c < frames * 2; c += 2) {
+        dst[c] = dst[c + 1] = 0.0;
+
+        if ((audio_vol_l != 0.0) && (channel_select[0] != 0)) {
+            if (channel_select[0] & 1)
+                dst[c] += ((double) src[c]);
+            if (channel_select[0] & 2)
+                dst[c] += ((double) src[c + 1]);
+
+            dst[c] *= audio_vol_l;
+        }
+
+        if ((audio_vol_r != 0.0) && (channel_select[1] != 0)) {
+            if (channel_select[1] & 1)
+                dst[c + 1] += ((double) src[c]);
+            if (channel_select[1] & 2)
+                dst[c + 1] += ((double) src[c + 1]);
+
+            dst[c + 1] *= audio_vol_r;
+        }
+    }
+}
+
+static void
+ref_double_to_float(float *dst, const double *src, int len)
+{
+    for (int c = 0; c < len; c++)
+        dst[c] += (float) (src[c] / 32768.0);
+}
+
+static void
+ref_double_to_int16(int16_t *dst, const double *src, int len)
+{
+    for (int c = 0; c < len; c++) {
+        int temp = (int) trunc(src[c]);
+
+        if (temp > 32767)
+            temp = 32767;
+        if (temp < -32768)
+            temp = -32768;
+
+        dst[c] += (int16_t) temp;
+    }
+}
+
+static void
+test_int32(const char *path, const int32_t *a, const int32_t *b, int len)
+{
+    static int32_t ia[TEST_LEN + TEST_OFFSET];
+    static int32_t ib[TEST_LEN + TEST_OFFSET];
+    static float   fa[TEST_LEN + TEST_OFFSET];
+    static float   fb[TEST_LEN + TEST_OFFSET];
+    static int16_t sa[TEST_LEN + TEST_OFFSET];
+    static int16_t sb[TEST_LEN + TEST_OFFSET];
+
+    memcpy(ia, a, len * sizeof(int32_t));
+    memcpy(ib, a, len * sizeof(int32_t));
+    sound_mix_int32(ia, b, len);
+    ref_mix_int32(ib, b, len);
+    check(path, "sound_mix_int32", len, ia, ib, len * sizeof(int32_t));
+
+    memset(fa, 0, sizeof(fa));
+    memset(fb, 0, sizeof(fb));
+    sound_int32_to_float(fa, a, len);
+    ref_int32_to_float(fb, a, len);
+    check(path, "sound_int32_to_float", len, fa, fb, sizeof(fa));
+
+    memset(sa, 0, sizeof(sa));
+    memset(sb, 0, sizeof(sb));
+    sound_int32_to_int16(sa, a, len);
+    ref_int32_to_int16(sb, a, len);
+    check(path, "sound_int32_to_int16", len, sa, sb, sizeof(sa));
+}
+
+static void
+test_double(const char *path, const double *src, int len)
+{
+    static float   fa[TEST_LEN + TEST_OFFSET];
+    static float   fb[TEST_LEN + TEST_OFFSET];
+    static int16_t sa[TEST_LEN + TEST_OFFSET];
+    static int16_t sb[TEST_LEN + TEST_OFFSET];
+
+    fill_float(fa, TEST_LEN + TEST_OFFSET);
+    memcpy(fb, fa, sizeof(fa));
+    sound_mix_double_to_float(fa + TEST_OFFSET, src, len);
+    ref_double_to_float(fb + TEST_OFFSET, src, len);
+    check(path, "sound_mix_double_to_float", len, fa, fb, sizeof(fa));
+
+    fill_int16(sa, TEST_LEN + TEST_OFFSET);
+    memcpy(sb, sa, sizeof(sa));
+    sound_mix_double_to_int16(sa + TEST_OFFSET, src, len);
+    ref_double_to_int16(sb + TEST_OFFSET, src, len);
+    check(path, "sound_mix_double_to_int16", len, sa, sb, sizeof(sa));
+}
+
+static void
+test_cd_audio(const char *path, const int16_t *src, int frames)
+{
+    static const double vol[] = { 0.0, 1.0, 0.5, 0.25, 0.999, 1.0 / 3.0 };
+    static double       da[TEST_LEN + TEST_OFFSET];
+    static double       db[TEST_LEN + TEST_OFFSET];
+    int                 channel_select[2];
+    double              audio_vol_l;
+    double              audio_vol_r;
+    double              matrix[4];
+    double              gain[2];
+
+    for (int sel = 0; sel < 16; sel++) {
+        channel_select[0] = sel & 3;
+        channel_select[1] = sel >> 2;
+        audio_vol_l       = vol[rng() % (sizeof(vol) / sizeof(vol[0]))];
+        audio_vol_r       = vol[rng() % (sizeof(vol) / sizeof(vol[0]))];
+
+        /* Built the same way as in sound_cd_thread(). */
+        matrix[0] = (channel_select[0] & 1) ? 1.0 : 0.0;
+        matrix[1] = (channel_select[0] & 2) ? 1.0 : 0.0;
+        matrix[2] = (channel_select[1] & 1) ? 1.0 : 0.0;
+        matrix[3] = (channel_select[1] & 2) ? 1.0 : 0.0;
+        gain[0]   = channel_select[0] ? audio_vol_l : 0.0;
+        gain[1]   = channel_select[1] ? audio_vol_r : 0.0;
+
+        memset(da, 0, sizeof(da));
+        memset(db, 0, sizeof(db));
+        sound_s16_to_double(da + TEST_OFFSET, src, frames, matrix, gain);
+        ref_cd_audio(db + TEST_OFFSET, src, frames, channel_select, audio_vol_l, audio_vol_r);
+        check(path, "sound_s16_to_double", frames, da, db, sizeof(da));
+
+        /* Feed the CD result on through the accumulation, as sound.c does. */
+        test_double(path, da + TEST_OFFSET, frames * 2);
+    }
+}
+
+static void
+test_kernels(const char *path)
+{
+    static int32_t a[TEST_LEN + TEST_OFFSET];
+    static int32_t b[TEST_LEN + TEST_OFFSET];
+    static double  d[TEST_LEN + TEST_OFFSET];
+    static int16_t s[TEST_LEN + TEST_OFFSET];
+    int            n = sizeof(fixed_int32) / sizeof(fixed_int32[0]);
+
+    /* Every pair of edge values, including the wrapping adds. */
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            a[j] = fixed_int32[i];
+            b[j] = fixed_int32[j];
+        }
+        test_int32(path, a, b, n);
+    }
+    test_double(path, fixed_double, sizeof(fixed_double) / sizeof(fixed_double[0]));
+
+    /* Every short length, so all the tails get hit, then full buffers. */
+    for (int len = 0; len <= 67; len++) {
+        fill_int32(a, len + TEST_OFFSET);
+        fill_int32(b, len + TEST_OFFSET);
+        fill_double(d, len + TEST_OFFSET);
+        fill_int16(s, (len + TEST_OFFSET) & ~1);
+        test_int32(path, a + (len & TEST_OFFSET), b + (len & TEST_OFFSET), len);
+        test_double(path, d + (len & TEST_OFFSET), len);
+        test_cd_audio(path, s, len >> 1);
+    }
+
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        int len = TEST_LEN - (rng() % 64);
+
+        fill_int32(a, TEST_LEN + TEST_OFFSET);
+        fill_int32(b, TEST_LEN + TEST_OFFSET);
+        fill_double(d, TEST_LEN + TEST_OFFSET);
+        fill_int16(s, TEST_LEN);
+        test_int32(path, a + (round & TEST_OFFSET), b + (round & TEST_OFFSET), len);
+        test_double(path, d + (round & TEST_OFFSET), len);
+        test_cd_audio(path, s, len >> 1);
+    }
+}
+
+int
+main(void)
+{
+    void (*mix_int32)(int32_t *dst, const int32_t *src, int len) = sound_mix_int32;
+
+#ifdef SOUND_MIX_NO_SIMD
+    test_kernels("C");
+#else
+    test_kernels("default");
+#endif
+
+    sound_mix_init();
+    if (sound_mix_int32 != mix_int32)
+        test_kernels("CPU specific");
+
+    if (failures) {
+        fprintf(stderr, "%i mismatches\n", failures);
+        return 1;
+    }
+
+    printf("All sound mix kernels match\n");
+    return 0;
+}
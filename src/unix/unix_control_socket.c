@@ -28,6 +28,12 @@
  *            screencrc [mon [x y w h]]  - CRC-32 of visible screen region
  *            mousecapture               - capture mouse
  *            mouserelease               - release mouse
+ *            netcapture start <card|all> [slots=<n>] [filter]
+ *                                       - record network frames
+ *            netcapture stop|clear|status|dump
+ *                                       - stop, empty, query or export it
+ *            netstats [card]            - network counters as JSON
+ *            netstats reset [card]      - clear network counters
  *            exit                       - exit emulator
  *
  *          Responses (server -> client):
@@ -41,6 +47,10 @@
  *          Screencrc response:
  *            OK <crc32_hex> <width> <height>\n
  *
+ *          Netcapture dump response (binary):
+ *            OK <data_bytes>\n
+ *            <pcapng file>
+ *
  *          Push events (server -> client, prefix '!'):
  *            !led <device> <id> <read|write|idle>
  *            !media <device> <id> <inserted|ejected>
@@ -84,6 +94,8 @@
 #include <86box/cartridge.h>
 #include <86box/cassette.h>
 #include <86box/network.h>
+#include <86box/net_capture.h>
+#include <86box/net_stats.h>
 #include <86box/machine_status.h>
 #include <86box/video.h>
 #include <86box/ui.h>
@@ -304,6 +316,128 @@ ctrl_send_status(ctrl_client_t *client)
     ctrl_send(client, line);
 }
 
+/* ------------------------------------------------------------------ */
+/* Control the network capture ring.                                   */
+/* ------------------------------------------------------------------ */
+static void
+ctrl_net_capture(ctrl_client_t *client, char **xargv, int cmdargc)
+{
+    char msg[256];
+
+    if (strcasecmp(xargv[1], "start") == 0) {
+        uint32_t cards = NET_CAPTURE_ALL_CARDS;
+        int      slots = 0;
+        int      arg   = 2;
+        char     filter[CTRL_BUF_SIZE];
+        char     err[128];
+
+        if ((arg < cmdargc) && strcasecmp(xargv[arg], "all")) {
+            char *end;
+            long  card = strtol(xargv[arg], &end, 10);
+            if (*end || (card < 0) || (card >= NET_CARD_MAX)) {
+                ctrl_send(client, "ERR invalid network card\n");
+                return;
+            }
+            cards = 1u << card;
+        }
+        arg++;
+
+        if ((arg < cmdargc) && !strncasecmp(xargv[arg], "slots=", 6))
+            slots = atoi(xargv[arg++] + 6);
+
+        filter[0] = '\0';
+        for (; arg < cmdargc; arg++) {
+            if ((strlen(filter) + strlen(xargv[arg]) + 2) > sizeof(filter)) {
+                ctrl_send(client, "ERR capture filter too long\n");
+                return;
+            }
+            if (filter[0])
+                strcat(filter, " ");
+            strcat(filter, xargv[arg]);
+        }
+
+        if (net_capture_start(cards, slots, filter, err, sizeof(err)) < 0) {
+            snprintf(msg, sizeof(msg), "ERR %s\n", err);
+            ctrl_send(client, msg);
+            return;
+        }
+        ctrl_send(client, "OK capture started\n");
+    } else if (strcasecmp(xargv[1], "stop") == 0) {
+        net_capture_stop();
+        ctrl_send(client, "OK capture stopped\n");
+    } else if (strcasecmp(xargv[1], "clear") == 0) {
+        net_capture_clear();
+        ctrl_send(client, "OK capture cleared\n");
+    } else if (strcasecmp(xargv[1], "status") == 0) {
+        uint32_t cards;
+        int      slots;
+        uint32_t count;
+        uint64_t overwritten;
+
+        net_capture_status(&cards, &slots, &count, &overwritten);
+        snprintf(msg, sizeof(msg), "OK cards=%08X slots=%d frames=%u overwritten=%llu\n",
+                 cards, slots, count, (unsigned long long) overwritten);
+        ctrl_send(client, msg);
+    } else if (strcasecmp(xargv[1], "dump") == 0) {
+        size_t   len;
+        uint8_t *buf = net_capture_export(&len);
+
+        if (!buf) {
+            ctrl_send(client, "ERR no capture available\n");
+            return;
+        }
+        snprintf(msg, sizeof(msg), "OK %zu\n", len);
+        ctrl_send(client, msg);
+        ctrl_send_binary(client, buf, len);
+        free(buf);
+    } else {
+        snprintf(msg, sizeof(msg), "ERR unknown netcapture command: %s\n", xargv[1]);
+        ctrl_send(client, msg);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Report or clear the network statistics.                             */
+/* ------------------------------------------------------------------ */
+static void
+ctrl_net_stats(ctrl_client_t *client, char **xargv, int cmdargc)
+{
+    int   reset = 0;
+    int   card  = -1;
+    int   arg   = 1;
+    char *json;
+
+    if ((arg < cmdargc) && (strcasecmp(xargv[arg], "reset") == 0)) {
+        reset = 1;
+        arg++;
+    }
+
+    if (arg < cmdargc) {
+        char *end;
+        card = (int) strtol(xargv[arg], &end, 10);
+        if (*end || (card < 0) || (card >= NET_CARD_MAX)) {
+            ctrl_send(client, "ERR invalid network card\n");
+            return;
+        }
+    }
+
+    if (reset) {
+        net_stats_reset(card);
+        ctrl_send(client, "OK stats reset\n");
+        return;
+    }
+
+    json = net_stats_json(card);
+    if (!json) {
+        ctrl_send(client, "ERR out of memory\n");
+        return;
+    }
+    ctrl_send(client, "OK ");
+    ctrl_send(client, json);
+    ctrl_send(client, "\n");
+    free(json);
+}
+
 /* ------------------------------------------------------------------ */
 /* Handle a single command line from a client.                         */
 /* ------------------------------------------------------------------ */
@@ -645,6 +779,10 @@ ctrl_handle_command(ctrl_client_t *client, char *line)
         char msg[128];
         snprintf(msg, sizeof(msg), "OK %08X %d %d\n", crc, bw, bh);
         ctrl_send(client, msg);
+    } else if (strcasecmp(xargv[0], "netcapture") == 0 && cmdargc >= 2) {
+        ctrl_net_capture(client, xargv, cmdargc);
+    } else if (strcasecmp(xargv[0], "netstats") == 0) {
+        ctrl_net_stats(client, xargv, cmdargc);
     } else if (strcasecmp(xargv[0], "mousecapture") == 0) {
         plat_mouse_capture(1);
         ctrl_send(client, "OK mouse captured\n");
@@ -671,6 +809,12 @@ ctrl_handle_command(ctrl_client_t *client, char *line)
                   "  screencrc [mon [x y w h]]  - CRC-32 of screen region\n"
                   "  mousecapture               - capture mouse\n"
                   "  mouserelease               - release mouse\n"
+                  "  netcapture start <card|all> [slots=<n>] [filter]\n"
+                  "                             - record network frames\n"
+                  "  netcapture stop|clear|status|dump\n"
+                  "                             - stop, empty, query or export\n"
+                  "  netstats [card]            - network counters as JSON\n"
+                  "  netstats reset [card]      - clear network counters\n"
                   "  version                    - print version\n"
                   "  exit                       - exit emulator\n"
                   "OK\n");
@@ -76,36 +76,21 @@ plat_serpt_set_line_state(void *priv)
     serial_set_ri(dev->serial, !!(curstate & TIOCM_RI));
 }
 
+/*
+ * Both kinds of descriptor are non-blocking, so a single read() takes
+ * whatever the host has queued up, up to len bytes, or nothing at all.
+ */
 int
-plat_serpt_read(void *priv, uint8_t *data)
+plat_serpt_read(void *priv, uint8_t *data, int len)
 {
     serial_passthrough_t *dev = (serial_passthrough_t *) priv;
-    int                   res;
-    struct timeval        tv;
-    fd_set                rdfds;
+    ssize_t               res;
 
     switch (dev->mode) {
-        case SERPT_MODE_HOSTSER: {
-            if (read(dev->master_fd, data, 1) > 0) {
-                return 1;
-            }
-            return 0;
-        }
+        case SERPT_MODE_HOSTSER:
         case SERPT_MODE_VCON:
-            FD_ZERO(&rdfds);
-            FD_SET(dev->master_fd, &rdfds);
-            tv.tv_sec  = 0;
-            tv.tv_usec = 0;
-
-            res = select(dev->master_fd + 1, &rdfds, NULL, NULL, &tv);
-            if (res <= 0 || !FD_ISSET(dev->master_fd, &rdfds)) {
-                return 0;
-            }
-
-            if (read(dev->master_fd, data, 1) > 0) {
-                return 1;
-            }
-            break;
+            res = read(dev->master_fd, data, len);
+            return (res > 0) ? (int) res : 0;
         default:
             break;
     }
@@ -124,34 +109,16 @@ plat_serpt_close(void *priv)
     close(dev->master_fd);
 }
 
-static void
-plat_serpt_write_vcon(serial_passthrough_t *dev, uint8_t data)
+/* Returns how much was written; the caller keeps the rest for later. */
+static int
+plat_serpt_write_vcon(serial_passthrough_t *dev, const uint8_t *data, int len)
 {
-#if 0
-    fd_set wrfds;
-    int    res;
-#endif
-    size_t res;
+    ssize_t res;
 
     /* We cannot use select here, this would block the hypervisor! */
-#if 0
-    FD_ZERO(&wrfds);
-    FD_SET(ctx->master_fd, &wrfds);
+    res = write(dev->master_fd, data, len);
 
-    res = select(ctx->master_fd + 1, NULL, &wrfds, NULL, NULL);
-
-    if (res <= 0) {
-        return;
-    }
-#endif
-
-    /* just write it out */
-    if (dev->mode == SERPT_MODE_HOSTSER) {
-        do {
-            res = write(dev->master_fd, &data, 1);
-        } while (res == 0 || (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)));
-    } else
-        res = write(dev->master_fd, &data, 1);
+    return (res > 0) ? (int) res : 0;
 }
 
 void
@@ -232,19 +199,19 @@ plat_serpt_set_params(void *priv)
     }
 }
 
-void
-plat_serpt_write(void *priv, uint8_t data)
+int
+plat_serpt_write(void *priv, const uint8_t *data, int len)
 {
     serial_passthrough_t *dev = (serial_passthrough_t *) priv;
 
     switch (dev->mode) {
         case SERPT_MODE_VCON:
         case SERPT_MODE_HOSTSER:
-            plat_serpt_write_vcon(dev, data);
-            break;
+            return plat_serpt_write_vcon(dev, data, len);
         default:
             break;
     }
+    return 0;
 }
 
 static int